@@ -0,0 +1,176 @@
+/* Runs the core benchmarks headless against a minimal pipeline, descriptor set and index
+ * buffer, then writes the results as JSON (see vka_write_benchmarks_json()).
+ *
+ * Build, from the repository root:
+ *	glslc Benchmarks/Benchmark.vert -o Benchmark.vert.spv
+ *	glslc Benchmarks/Benchmark.frag -o Benchmark.frag.spv
+ *	cc -O2 -DVKA_BENCHMARK -I . -I Include Benchmarks/Benchmark.c Vulkan-Abstraction.c \
+ *		Include/Volk/volk.c -lSDL3 -lm -o Benchmark
+ *
+ * Usage:
+ *	./Benchmark [vertex.spv fragment.spv [output.json]]
+ *
+ * Results go to stdout if no output path is given. To run on a software driver, point the
+ * loader at one, e.g. VK_DRIVER_FILES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json. */
+
+#include "Vulkan-Abstraction.h"
+
+#ifndef VKA_BENCHMARK
+#error "Compile with -DVKA_BENCHMARK."
+#endif
+
+#define BENCHMARK_IMAGE_SIZE 256
+
+vka_vulkan_t vulkan;
+vka_allocation_t image_allocation;
+vka_image_t colour_image;
+vka_allocation_t host_allocation;
+vka_buffer_t buffers[2];	// Uniforms, indices.
+vka_descriptor_pool_t descriptor_pool;
+vka_descriptor_set_t descriptor_set;
+vka_pipeline_t pipeline;
+vka_render_info_t render_info;
+vka_benchmark_t benchmark;
+
+int set_up(const char *vertex_path, const char *fragment_path)
+{
+	strcpy(vulkan.name, "Vulkan Abstraction Benchmark");
+	vulkan.headless = 1;
+	if (vka_set_up_vulkan(&vulkan)) { return -1; }
+
+	// Offscreen colour target. Draws are only recorded, so it is never rendered to:
+	strcpy(image_allocation.name, "Benchmark image allocation");
+	image_allocation.properties[0] = VKA_MEMORY_DEVICE;
+	strcpy(colour_image.name, "Benchmark colour image");
+	colour_image.allocation		= &image_allocation;
+	colour_image.format		= VK_FORMAT_R8G8B8A8_UNORM;
+	colour_image.width		= BENCHMARK_IMAGE_SIZE;
+	colour_image.height		= BENCHMARK_IMAGE_SIZE;
+	colour_image.usage		= VKA_IMAGE_USAGE_COLOUR;
+	colour_image.aspect_mask	= VK_IMAGE_ASPECT_COLOR_BIT;
+	if (vka_set_up_images(&vulkan, 1, &colour_image)) { return -1; }
+
+	// Uniforms (offset, colour) and one triangle's indices, sharing a host allocation:
+	strcpy(host_allocation.name, "Benchmark host allocation");
+	host_allocation.properties[0] = VKA_MEMORY_HOST;
+	strcpy(buffers[0].name, "Benchmark uniforms");
+	buffers[0].allocation	= &host_allocation;
+	buffers[0].size		= 8 * sizeof(float);
+	buffers[0].usage	= VKA_BUFFER_USAGE_UNIFORM;
+	strcpy(buffers[1].name, "Benchmark indices");
+	buffers[1].allocation	= &host_allocation;
+	buffers[1].size		= 3 * sizeof(uint16_t);
+	buffers[1].usage	= VKA_BUFFER_USAGE_INDEX;
+	buffers[1].index_type	= VK_INDEX_TYPE_UINT16;
+	if (vka_set_up_buffers(&vulkan, 2, buffers)) { return -1; }
+	if (vka_map_memory(&vulkan, &host_allocation)) { return -1; }
+
+	float uniforms[8] = { 0.f, 0.f, 0.f, 0.f, 1.f, 0.5f, 0.f, 1.f };
+	uint16_t indices[3] = { 0, 1, 2 };
+	uint8_t *data = host_allocation.mapped_data;
+	memcpy(data + buffers[0].offset, uniforms, sizeof(uniforms));
+	memcpy(data + buffers[1].offset, indices, sizeof(indices));
+
+	strcpy(descriptor_pool.name, "Benchmark descriptor pool");
+	strcpy(descriptor_set.name, "Benchmark descriptor set");
+	descriptor_set.pool		= &descriptor_pool;
+	descriptor_set.binding		= 0;
+	descriptor_set.count		= 1;
+	descriptor_set.type		= VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptor_set.stage_flags	= VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	descriptor_set.data = malloc(sizeof(void *));
+	if (!descriptor_set.data)
+	{
+		snprintf(vulkan.error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for descriptor set \"%s\" data.",
+			descriptor_set.name);
+		return -1;
+	}
+	descriptor_set.data[0] = &(buffers[0]);
+	if (vka_create_descriptor_set_layout(&vulkan, &descriptor_set)) { return -1; }
+	if (vka_create_descriptor_pool(&vulkan, &descriptor_pool)) { return -1; }
+	if (vka_allocate_descriptor_set(&vulkan, &descriptor_set)) { return -1; }
+	if (vka_update_descriptor_set(&vulkan, &descriptor_set)) { return -1; }
+
+	strcpy(pipeline.name, "Benchmark pipeline");
+	snprintf(pipeline.shaders[VKA_SHADER_TYPE_VERTEX].path, VKA_MAX_PATH_LENGTH, "%s",
+								vertex_path);
+	snprintf(pipeline.shaders[VKA_SHADER_TYPE_FRAGMENT].path, VKA_MAX_PATH_LENGTH, "%s",
+								fragment_path);
+	pipeline.num_descriptor_sets		= 1;
+	pipeline.descriptor_sets[0]		= &descriptor_set;
+	pipeline.topology			= VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	pipeline.colour_attachment_format	= colour_image.format;
+	if (vka_create_pipeline(&vulkan, &pipeline)) { return -1; }
+
+	render_info.colour_image		= &colour_image;
+	render_info.colour_load_op		= VK_ATTACHMENT_LOAD_OP_CLEAR;
+	render_info.colour_store_op		= VK_ATTACHMENT_STORE_OP_STORE;
+	render_info.render_area.extent.width	= BENCHMARK_IMAGE_SIZE;
+	render_info.render_area.extent.height	= BENCHMARK_IMAGE_SIZE;
+	render_info.render_target_height	= BENCHMARK_IMAGE_SIZE;
+	render_info.scissor_area		= render_info.render_area;
+
+	benchmark.descriptor_set	= &descriptor_set;
+	benchmark.pipeline		= &pipeline;
+	benchmark.render_info		= &render_info;
+	benchmark.index_buffer		= &(buffers[1]);
+	return vka_create_benchmark(&vulkan, &benchmark);
+}
+
+void shut_down(void)
+{
+	vka_device_wait_idle(&vulkan);
+	vka_destroy_benchmark(&vulkan, &benchmark);
+	vka_destroy_pipeline(&vulkan, &pipeline);
+	vka_destroy_descriptor_set(&vulkan, &descriptor_set);
+	vka_destroy_descriptor_pool(&vulkan, &descriptor_pool);
+	for (int i = 0; i < 2; i++) { vka_destroy_buffer(&vulkan, &(buffers[i])); }
+	vka_destroy_allocation(&vulkan, &host_allocation);
+	vka_destroy_image(&vulkan, &colour_image);
+	vka_destroy_allocation(&vulkan, &image_allocation);
+	vka_shut_down_vulkan(&vulkan);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *vertex_path = "Benchmark.vert.spv";
+	const char *fragment_path = "Benchmark.frag.spv";
+	const char *output_path = NULL;
+	if ((argc == 2) || (argc > 4))
+	{
+		fprintf(stderr, "Usage: %s [vertex.spv fragment.spv [output.json]]\n", argv[0]);
+		return 1;
+	}
+	if (argc >= 3)
+	{
+		vertex_path = argv[1];
+		fragment_path = argv[2];
+	}
+	if (argc == 4) { output_path = argv[3]; }
+
+	if (set_up(vertex_path, fragment_path) || vka_run_benchmarks(&vulkan, &benchmark))
+	{
+		fprintf(stderr, "%s\n", vulkan.error);
+		shut_down();
+		return 1;
+	}
+
+	FILE *file = stdout;
+	if (output_path)
+	{
+		file = fopen(output_path, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Could not open \"%s\" for writing.\n", output_path);
+			shut_down();
+			return 1;
+		}
+	}
+	vka_write_benchmarks_json(file, &vulkan, &benchmark);
+	if (file != stdout) { fclose(file); }
+
+	shut_down();
+
+	return 0;
+}
@@ -0,0 +1,16 @@
+#version 450
+
+// Fragment shader for Benchmarks/Benchmark.c.
+
+layout(std140, set = 0, binding = 0) uniform uniforms_buffer
+{
+	vec4 offset;
+	vec4 colour;
+};
+
+layout(location = 0) out vec4 out_colour;
+
+void main()
+{
+	out_colour = colour;
+}
@@ -0,0 +1,15 @@
+#version 450
+
+// Vertex shader for Benchmarks/Benchmark.c. One triangle from gl_VertexIndex, no vertex buffers.
+
+layout(std140, set = 0, binding = 0) uniform uniforms_buffer
+{
+	vec4 offset;
+	vec4 colour;
+};
+
+void main()
+{
+	vec2 positions[3] = vec2[](vec2(-0.5, -0.5), vec2(0.5, -0.5), vec2(0.0, 0.5));
+	gl_Position = vec4(positions[gl_VertexIndex % 3] + offset.xy, 0.0, 1.0);
+}
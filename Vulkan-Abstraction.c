@@ -1,5 +1,7 @@
 #include "Vulkan-Abstraction.h"
 
+#include <math.h>
+
 /********************
  * Main Vulkan base *
  ********************/
@@ -22,40 +24,62 @@ int vka_set_up_vulkan(vka_vulkan_t *vulkan)
 
 	vulkan->maintenance_properties.sType =
 		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
-	vulkan->maintenance_properties.pNext = NULL;
+	vulkan->maintenance_properties.pNext = &(vulkan->subgroup_properties);
+
+	vulkan->subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	vulkan->subgroup_properties.pNext = NULL;
 
 	vulkan->device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
 	vulkan->device_properties.pNext = &(vulkan->maintenance_properties);
 
 	vulkan->graphics_family_index = 100;
 	vulkan->present_family_index = 100;
+	vulkan->compute_family_index = 100;
 	vulkan->swapchain_format = VK_FORMAT_UNDEFINED;
 
-	if (vka_create_window(vulkan)) { return -1; }
-	if (volkInitialize()) { return -1; }
+	if (!vulkan->headless && vka_create_window(vulkan)) { return -1; }
+	if (volkInitialize())
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not load Vulkan loader.");
+		return -1;
+	}
 
 	#ifdef VKA_DEBUG
 	if (vka_check_instance_layer_extension_support(vulkan)) { return -1; }
 	#endif
 
 	if (vka_create_instance(vulkan)) { return -1; }
-	if (vka_create_surface(vulkan)) { return -1; }
+	if (!vulkan->headless && vka_create_surface(vulkan)) { return -1; }
 
 	#ifdef VKA_DEBUG
 	if (vka_create_debug_messenger(vulkan)) { return -1; }
 	#endif
 
 	if (vka_create_device(vulkan)) { return -1; }
+	if (vulkan->use_pipeline_library && vka_pipeline_linker_set_up(vulkan)) { return -1; }
 	if (vka_create_semaphores(vulkan)) { return -1; }
 	if (vka_create_command_pool(vulkan)) { return -1; }
 	if (vka_create_command_buffers(vulkan)) { return -1; }
-	if (vka_create_swapchain(vulkan)) { return -1; }
+	if (vulkan->use_async_compute && vka_create_compute_command_buffers(vulkan)) { return -1; }
+	if (!vulkan->headless && vka_create_swapchain(vulkan)) { return -1; }
 	vulkan->recreate_pipelines = 0;
 
 	#ifdef VKA_NUKLEAR
 	if (vka_nuklear_set_up(vulkan)) { return -1; }
 	#endif
 
+	#ifdef VKA_SHADER_WATCHER
+	if (vka_shader_watcher_set_up(vulkan)) { return -1; }
+	#endif
+
+	#ifdef VKA_STATISTICS
+	if (vka_statistics_set_up(vulkan)) { return -1; }
+	#endif
+
+	#ifdef VKA_TRACE
+	if (vka_trace_set_up(vulkan)) { return -1; }
+	#endif
+
 	return 0;
 }
 
@@ -67,6 +91,20 @@ void vka_shut_down_vulkan(vka_vulkan_t *vulkan)
 	vka_nuklear_shut_down(vulkan);
 	#endif
 
+	#ifdef VKA_SHADER_WATCHER
+	vka_shader_watcher_shut_down(vulkan);
+	#endif
+
+	#ifdef VKA_STATISTICS
+	vka_statistics_shut_down(vulkan);
+	#endif
+
+	#ifdef VKA_TRACE
+	vka_trace_shut_down(vulkan);
+	#endif
+
+	vka_pipeline_linker_shut_down(vulkan);
+
 	if (vulkan->swapchain_images)
 	{
 		for (uint32_t i = 0; i < vulkan->num_swapchain_images; i++)
@@ -83,6 +121,36 @@ void vka_shut_down_vulkan(vka_vulkan_t *vulkan)
 		vulkan->swapchain = VK_NULL_HANDLE;
 	}
 
+	vka_destroy_retired_objects(vulkan, 1);
+	if (vulkan->retired_objects)
+	{
+		free(vulkan->retired_objects);
+		vulkan->retired_objects = NULL;
+		vulkan->max_retired_objects = 0;
+	}
+
+	// Mesh pools own the free lists, so there is nothing left to release them into:
+	if (vulkan->retired_ranges)
+	{
+		free(vulkan->retired_ranges);
+		vulkan->retired_ranges = NULL;
+		vulkan->num_retired_ranges = 0;
+		vulkan->max_retired_ranges = 0;
+	}
+
+	if (vulkan->shader_modules)
+	{
+		for (uint32_t i = 0; i < vulkan->num_shader_modules; i++)
+		{
+			vkDestroyShaderModule(vulkan->device, vulkan->shader_modules[i].shader, NULL);
+			free(vulkan->shader_modules[i].code);
+		}
+		free(vulkan->shader_modules);
+		vulkan->shader_modules = NULL;
+		vulkan->num_shader_modules = 0;
+		vulkan->max_shader_modules = 0;
+	}
+
 	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
 	{
 		if (vulkan->image_available[i])
@@ -95,6 +163,11 @@ void vka_shut_down_vulkan(vka_vulkan_t *vulkan)
 			vkDestroySemaphore(vulkan->device, vulkan->render_complete[i], NULL);
 			vulkan->render_complete[i] = VK_NULL_HANDLE;
 		}
+		if (vulkan->compute_complete[i])
+		{
+			vkDestroySemaphore(vulkan->device, vulkan->compute_complete[i], NULL);
+			vulkan->compute_complete[i] = VK_NULL_HANDLE;
+		}
 	}
 
 	if (vulkan->command_pool)
@@ -108,6 +181,17 @@ void vka_shut_down_vulkan(vka_vulkan_t *vulkan)
 		vka_destroy_command_buffer(vulkan, &(vulkan->command_buffers[i]));
 	}
 
+	if (vulkan->compute_command_pool)
+	{
+		vkDestroyCommandPool(vulkan->device, vulkan->compute_command_pool, NULL);
+		vulkan->compute_command_pool = VK_NULL_HANDLE;
+	}
+
+	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		vka_destroy_command_buffer(vulkan, &(vulkan->compute_command_buffers[i]));
+	}
+
 	if (vulkan->device)
 	{
 		vkDestroyDevice(vulkan->device, NULL);
@@ -192,8 +276,12 @@ int vka_create_instance(vka_vulkan_t *vulkan)
 
 	uint32_t layer_count = 0;
 	char *layers[1];
-	uint32_t extension_count;
-	char const * const *SDL_extensions = SDL_Vulkan_GetInstanceExtensions(&extension_count);
+	uint32_t extension_count = 0;
+	char const * const *SDL_extensions = NULL;
+	if (!vulkan->headless)
+	{
+		SDL_extensions = SDL_Vulkan_GetInstanceExtensions(&extension_count);
+	}
 
 	uint32_t debug_extension_count = 0;
 	#ifdef VKA_DEBUG
@@ -302,18 +390,21 @@ int vka_create_device(vka_vulkan_t *vulkan)
 	int best_score = -1;
 	uint32_t graphics_family_index;
 	uint32_t present_family_index;
+	uint32_t compute_family_index;
 	VkBool32 sampler_anisotropy;
 
 	for (uint32_t i = 0; i < num_physical_devices; i++)
 	{
 		int score = vka_score_physical_device(vulkan, physical_devices[i],
-			&graphics_family_index, &present_family_index, &sampler_anisotropy);
+			&graphics_family_index, &present_family_index, &compute_family_index,
+			&sampler_anisotropy);
 		if (score > best_score)
 		{
 			best_score = score;
 			vulkan->physical_device = physical_devices[i];
 			vulkan->graphics_family_index = graphics_family_index;
 			vulkan->present_family_index = present_family_index;
+			vulkan->compute_family_index = compute_family_index;
 			vulkan->enabled_features.samplerAnisotropy = sampler_anisotropy;
 		}
 	}
@@ -328,12 +419,34 @@ int vka_create_device(vka_vulkan_t *vulkan)
 
 	vkGetPhysicalDeviceProperties2(vulkan->physical_device, &(vulkan->device_properties));
 
-	uint32_t num_queue_families;
-	if (vulkan->graphics_family_index == vulkan->present_family_index)
+	// Async compute needs a family without graphics, otherwise compute uses the graphics queue:
+	if (vulkan->compute_family_index == vulkan->graphics_family_index)
+	{
+		vulkan->use_async_compute = 0;
+	}
+	if (!vulkan->use_async_compute)
+	{
+		vulkan->compute_family_index = vulkan->graphics_family_index;
+	}
+
+	uint32_t family_indices[3] = { vulkan->graphics_family_index,
+					vulkan->present_family_index,
+					vulkan->compute_family_index };
+	uint32_t num_queue_families = 0;
+	uint32_t unique_family_indices[3];
+	for (int i = 0; i < 3; i++)
 	{
-		num_queue_families = 1;
+		int duplicate = 0;
+		for (uint32_t j = 0; j < num_queue_families; j++)
+		{
+			if (unique_family_indices[j] == family_indices[i]) { duplicate = 1; }
+		}
+		if (!duplicate)
+		{
+			unique_family_indices[num_queue_families] = family_indices[i];
+			num_queue_families++;
+		}
 	}
-	else { num_queue_families = 2; }
 
 	VkDeviceQueueCreateInfo *queue_info = malloc(num_queue_families *
 					sizeof(VkDeviceQueueCreateInfo));
@@ -352,17 +465,8 @@ int vka_create_device(vka_vulkan_t *vulkan)
 		queue_info[i].pNext		= NULL;
 		queue_info[i].flags		= 0;
 		queue_info[i].pQueuePriorities	= queue_priorities;
-
-		if (i == 0)
-		{
-			queue_info[i].queueFamilyIndex	= vulkan->graphics_family_index;
-			queue_info[i].queueCount	= 1;
-		}
-		else
-		{
-			queue_info[i].queueFamilyIndex	= vulkan->present_family_index;
-			queue_info[i].queueCount	= 1;
-		}
+		queue_info[i].queueFamilyIndex	= unique_family_indices[i];
+		queue_info[i].queueCount	= 1;
 	}
 
 	VkPhysicalDeviceFeatures2 enabled_features;
@@ -371,7 +475,119 @@ int vka_create_device(vka_vulkan_t *vulkan)
 	enabled_features.pNext		= &(vulkan->enabled_features_13);
 	enabled_features.features	= vulkan->enabled_features;
 
-	char *enabled_extensions[1] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	// Optional extensions, enabled if requested and supported:
+	char *enabled_extensions[5] = { NULL, NULL, NULL, NULL, NULL };
+	uint32_t num_enabled_extensions = 0;
+	if (!vulkan->headless)
+	{
+		enabled_extensions[0] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+		num_enabled_extensions = 1;
+	}
+
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features;
+	memset(&library_features, 0, sizeof(library_features));
+	library_features.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+	library_features.pNext = NULL;
+
+	if (vulkan->use_pipeline_library)
+	{
+		vulkan->use_pipeline_library = vka_check_device_extension_support(vulkan,
+					VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) &&
+			vka_check_device_extension_support(vulkan,
+					VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+	}
+	if (vulkan->use_pipeline_library)
+	{
+		VkPhysicalDeviceFeatures2 supported_features;
+		memset(&supported_features, 0, sizeof(supported_features));
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &library_features;
+		vkGetPhysicalDeviceFeatures2(vulkan->physical_device, &supported_features);
+
+		vulkan->use_pipeline_library = library_features.graphicsPipelineLibrary;
+	}
+	if (vulkan->use_pipeline_library)
+	{
+		enabled_extensions[num_enabled_extensions] =
+			VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME;
+		enabled_extensions[num_enabled_extensions + 1] =
+			VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME;
+		num_enabled_extensions += 2;
+
+		library_features.graphicsPipelineLibrary = VK_TRUE;
+		library_features.pNext = enabled_features.pNext;
+		enabled_features.pNext = &library_features;
+	}
+
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state_3_features;
+	memset(&dynamic_state_3_features, 0, sizeof(dynamic_state_3_features));
+	dynamic_state_3_features.sType =
+		VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+	dynamic_state_3_features.pNext = NULL;
+
+	if (vulkan->use_extended_dynamic_state_3)
+	{
+		vulkan->use_extended_dynamic_state_3 = vka_check_device_extension_support(vulkan,
+					VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+	}
+	if (vulkan->use_extended_dynamic_state_3)
+	{
+		VkPhysicalDeviceFeatures2 supported_features;
+		memset(&supported_features, 0, sizeof(supported_features));
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &dynamic_state_3_features;
+		vkGetPhysicalDeviceFeatures2(vulkan->physical_device, &supported_features);
+
+		// Only blend enable is used:
+		vulkan->use_extended_dynamic_state_3 =
+			dynamic_state_3_features.extendedDynamicState3ColorBlendEnable;
+		memset(&dynamic_state_3_features, 0, sizeof(dynamic_state_3_features));
+		dynamic_state_3_features.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+	}
+	if (vulkan->use_extended_dynamic_state_3)
+	{
+		enabled_extensions[num_enabled_extensions] =
+			VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME;
+		num_enabled_extensions++;
+
+		dynamic_state_3_features.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+		dynamic_state_3_features.pNext = enabled_features.pNext;
+		enabled_features.pNext = &dynamic_state_3_features;
+	}
+
+	#ifdef VKA_TRACE
+	vulkan->trace.calibrated_timestamps = vka_check_device_extension_support(vulkan,
+					VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+	if (vulkan->trace.calibrated_timestamps)
+	{
+		enabled_extensions[num_enabled_extensions] =
+			VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+		num_enabled_extensions++;
+	}
+	#endif
+
+	// Optional query features, enabled if requested and supported:
+	if (vulkan->use_pipeline_statistics || vulkan->use_precise_occlusion)
+	{
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(vulkan->physical_device, &supported_features);
+		vulkan->use_pipeline_statistics = vulkan->use_pipeline_statistics &&
+					supported_features.pipelineStatisticsQuery;
+		vulkan->use_precise_occlusion = vulkan->use_precise_occlusion &&
+					supported_features.occlusionQueryPrecise;
+	}
+	if (vulkan->use_pipeline_statistics)
+	{
+		vulkan->enabled_features.pipelineStatisticsQuery = VK_TRUE;
+		enabled_features.features.pipelineStatisticsQuery = VK_TRUE;
+	}
+	if (vulkan->use_precise_occlusion)
+	{
+		vulkan->enabled_features.occlusionQueryPrecise = VK_TRUE;
+		enabled_features.features.occlusionQueryPrecise = VK_TRUE;
+	}
 
 	VkDeviceCreateInfo device_info;
 	memset(&device_info, 0, sizeof(device_info));
@@ -382,7 +598,7 @@ int vka_create_device(vka_vulkan_t *vulkan)
 	device_info.pQueueCreateInfos		= queue_info;
 	device_info.enabledLayerCount		= 0;
 	device_info.ppEnabledLayerNames		= NULL;
-	device_info.enabledExtensionCount	= 1;
+	device_info.enabledExtensionCount	= num_enabled_extensions;
 	device_info.ppEnabledExtensionNames	= (const char **)enabled_extensions;
 	device_info.pEnabledFeatures		= NULL;
 
@@ -414,6 +630,14 @@ int vka_create_device(vka_vulkan_t *vulkan)
 		return -1;
 	}
 
+	vkGetDeviceQueue(vulkan->device, vulkan->compute_family_index, 0,
+					&(vulkan->compute_queue));
+	if (!vulkan->compute_queue)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not retrieve compute queue.");
+		return -1;
+	}
+
 	// Get memory heap size information:
 	VkPhysicalDeviceMemoryProperties device_memory_properties;
 	vkGetPhysicalDeviceMemoryProperties(vulkan->physical_device, &device_memory_properties);
@@ -450,6 +674,14 @@ int vka_create_semaphores(vka_vulkan_t *vulkan)
 				"Could not create semaphore: \"Render complete\".");
 			return -1;
 		}
+
+		if (vulkan->use_async_compute && (vkCreateSemaphore(vulkan->device,
+			&semaphore_info, NULL, &(vulkan->compute_complete[i])) != VK_SUCCESS))
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not create semaphore: \"Compute complete\".");
+			return -1;
+		}
 	}
 
 	return 0;
@@ -482,8 +714,9 @@ int vka_create_command_buffers(vka_vulkan_t *vulkan)
 		vulkan->command_buffers[i].fence_signaled = 1;
 		if (vka_create_command_buffer(vulkan, &(vulkan->command_buffers[i]))) { return -1; }
 
-		vulkan->command_buffers[i].use_wait = 1;
-		vulkan->command_buffers[i].use_signal = 1;
+		// Headless has no swapchain images to wait on or present:
+		vulkan->command_buffers[i].use_wait = (vulkan->headless == 0);
+		vulkan->command_buffers[i].use_signal = (vulkan->headless == 0);
 		vulkan->command_buffers[i].wait_dst_stage_mask =
 			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 		vulkan->command_buffers[i].wait_semaphore = &(vulkan->image_available[i]);
@@ -494,21 +727,58 @@ int vka_create_command_buffers(vka_vulkan_t *vulkan)
 	return 0;
 }
 
-int vka_create_swapchain(vka_vulkan_t *vulkan)
+int vka_create_compute_command_buffers(vka_vulkan_t *vulkan)
 {
-	// Used for initial creation AND recreation of swapchain.
-	vka_device_wait_idle(vulkan);
+	// Pool and per-frame command buffers for the dedicated compute queue:
+	VkCommandPoolCreateInfo pool_info;
+	memset(&pool_info, 0, sizeof(pool_info));
+	pool_info.sType			= VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.pNext			= NULL;
+	pool_info.flags			= VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	pool_info.queueFamilyIndex	= vulkan->compute_family_index;
 
-	if (vulkan->swapchain_images)
+	if (vkCreateCommandPool(vulkan->device, &pool_info, NULL,
+			&(vulkan->compute_command_pool)) != VK_SUCCESS)
 	{
-		for (uint32_t i = 0; i < vulkan->num_swapchain_images; i++)
-		{
-			vka_destroy_image(vulkan, &(vulkan->swapchain_images[i]));
-		}
-		free(vulkan->swapchain_images);
-		vulkan->swapchain_images = NULL;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create compute command pool.");
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		vka_command_buffer_t *command_buffer = &(vulkan->compute_command_buffers[i]);
+		snprintf(command_buffer->name, VKA_MAX_NAME_LENGTH, "Vulkan Base Compute %u", i);
+		command_buffer->fence_signaled = 1;
+		command_buffer->command_pool = vulkan->compute_command_pool;
+		if (vka_create_command_buffer(vulkan, command_buffer)) { return -1; }
+
+		command_buffer->use_signal = 1;
+		command_buffer->signal_semaphore = &(vulkan->compute_complete[i]);
+		command_buffer->queue = &(vulkan->compute_queue);
 	}
 
+	return 0;
+}
+
+int vka_submit_compute(vka_vulkan_t *vulkan, VkPipelineStageFlags wait_dst_stage_mask)
+{
+	/* Submits this frame's compute command buffer, and makes this frame's graphics submission
+	 * wait for it at wait_dst_stage_mask. Submit before the graphics command buffer. */
+	vka_command_buffer_t *compute = &(vulkan->compute_command_buffers[vulkan->current_frame]);
+	if (vka_submit_command_buffer(vulkan, compute)) { return -1; }
+
+	vka_command_buffer_t *graphics = &(vulkan->command_buffers[vulkan->current_frame]);
+	graphics->next_wait_semaphore = vulkan->compute_complete[vulkan->current_frame];
+	graphics->next_wait_dst_stage_mask = wait_dst_stage_mask;
+
+	return 0;
+}
+
+int vka_create_swapchain(vka_vulkan_t *vulkan)
+{
+	/* Used for initial creation AND recreation of swapchain. The old swapchain and its image
+	 * views are retired rather than destroyed, so frames in flight don't need to be drained. */
 	VkFormat old_format = vulkan->swapchain_format;
 	VkSwapchainKHR old_swapchain = vulkan->swapchain;
 
@@ -562,7 +832,6 @@ int vka_create_swapchain(vka_vulkan_t *vulkan)
 		}
 	}
 
-	vulkan->swapchain_format = chosen_format.format;
 	free(formats);
 
 	uint32_t num_modes;
@@ -690,30 +959,81 @@ int vka_create_swapchain(vka_vulkan_t *vulkan)
 		swapchain_info.pQueueFamilyIndices	= queue_family_indices;
 	}
 
+	// Room for the old views and swapchain first, so retiring them below can't fail part way:
+	if (old_swapchain &&
+		vka_reserve_retired_objects(vulkan, vulkan->num_swapchain_images + 1))
+	{
+		return -1;
+	}
+
 	if (vkCreateSwapchainKHR(vulkan->device, &swapchain_info, NULL,
 				&(vulkan->swapchain)) != VK_SUCCESS)
 	{
+		/* The old swapchain was passed as oldSwapchain, so it's retired even though this
+		 * failed. Nothing more can be acquired from it, so destroy it and its views: */
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not create swapchain.");
-		vulkan->swapchain = old_swapchain;
+		vulkan->swapchain = VK_NULL_HANDLE;
+		if (old_swapchain)
+		{
+			vka_device_wait_idle(vulkan);
+			for (uint32_t i = 0; i < vulkan->num_swapchain_images; i++)
+			{
+				vka_destroy_image(vulkan, &(vulkan->swapchain_images[i]));
+			}
+			vkDestroySwapchainKHR(vulkan->device, old_swapchain, NULL);
+		}
 		return -1;
 	}
 
-	if (old_swapchain) { vkDestroySwapchainKHR(vulkan->device, old_swapchain, NULL); }
+	vulkan->swapchain_format = chosen_format.format;
+
+	// Old image views may still be referenced by frames in flight:
+	if (vulkan->swapchain_images)
+	{
+		for (uint32_t i = 0; i < vulkan->num_swapchain_images; i++)
+		{
+			if (vulkan->swapchain_images[i].image_view)
+			{
+				vka_retire_object(vulkan, VK_OBJECT_TYPE_IMAGE_VIEW,
+					(uint64_t)(vulkan->swapchain_images[i].image_view));
+			}
+			vulkan->swapchain_images[i].image_view = VK_NULL_HANDLE;
+			vulkan->swapchain_images[i].image = VK_NULL_HANDLE;
+		}
+	}
+
+	if (old_swapchain)
+	{
+		vka_retire_object(vulkan, VK_OBJECT_TYPE_SWAPCHAIN_KHR, (uint64_t)old_swapchain);
+	}
 
+	uint32_t num_swapchain_images;
 	if (vkGetSwapchainImagesKHR(vulkan->device, vulkan->swapchain,
-		&(vulkan->num_swapchain_images), NULL) != VK_SUCCESS)
+		&num_swapchain_images, NULL) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
 			"Could not get number of swapchain images.");
 		return -1;
 	}
 
-	vulkan->swapchain_images = calloc(vulkan->num_swapchain_images, sizeof(vka_image_t));
+	// Keep the image array if the image count hasn't changed:
+	if (vulkan->swapchain_images && (num_swapchain_images != vulkan->num_swapchain_images))
+	{
+		free(vulkan->swapchain_images);
+		vulkan->swapchain_images = NULL;
+	}
+	vulkan->num_swapchain_images = num_swapchain_images;
+
 	if (!vulkan->swapchain_images)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not allocate memory for swapchain images.");
-		return -1;
+		vulkan->swapchain_images = calloc(vulkan->num_swapchain_images,
+							sizeof(vka_image_t));
+		if (!vulkan->swapchain_images)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for swapchain images.");
+			return -1;
+		}
 	}
 	for (uint32_t i = 0; i < vulkan->num_swapchain_images; i++)
 	{
@@ -723,6 +1043,8 @@ int vka_create_swapchain(vka_vulkan_t *vulkan)
 		vulkan->swapchain_images[i].image_view = VK_NULL_HANDLE;
 		vulkan->swapchain_images[i].is_swapchain_image = 1;
 		vulkan->swapchain_images[i].format = vulkan->swapchain_format;
+		vulkan->swapchain_images[i].width = vulkan->swapchain_extent.width;
+		vulkan->swapchain_images[i].height = vulkan->swapchain_extent.height;
 		vulkan->swapchain_images[i].aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
 		vulkan->swapchain_images[i].mip_levels = 1;
 	}
@@ -759,7 +1081,7 @@ int vka_create_swapchain(vka_vulkan_t *vulkan)
 
 int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_device,
 		uint32_t *graphics_family_index, uint32_t *present_family_index,
-		VkBool32 *sampler_anisotropy)
+		uint32_t *compute_family_index, VkBool32 *sampler_anisotropy)
 {
 	int score = 0;
 
@@ -820,7 +1142,8 @@ int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_de
 		return -1;
 	}
 
-	int supported = 0;
+	// Headless doesn't need the swapchain extension:
+	int supported = (vulkan->headless != 0);
 	for (uint32_t i = 0; i < num_supported_extensions; i++)
 	{
 		if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, supported_extensions[i].extensionName))
@@ -953,6 +1276,19 @@ int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_de
 	vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &num_queue_families,
 								queue_families);
 
+	// Prefer a compute family without graphics, for async compute:
+	int compute_queue_family_found = 0;
+	for (uint32_t i = 0; i < num_queue_families; i++)
+	{
+		if ((queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+			!(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			*compute_family_index = i;
+			compute_queue_family_found = 1;
+			break;
+		}
+	}
+
 	for (uint32_t i = 0; i < num_queue_families; i++)
 	{
 		int queues_found = 0;
@@ -967,8 +1303,14 @@ int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_de
 			}
 		}
 
+		// Headless has nothing to present to, so the present family is the graphics family:
 		VkBool32 present_supported = VK_FALSE;
-		if (vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i,
+		if (vulkan->headless)
+		{
+			present_supported = ((graphics_flags & queue_families[i].queueFlags) ==
+								graphics_flags);
+		}
+		else if (vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i,
 			vulkan->surface, &present_supported) != VK_SUCCESS)
 		{
 			continue;
@@ -995,11 +1337,48 @@ int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_de
 		free(queue_families);
 		return -1;
 	}
+	if (!compute_queue_family_found) { *compute_family_index = *graphics_family_index; }
+	else if (vulkan->use_async_compute) { score += 1; }
 
 	free(queue_families);
 	return score;
 }
 
+int vka_check_device_extension_support(vka_vulkan_t *vulkan, const char *extension_name)
+{
+	// Returns 1 if the chosen physical device supports the extension, 0 otherwise.
+	uint32_t num_supported_extensions;
+	if (vkEnumerateDeviceExtensionProperties(vulkan->physical_device, NULL,
+			&num_supported_extensions, NULL) != VK_SUCCESS)
+	{
+		return 0;
+	}
+
+	VkExtensionProperties *supported_extensions = malloc(num_supported_extensions *
+							sizeof(VkExtensionProperties));
+	if (!supported_extensions) { return 0; }
+
+	if (vkEnumerateDeviceExtensionProperties(vulkan->physical_device, NULL,
+		&num_supported_extensions, supported_extensions) != VK_SUCCESS)
+	{
+		free(supported_extensions);
+		return 0;
+	}
+
+	int supported = 0;
+	for (uint32_t i = 0; i < num_supported_extensions; i++)
+	{
+		if (!strcmp(extension_name, supported_extensions[i].extensionName))
+		{
+			supported = 1;
+			break;
+		}
+	}
+
+	free(supported_extensions);
+	return supported;
+}
+
 /*************************
  * Pipelines and shaders *
  *************************/
@@ -1077,6 +1456,8 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 			if (push_constant_ranges) { free(push_constant_ranges); }
 			return -1;
 		}
+		vka_set_object_name(vulkan, VK_OBJECT_TYPE_PIPELINE_LAYOUT,
+					(uint64_t)(pipeline->layout), pipeline->name);
 
 		if (push_constant_ranges) { free(push_constant_ranges); }
 	}
@@ -1087,6 +1468,13 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 		vka_shader_t *c_shader = &(pipeline->shaders[VKA_SHADER_TYPE_COMPUTE]);
 		if (!c_shader->shader && vka_create_shader(vulkan, c_shader)) { return -1; }
 
+		VkSpecializationInfo c_specialisation_info;
+		if (vka_get_specialisation_info(vulkan, pipeline, VKA_SHADER_TYPE_COMPUTE,
+							&c_specialisation_info))
+		{
+			return -1;
+		}
+
 		VkPipelineShaderStageCreateInfo c_shader_stage_info;
 		memset(&c_shader_stage_info, 0, sizeof(c_shader_stage_info));
 		c_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1096,12 +1484,16 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 		c_shader_stage_info.module		= c_shader->shader;
 		c_shader_stage_info.pName		= "main";
 		c_shader_stage_info.pSpecializationInfo	= NULL;
+		if (c_specialisation_info.mapEntryCount)
+		{
+			c_shader_stage_info.pSpecializationInfo = &c_specialisation_info;
+		}
 
 		VkComputePipelineCreateInfo c_pipeline_info;
 		memset(&c_pipeline_info, 0, sizeof(c_pipeline_info));
 		c_pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 		c_pipeline_info.pNext			= NULL;
-		c_pipeline_info.flags			= 0;
+		c_pipeline_info.flags			= VK_PIPELINE_CREATE_DISPATCH_BASE_BIT;
 		c_pipeline_info.stage			= c_shader_stage_info;
 		c_pipeline_info.layout			= pipeline->layout;
 		c_pipeline_info.basePipelineHandle	= NULL;
@@ -1122,6 +1514,27 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 			vkDestroyPipeline(vulkan->device, pipeline->pipeline, NULL);
 		}
 		pipeline->pipeline = c_temp;
+		vka_set_object_name(vulkan, VK_OBJECT_TYPE_PIPELINE, (uint64_t)(pipeline->pipeline),
+								pipeline->name);
+
+		// Workgroup size, with any specialisation constants that override it:
+		vka_specialisation_t *specialisation =
+			&(pipeline->specialisation[VKA_SHADER_TYPE_COMPUTE]);
+		for (int i = 0; i < 3; i++)
+		{
+			pipeline->workgroup_size[i] = c_shader->workgroup_size[i];
+			for (uint32_t j = 0; j < specialisation->num_constants; j++)
+			{
+				VkSpecializationMapEntry *entry = &(specialisation->entries[j]);
+				if ((entry->constantID == c_shader->workgroup_size_ids[i]) &&
+					(entry->size == sizeof(uint32_t)))
+				{
+					memcpy(&(pipeline->workgroup_size[i]),
+						(uint8_t *)(specialisation->data) + entry->offset,
+						sizeof(uint32_t));
+				}
+			}
+		}
 
 		return 0;
 	}
@@ -1168,12 +1581,19 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 					&(pipeline->shaders[VKA_SHADER_TYPE_FRAGMENT]) };
 	VkShaderStageFlagBits stage_flags[2] = { VK_SHADER_STAGE_VERTEX_BIT,
 						VK_SHADER_STAGE_FRAGMENT_BIT };
+	uint32_t shader_types[2] = { VKA_SHADER_TYPE_VERTEX, VKA_SHADER_TYPE_FRAGMENT };
 
 	VkPipelineShaderStageCreateInfo shader_stages[stage_count];
+	VkSpecializationInfo specialisation_info[stage_count];
 	memset(shader_stages, 0, stage_count * sizeof(shader_stages[0]));
 	for (uint32_t i = 0; i < stage_count; i++)
 	{
 		if (!shaders[i]->shader && vka_create_shader(vulkan, shaders[i])) { return -1; }
+		if (vka_get_specialisation_info(vulkan, pipeline, shader_types[i],
+						&(specialisation_info[i])))
+		{
+			return -1;
+		}
 
 		shader_stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shader_stages[i].pNext			= NULL;
@@ -1182,6 +1602,10 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 		shader_stages[i].module			= shaders[i]->shader;
 		shader_stages[i].pName			= "main";
 		shader_stages[i].pSpecializationInfo	= NULL;
+		if (specialisation_info[i].mapEntryCount)
+		{
+			shader_stages[i].pSpecializationInfo = &(specialisation_info[i]);
+		}
 	}
 
 	// Vertex input:
@@ -1326,17 +1750,45 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 	blend_info.blendConstants[2]	= 0.f;
 	blend_info.blendConstants[3]	= 0.f;
 
-	// Dynamic state:
-	VkDynamicState dynamic_state[2];
+	// Dynamic state (viewport and scissor always, the rest opt-in):
+	uint32_t dynamic_state_mask = pipeline->dynamic_state;
+	if (!vulkan->use_extended_dynamic_state_3)
+	{
+		dynamic_state_mask &= ~VKA_DYNAMIC_STATE_BLEND_ENABLE;
+	}
+
+	uint32_t dynamic_state_count = 2;
+	VkDynamicState dynamic_state[8];
 	dynamic_state[0] = VK_DYNAMIC_STATE_VIEWPORT;
 	dynamic_state[1] = VK_DYNAMIC_STATE_SCISSOR;
 
+	uint32_t dynamic_state_flags[6] = { VKA_DYNAMIC_STATE_CULL_MODE,
+						VKA_DYNAMIC_STATE_DEPTH_TEST,
+						VKA_DYNAMIC_STATE_DEPTH_WRITE,
+						VKA_DYNAMIC_STATE_DEPTH_COMPARE,
+						VKA_DYNAMIC_STATE_TOPOLOGY,
+						VKA_DYNAMIC_STATE_BLEND_ENABLE };
+	VkDynamicState dynamic_states[6] = { VK_DYNAMIC_STATE_CULL_MODE,
+						VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE,
+						VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE,
+						VK_DYNAMIC_STATE_DEPTH_COMPARE_OP,
+						VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY,
+						VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT };
+	for (int i = 0; i < 6; i++)
+	{
+		if (dynamic_state_mask & dynamic_state_flags[i])
+		{
+			dynamic_state[dynamic_state_count] = dynamic_states[i];
+			dynamic_state_count++;
+		}
+	}
+
 	VkPipelineDynamicStateCreateInfo dynamic_state_info;
 	memset(&dynamic_state_info, 0, sizeof(dynamic_state_info));
 	dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 	dynamic_state_info.pNext		= NULL;
 	dynamic_state_info.flags		= 0;
-	dynamic_state_info.dynamicStateCount	= 2;
+	dynamic_state_info.dynamicStateCount	= dynamic_state_count;
 	dynamic_state_info.pDynamicStates	= dynamic_state;
 
 	// Rendering (TODO - add config for multiple colour attachments and formats):
@@ -1375,7 +1827,11 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 
 	// Create a temporary pipeline in case this doesn't work out:
 	VkPipeline temp = VK_NULL_HANDLE;
-	if (vkCreateGraphicsPipelines(vulkan->device, VK_NULL_HANDLE, 1,
+	if (vulkan->use_pipeline_library)
+	{
+		if (vka_link_pipeline(vulkan, pipeline, &pipeline_info, &temp)) { return -1; }
+	}
+	else if (vkCreateGraphicsPipelines(vulkan->device, VK_NULL_HANDLE, 1,
 			&pipeline_info, NULL, &temp) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
@@ -1385,12 +1841,20 @@ int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 
 	if (pipeline->pipeline) { vkDestroyPipeline(vulkan->device, pipeline->pipeline, NULL); }
 	pipeline->pipeline = temp;
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_PIPELINE, (uint64_t)(pipeline->pipeline),
+								pipeline->name);
 
 	return 0;
 }
 
 void vka_destroy_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 {
+	vka_cancel_pipeline_links(vulkan, pipeline);
+
+	#ifdef VKA_SHADER_WATCHER
+	vka_unwatch_pipeline(vulkan, pipeline);
+	#endif
+
 	if (pipeline->descriptor_set_tracker)
 	{
 		free(pipeline->descriptor_set_tracker);
@@ -1418,1885 +1882,7405 @@ void vka_destroy_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 	}
 }
 
-void vka_bind_pipeline(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
-{
-	VkPipelineBindPoint bind_point;
-	if (pipeline->is_compute_pipeline) { bind_point = VK_PIPELINE_BIND_POINT_COMPUTE; }
-	else { bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS; }
-
-	vkCmdBindPipeline(command_buffer->buffer, bind_point, pipeline->pipeline);
-}
-
-int vka_create_shader(vka_vulkan_t *vulkan, vka_shader_t *shader)
+int vka_link_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+		VkGraphicsPipelineCreateInfo *pipeline_info, VkPipeline *linked_pipeline)
 {
-	FILE *shader_file = fopen(shader->path, "rb");
-	if (!shader_file)
+	/* Builds a graphics pipeline out of four library parts, each covering part of the state.
+	 * Parts are cached in vka_vulkan_t by a hash of the state they cover, so pipelines that
+	 * only differ in some state reuse the parts they have in common. The parts are linked
+	 * without optimisation here, and an optimised link is queued for the linker thread. */
+	VkGraphicsPipelineLibraryFlagsEXT parts[4] = {
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT };
+
+	// Dynamic state applies to every part:
+	const VkPipelineDynamicStateCreateInfo *dynamic_state_info = pipeline_info->pDynamicState;
+	uint8_t dynamic_cull_mode = 0;
+	uint8_t dynamic_depth_test = 0;
+	uint8_t dynamic_depth_write = 0;
+	uint8_t dynamic_depth_compare = 0;
+	uint8_t dynamic_topology = 0;
+	uint8_t dynamic_blend_enable = 0;
+	for (uint32_t i = 0; i < dynamic_state_info->dynamicStateCount; i++)
+	{
+		VkDynamicState state = dynamic_state_info->pDynamicStates[i];
+		if (state == VK_DYNAMIC_STATE_CULL_MODE) { dynamic_cull_mode = 1; }
+		if (state == VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE) { dynamic_depth_test = 1; }
+		if (state == VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE) { dynamic_depth_write = 1; }
+		if (state == VK_DYNAMIC_STATE_DEPTH_COMPARE_OP) { dynamic_depth_compare = 1; }
+		if (state == VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY) { dynamic_topology = 1; }
+		if (state == VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT) { dynamic_blend_enable = 1; }
+	}
+
+	vka_pipeline_library_key_t keys[4];
+	memset(keys, 0, sizeof(keys));
+	for (int i = 0; i < 4; i++)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not open shader file \"%s\".", shader->path);
-		return -1;
+		keys[i].part = parts[i];
+		keys[i].num_dynamic_states = dynamic_state_info->dynamicStateCount;
+		memcpy(keys[i].dynamic_states, dynamic_state_info->pDynamicStates,
+			dynamic_state_info->dynamicStateCount * sizeof(VkDynamicState));
+	}
+
+	// Vertex input. A dynamic topology must still be in the same class (point, line, etc.):
+	const VkPipelineVertexInputStateCreateInfo *input_info = pipeline_info->pVertexInputState;
+	keys[0].num_vertex_bindings = input_info->vertexBindingDescriptionCount;
+	memcpy(keys[0].vertex_bindings, input_info->pVertexBindingDescriptions,
+		input_info->vertexBindingDescriptionCount *
+		sizeof(VkVertexInputBindingDescription));
+	keys[0].num_vertex_attributes = input_info->vertexAttributeDescriptionCount;
+	memcpy(keys[0].vertex_attributes, input_info->pVertexAttributeDescriptions,
+		input_info->vertexAttributeDescriptionCount *
+		sizeof(VkVertexInputAttributeDescription));
+	keys[0].topology = pipeline->topology;
+	if (dynamic_topology)
+	{
+		VkPrimitiveTopology topology = pipeline->topology;
+		if ((topology == VK_PRIMITIVE_TOPOLOGY_LINE_LIST) ||
+			(topology == VK_PRIMITIVE_TOPOLOGY_LINE_STRIP) ||
+			(topology == VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY) ||
+			(topology == VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY))
+		{
+			keys[0].topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+		}
+		else if ((topology != VK_PRIMITIVE_TOPOLOGY_POINT_LIST) &&
+			(topology != VK_PRIMITIVE_TOPOLOGY_PATCH_LIST))
+		{
+			keys[0].topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		}
 	}
 
-	if (fseek(shader_file, 0, SEEK_END))
+	// Shaders (pre-rasterisation and fragment), with their layout and specialisation constants:
+	uint32_t shader_types[2] = { VKA_SHADER_TYPE_VERTEX, VKA_SHADER_TYPE_FRAGMENT };
+	for (int i = 0; i < 2; i++)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not navigate shader file \"%s\".", shader->path);
-		fclose(shader_file);
-		return -1;
+		vka_shader_t *shader = &(pipeline->shaders[shader_types[i]]);
+		vka_specialisation_t *specialisation = &(pipeline->specialisation[shader_types[i]]);
+		vka_pipeline_library_key_t *key = &(keys[i + 1]);
+
+		memcpy(key->set_layouts, pipeline->descriptor_layout_tracker,
+			pipeline->num_descriptor_sets * sizeof(VkDescriptorSetLayout));
+		for (uint32_t j = 0; j < pipeline->num_push_constants; j++)
+		{
+			key->push_constant_stages[j] = pipeline->push_constants[j].stage_flags;
+			key->push_constant_sizes[j] = pipeline->push_constants[j].size;
+		}
+
+		key->shader = shader->shader;
+		key->shader_hash = shader->hash;
+		key->num_constants = specialisation->num_constants;
+		for (uint32_t j = 0; j < specialisation->num_constants; j++)
+		{
+			// Constants are scalars, so at most 8 bytes each:
+			VkSpecializationMapEntry *entry = &(specialisation->entries[j]);
+			key->constant_entries[j] = *entry;
+			size_t size = entry->size;
+			if (size > sizeof(uint64_t)) { size = sizeof(uint64_t); }
+			memcpy(&(key->constant_values[j]),
+				(const uint8_t *)(specialisation->data) + entry->offset, size);
+		}
 	}
-	long file_size = ftell(shader_file);
-	if (file_size == -1)
+
+	// Pre-rasterisation:
+	keys[1].polygon_mode = pipeline->polygon_mode;
+	if (!dynamic_cull_mode) { keys[1].cull_mode = pipeline->cull_mode; }
+	keys[1].line_width = pipeline->line_width;
+
+	// Fragment shader:
+	if (!dynamic_depth_test) { keys[2].depth_test_enable = pipeline->depth_test_enable; }
+	if (!dynamic_depth_write) { keys[2].depth_write_enable = pipeline->depth_write_enable; }
+	if (!dynamic_depth_compare) { keys[2].depth_compare_op = pipeline->depth_compare_op; }
+	keys[2].depth_attachment_format = pipeline->depth_attachment_format;
+
+	// Fragment output:
+	keys[3].blend_state = pipeline_info->pColorBlendState->pAttachments[0];
+	if (dynamic_blend_enable) { keys[3].blend_state.blendEnable = VK_FALSE; }
+	keys[3].colour_attachment_format = pipeline->colour_attachment_format;
+	keys[3].depth_attachment_format = pipeline->depth_attachment_format;
+
+	VkPipeline libraries[4];
+	for (int i = 0; i < 4; i++)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not get size of shader file \"%s\".", shader->path);
-		fclose(shader_file);
-		return -1;
+		// The hash narrows the search, the key confirms a hit:
+		uint64_t hash = vka_hash(&(keys[i]), sizeof(vka_pipeline_library_key_t),
+								VKA_HASH_SEED);
+		libraries[i] = VK_NULL_HANDLE;
+		for (uint32_t j = 0; j < vulkan->num_pipeline_libraries; j++)
+		{
+			vka_pipeline_library_t *library = &(vulkan->pipeline_libraries[j]);
+			if ((library->hash == hash) &&
+				!memcmp(&(library->key), &(keys[i]),
+					sizeof(vka_pipeline_library_key_t)))
+			{
+				libraries[i] = library->library;
+				break;
+			}
+		}
+		if (libraries[i]) { continue; }
+
+		if (vulkan->num_pipeline_libraries == vulkan->max_pipeline_libraries)
+		{
+			uint32_t max_pipeline_libraries = 2 * vulkan->max_pipeline_libraries;
+			if (!max_pipeline_libraries) { max_pipeline_libraries = 16; }
+
+			vka_pipeline_library_t *pipeline_libraries = realloc(
+				vulkan->pipeline_libraries,
+				max_pipeline_libraries * sizeof(vka_pipeline_library_t));
+			if (!pipeline_libraries)
+			{
+				snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+					"Could not allocate memory for pipeline libraries for "
+					"pipeline \"%s\".", pipeline->name);
+				return -1;
+			}
+			vulkan->pipeline_libraries = pipeline_libraries;
+			vulkan->max_pipeline_libraries = max_pipeline_libraries;
+		}
+
+		VkGraphicsPipelineLibraryCreateInfoEXT library_info;
+		memset(&library_info, 0, sizeof(library_info));
+		library_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+		library_info.pNext	= pipeline_info->pNext; // Rendering info.
+		library_info.flags	= parts[i];
+
+		VkGraphicsPipelineCreateInfo part_info;
+		memset(&part_info, 0, sizeof(part_info));
+		part_info.sType		= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		part_info.pNext		= &library_info;
+		part_info.flags		= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR |
+				VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+		part_info.pDynamicState	= dynamic_state_info;
+
+		if (i == 0)
+		{
+			part_info.pVertexInputState	= pipeline_info->pVertexInputState;
+			part_info.pInputAssemblyState	= pipeline_info->pInputAssemblyState;
+		}
+		else if (i == 1)
+		{
+			part_info.stageCount		= 1;
+			part_info.pStages		= &(pipeline_info->pStages[0]);
+			part_info.pViewportState	= pipeline_info->pViewportState;
+			part_info.pRasterizationState	= pipeline_info->pRasterizationState;
+			part_info.layout		= pipeline->layout;
+		}
+		else if (i == 2)
+		{
+			part_info.stageCount		= 1;
+			part_info.pStages		= &(pipeline_info->pStages[1]);
+			part_info.pMultisampleState	= pipeline_info->pMultisampleState;
+			part_info.pDepthStencilState	= pipeline_info->pDepthStencilState;
+			part_info.layout		= pipeline->layout;
+		}
+		else
+		{
+			part_info.pMultisampleState	= pipeline_info->pMultisampleState;
+			part_info.pColorBlendState	= pipeline_info->pColorBlendState;
+		}
+
+		if (vkCreateGraphicsPipelines(vulkan->device, VK_NULL_HANDLE, 1, &part_info,
+						NULL, &(libraries[i])) != VK_SUCCESS)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not create pipeline library part %d for pipeline \"%s\".",
+				i, pipeline->name);
+			return -1;
+		}
+
+		vka_pipeline_library_t *library =
+			&(vulkan->pipeline_libraries[vulkan->num_pipeline_libraries]);
+		library->hash = hash;
+		library->key = keys[i];
+		library->library = libraries[i];
+		vulkan->num_pipeline_libraries++;
 	}
-	if (file_size % 4)
+
+	// Fast link:
+	VkPipelineLibraryCreateInfoKHR link_info;
+	memset(&link_info, 0, sizeof(link_info));
+	link_info.sType		= VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+	link_info.pNext		= NULL;
+	link_info.libraryCount	= 4;
+	link_info.pLibraries	= libraries;
+
+	VkGraphicsPipelineCreateInfo linked_info;
+	memset(&linked_info, 0, sizeof(linked_info));
+	linked_info.sType	= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	linked_info.pNext	= &link_info;
+	linked_info.flags	= 0;
+	linked_info.layout	= pipeline->layout;
+
+	if (vkCreateGraphicsPipelines(vulkan->device, VK_NULL_HANDLE, 1, &linked_info,
+						NULL, linked_pipeline) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Shader file \"%s\" size is not a multiple of 4 bytes.", shader->path);
-		fclose(shader_file);
+			"Could not link pipeline \"%s\".", pipeline->name);
 		return -1;
 	}
-	rewind(shader_file);
 
-	size_t code_size = file_size;
-	uint32_t *shader_code = malloc(code_size);
-	if (!shader_code)
+	// Optimised link, swapped in by vka_next_frame() when it's done:
+	if (!vulkan->pipeline_link_mutex) { return 0; }
+
+	SDL_LockMutex(vulkan->pipeline_link_mutex);
+	if (vulkan->num_pipeline_links == vulkan->max_pipeline_links)
+	{
+		uint32_t max_pipeline_links = 2 * vulkan->max_pipeline_links;
+		if (!max_pipeline_links) { max_pipeline_links = 16; }
+
+		vka_pipeline_link_t *pipeline_links = realloc(vulkan->pipeline_links,
+					max_pipeline_links * sizeof(vka_pipeline_link_t));
+		if (!pipeline_links)
+		{
+			// Not fatal, the fast link is still usable:
+			SDL_UnlockMutex(vulkan->pipeline_link_mutex);
+			return 0;
+		}
+		vulkan->pipeline_links = pipeline_links;
+		vulkan->max_pipeline_links = max_pipeline_links;
+	}
+
+	vka_pipeline_link_t *link = &(vulkan->pipeline_links[vulkan->num_pipeline_links]);
+	memset(link, 0, sizeof(vka_pipeline_link_t));
+	link->pipeline = pipeline;
+	link->layout = pipeline->layout;
+	link->fast_pipeline = *linked_pipeline;
+	memcpy(link->libraries, libraries, 4 * sizeof(VkPipeline));
+	link->state = VKA_LINK_STATE_QUEUED;
+	vulkan->num_pipeline_links++;
+
+	// Broadcast, as vka_cancel_pipeline_links() may be waiting on the same condition:
+	SDL_BroadcastCondition(vulkan->pipeline_link_condition);
+	SDL_UnlockMutex(vulkan->pipeline_link_mutex);
+
+	return 0;
+}
+
+int vka_pipeline_linker_set_up(vka_vulkan_t *vulkan)
+{
+	vulkan->pipeline_link_mutex = SDL_CreateMutex();
+	if (!vulkan->pipeline_link_mutex)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not allocate memory for shader code from file \"%s\".",
-			shader->path);
-		fclose(shader_file);
+			"Could not create mutex for pipeline linker: %s", SDL_GetError());
 		return -1;
 	}
 
-	if (fread(shader_code, 4, code_size / 4, shader_file) != (code_size / 4))
+	vulkan->pipeline_link_condition = SDL_CreateCondition();
+	if (!vulkan->pipeline_link_condition)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not read shader code from file \"%s\".", shader->path);
-		free(shader_code);
-		fclose(shader_file);
+			"Could not create condition for pipeline linker: %s", SDL_GetError());
 		return -1;
 	}
 
-	fclose(shader_file);
-
-	VkShaderModuleCreateInfo shader_module_info;
-	memset(&shader_module_info, 0, sizeof(shader_module_info));
-	shader_module_info.sType	= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shader_module_info.pNext	= NULL;
-	shader_module_info.flags	= 0;
-	shader_module_info.codeSize	= code_size;
-	shader_module_info.pCode	= shader_code;
-
-	// Create a temporary shader module in case this doesn't work out:
-	VkShaderModule temp = VK_NULL_HANDLE;
-	if (vkCreateShaderModule(vulkan->device, &shader_module_info, NULL, &temp) != VK_SUCCESS)
+	SDL_SetAtomicInt(&(vulkan->pipeline_link_quit), 0);
+	vulkan->pipeline_link_thread = SDL_CreateThread(vka_pipeline_linker_thread,
+							"Pipeline linker", vulkan);
+	if (!vulkan->pipeline_link_thread)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create shader module for \"%s\".", shader->path);
-		free(shader_code);
+			"Could not create pipeline linker thread: %s", SDL_GetError());
 		return -1;
 	}
 
-	vka_destroy_shader(vulkan, shader);
-	shader->shader = temp;
-
-	free(shader_code);
 	return 0;
 }
 
-int vka_create_shader_from_array(vka_vulkan_t *vulkan, vka_shader_t *shader,
-				size_t code_size, uint32_t *shader_code)
+void vka_pipeline_linker_shut_down(vka_vulkan_t *vulkan)
 {
-	VkShaderModuleCreateInfo shader_module_info;
-	memset(&shader_module_info, 0, sizeof(shader_module_info));
-	shader_module_info.sType	= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	shader_module_info.pNext	= NULL;
-	shader_module_info.flags	= 0;
-	shader_module_info.codeSize	= code_size;
-	shader_module_info.pCode	= shader_code;
+	// Device must be idle.
+	if (vulkan->pipeline_link_thread)
+	{
+		SDL_SetAtomicInt(&(vulkan->pipeline_link_quit), 1);
+		SDL_LockMutex(vulkan->pipeline_link_mutex);
+		SDL_BroadcastCondition(vulkan->pipeline_link_condition);
+		SDL_UnlockMutex(vulkan->pipeline_link_mutex);
 
-	// Create a temporary shader module in case this doesn't work out:
-	VkShaderModule temp = VK_NULL_HANDLE;
-	if (vkCreateShaderModule(vulkan->device, &shader_module_info, NULL, &temp) != VK_SUCCESS)
+		SDL_WaitThread(vulkan->pipeline_link_thread, NULL);
+		vulkan->pipeline_link_thread = NULL;
+	}
+
+	if (vulkan->pipeline_links)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create shader module from array for \"%s\".", shader->path);
-		free(shader_code);
-		return -1;
+		for (uint32_t i = 0; i < vulkan->num_pipeline_links; i++)
+		{
+			if (vulkan->pipeline_links[i].optimised_pipeline)
+			{
+				vkDestroyPipeline(vulkan->device,
+					vulkan->pipeline_links[i].optimised_pipeline, NULL);
+			}
+		}
+		free(vulkan->pipeline_links);
+		vulkan->pipeline_links = NULL;
+		vulkan->num_pipeline_links = 0;
+		vulkan->max_pipeline_links = 0;
 	}
 
-	vka_destroy_shader(vulkan, shader);
-	shader->shader = temp;
+	if (vulkan->pipeline_libraries)
+	{
+		for (uint32_t i = 0; i < vulkan->num_pipeline_libraries; i++)
+		{
+			vkDestroyPipeline(vulkan->device, vulkan->pipeline_libraries[i].library, NULL);
+		}
+		free(vulkan->pipeline_libraries);
+		vulkan->pipeline_libraries = NULL;
+		vulkan->num_pipeline_libraries = 0;
+		vulkan->max_pipeline_libraries = 0;
+	}
 
-	return 0;
+	if (vulkan->pipeline_link_condition)
+	{
+		SDL_DestroyCondition(vulkan->pipeline_link_condition);
+		vulkan->pipeline_link_condition = NULL;
+	}
+
+	if (vulkan->pipeline_link_mutex)
+	{
+		SDL_DestroyMutex(vulkan->pipeline_link_mutex);
+		vulkan->pipeline_link_mutex = NULL;
+	}
 }
 
-void vka_destroy_shader(vka_vulkan_t *vulkan, vka_shader_t *shader)
+void vka_update_pipeline_links(vka_vulkan_t *vulkan)
 {
-	if (shader->shader)
+	// Swaps in finished optimised links, if their pipeline hasn't been recreated meanwhile.
+	if (!vulkan->pipeline_link_mutex) { return; }
+
+	SDL_LockMutex(vulkan->pipeline_link_mutex);
+	uint32_t num_kept = 0;
+	for (uint32_t i = 0; i < vulkan->num_pipeline_links; i++)
 	{
-		vkDestroyShaderModule(vulkan->device, shader->shader, NULL);
-		shader->shader = VK_NULL_HANDLE;
+		vka_pipeline_link_t *link = &(vulkan->pipeline_links[i]);
+		if (link->state == VKA_LINK_STATE_READY)
+		{
+			if (link->pipeline->pipeline == link->fast_pipeline)
+			{
+				// Fast link may still be in use by frames in flight:
+				vka_retire_object(vulkan, VK_OBJECT_TYPE_PIPELINE,
+						(uint64_t)(link->fast_pipeline));
+				link->pipeline->pipeline = link->optimised_pipeline;
+				vka_set_object_name(vulkan, VK_OBJECT_TYPE_PIPELINE,
+					(uint64_t)(link->optimised_pipeline), link->pipeline->name);
+			}
+			else
+			{
+				// Never bound, so no need to retire it:
+				vkDestroyPipeline(vulkan->device, link->optimised_pipeline, NULL);
+			}
+		}
+		else if (link->state != VKA_LINK_STATE_FAILED)
+		{
+			vulkan->pipeline_links[num_kept] = *link;
+			num_kept++;
+		}
 	}
+	vulkan->num_pipeline_links = num_kept;
+	SDL_UnlockMutex(vulkan->pipeline_link_mutex);
 }
 
-/*******************
- * Command buffers *
- *******************/
-
-int vka_create_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+void vka_cancel_pipeline_links(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 {
-	vka_destroy_command_buffer(vulkan, command_buffer);
+	if (!vulkan->pipeline_link_mutex) { return; }
 
-	// If flags are 0, set to appropriate value:
-	if (!command_buffer->flags)
+	SDL_LockMutex(vulkan->pipeline_link_mutex);
+
+	// Let the linker thread finish with the pipeline first (waiting unlocks the mutex):
+	uint32_t i = 0;
+	while (i < vulkan->num_pipeline_links)
 	{
-		command_buffer->flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if ((vulkan->pipeline_links[i].pipeline == pipeline) &&
+			(vulkan->pipeline_links[i].state == VKA_LINK_STATE_BUILDING))
+		{
+			SDL_WaitCondition(vulkan->pipeline_link_condition,
+					vulkan->pipeline_link_mutex);
+			i = 0;
+			continue;
+		}
+		i++;
 	}
 
-	VkCommandBufferAllocateInfo allocate_info;
-	memset(&allocate_info, 0, sizeof(allocate_info));
-	allocate_info.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocate_info.pNext			= NULL;
-	allocate_info.commandPool		= vulkan->command_pool;
-	allocate_info.level			= command_buffer->level;
-	allocate_info.commandBufferCount	= 1;
-
-	if (vkAllocateCommandBuffers(vulkan->device, &allocate_info,
-			&(command_buffer->buffer)) != VK_SUCCESS)
+	// Then remove its links in one pass, so the linker thread can't see them half moved:
+	uint32_t num_kept = 0;
+	for (i = 0; i < vulkan->num_pipeline_links; i++)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create command buffer \"%s\".", command_buffer->name);
-		return -1;
+		vka_pipeline_link_t *link = &(vulkan->pipeline_links[i]);
+		if (link->pipeline != pipeline)
+		{
+			vulkan->pipeline_links[num_kept] = *link;
+			num_kept++;
+			continue;
+		}
+
+		if (link->optimised_pipeline)
+		{
+			vkDestroyPipeline(vulkan->device, link->optimised_pipeline, NULL);
+		}
 	}
+	vulkan->num_pipeline_links = num_kept;
+	SDL_UnlockMutex(vulkan->pipeline_link_mutex);
+}
 
-	VkFenceCreateInfo fence_info;
-	memset(&fence_info, 0, sizeof(fence_info));
-	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_info.pNext = NULL;
-	if (command_buffer->fence_signaled) { fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; }
-	else { fence_info.flags = 0; }
+int vka_pipeline_linker_thread(void *data)
+{
+	vka_vulkan_t *vulkan = (vka_vulkan_t *)data;
 
-	if (vkCreateFence(vulkan->device, &fence_info, NULL,
-		&(command_buffer->fence)) != VK_SUCCESS)
+	SDL_LockMutex(vulkan->pipeline_link_mutex);
+	while (!SDL_GetAtomicInt(&(vulkan->pipeline_link_quit)))
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create fence \"%s\".", command_buffer->name);
-		return -1;
+		vka_pipeline_link_t link;
+		int found = 0;
+		for (uint32_t i = 0; i < vulkan->num_pipeline_links; i++)
+		{
+			if (vulkan->pipeline_links[i].state == VKA_LINK_STATE_QUEUED)
+			{
+				vulkan->pipeline_links[i].state = VKA_LINK_STATE_BUILDING;
+				link = vulkan->pipeline_links[i];
+				found = 1;
+				break;
+			}
+		}
+
+		if (!found)
+		{
+			SDL_WaitCondition(vulkan->pipeline_link_condition,
+					vulkan->pipeline_link_mutex);
+			continue;
+		}
+		SDL_UnlockMutex(vulkan->pipeline_link_mutex);
+
+		VkPipelineLibraryCreateInfoKHR link_info;
+		memset(&link_info, 0, sizeof(link_info));
+		link_info.sType		= VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		link_info.pNext		= NULL;
+		link_info.libraryCount	= 4;
+		link_info.pLibraries	= link.libraries;
+
+		VkGraphicsPipelineCreateInfo linked_info;
+		memset(&linked_info, 0, sizeof(linked_info));
+		linked_info.sType	= VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		linked_info.pNext	= &link_info;
+		linked_info.flags	= VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+		linked_info.layout	= link.layout;
+
+		VkPipeline optimised_pipeline = VK_NULL_HANDLE;
+		VkResult result = vkCreateGraphicsPipelines(vulkan->device, VK_NULL_HANDLE, 1,
+						&linked_info, NULL, &optimised_pipeline);
+
+		// Links may have moved while building. Cancelling waits for this one to finish:
+		SDL_LockMutex(vulkan->pipeline_link_mutex);
+		found = 0;
+		for (uint32_t i = 0; i < vulkan->num_pipeline_links; i++)
+		{
+			vka_pipeline_link_t *building = &(vulkan->pipeline_links[i]);
+			if ((building->pipeline != link.pipeline) ||
+				(building->state != VKA_LINK_STATE_BUILDING))
+			{
+				continue;
+			}
+
+			if (result == VK_SUCCESS)
+			{
+				building->optimised_pipeline = optimised_pipeline;
+				building->state = VKA_LINK_STATE_READY;
+			}
+			else { building->state = VKA_LINK_STATE_FAILED; }
+			found = 1;
+			break;
+		}
+
+		// Nothing to hand the result to, so don't leak it:
+		if (!found && (result == VK_SUCCESS))
+		{
+			vkDestroyPipeline(vulkan->device, optimised_pipeline, NULL);
+		}
+		SDL_BroadcastCondition(vulkan->pipeline_link_condition);
 	}
+	SDL_UnlockMutex(vulkan->pipeline_link_mutex);
 
 	return 0;
 }
 
-void vka_destroy_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+void vka_bind_pipeline(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
 {
-	if (command_buffer->fence)
+	VkPipelineBindPoint bind_point;
+	if (pipeline->is_compute_pipeline) { bind_point = VK_PIPELINE_BIND_POINT_COMPUTE; }
+	else { bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS; }
+
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if (bound_state->pipelines[bind_point] == pipeline->pipeline)
 	{
-		vkDestroyFence(vulkan->device, command_buffer->fence, NULL);
-		command_buffer->fence = VK_NULL_HANDLE;
+		command_buffer->num_elided_pipelines++;
+		return;
 	}
 
-	command_buffer->buffer = VK_NULL_HANDLE;
+	vkCmdBindPipeline(command_buffer->buffer, bind_point, pipeline->pipeline);
+	VKA_COUNT(command_buffer->counters, num_pipeline_binds, 1);
+	bound_state->pipelines[bind_point] = pipeline->pipeline;
 }
 
-int vka_begin_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+int vka_create_shader(vka_vulkan_t *vulkan, vka_shader_t *shader)
 {
-	// If fence is created signaled, wait here:
-	if (command_buffer->fence_signaled && vka_wait_for_fence(vulkan, command_buffer))
+	/* Shader modules are shared between shaders with identical SPIR-V. If the file hasn't
+	 * changed since it was last loaded, the existing module is reused without reading it. */
+	struct stat file_info;
+	if (stat(shader->path, &file_info))
 	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not open shader file \"%s\".", shader->path);
 		return -1;
 	}
 
-	VkCommandBufferInheritanceInfo inheritance_info;
-	memset(&inheritance_info, 0, sizeof(inheritance_info));
-	inheritance_info.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
-	inheritance_info.pNext			= NULL;
-	inheritance_info.renderPass		= VK_NULL_HANDLE;
-	inheritance_info.subpass		= 0;
-	inheritance_info.framebuffer		= VK_NULL_HANDLE;
-	inheritance_info.occlusionQueryEnable	= VK_FALSE;
-	inheritance_info.queryFlags		= 0;
-	inheritance_info.pipelineStatistics	= 0;
+	// Nanoseconds, as compilers can rewrite a file to the same size within a second:
+	#if defined(_WIN32)
+	int64_t modified_time = (int64_t)(file_info.st_mtime) * 1000000000;
+	#elif defined(__APPLE__)
+	int64_t modified_time = ((int64_t)(file_info.st_mtimespec.tv_sec) * 1000000000) +
+						(int64_t)(file_info.st_mtimespec.tv_nsec);
+	#else
+	int64_t modified_time = ((int64_t)(file_info.st_mtim.tv_sec) * 1000000000) +
+						(int64_t)(file_info.st_mtim.tv_nsec);
+	#endif
 
-	VkCommandBufferBeginInfo begin_info;
-	memset(&begin_info, 0, sizeof(begin_info));
-	begin_info.sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	begin_info.pNext		= NULL;
-	begin_info.flags		= command_buffer->flags;
-	begin_info.pInheritanceInfo	= &inheritance_info;
+	for (uint32_t i = 0; i < vulkan->num_shader_modules; i++)
+	{
+		vka_shader_module_t *module = &(vulkan->shader_modules[i]);
+		if (!strcmp(module->path, shader->path) &&
+			(module->modified_time == modified_time) &&
+			(module->file_size == (uint64_t)(file_info.st_size)))
+		{
+			module->reference_count++;
+			VkShaderModule temp = module->shader;
+			uint64_t hash = module->hash;
+			memcpy(shader->workgroup_size, module->workgroup_size, 3 * sizeof(uint32_t));
+			memcpy(shader->workgroup_size_ids, module->workgroup_size_ids,
+							3 * sizeof(uint32_t));
+
+			vka_destroy_shader(vulkan, shader);
+			shader->shader = temp;
+			shader->hash = hash;
+			return 0;
+		}
+	}
 
-	if (vkBeginCommandBuffer(command_buffer->buffer, &begin_info) != VK_SUCCESS)
+	void *shader_code;
+	size_t code_size;
+	if (vka_map_file(vulkan, shader->path, &shader_code, &code_size)) { return -1; }
+
+	if (!code_size || (code_size % 4))
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not begin command buffer \"%s\".", command_buffer->name);
+			"Shader file \"%s\" size is not a multiple of 4 bytes.", shader->path);
+		vka_unmap_file(shader_code, code_size);
 		return -1;
 	}
 
-	return 0;
-}
+	vka_shader_module_t *module = vka_acquire_shader_module(vulkan, shader,
+						code_size, (uint32_t *)shader_code);
+	vka_unmap_file(shader_code, code_size);
+	if (!module) { return -1; }
 
-int vka_end_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
-{
-	if (vkEndCommandBuffer(command_buffer->buffer) != VK_SUCCESS)
+	// Remember where the module came from, so unchanged files don't need to be read again:
+	if (!strcmp(module->path, ""))
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not end command buffer \"%s\".", command_buffer->name);
-		return -1;
+		strcpy(module->path, shader->path);
+		module->modified_time = modified_time;
+		module->file_size = (uint64_t)(file_info.st_size);
 	}
 
+	// Releasing the old module can move registry entries, so take what's needed first:
+	VkShaderModule temp = module->shader;
+	uint64_t hash = module->hash;
+	memcpy(shader->workgroup_size, module->workgroup_size, 3 * sizeof(uint32_t));
+	memcpy(shader->workgroup_size_ids, module->workgroup_size_ids, 3 * sizeof(uint32_t));
+
+	vka_destroy_shader(vulkan, shader);
+	shader->shader = temp;
+	shader->hash = hash;
+
 	return 0;
 }
 
-int vka_submit_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+int vka_create_shader_from_array(vka_vulkan_t *vulkan, vka_shader_t *shader,
+				size_t code_size, uint32_t *shader_code)
 {
-	VkSubmitInfo submit_info;
-	memset(&submit_info, 0, sizeof(submit_info));
-	submit_info.sType			= VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.pNext			= NULL;
-	submit_info.commandBufferCount		= 1;
-	submit_info.pCommandBuffers		= &(command_buffer->buffer);
-	submit_info.waitSemaphoreCount		= (command_buffer->use_wait != 0);
-	submit_info.pWaitSemaphores		= command_buffer->wait_semaphore;
-	submit_info.pWaitDstStageMask		= &command_buffer->wait_dst_stage_mask;
-	submit_info.signalSemaphoreCount	= (command_buffer->use_signal != 0);
-	submit_info.pSignalSemaphores		= command_buffer->signal_semaphore;
+	vka_shader_module_t *module = vka_acquire_shader_module(vulkan, shader,
+							code_size, shader_code);
+	if (!module) { return -1; }
 
-	if (vkQueueSubmit(*(command_buffer->queue), 1, &submit_info,
-			command_buffer->fence) != VK_SUCCESS)
-	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not submit command buffer \"%s\".", command_buffer->name);
-		return -1;
-	}
+	VkShaderModule temp = module->shader;
+	uint64_t hash = module->hash;
+	memcpy(shader->workgroup_size, module->workgroup_size, 3 * sizeof(uint32_t));
+	memcpy(shader->workgroup_size_ids, module->workgroup_size_ids, 3 * sizeof(uint32_t));
+
+	vka_destroy_shader(vulkan, shader);
+	shader->shader = temp;
+	shader->hash = hash;
 
 	return 0;
 }
 
-int vka_wait_for_fence(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+void vka_destroy_shader(vka_vulkan_t *vulkan, vka_shader_t *shader)
 {
-	if (vkWaitForFences(vulkan->device, 1, &(command_buffer->fence),
-				VK_TRUE, UINT32_MAX) != VK_SUCCESS)
-	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not wait for fence \"%s\".", command_buffer->name);
-		return -1;
-	}
-
-	if (vkResetFences(vulkan->device, 1, &(command_buffer->fence)) != VK_SUCCESS)
+	if (shader->shader)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not reset fence \"%s\".", command_buffer->name);
-		return -1;
+		vka_release_shader_module(vulkan, shader->shader);
+		shader->shader = VK_NULL_HANDLE;
+		shader->hash = 0;
 	}
-
-	return 0;
-}
-
-void vka_execute_commands(vka_command_buffer_t *primary, vka_command_buffer_t *secondary)
-{
-	vkCmdExecuteCommands(primary->buffer, 1, &(secondary->buffer));
 }
 
-/***************
- * Descriptors *
- ***************/
-
-int vka_create_descriptor_pool(vka_vulkan_t *vulkan, vka_descriptor_pool_t *descriptor_pool)
+vka_shader_module_t *vka_acquire_shader_module(vka_vulkan_t *vulkan, vka_shader_t *shader,
+						size_t code_size, uint32_t *shader_code)
 {
-	uint32_t counts[4] = { descriptor_pool->num_uniform_buffers,
-				descriptor_pool->num_storage_buffers,
-				descriptor_pool->num_storage_images,
-				descriptor_pool->num_image_samplers };
-	VkDescriptorType types[4] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+	/* Finds a module with matching SPIR-V, or creates one. Adds a reference either way.
+	 * The hash only narrows the search, the SPIR-V itself is compared on a hit. */
+	uint64_t hash = vka_hash(shader_code, code_size, VKA_HASH_SEED);
+	for (uint32_t i = 0; i < vulkan->num_shader_modules; i++)
+	{
+		vka_shader_module_t *module = &(vulkan->shader_modules[i]);
+		if ((module->hash == hash) && (module->code_size == code_size) &&
+			!memcmp(module->code, shader_code, code_size))
+		{
+			module->reference_count++;
+			return module;
+		}
+	}
 
-	VkDescriptorPoolSize pool_sizes[4];
-	memset(pool_sizes, 0, 4 * sizeof(pool_sizes[0]));
-	uint32_t pool_size_count = 0;
-	for (int i = 0; i < 4; i++)
+	if (vulkan->num_shader_modules == vulkan->max_shader_modules)
 	{
-		if (counts[i])
+		uint32_t max_shader_modules = 2 * vulkan->max_shader_modules;
+		if (!max_shader_modules) { max_shader_modules = 16; }
+
+		vka_shader_module_t *shader_modules = realloc(vulkan->shader_modules,
+					max_shader_modules * sizeof(vka_shader_module_t));
+		if (!shader_modules)
 		{
-			pool_sizes[pool_size_count].type = types[i];
-			pool_sizes[pool_size_count].descriptorCount = counts[i];
-			pool_size_count++;
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for shader module for \"%s\".",
+				shader->path);
+			return NULL;
 		}
+		vulkan->shader_modules = shader_modules;
+		vulkan->max_shader_modules = max_shader_modules;
 	}
 
-	if (!pool_size_count)
+	uint32_t *code = malloc(code_size);
+	if (!code)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Descriptor pool \"%s\" has descriptor count of 0.", descriptor_pool->name);
-		return -1;
+			"Could not allocate memory for shader code for \"%s\".", shader->path);
+		return NULL;
 	}
+	memcpy(code, shader_code, code_size);
 
-	VkDescriptorPoolCreateInfo pool_info;
-	memset(&pool_info, 0, sizeof(pool_info));
-	pool_info.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	pool_info.pNext		= NULL;
-	pool_info.flags		= 0;
-	pool_info.maxSets	= descriptor_pool->max_sets;
-	pool_info.poolSizeCount	= pool_size_count;
-	pool_info.pPoolSizes	= pool_sizes;
+	VkShaderModuleCreateInfo shader_module_info;
+	memset(&shader_module_info, 0, sizeof(shader_module_info));
+	shader_module_info.sType	= VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	shader_module_info.pNext	= NULL;
+	shader_module_info.flags	= 0;
+	shader_module_info.codeSize	= code_size;
+	shader_module_info.pCode	= shader_code;
 
-	if (vkCreateDescriptorPool(vulkan->device, &pool_info, NULL,
-			&(descriptor_pool->pool)) != VK_SUCCESS)
+	VkShaderModule temp = VK_NULL_HANDLE;
+	if (vkCreateShaderModule(vulkan->device, &shader_module_info, NULL, &temp) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create descriptor pool \"%s\".", descriptor_pool->name);
-		return -1;
-	}
-
-	return 0;
+			"Could not create shader module for \"%s\".", shader->path);
+		free(code);
+		return NULL;
+	}
+
+	vka_shader_module_t *module = &(vulkan->shader_modules[vulkan->num_shader_modules]);
+	memset(module, 0, sizeof(vka_shader_module_t));
+	module->hash = hash;
+	module->code_size = code_size;
+	module->code = code;
+	module->shader = temp;
+	module->reference_count = 1;
+	vka_reflect_workgroup_size(code_size, shader_code, module->workgroup_size,
+						module->workgroup_size_ids);
+	vulkan->num_shader_modules++;
+
+	return module;
 }
 
-void vka_destroy_descriptor_pool(vka_vulkan_t *vulkan, vka_descriptor_pool_t *descriptor_pool)
+void vka_release_shader_module(vka_vulkan_t *vulkan, VkShaderModule shader)
 {
-	if (descriptor_pool->pool)
+	for (uint32_t i = 0; i < vulkan->num_shader_modules; i++)
 	{
-		vkDestroyDescriptorPool(vulkan->device, descriptor_pool->pool, NULL);
-		descriptor_pool->pool = VK_NULL_HANDLE;
+		vka_shader_module_t *module = &(vulkan->shader_modules[i]);
+		if (module->shader != shader) { continue; }
+
+		module->reference_count--;
+		if (!module->reference_count)
+		{
+			vkDestroyShaderModule(vulkan->device, module->shader, NULL);
+			free(module->code);
+			vulkan->num_shader_modules--;
+			*module = vulkan->shader_modules[vulkan->num_shader_modules];
+		}
+		return;
 	}
+
+	// Not owned by the registry:
+	vkDestroyShaderModule(vulkan->device, shader, NULL);
 }
 
-int vka_create_descriptor_set_layout(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
+void vka_reflect_workgroup_size(size_t code_size, const uint32_t *shader_code,
+			uint32_t workgroup_size[3], uint32_t workgroup_size_ids[3])
 {
-	// Note - also updates descriptor and set count in associated pool (if there is one).
-	VkDescriptorType types[4] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
-	int suitable_type = 0;
-	for (int i = 0; i < 4; i++)
+	/* Reads the LocalSize execution mode, or the WorkgroupSize built-in that overrides it
+	 * (which is how local_size_x_id etc. come out of glslang). Defaults to 1 x 1 x 1. */
+	for (int i = 0; i < 3; i++)
 	{
-		if (descriptor_set->type == types[i])
+		workgroup_size[i] = 1;
+		workgroup_size_ids[i] = VKA_SPECIALISATION_ID_NONE;
+	}
+
+	size_t num_words = code_size / 4;
+	if ((num_words < 5) || (shader_code[0] != 0x07230203)) { return; }
+
+	uint32_t builtin_id = 0;
+	uint32_t local_size_ids[3] = { 0, 0, 0 };
+	size_t i = 5;
+	while (i < num_words)
+	{
+		uint32_t opcode = shader_code[i] & 0xFFFF;
+		uint32_t word_count = shader_code[i] >> 16;
+		if (!word_count || ((i + word_count) > num_words)) { return; }
+
+		// OpExecutionMode with LocalSize, or OpExecutionMode(Id) with LocalSizeId:
+		if (((opcode == 16) || (opcode == 331)) && (word_count >= 6))
 		{
-			suitable_type = 1;
-			break;
+			if ((opcode == 16) && (shader_code[i + 2] == 17))
+			{
+				for (int j = 0; j < 3; j++) { workgroup_size[j] = shader_code[i + 3 + j]; }
+			}
+			else if (shader_code[i + 2] == 38)
+			{
+				for (int j = 0; j < 3; j++) { local_size_ids[j] = shader_code[i + 3 + j]; }
+			}
+		}
+
+		// OpDecorate with BuiltIn WorkgroupSize:
+		if ((opcode == 71) && (word_count >= 4) && (shader_code[i + 2] == 11) &&
+			(shader_code[i + 3] == 25))
+		{
+			builtin_id = shader_code[i + 1];
 		}
+
+		i += word_count;
 	}
-	if (!suitable_type)
+
+	// The built-in is a composite of (specialisation) constants:
+	if (builtin_id)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Unsupported descriptor type for set \"%s\".", descriptor_set->name);
-		return -1;
-	}
+		i = 5;
+		while (i < num_words)
+		{
+			uint32_t opcode = shader_code[i] & 0xFFFF;
+			uint32_t word_count = shader_code[i] >> 16;
 
-	VkDescriptorSetLayoutBinding layout_binding;
-	memset(&layout_binding, 0, sizeof(layout_binding));
-	layout_binding.binding			= descriptor_set->binding;
-	layout_binding.descriptorType		= descriptor_set->type;
-	layout_binding.descriptorCount		= descriptor_set->count;
-	layout_binding.stageFlags		= descriptor_set->stage_flags;
-	layout_binding.pImmutableSamplers	= NULL;
+			// OpConstantComposite or OpSpecConstantComposite:
+			if (((opcode == 44) || (opcode == 51)) && (word_count >= 6) &&
+				(shader_code[i + 2] == builtin_id))
+			{
+				for (int j = 0; j < 3; j++) { local_size_ids[j] = shader_code[i + 3 + j]; }
+				break;
+			}
 
-	VkDescriptorSetLayoutCreateInfo layout_info;
-	memset(&layout_info, 0, sizeof(layout_info));
-	layout_info.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layout_info.pNext		= NULL;
-	layout_info.flags		= 0;
-	layout_info.bindingCount	= 1;
-	layout_info.pBindings		= &layout_binding;
+			i += word_count;
+		}
+	}
 
-	if (vkCreateDescriptorSetLayout(vulkan->device, &layout_info, NULL,
-				&(descriptor_set->layout)) != VK_SUCCESS)
+	for (int j = 0; j < 3; j++)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create descriptor set layout for \"%s\".", descriptor_set->name);
-		return -1;
+		if (!local_size_ids[j]) { continue; }
+		vka_reflect_constant(code_size, shader_code, local_size_ids[j], &(workgroup_size[j]),
+							&(workgroup_size_ids[j]));
 	}
+}
 
-	if (!descriptor_set->pool) { return 0; }
+int vka_reflect_constant(size_t code_size, const uint32_t *shader_code, uint32_t id,
+				uint32_t *value, uint32_t *specialisation_id)
+{
+	// Finds the value of a 32-bit integer constant, and its specialisation ID if it has one.
+	size_t num_words = code_size / 4;
+	int found = 0;
+	size_t i = 5;
+	while (i < num_words)
+	{
+		uint32_t opcode = shader_code[i] & 0xFFFF;
+		uint32_t word_count = shader_code[i] >> 16;
+		if (!word_count || ((i + word_count) > num_words)) { return -1; }
+
+		// OpConstant or OpSpecConstant:
+		if (((opcode == 43) || (opcode == 50)) && (word_count == 4) &&
+			(shader_code[i + 2] == id))
+		{
+			*value = shader_code[i + 3];
+			found = 1;
+		}
 
-	// Update descriptor pool information:
-	descriptor_set->pool->max_sets++;
-	if (descriptor_set->type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+		// OpDecorate with SpecId:
+		if ((opcode == 71) && (word_count >= 4) && (shader_code[i + 1] == id) &&
+			(shader_code[i + 2] == 1))
+		{
+			*specialisation_id = shader_code[i + 3];
+		}
+
+		i += word_count;
+	}
+
+	if (!found) { return -1; }
+	return 0;
+}
+
+int vka_get_specialisation_info(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+				uint32_t shader_type, VkSpecializationInfo *specialisation_info)
+{
+	// Validates the specialisation constants for a shader type and fills in the info struct.
+	vka_specialisation_t *specialisation = &(pipeline->specialisation[shader_type]);
+	memset(specialisation_info, 0, sizeof(VkSpecializationInfo));
+	if (!specialisation->num_constants) { return 0; }
+
+	if (specialisation->num_constants > VKA_MAX_SPECIALISATION_CONSTANTS)
 	{
-		descriptor_set->pool->num_uniform_buffers += descriptor_set->count;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Too many specialisation constants for shader %u of pipeline \"%s\".",
+			shader_type, pipeline->name);
+		return -1;
 	}
-	else if (descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+
+	if (!specialisation->data || !specialisation->size)
 	{
-		descriptor_set->pool->num_storage_buffers += descriptor_set->count;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"No specialisation data for shader %u of pipeline \"%s\".",
+			shader_type, pipeline->name);
+		return -1;
 	}
-	else if (descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+
+	for (uint32_t i = 0; i < specialisation->num_constants; i++)
 	{
-		descriptor_set->pool->num_storage_images += descriptor_set->count;
+		if ((specialisation->entries[i].offset + specialisation->entries[i].size) >
+								specialisation->size)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Specialisation constant %u for shader %u of pipeline \"%s\" "
+				"is out of bounds.", i, shader_type, pipeline->name);
+			return -1;
+		}
 	}
-	else { descriptor_set->pool->num_image_samplers += descriptor_set->count; }
+
+	specialisation_info->mapEntryCount	= specialisation->num_constants;
+	specialisation_info->pMapEntries	= specialisation->entries;
+	specialisation_info->dataSize		= specialisation->size;
+	specialisation_info->pData		= specialisation->data;
 
 	return 0;
 }
 
-void vka_destroy_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
+/*******************
+ * Command buffers *
+ *******************/
+
+int vka_create_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	if (descriptor_set->layout)
+	vka_destroy_command_buffer(vulkan, command_buffer);
+
+	// If flags are 0, set to appropriate value:
+	if (!command_buffer->flags)
 	{
-		vkDestroyDescriptorSetLayout(vulkan->device, descriptor_set->layout, NULL);
-		descriptor_set->layout = VK_NULL_HANDLE;
+		command_buffer->flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 	}
 
-	descriptor_set->set = VK_NULL_HANDLE;
+	VkCommandBufferAllocateInfo allocate_info;
+	memset(&allocate_info, 0, sizeof(allocate_info));
+	allocate_info.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocate_info.pNext			= NULL;
+	allocate_info.commandPool		= vulkan->command_pool;
+	allocate_info.level			= command_buffer->level;
+	if (command_buffer->command_pool) { allocate_info.commandPool = command_buffer->command_pool; }
+	allocate_info.commandBufferCount	= 1;
 
-	if (descriptor_set->data)
+	if (vkAllocateCommandBuffers(vulkan->device, &allocate_info,
+			&(command_buffer->buffer)) != VK_SUCCESS)
 	{
-		free(descriptor_set->data);
-		descriptor_set->data = NULL;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create command buffer \"%s\".", command_buffer->name);
+		return -1;
 	}
-}
 
-int vka_allocate_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
-{
-	VkDescriptorSetAllocateInfo allocate_info;
-	memset(&allocate_info, 0, sizeof(allocate_info));
-	allocate_info.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocate_info.pNext			= NULL;
-	allocate_info.descriptorPool		= descriptor_set->pool->pool;
-	allocate_info.descriptorSetCount	= descriptor_set->count;
-	allocate_info.pSetLayouts		= &(descriptor_set->layout);
+	VkFenceCreateInfo fence_info;
+	memset(&fence_info, 0, sizeof(fence_info));
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.pNext = NULL;
+	if (command_buffer->fence_signaled) { fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT; }
+	else { fence_info.flags = 0; }
 
-	if (vkAllocateDescriptorSets(vulkan->device, &allocate_info,
-			&(descriptor_set->set)) != VK_SUCCESS)
+	if (vkCreateFence(vulkan->device, &fence_info, NULL,
+		&(command_buffer->fence)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not allocate descriptor set \"%s\".", descriptor_set->name);
+			"Could not create fence \"%s\".", command_buffer->name);
 		return -1;
 	}
 
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_COMMAND_BUFFER,
+		(uint64_t)(command_buffer->buffer), command_buffer->name);
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_FENCE, (uint64_t)(command_buffer->fence),
+								command_buffer->name);
+
 	return 0;
 }
 
-int vka_update_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
+void vka_destroy_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	if (!descriptor_set->data)
+	if (command_buffer->fence)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"No data for descriptor set \"%s\".", descriptor_set->name);
-		return -1;
+		vkDestroyFence(vulkan->device, command_buffer->fence, NULL);
+		command_buffer->fence = VK_NULL_HANDLE;
 	}
 
-	VkDescriptorBufferInfo *buffer_info = NULL;
-	VkDescriptorImageInfo *image_info = NULL;
+	command_buffer->buffer = VK_NULL_HANDLE;
+}
 
-	if ((descriptor_set->type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) ||
-		(descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER))
+int vka_begin_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
+{
+	// If fence is created signaled, wait here:
+	if (command_buffer->fence_signaled && vka_wait_for_fence(vulkan, command_buffer))
 	{
-		buffer_info = malloc(descriptor_set->count * sizeof(VkDescriptorBufferInfo));
-		if (!buffer_info)
-		{
-			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Could not allocate memory for buffer info for set \"%s\".",
-				descriptor_set->name);
-			return -1;
-		}
-		memset(buffer_info, 0, descriptor_set->count * sizeof(VkDescriptorBufferInfo));
-		vka_buffer_t **buffers = (vka_buffer_t **)(descriptor_set->data);
-		for (uint32_t i = 0; i < descriptor_set->count; i++)
-		{
-			buffer_info[i].buffer	= buffers[i]->buffer;
-			buffer_info[i].offset	= 0;
-			buffer_info[i].range	= VK_WHOLE_SIZE;
-		}
-	}
-	else if ((descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) ||
-		(descriptor_set->type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER))
-	{
-		image_info = malloc(descriptor_set->count * sizeof(VkDescriptorImageInfo));
-		if (!image_info)
-		{
-			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Could not allocate memory for image info for set \"%s\".",
-				descriptor_set->name);
-			return -1;
-		}
-		memset(image_info, 0, descriptor_set->count * sizeof(VkDescriptorImageInfo));
-		vka_image_t **images = (vka_image_t **)(descriptor_set->data);
-		for (uint32_t i = 0; i < descriptor_set->count; i++)
-		{
-			image_info[i].sampler		= images[i]->sampler->sampler;
-			image_info[i].imageView		= images[i]->image_view;
-			image_info[i].imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		}
+		return -1;
 	}
-	else
+
+	VkCommandBufferInheritanceInfo inheritance_info;
+	memset(&inheritance_info, 0, sizeof(inheritance_info));
+	inheritance_info.sType			= VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.pNext			= NULL;
+	inheritance_info.renderPass		= VK_NULL_HANDLE;
+	inheritance_info.subpass		= 0;
+	inheritance_info.framebuffer		= VK_NULL_HANDLE;
+	inheritance_info.occlusionQueryEnable	= VK_FALSE;
+	inheritance_info.queryFlags		= 0;
+	inheritance_info.pipelineStatistics	= 0;
+
+	VkCommandBufferBeginInfo begin_info;
+	memset(&begin_info, 0, sizeof(begin_info));
+	begin_info.sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.pNext		= NULL;
+	begin_info.flags		= command_buffer->flags;
+	begin_info.pInheritanceInfo	= &inheritance_info;
+
+	if (vkBeginCommandBuffer(command_buffer->buffer, &begin_info) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Unsupported descriptor type for set \"%s\".", descriptor_set->name);
+			"Could not begin command buffer \"%s\".", command_buffer->name);
 		return -1;
 	}
 
-	VkWriteDescriptorSet write_info;
-	memset(&write_info, 0, sizeof(write_info));
-	write_info.sType		= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write_info.pNext		= NULL;
-	write_info.dstSet		= descriptor_set->set;
-	write_info.dstBinding		= descriptor_set->binding;
-	write_info.dstArrayElement	= 0;
-	write_info.descriptorCount	= descriptor_set->count;
-	write_info.descriptorType	= descriptor_set->type;
-	write_info.pImageInfo		= image_info;
-	write_info.pBufferInfo		= buffer_info;
-	write_info.pTexelBufferView	= NULL;
+	vka_reset_bound_state(command_buffer);
+	command_buffer->num_elided_pipelines		= 0;
+	command_buffer->num_elided_descriptor_sets	= 0;
+	command_buffer->num_elided_vertex_buffers	= 0;
+	command_buffer->num_elided_viewports		= 0;
+	command_buffer->num_elided_push_constants	= 0;
 
-	vkUpdateDescriptorSets(vulkan->device, 1, &write_info, 0, NULL);
+	#ifdef VKA_STATISTICS
+	vka_reset_counters(&(command_buffer->counters));
+	#endif
 
-	if (buffer_info) { free(buffer_info); }
-	if (image_info) { free(image_info); }
 	return 0;
 }
 
-/************************************
- * Samplers, images and image views *
- ************************************/
-
-int vka_create_sampler(vka_vulkan_t *vulkan, vka_sampler_t *sampler)
+int vka_end_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	if (vulkan->enabled_features.samplerAnisotropy == VK_FALSE)
-	{
-		sampler->anisotropy_enable = VK_FALSE;
-	}
-	if (sampler->max_anisotropy < 1.f) { sampler->max_anisotropy = 1.f; }
-
-	VkSamplerCreateInfo sampler_info;
-	memset(&sampler_info, 0, sizeof(sampler_info));
-	sampler_info.sType			= VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	sampler_info.pNext			= NULL;
-	sampler_info.flags			= 0;
-	sampler_info.magFilter			= sampler->filter;
-	sampler_info.minFilter			= sampler->filter;
-	sampler_info.mipmapMode			= VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	sampler_info.addressModeU		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler_info.addressModeV		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler_info.addressModeW		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	sampler_info.mipLodBias			= 0.f;
-	sampler_info.anisotropyEnable		= sampler->anisotropy_enable;
-	sampler_info.maxAnisotropy		= sampler->max_anisotropy;
-	sampler_info.compareEnable		= VK_FALSE;
-	sampler_info.compareOp			= VK_COMPARE_OP_NEVER;
-	sampler_info.minLod			= 0.f;
-	sampler_info.maxLod			= VK_LOD_CLAMP_NONE;
-	sampler_info.borderColor		= sampler->border_colour;
-	sampler_info.unnormalizedCoordinates	= VK_FALSE;
-
-	if (vkCreateSampler(vulkan->device, &sampler_info, NULL, &(sampler->sampler)) != VK_SUCCESS)
+	if (vkEndCommandBuffer(command_buffer->buffer) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create sampler \"%s\".", sampler->name);
+			"Could not end command buffer \"%s\".", command_buffer->name);
 		return -1;
 	}
 
 	return 0;
 }
 
-void vka_destroy_sampler(vka_vulkan_t *vulkan, vka_sampler_t *sampler)
+int vka_submit_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	if (sampler->sampler)
+	VkSemaphore wait_semaphores[2];
+	VkPipelineStageFlags wait_dst_stage_masks[2];
+	uint32_t num_wait_semaphores = 0;
+	if (command_buffer->use_wait)
 	{
-		vkDestroySampler(vulkan->device, sampler->sampler, NULL);
-		sampler->sampler = VK_NULL_HANDLE;
+		wait_semaphores[0] = *(command_buffer->wait_semaphore);
+		wait_dst_stage_masks[0] = command_buffer->wait_dst_stage_mask;
+		num_wait_semaphores++;
+	}
+	if (command_buffer->next_wait_semaphore)
+	{
+		wait_semaphores[num_wait_semaphores] = command_buffer->next_wait_semaphore;
+		wait_dst_stage_masks[num_wait_semaphores] = command_buffer->next_wait_dst_stage_mask;
+		num_wait_semaphores++;
 	}
-}
 
-int vka_create_image(vka_vulkan_t *vulkan, vka_image_t *image)
-{
-	if (image->mip_levels < 1) { image->mip_levels = 1; }
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType			= VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext			= NULL;
+	submit_info.commandBufferCount		= 1;
+	submit_info.pCommandBuffers		= &(command_buffer->buffer);
+	submit_info.waitSemaphoreCount		= num_wait_semaphores;
+	submit_info.pWaitSemaphores		= wait_semaphores;
+	submit_info.pWaitDstStageMask		= wait_dst_stage_masks;
+	submit_info.signalSemaphoreCount	= (command_buffer->use_signal != 0);
+	submit_info.pSignalSemaphores		= command_buffer->signal_semaphore;
 
-	if (!image->is_swapchain_image)
+	VKA_TRACE_BEGIN(vulkan, trace_start);
+	VkResult result = vkQueueSubmit(*(command_buffer->queue), 1, &submit_info,
+					command_buffer->fence);
+	VKA_TRACE_END(vulkan, "vka_submit_command_buffer", trace_start);
+	if (result != VK_SUCCESS)
 	{
-		VkImageCreateInfo image_info;
-		memset(&image_info, 0, sizeof(image_info));
-		image_info.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		image_info.pNext			= NULL;
-		image_info.flags			= 0;
-		image_info.imageType			= VK_IMAGE_TYPE_2D;
-		image_info.format			= image->format;
-		image_info.extent.width			= image->width;
-		image_info.extent.height		= image->height;
-		image_info.extent.depth			= 1;
-		image_info.mipLevels			= image->mip_levels;
-		image_info.arrayLayers			= 1;
-		image_info.samples			= VK_SAMPLE_COUNT_1_BIT;
-		image_info.tiling			= VK_IMAGE_TILING_OPTIMAL;
-		image_info.usage			= image->usage;
-		image_info.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
-		image_info.queueFamilyIndexCount	= 0;
-		image_info.pQueueFamilyIndices		= NULL;
-		image_info.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
-
-		if (vkCreateImage(vulkan->device, &image_info, NULL, &(image->image)) != VK_SUCCESS)
-		{
-			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Could not create image \"%s\".", image->name);
-			return -1;
-		}
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not submit command buffer \"%s\".", command_buffer->name);
+		return -1;
 	}
+	command_buffer->next_wait_semaphore = VK_NULL_HANDLE;
+	VKA_COUNT(vulkan->counters, num_submits, 1);
 
 	return 0;
 }
 
-int vka_create_image_view(vka_vulkan_t *vulkan, vka_image_t *image)
+int vka_wait_for_fence(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	if (image->mip_levels < 1) { image->mip_levels = 1; }
-
-	VkImageViewCreateInfo view_info;
-	memset(&view_info, 0, sizeof(view_info));
-	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	view_info.pNext					= NULL;
-	view_info.flags					= 0;
-	view_info.image					= image->image;
-	view_info.viewType				= VK_IMAGE_VIEW_TYPE_2D;
-	view_info.format				= image->format;
-	view_info.components.r				= VK_COMPONENT_SWIZZLE_IDENTITY;
-	view_info.components.g				= VK_COMPONENT_SWIZZLE_IDENTITY;
-	view_info.components.b				= VK_COMPONENT_SWIZZLE_IDENTITY;
-	view_info.components.a				= VK_COMPONENT_SWIZZLE_IDENTITY;
-	view_info.subresourceRange.aspectMask		= image->aspect_mask;
-	view_info.subresourceRange.baseMipLevel		= 0;
-	view_info.subresourceRange.levelCount		= image->mip_levels;
-	view_info.subresourceRange.baseArrayLayer	= 0;
-	view_info.subresourceRange.layerCount		= 1;
+	VKA_TRACE_BEGIN(vulkan, trace_start);
+	VkResult result = vkWaitForFences(vulkan->device, 1, &(command_buffer->fence),
+					VK_TRUE, UINT32_MAX);
+	VKA_TRACE_END(vulkan, "vka_wait_for_fence", trace_start);
+	if (result != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not wait for fence \"%s\".", command_buffer->name);
+		return -1;
+	}
 
-	if (vkCreateImageView(vulkan->device, &view_info, NULL, &(image->image_view)) != VK_SUCCESS)
+	if (vkResetFences(vulkan->device, 1, &(command_buffer->fence)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create image view \"%s\".", image->name);
+			"Could not reset fence \"%s\".", command_buffer->name);
 		return -1;
 	}
 
 	return 0;
 }
 
-void vka_destroy_image(vka_vulkan_t *vulkan, vka_image_t *image)
+void vka_execute_commands(vka_command_buffer_t *primary, vka_command_buffer_t *secondary)
 {
-	if (image->image_view)
-	{
-		vkDestroyImageView(vulkan->device, image->image_view, NULL);
-		image->image_view = VK_NULL_HANDLE;
-	}
+	vkCmdExecuteCommands(primary->buffer, 1, &(secondary->buffer));
 
-	if (image->image)
+	// State bound to the primary command buffer is undefined after this:
+	vka_reset_bound_state(primary);
+}
+
+void vka_reset_bound_state(vka_command_buffer_t *command_buffer)
+{
+	memset(&(command_buffer->bound_state), 0, sizeof(vka_bound_state_t));
+}
+
+/***************
+ * Descriptors *
+ ***************/
+
+int vka_create_descriptor_pool(vka_vulkan_t *vulkan, vka_descriptor_pool_t *descriptor_pool)
+{
+	uint32_t counts[4] = { descriptor_pool->num_uniform_buffers,
+				descriptor_pool->num_storage_buffers,
+				descriptor_pool->num_storage_images,
+				descriptor_pool->num_image_samplers };
+	VkDescriptorType types[4] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+
+	VkDescriptorPoolSize pool_sizes[4];
+	memset(pool_sizes, 0, 4 * sizeof(pool_sizes[0]));
+	uint32_t pool_size_count = 0;
+	for (int i = 0; i < 4; i++)
 	{
-		if (!image->is_swapchain_image)
+		if (counts[i])
 		{
-			vkDestroyImage(vulkan->device, image->image, NULL);
+			pool_sizes[pool_size_count].type = types[i];
+			pool_sizes[pool_size_count].descriptorCount = counts[i];
+			pool_size_count++;
 		}
-		image->image = VK_NULL_HANDLE;
 	}
-}
 
-int vka_get_image_requirements(vka_vulkan_t *vulkan, vka_image_t *image)
-{
-	if (!image->allocation)
+	if (!pool_size_count)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Image \"%s\" has no valid allocation.", image->name);
+			"Descriptor pool \"%s\" has descriptor count of 0.", descriptor_pool->name);
 		return -1;
 	}
 
-	if (image->allocation->memory)
+	VkDescriptorPoolCreateInfo pool_info;
+	memset(&pool_info, 0, sizeof(pool_info));
+	pool_info.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.pNext		= NULL;
+	pool_info.flags		= 0;
+	pool_info.maxSets	= descriptor_pool->max_sets;
+	pool_info.poolSizeCount	= pool_size_count;
+	pool_info.pPoolSizes	= pool_sizes;
+
+	if (vkCreateDescriptorPool(vulkan->device, &pool_info, NULL,
+			&(descriptor_pool->pool)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Image \"%s\" already has memory allocated.", image->name);
+			"Could not create descriptor pool \"%s\".", descriptor_pool->name);
 		return -1;
 	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_DESCRIPTOR_POOL,
+		(uint64_t)(descriptor_pool->pool), descriptor_pool->name);
 
-	// Get memory requirements and add to current allocation information:
-	VkMemoryRequirements requirements;
-	vkGetImageMemoryRequirements(vulkan->device, image->image, &requirements);
+	return 0;
+}
 
-	if (!image->allocation->requirements.memoryTypeBits)
+void vka_destroy_descriptor_pool(vka_vulkan_t *vulkan, vka_descriptor_pool_t *descriptor_pool)
+{
+	if (descriptor_pool->pool)
 	{
-		image->allocation->requirements.memoryTypeBits = requirements.memoryTypeBits;
+		vkDestroyDescriptorPool(vulkan->device, descriptor_pool->pool, NULL);
+		descriptor_pool->pool = VK_NULL_HANDLE;
 	}
+	descriptor_pool->num_allocated_sets = 0;
+}
 
-	if (image->allocation->requirements.memoryTypeBits != requirements.memoryTypeBits)
+int vka_create_descriptor_set_layout(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
+{
+	// Note - also updates descriptor and set count in associated pool (if there is one).
+	VkDescriptorType types[4] = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+	int suitable_type = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (descriptor_set->type == types[i])
+		{
+			suitable_type = 1;
+			break;
+		}
+	}
+	if (!suitable_type)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Memory type bits for image \"%s\" don't match allocation \"%s\".",
-			image->name, image->allocation->name);
+			"Unsupported descriptor type for set \"%s\".", descriptor_set->name);
 		return -1;
 	}
 
-	// Set offset of current image to current accumulated size (with alignment restrictions):
-	image->offset = 0;
-	while (image->offset < image->allocation->requirements.size)
-	{
-		image->offset += requirements.alignment;
-	}
-	image->allocation->requirements.size = image->offset + requirements.size;
+	VkDescriptorSetLayoutBinding layout_binding;
+	memset(&layout_binding, 0, sizeof(layout_binding));
+	layout_binding.binding			= descriptor_set->binding;
+	layout_binding.descriptorType		= descriptor_set->type;
+	layout_binding.descriptorCount		= descriptor_set->count;
+	layout_binding.stageFlags		= descriptor_set->stage_flags;
+	layout_binding.pImmutableSamplers	= NULL;
 
-	return 0;
-}
+	VkDescriptorSetLayoutCreateInfo layout_info;
+	memset(&layout_info, 0, sizeof(layout_info));
+	layout_info.sType		= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.pNext		= NULL;
+	layout_info.flags		= 0;
+	layout_info.bindingCount	= 1;
+	layout_info.pBindings		= &layout_binding;
 
-int vka_bind_image_memory(vka_vulkan_t *vulkan, vka_image_t *image)
-{
-	if (vkBindImageMemory(vulkan->device, image->image,
-		image->allocation->memory, image->offset) != VK_SUCCESS)
+	if (vkCreateDescriptorSetLayout(vulkan->device, &layout_info, NULL,
+				&(descriptor_set->layout)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not bind memory for image \"%s\".", image->name);
+			"Could not create descriptor set layout for \"%s\".", descriptor_set->name);
 		return -1;
 	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT,
+		(uint64_t)(descriptor_set->layout), descriptor_set->name);
 
-	return 0;
-}
-
-void vka_image_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info)
-{
-	vka_image_t *image = (vka_image_t *)(barrier_info->resource);
+	if (!descriptor_set->pool) { return 0; }
 
-	VkImageMemoryBarrier image_barrier;
-	memset(&image_barrier, 0, sizeof(image_barrier));
-	image_barrier.sType				= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	image_barrier.pNext				= NULL;
-	image_barrier.srcAccessMask			= barrier_info->src_access_mask;
-	image_barrier.dstAccessMask			= barrier_info->dst_access_mask;
-	image_barrier.oldLayout				= barrier_info->old_layout;
-	image_barrier.newLayout				= barrier_info->new_layout;
-	image_barrier.srcQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
-	image_barrier.dstQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
-	image_barrier.image				= image->image;
-	image_barrier.subresourceRange.aspectMask	= image->aspect_mask;
-	image_barrier.subresourceRange.baseMipLevel	= 0;
-	image_barrier.subresourceRange.levelCount	= image->mip_levels;
-	image_barrier.subresourceRange.baseArrayLayer	= 0;
-	image_barrier.subresourceRange.layerCount	= 1;
+	// Update descriptor pool information:
+	descriptor_set->pool->max_sets++;
+	if (descriptor_set->type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+	{
+		descriptor_set->pool->num_uniform_buffers += descriptor_set->count;
+	}
+	else if (descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+	{
+		descriptor_set->pool->num_storage_buffers += descriptor_set->count;
+	}
+	else if (descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
+	{
+		descriptor_set->pool->num_storage_images += descriptor_set->count;
+	}
+	else { descriptor_set->pool->num_image_samplers += descriptor_set->count; }
 
-	vkCmdPipelineBarrier(command_buffer->buffer, barrier_info->src_stage_mask,
-		barrier_info->dst_stage_mask, 0, 0, NULL, 0, NULL, 1, &image_barrier);
+	return 0;
 }
 
-void vka_copy_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+void vka_destroy_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
 {
-	vka_image_t *source = (vka_image_t *)(copy_info->source);
-	vka_image_t *destination = (vka_image_t *)(copy_info->destination);
-
-	// Initialise copy info:
-	VkImageCopy image_copy_info;
-	memset(&image_copy_info, 0, sizeof(image_copy_info));
-
-	// Set source attributes:
-	image_copy_info.srcSubresource.aspectMask	= source->aspect_mask;
-	image_copy_info.srcSubresource.mipLevel		= 0;
-	image_copy_info.srcSubresource.baseArrayLayer	= 0;
-	image_copy_info.srcSubresource.layerCount	= 1;
-	image_copy_info.srcOffset.x			= 0;
-	image_copy_info.srcOffset.y			= 0;
-	image_copy_info.srcOffset.z			= 0;
+	if (descriptor_set->layout)
+	{
+		vkDestroyDescriptorSetLayout(vulkan->device, descriptor_set->layout, NULL);
+		descriptor_set->layout = VK_NULL_HANDLE;
+	}
 
-	// Set destination attributes:
-	image_copy_info.dstSubresource.aspectMask	= destination->aspect_mask;
-	image_copy_info.dstSubresource.mipLevel		= 0;
-	image_copy_info.dstSubresource.baseArrayLayer	= 0;
-	image_copy_info.dstSubresource.layerCount	= 1;
-	image_copy_info.dstOffset.x			= 0;
-	image_copy_info.dstOffset.y			= 0;
-	image_copy_info.dstOffset.z			= 0;
+	descriptor_set->set = VK_NULL_HANDLE;
 
-	// Choose extent based on which image is smaller:
-	if (source->width < destination->width) { image_copy_info.extent.width = source->width; }
-	else { image_copy_info.extent.width = destination->width; }
-	if (source->height < destination->height)
+	if (descriptor_set->data)
 	{
-		image_copy_info.extent.height = source->height;
+		free(descriptor_set->data);
+		descriptor_set->data = NULL;
 	}
-	else { image_copy_info.extent.height = destination->height; }
-	image_copy_info.extent.depth = 1;
-
-	// Copy source to destination:
-	vkCmdCopyImage(command_buffer->buffer, source->image, copy_info->source_layout,
-		destination->image, copy_info->destination_layout, 1, &image_copy_info);
 }
 
-void vka_copy_buffer_to_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+int vka_allocate_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
 {
-	vka_buffer_t *source = (vka_buffer_t *)(copy_info->source);
-	vka_image_t *destination = (vka_image_t *)(copy_info->destination);
-
-	vka_barrier_info_t barrier_info = {0};
-	barrier_info.resource		= destination;
-	barrier_info.src_access_mask	= VK_ACCESS_NONE;
-	barrier_info.dst_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier_info.old_layout		= VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier_info.new_layout		= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
-	vka_image_barrier(command_buffer, &barrier_info);
-
-	VkBufferImageCopy image_copy;
-	memset(&image_copy, 0, sizeof(VkBufferImageCopy));
-	image_copy.bufferOffset				= 0;
-	image_copy.bufferRowLength			= 0;
-	image_copy.bufferImageHeight			= 0;
-	image_copy.imageSubresource.aspectMask		= destination->aspect_mask;
-	image_copy.imageSubresource.mipLevel		= 0;
-	image_copy.imageSubresource.baseArrayLayer	= 0;
-	image_copy.imageSubresource.layerCount		= 1;
-	image_copy.imageOffset.x			= 0;
-	image_copy.imageOffset.y			= 0;
-	image_copy.imageOffset.z			= 0;
-	image_copy.imageExtent.width			= destination->width;
-	image_copy.imageExtent.height			= destination->height;
-	image_copy.imageExtent.depth			= 1;
+	VkDescriptorSetAllocateInfo allocate_info;
+	memset(&allocate_info, 0, sizeof(allocate_info));
+	allocate_info.sType			= VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.pNext			= NULL;
+	allocate_info.descriptorPool		= descriptor_set->pool->pool;
+	allocate_info.descriptorSetCount	= descriptor_set->count;
+	allocate_info.pSetLayouts		= &(descriptor_set->layout);
 
-	vkCmdCopyBufferToImage(command_buffer->buffer, source->buffer, destination->image,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+	if (vkAllocateDescriptorSets(vulkan->device, &allocate_info,
+			&(descriptor_set->set)) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate descriptor set \"%s\".", descriptor_set->name);
+		return -1;
+	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_DESCRIPTOR_SET,
+		(uint64_t)(descriptor_set->set), descriptor_set->name);
+	descriptor_set->pool->num_allocated_sets += descriptor_set->count;
+	VKA_COUNT(vulkan->counters, num_descriptor_allocations, descriptor_set->count);
 
-	barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier_info.dst_access_mask	= VK_ACCESS_SHADER_READ_BIT;
-	barrier_info.old_layout		= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier_info.new_layout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
-	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	vka_image_barrier(command_buffer, &barrier_info);
+	return 0;
 }
 
-int vka_set_up_images(vka_vulkan_t *vulkan, uint32_t num_images, vka_image_t *images)
+int vka_update_descriptor_set(vka_vulkan_t *vulkan, vka_descriptor_set_t *descriptor_set)
 {
-	/* Convenience function to set up multiple images.
-	 * Does not destroy images on failure.
-	 * Expects all images to use the same allocation. */
-	if (!num_images || !images)
+	if (!descriptor_set->data)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not set up images: no images provided.");
+			"No data for descriptor set \"%s\".", descriptor_set->name);
 		return -1;
 	}
 
-	// Check all images are using same allocation:
-	for (uint32_t i = 1; i < num_images; i++)
+	VkDescriptorBufferInfo *buffer_info = NULL;
+	VkDescriptorImageInfo *image_info = NULL;
+
+	if ((descriptor_set->type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) ||
+		(descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER))
 	{
-		if (images[i].allocation != images[i - 1].allocation)
+		buffer_info = malloc(descriptor_set->count * sizeof(VkDescriptorBufferInfo));
+		if (!buffer_info)
 		{
 			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Image \"%s\" is not using the same allocation as image \"%s\".",
-				images[i].name, images[i - 1].name);
+				"Could not allocate memory for buffer info for set \"%s\".",
+				descriptor_set->name);
 			return -1;
 		}
+		memset(buffer_info, 0, descriptor_set->count * sizeof(VkDescriptorBufferInfo));
+		vka_buffer_t **buffers = (vka_buffer_t **)(descriptor_set->data);
+		for (uint32_t i = 0; i < descriptor_set->count; i++)
+		{
+			buffer_info[i].buffer	= buffers[i]->buffer;
+			buffer_info[i].offset	= 0;
+			buffer_info[i].range	= VK_WHOLE_SIZE;
+		}
 	}
-
-	// Check all images have width and height:
-	for (uint32_t i = 0; i < num_images; i++)
+	else if ((descriptor_set->type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) ||
+		(descriptor_set->type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER))
 	{
-		if (!images[i].width || !images[i].height)
+		image_info = malloc(descriptor_set->count * sizeof(VkDescriptorImageInfo));
+		if (!image_info)
 		{
 			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Image \"%s\" has a width or height of 0.", images[i].name);
+				"Could not allocate memory for image info for set \"%s\".",
+				descriptor_set->name);
 			return -1;
 		}
+		memset(image_info, 0, descriptor_set->count * sizeof(VkDescriptorImageInfo));
+		vka_image_t **images = (vka_image_t **)(descriptor_set->data);
+		for (uint32_t i = 0; i < descriptor_set->count; i++)
+		{
+			image_info[i].sampler		= images[i]->sampler->sampler;
+			image_info[i].imageView		= images[i]->image_view;
+			image_info[i].imageLayout	= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
 	}
-
-	// Create images and get requirements:
-	for (uint32_t i = 0; i < num_images; i++)
+	else
 	{
-		if (vka_create_image(vulkan, &(images[i]))) { return -1; }
-		if (vka_get_image_requirements(vulkan, &(images[i]))) { return -1; }
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Unsupported descriptor type for set \"%s\".", descriptor_set->name);
+		return -1;
 	}
 
-	// If there is no allocation, stop here:
-	if (!images[0].allocation) { return 0; }
-
-	// Otherwise set it up:
-	if (vka_create_allocation(vulkan, images[0].allocation)) { return -1; }
+	VkWriteDescriptorSet write_info;
+	memset(&write_info, 0, sizeof(write_info));
+	write_info.sType		= VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_info.pNext		= NULL;
+	write_info.dstSet		= descriptor_set->set;
+	write_info.dstBinding		= descriptor_set->binding;
+	write_info.dstArrayElement	= 0;
+	write_info.descriptorCount	= descriptor_set->count;
+	write_info.descriptorType	= descriptor_set->type;
+	write_info.pImageInfo		= image_info;
+	write_info.pBufferInfo		= buffer_info;
+	write_info.pTexelBufferView	= NULL;
 
-	// Bind image memory and create image views:
-	for (uint32_t i = 0; i < num_images; i++)
-	{
-		if (vka_bind_image_memory(vulkan, &(images[i]))) { return -1; }
-		if (vka_create_image_view(vulkan, &(images[i]))) { return -1; }
-	}
+	vkUpdateDescriptorSets(vulkan->device, 1, &write_info, 0, NULL);
+	VKA_COUNT(vulkan->counters, num_descriptor_updates, 1);
 
+	if (buffer_info) { free(buffer_info); }
+	if (image_info) { free(image_info); }
 	return 0;
 }
 
-/***********
- * Buffers *
- ***********/
+/************************************
+ * Samplers, images and image views *
+ ************************************/
 
-int vka_create_buffer(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+int vka_create_sampler(vka_vulkan_t *vulkan, vka_sampler_t *sampler)
 {
-	if (!buffer->size)
+	if (vulkan->enabled_features.samplerAnisotropy == VK_FALSE)
 	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Buffer \"%s\" size is 0.", buffer->name);
-		return -1;
+		sampler->anisotropy_enable = VK_FALSE;
 	}
+	if (sampler->max_anisotropy < 1.f) { sampler->max_anisotropy = 1.f; }
 
-	if (!buffer->usage)
+	VkSamplerCreateInfo sampler_info;
+	memset(&sampler_info, 0, sizeof(sampler_info));
+	sampler_info.sType			= VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.pNext			= NULL;
+	sampler_info.flags			= 0;
+	sampler_info.magFilter			= sampler->filter;
+	sampler_info.minFilter			= sampler->filter;
+	sampler_info.mipmapMode			= VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	sampler_info.addressModeU		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_info.addressModeV		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_info.addressModeW		= VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_info.mipLodBias			= 0.f;
+	sampler_info.anisotropyEnable		= sampler->anisotropy_enable;
+	sampler_info.maxAnisotropy		= sampler->max_anisotropy;
+	sampler_info.compareEnable		= VK_FALSE;
+	sampler_info.compareOp			= VK_COMPARE_OP_NEVER;
+	sampler_info.minLod			= 0.f;
+	sampler_info.maxLod			= VK_LOD_CLAMP_NONE;
+	sampler_info.borderColor		= sampler->border_colour;
+	sampler_info.unnormalizedCoordinates	= VK_FALSE;
+
+	if (vkCreateSampler(vulkan->device, &sampler_info, NULL, &(sampler->sampler)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Buffer \"%s\" has no usage flags.", buffer->name);
+			"Could not create sampler \"%s\".", sampler->name);
 		return -1;
 	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_SAMPLER, (uint64_t)(sampler->sampler),
+								sampler->name);
 
-	VkBufferCreateInfo buffer_info;
-	memset(&buffer_info, 0, sizeof(buffer_info));
-	buffer_info.sType			= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	buffer_info.pNext			= NULL;
-	buffer_info.flags			= 0;
-	buffer_info.size			= buffer->size;
-	buffer_info.usage			= buffer->usage;
-	buffer_info.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
-	buffer_info.queueFamilyIndexCount	= 0;
-	buffer_info.pQueueFamilyIndices		= NULL;
+	return 0;
+}
 
-	vka_destroy_buffer(vulkan, buffer);
-	if (vkCreateBuffer(vulkan->device, &buffer_info, NULL, &(buffer->buffer)) != VK_SUCCESS)
+void vka_destroy_sampler(vka_vulkan_t *vulkan, vka_sampler_t *sampler)
+{
+	if (sampler->sampler)
+	{
+		vkDestroySampler(vulkan->device, sampler->sampler, NULL);
+		sampler->sampler = VK_NULL_HANDLE;
+	}
+}
+
+int vka_create_image(vka_vulkan_t *vulkan, vka_image_t *image)
+{
+	if (image->mip_levels < 1) { image->mip_levels = 1; }
+
+	if (!image->is_swapchain_image)
+	{
+		VkImageCreateInfo image_info;
+		memset(&image_info, 0, sizeof(image_info));
+		image_info.sType			= VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext			= NULL;
+		image_info.flags			= 0;
+		image_info.imageType			= VK_IMAGE_TYPE_2D;
+		image_info.format			= image->format;
+		image_info.extent.width			= image->width;
+		image_info.extent.height		= image->height;
+		image_info.extent.depth			= 1;
+		image_info.mipLevels			= image->mip_levels;
+		image_info.arrayLayers			= 1;
+		image_info.samples			= VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling			= VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage			= image->usage;
+		image_info.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+		image_info.queueFamilyIndexCount	= 0;
+		image_info.pQueueFamilyIndices		= NULL;
+		image_info.initialLayout		= VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(vulkan->device, &image_info, NULL, &(image->image)) != VK_SUCCESS)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not create image \"%s\".", image->name);
+			return -1;
+		}
+		vka_set_object_name(vulkan, VK_OBJECT_TYPE_IMAGE, (uint64_t)(image->image),
+								image->name);
+	}
+
+	return 0;
+}
+
+int vka_create_image_view(vka_vulkan_t *vulkan, vka_image_t *image)
+{
+	if (image->mip_levels < 1) { image->mip_levels = 1; }
+
+	VkImageViewCreateInfo view_info;
+	memset(&view_info, 0, sizeof(view_info));
+	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_info.pNext					= NULL;
+	view_info.flags					= 0;
+	view_info.image					= image->image;
+	view_info.viewType				= VK_IMAGE_VIEW_TYPE_2D;
+	view_info.format				= image->format;
+	view_info.components.r				= VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_info.components.g				= VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_info.components.b				= VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_info.components.a				= VK_COMPONENT_SWIZZLE_IDENTITY;
+	view_info.subresourceRange.aspectMask		= image->aspect_mask;
+	view_info.subresourceRange.baseMipLevel		= 0;
+	view_info.subresourceRange.levelCount		= image->mip_levels;
+	view_info.subresourceRange.baseArrayLayer	= 0;
+	view_info.subresourceRange.layerCount		= 1;
+
+	if (vkCreateImageView(vulkan->device, &view_info, NULL, &(image->image_view)) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not create buffer \"%s\".", buffer->name);
+			"Could not create image view \"%s\".", image->name);
 		return -1;
 	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)(image->image_view),
+								image->name);
 
 	return 0;
 }
 
-void vka_destroy_buffer(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+void vka_destroy_image(vka_vulkan_t *vulkan, vka_image_t *image)
 {
-	if (buffer->buffer)
+	if (image->image_view)
 	{
-		vkDestroyBuffer(vulkan->device, buffer->buffer, NULL);
-		buffer->buffer = VK_NULL_HANDLE;
+		vkDestroyImageView(vulkan->device, image->image_view, NULL);
+		image->image_view = VK_NULL_HANDLE;
+	}
+
+	if (image->image)
+	{
+		if (!image->is_swapchain_image)
+		{
+			vkDestroyImage(vulkan->device, image->image, NULL);
+		}
+		image->image = VK_NULL_HANDLE;
 	}
 }
 
-int vka_get_buffer_requirements(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+int vka_get_image_requirements(vka_vulkan_t *vulkan, vka_image_t *image)
 {
-	if (!buffer->allocation)
+	if (!image->allocation)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Buffer \"%s\" has no valid allocation.", buffer->name);
+			"Image \"%s\" has no valid allocation.", image->name);
 		return -1;
 	}
 
-	if (buffer->allocation->memory)
+	if (image->allocation->memory)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Buffer \"%s\" already has memory allocated.", buffer->name);
+			"Image \"%s\" already has memory allocated.", image->name);
 		return -1;
 	}
 
 	// Get memory requirements and add to current allocation information:
 	VkMemoryRequirements requirements;
-	vkGetBufferMemoryRequirements(vulkan->device, buffer->buffer, &requirements);
+	vkGetImageMemoryRequirements(vulkan->device, image->image, &requirements);
 
-	if (!buffer->allocation->requirements.memoryTypeBits)
+	if (!image->allocation->requirements.memoryTypeBits)
 	{
-		buffer->allocation->requirements.memoryTypeBits = requirements.memoryTypeBits;
-		buffer->allocation->requirements.alignment = requirements.alignment;
+		image->allocation->requirements.memoryTypeBits = requirements.memoryTypeBits;
 	}
 
-	if (buffer->allocation->requirements.memoryTypeBits != requirements.memoryTypeBits)
+	if (image->allocation->requirements.memoryTypeBits != requirements.memoryTypeBits)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Memory type bits for buffer \"%s\" don't match allocation \"%s\".",
-			buffer->name, buffer->allocation->name);
+			"Memory type bits for image \"%s\" don't match allocation \"%s\".",
+			image->name, image->allocation->name);
 		return -1;
 	}
 
-	// Set offset of current buffer to current accumulated memory size:
-	buffer->offset = buffer->allocation->requirements.size;
-	buffer->allocation->requirements.size += requirements.size;
+	// Set offset of current image to current accumulated size (with alignment restrictions):
+	image->offset = 0;
+	while (image->offset < image->allocation->requirements.size)
+	{
+		image->offset += requirements.alignment;
+	}
+	image->allocation->requirements.size = image->offset + requirements.size;
 
 	return 0;
 }
 
-int vka_bind_buffer_memory(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+int vka_bind_image_memory(vka_vulkan_t *vulkan, vka_image_t *image)
 {
-	if (vkBindBufferMemory(vulkan->device, buffer->buffer,
-		buffer->allocation->memory, buffer->offset) != VK_SUCCESS)
+	if (vkBindImageMemory(vulkan->device, image->image,
+		image->allocation->memory, image->offset) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not bind memory for buffer \"%s\".", buffer->name);
+			"Could not bind memory for image \"%s\".", image->name);
 		return -1;
 	}
 
 	return 0;
 }
 
-void vka_buffer_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info)
+void vka_image_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info)
 {
-	vka_buffer_t *buffer = (vka_buffer_t *)(barrier_info->resource);
-
-	VkBufferMemoryBarrier buffer_barrier;
-	memset(&buffer_barrier, 0, sizeof(buffer_barrier));
-	buffer_barrier.sType			= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-	buffer_barrier.pNext			= NULL;
-	buffer_barrier.srcAccessMask		= barrier_info->src_access_mask;
-	buffer_barrier.dstAccessMask		= barrier_info->dst_access_mask;
-	buffer_barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
-	buffer_barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
-	buffer_barrier.buffer			= buffer->buffer;
-	buffer_barrier.offset			= barrier_info->offset;
+	vka_image_t *image = (vka_image_t *)(barrier_info->resource);
 
-	if (!barrier_info->size) { buffer_barrier.size = VK_WHOLE_SIZE; }
-	else { buffer_barrier.size = barrier_info->size; }
+	VkImageMemoryBarrier image_barrier;
+	memset(&image_barrier, 0, sizeof(image_barrier));
+	image_barrier.sType				= VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.pNext				= NULL;
+	image_barrier.srcAccessMask			= barrier_info->src_access_mask;
+	image_barrier.dstAccessMask			= barrier_info->dst_access_mask;
+	image_barrier.oldLayout				= barrier_info->old_layout;
+	image_barrier.newLayout				= barrier_info->new_layout;
+	image_barrier.srcQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex		= VK_QUEUE_FAMILY_IGNORED;
+	if (barrier_info->src_queue_family != barrier_info->dst_queue_family)
+	{
+		image_barrier.srcQueueFamilyIndex	= barrier_info->src_queue_family;
+		image_barrier.dstQueueFamilyIndex	= barrier_info->dst_queue_family;
+	}
+	image_barrier.image				= image->image;
+	image_barrier.subresourceRange.aspectMask	= image->aspect_mask;
+	image_barrier.subresourceRange.baseMipLevel	= 0;
+	image_barrier.subresourceRange.levelCount	= image->mip_levels;
+	image_barrier.subresourceRange.baseArrayLayer	= 0;
+	image_barrier.subresourceRange.layerCount	= 1;
 
 	vkCmdPipelineBarrier(command_buffer->buffer, barrier_info->src_stage_mask,
-		barrier_info->dst_stage_mask, 0, 0, NULL, 1, &buffer_barrier, 0, NULL);
+		barrier_info->dst_stage_mask, 0, 0, NULL, 0, NULL, 1, &image_barrier);
+	VKA_COUNT(command_buffer->counters, num_barriers, 1);
+}
+
+void vka_image_ownership_transfer(vka_command_buffer_t *release_command_buffer,
+	vka_command_buffer_t *acquire_command_buffer, vka_barrier_info_t *barrier_info)
+{
+	/* Records the release half of the barrier for the source queue family, and the acquire
+	 * half for the destination. Submit the acquire after the release (e.g. via a semaphore). */
+	vka_barrier_info_t release_info = *barrier_info;
+	release_info.dst_access_mask = 0;
+	release_info.dst_stage_mask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vka_image_barrier(release_command_buffer, &release_info);
+
+	vka_barrier_info_t acquire_info = *barrier_info;
+	acquire_info.src_access_mask = 0;
+	acquire_info.src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	vka_image_barrier(acquire_command_buffer, &acquire_info);
+}
+
+void vka_copy_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	vka_image_t *source = (vka_image_t *)(copy_info->source);
+	vka_image_t *destination = (vka_image_t *)(copy_info->destination);
+
+	// Initialise copy info:
+	VkImageCopy image_copy_info;
+	memset(&image_copy_info, 0, sizeof(image_copy_info));
+
+	// Set source attributes:
+	image_copy_info.srcSubresource.aspectMask	= source->aspect_mask;
+	image_copy_info.srcSubresource.mipLevel		= 0;
+	image_copy_info.srcSubresource.baseArrayLayer	= 0;
+	image_copy_info.srcSubresource.layerCount	= 1;
+	image_copy_info.srcOffset.x			= 0;
+	image_copy_info.srcOffset.y			= 0;
+	image_copy_info.srcOffset.z			= 0;
+
+	// Set destination attributes:
+	image_copy_info.dstSubresource.aspectMask	= destination->aspect_mask;
+	image_copy_info.dstSubresource.mipLevel		= 0;
+	image_copy_info.dstSubresource.baseArrayLayer	= 0;
+	image_copy_info.dstSubresource.layerCount	= 1;
+	image_copy_info.dstOffset.x			= 0;
+	image_copy_info.dstOffset.y			= 0;
+	image_copy_info.dstOffset.z			= 0;
+
+	// Choose extent based on which image is smaller:
+	if (source->width < destination->width) { image_copy_info.extent.width = source->width; }
+	else { image_copy_info.extent.width = destination->width; }
+	if (source->height < destination->height)
+	{
+		image_copy_info.extent.height = source->height;
+	}
+	else { image_copy_info.extent.height = destination->height; }
+	image_copy_info.extent.depth = 1;
+
+	// Copy source to destination:
+	vkCmdCopyImage(command_buffer->buffer, source->image, copy_info->source_layout,
+		destination->image, copy_info->destination_layout, 1, &image_copy_info);
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+}
+
+void vka_copy_buffer_to_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	vka_buffer_t *source = (vka_buffer_t *)(copy_info->source);
+	vka_image_t *destination = (vka_image_t *)(copy_info->destination);
+
+	vka_barrier_info_t barrier_info = {0};
+	barrier_info.resource		= destination;
+	barrier_info.src_access_mask	= VK_ACCESS_NONE;
+	barrier_info.dst_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_info.old_layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier_info.new_layout		= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
+
+	VkBufferImageCopy image_copy;
+	memset(&image_copy, 0, sizeof(VkBufferImageCopy));
+	image_copy.bufferOffset				= 0;
+	image_copy.bufferRowLength			= 0;
+	image_copy.bufferImageHeight			= 0;
+	image_copy.imageSubresource.aspectMask		= destination->aspect_mask;
+	image_copy.imageSubresource.mipLevel		= 0;
+	image_copy.imageSubresource.baseArrayLayer	= 0;
+	image_copy.imageSubresource.layerCount		= 1;
+	image_copy.imageOffset.x			= 0;
+	image_copy.imageOffset.y			= 0;
+	image_copy.imageOffset.z			= 0;
+	image_copy.imageExtent.width			= destination->width;
+	image_copy.imageExtent.height			= destination->height;
+	image_copy.imageExtent.depth			= 1;
+
+	vkCmdCopyBufferToImage(command_buffer->buffer, source->buffer, destination->image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy);
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+	VKA_COUNT(command_buffer->counters, bytes_copied, source->size);
+
+	barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_SHADER_READ_BIT;
+	barrier_info.old_layout		= VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier_info.new_layout		= VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
+}
+
+void vka_copy_image_to_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	// The image must already be in source_layout. Buffer rows are tightly packed:
+	vka_image_t *source = (vka_image_t *)(copy_info->source);
+	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+
+	VkBufferImageCopy image_copy;
+	memset(&image_copy, 0, sizeof(VkBufferImageCopy));
+	image_copy.bufferOffset				= copy_info->destination_offset;
+	image_copy.bufferRowLength			= 0;
+	image_copy.bufferImageHeight			= 0;
+	image_copy.imageSubresource.aspectMask		= source->aspect_mask;
+	image_copy.imageSubresource.mipLevel		= 0;
+	image_copy.imageSubresource.baseArrayLayer	= 0;
+	image_copy.imageSubresource.layerCount		= 1;
+	image_copy.imageOffset.x			= 0;
+	image_copy.imageOffset.y			= 0;
+	image_copy.imageOffset.z			= 0;
+	image_copy.imageExtent.width			= source->width;
+	image_copy.imageExtent.height			= source->height;
+	image_copy.imageExtent.depth			= 1;
+
+	vkCmdCopyImageToBuffer(command_buffer->buffer, source->image, copy_info->source_layout,
+					destination->buffer, 1, &image_copy);
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+
+	// Bytes written, not the buffer size. Unlisted formats count the rest of the buffer:
+	VkDeviceSize size = (VkDeviceSize)(source->width) * source->height *
+					vka_get_texel_size(source->format);
+	if (!size) { size = destination->size - copy_info->destination_offset; }
+	VKA_COUNT(command_buffer->counters, bytes_copied, size);
+}
+
+int vka_set_up_images(vka_vulkan_t *vulkan, uint32_t num_images, vka_image_t *images)
+{
+	/* Convenience function to set up multiple images.
+	 * Does not destroy images on failure.
+	 * Expects all images to use the same allocation. */
+	if (!num_images || !images)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not set up images: no images provided.");
+		return -1;
+	}
+
+	// Check all images are using same allocation:
+	for (uint32_t i = 1; i < num_images; i++)
+	{
+		if (images[i].allocation != images[i - 1].allocation)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Image \"%s\" is not using the same allocation as image \"%s\".",
+				images[i].name, images[i - 1].name);
+			return -1;
+		}
+	}
+
+	// Check all images have width and height:
+	for (uint32_t i = 0; i < num_images; i++)
+	{
+		if (!images[i].width || !images[i].height)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Image \"%s\" has a width or height of 0.", images[i].name);
+			return -1;
+		}
+	}
+
+	// Create images and get requirements:
+	for (uint32_t i = 0; i < num_images; i++)
+	{
+		if (vka_create_image(vulkan, &(images[i]))) { return -1; }
+		if (vka_get_image_requirements(vulkan, &(images[i]))) { return -1; }
+	}
+
+	// If there is no allocation, stop here:
+	if (!images[0].allocation) { return 0; }
+
+	// Otherwise set it up:
+	if (vka_create_allocation(vulkan, images[0].allocation)) { return -1; }
+
+	// Bind image memory and create image views:
+	for (uint32_t i = 0; i < num_images; i++)
+	{
+		if (vka_bind_image_memory(vulkan, &(images[i]))) { return -1; }
+		if (vka_create_image_view(vulkan, &(images[i]))) { return -1; }
+	}
+
+	return 0;
+}
+
+uint32_t vka_get_texel_size(VkFormat format)
+{
+	// Bytes per texel for common uncompressed formats, or 0 if the format isn't listed:
+	VkFormat formats[21] = { VK_FORMAT_R8_UNORM, VK_FORMAT_R8_UINT, VK_FORMAT_S8_UINT,
+				VK_FORMAT_R8G8_UNORM, VK_FORMAT_R16_UNORM, VK_FORMAT_R16_UINT,
+				VK_FORMAT_R16_SFLOAT, VK_FORMAT_D16_UNORM,
+				VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB,
+				VK_FORMAT_B8G8R8A8_UNORM, VK_FORMAT_B8G8R8A8_SRGB,
+				VK_FORMAT_A2B10G10R10_UNORM_PACK32, VK_FORMAT_B10G11R11_UFLOAT_PACK32,
+				VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R32_UINT, VK_FORMAT_R32_SFLOAT,
+				VK_FORMAT_D32_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT,
+				VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+	uint32_t sizes[21] = { 1, 1, 1, 2, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 8, 8, 16 };
+	for (int i = 0; i < 21; i++)
+	{
+		if (format == formats[i]) { return sizes[i]; }
+	}
+
+	return 0;
+}
+
+/***********
+ * Buffers *
+ ***********/
+
+int vka_create_buffer(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+{
+	if (!buffer->size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Buffer \"%s\" size is 0.", buffer->name);
+		return -1;
+	}
+
+	if (!buffer->usage)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Buffer \"%s\" has no usage flags.", buffer->name);
+		return -1;
+	}
+
+	VkBufferCreateInfo buffer_info;
+	memset(&buffer_info, 0, sizeof(buffer_info));
+	buffer_info.sType			= VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext			= NULL;
+	buffer_info.flags			= 0;
+	buffer_info.size			= buffer->size;
+	buffer_info.usage			= buffer->usage;
+	buffer_info.sharingMode			= VK_SHARING_MODE_EXCLUSIVE;
+	buffer_info.queueFamilyIndexCount	= 0;
+	buffer_info.pQueueFamilyIndices		= NULL;
+
+	vka_destroy_buffer(vulkan, buffer);
+	if (vkCreateBuffer(vulkan->device, &buffer_info, NULL, &(buffer->buffer)) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create buffer \"%s\".", buffer->name);
+		return -1;
+	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_BUFFER, (uint64_t)(buffer->buffer),
+								buffer->name);
+
+	return 0;
+}
+
+void vka_destroy_buffer(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+{
+	if (buffer->buffer)
+	{
+		vkDestroyBuffer(vulkan->device, buffer->buffer, NULL);
+		buffer->buffer = VK_NULL_HANDLE;
+	}
+}
+
+int vka_get_buffer_requirements(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+{
+	if (!buffer->allocation)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Buffer \"%s\" has no valid allocation.", buffer->name);
+		return -1;
+	}
+
+	if (buffer->allocation->memory)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Buffer \"%s\" already has memory allocated.", buffer->name);
+		return -1;
+	}
+
+	// Get memory requirements and add to current allocation information:
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(vulkan->device, buffer->buffer, &requirements);
+
+	if (!buffer->allocation->requirements.memoryTypeBits)
+	{
+		buffer->allocation->requirements.memoryTypeBits = requirements.memoryTypeBits;
+		buffer->allocation->requirements.alignment = requirements.alignment;
+	}
+
+	if (buffer->allocation->requirements.memoryTypeBits != requirements.memoryTypeBits)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Memory type bits for buffer \"%s\" don't match allocation \"%s\".",
+			buffer->name, buffer->allocation->name);
+		return -1;
+	}
+
+	// Set offset of current buffer to current accumulated memory size:
+	buffer->offset = buffer->allocation->requirements.size;
+	buffer->allocation->requirements.size += requirements.size;
+
+	return 0;
+}
+
+int vka_bind_buffer_memory(vka_vulkan_t *vulkan, vka_buffer_t *buffer)
+{
+	if (vkBindBufferMemory(vulkan->device, buffer->buffer,
+		buffer->allocation->memory, buffer->offset) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not bind memory for buffer \"%s\".", buffer->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+void vka_buffer_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info)
+{
+	vka_buffer_t *buffer = (vka_buffer_t *)(barrier_info->resource);
+
+	VkBufferMemoryBarrier buffer_barrier;
+	memset(&buffer_barrier, 0, sizeof(buffer_barrier));
+	buffer_barrier.sType			= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext			= NULL;
+	buffer_barrier.srcAccessMask		= barrier_info->src_access_mask;
+	buffer_barrier.dstAccessMask		= barrier_info->dst_access_mask;
+	buffer_barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	if (barrier_info->src_queue_family != barrier_info->dst_queue_family)
+	{
+		buffer_barrier.srcQueueFamilyIndex	= barrier_info->src_queue_family;
+		buffer_barrier.dstQueueFamilyIndex	= barrier_info->dst_queue_family;
+	}
+	buffer_barrier.buffer			= buffer->buffer;
+	buffer_barrier.offset			= barrier_info->offset;
+
+	if (!barrier_info->size) { buffer_barrier.size = VK_WHOLE_SIZE; }
+	else { buffer_barrier.size = barrier_info->size; }
+
+	vkCmdPipelineBarrier(command_buffer->buffer, barrier_info->src_stage_mask,
+		barrier_info->dst_stage_mask, 0, 0, NULL, 1, &buffer_barrier, 0, NULL);
+	VKA_COUNT(command_buffer->counters, num_barriers, 1);
+}
+
+void vka_buffer_barrier_reverse(vka_command_buffer_t *command_buffer,
+				vka_barrier_info_t *barrier_info)
+{
+	// Same as previous function but with source and destination swapped for convenience.
+	vka_buffer_t *buffer = (vka_buffer_t *)(barrier_info->resource);
+
+	VkBufferMemoryBarrier buffer_barrier;
+	memset(&buffer_barrier, 0, sizeof(buffer_barrier));
+	buffer_barrier.sType			= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	buffer_barrier.pNext			= NULL;
+	buffer_barrier.srcAccessMask		= barrier_info->dst_access_mask;
+	buffer_barrier.dstAccessMask		= barrier_info->src_access_mask;
+	buffer_barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
+	if (barrier_info->src_queue_family != barrier_info->dst_queue_family)
+	{
+		buffer_barrier.srcQueueFamilyIndex	= barrier_info->dst_queue_family;
+		buffer_barrier.dstQueueFamilyIndex	= barrier_info->src_queue_family;
+	}
+	buffer_barrier.buffer			= buffer->buffer;
+	buffer_barrier.offset			= barrier_info->offset;
+
+	if (!barrier_info->size) { buffer_barrier.size = VK_WHOLE_SIZE; }
+	else { buffer_barrier.size = barrier_info->size; }
+
+	vkCmdPipelineBarrier(command_buffer->buffer, barrier_info->dst_stage_mask,
+		barrier_info->src_stage_mask, 0, 0, NULL, 1, &buffer_barrier, 0, NULL);
+	VKA_COUNT(command_buffer->counters, num_barriers, 1);
+}
+
+void vka_buffer_ownership_transfer(vka_command_buffer_t *release_command_buffer,
+	vka_command_buffer_t *acquire_command_buffer, vka_barrier_info_t *barrier_info)
+{
+	// Same as the image version, for buffers.
+	vka_barrier_info_t release_info = *barrier_info;
+	release_info.dst_access_mask = 0;
+	release_info.dst_stage_mask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vka_buffer_barrier(release_command_buffer, &release_info);
+
+	vka_barrier_info_t acquire_info = *barrier_info;
+	acquire_info.src_access_mask = 0;
+	acquire_info.src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	vka_buffer_barrier(acquire_command_buffer, &acquire_info);
+}
+
+void vka_copy_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	vka_buffer_t *source = (vka_buffer_t *)(copy_info->source);
+	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+
+	// If no size given, choose size based on which buffer is smaller:
+	VkDeviceSize copy_size = copy_info->size;
+	if (!copy_size)
+	{
+		copy_size = destination->size;
+		if (source->size < copy_size) { copy_size = source->size; }
+	}
+
+	VkBufferCopy buffer_copy_info;
+	memset(&buffer_copy_info, 0, sizeof(buffer_copy_info));
+	buffer_copy_info.srcOffset	= copy_info->source_offset;
+	buffer_copy_info.dstOffset	= copy_info->destination_offset;
+	buffer_copy_info.size		= copy_size;
+
+	vkCmdCopyBuffer(command_buffer->buffer, source->buffer,
+		destination->buffer, 1, &buffer_copy_info);
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+	VKA_COUNT(command_buffer->counters, bytes_copied, copy_size);
+}
+
+void vka_update_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+
+	// Copy must have size <= 65536. Uses source from copy info as a pointer into host memory.
+	vkCmdUpdateBuffer(command_buffer->buffer, destination->buffer,
+		copy_info->destination_offset, copy_info->size, copy_info->source);
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+	VKA_COUNT(command_buffer->counters, bytes_copied, copy_info->size);
+}
+
+void vka_fill_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+{
+	// Uses destination buffer and offset in copy_info.
+	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+	VkDeviceSize size = copy_info->size;
+	if (!size) { size = VK_WHOLE_SIZE; }
+	vkCmdFillBuffer(command_buffer->buffer, destination->buffer,
+		copy_info->destination_offset, size, copy_info->data);
+
+	if (!copy_info->size) { size = destination->size - copy_info->destination_offset; }
+	VKA_COUNT(command_buffer->counters, num_copies, 1);
+	VKA_COUNT(command_buffer->counters, bytes_copied, size);
+}
+
+int vka_set_up_buffers(vka_vulkan_t *vulkan, uint32_t num_buffers, vka_buffer_t *buffers)
+{
+	/* Convenience function to set up multiple buffers.
+	 * Does not destroy buffers on failure.
+	 * Expects all buffers to use the same allocation. */
+	if (!num_buffers || !buffers)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not set up buffers: no buffers provided.");
+		return -1;
+	}
+
+	// Check all buffers are using same allocation:
+	for (uint32_t i = 1; i < num_buffers; i++)
+	{
+		if (buffers[i].allocation != buffers[i - 1].allocation)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Buffer \"%s\" is not using the same allocation as buffer \"%s\".",
+				buffers[i].name, buffers[i - 1].name);
+			return -1;
+		}
+	}
+
+	// Check all buffers have a size:
+	for (uint32_t i = 0; i < num_buffers; i++)
+	{
+		if (!buffers[i].size)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Buffer \"%s\" has a size of 0.", buffers[i].name);
+			return -1;
+		}
+	}
+
+	// Create buffers and get requirements:
+	for (uint32_t i = 0; i < num_buffers; i++)
+	{
+		if (vka_create_buffer(vulkan, &(buffers[i]))) { return -1; }
+		if (vka_get_buffer_requirements(vulkan, &(buffers[i]))) { return -1; }
+	}
+
+	// If there is no allocation, stop here:
+	if (!buffers[0].allocation) { return 0; }
+
+	// Otherwise set it up:
+	if (vka_create_allocation(vulkan, buffers[0].allocation)) { return -1; }
+
+	// Bind buffer memory:
+	for (uint32_t i = 0; i < num_buffers; i++)
+	{
+		if (vka_bind_buffer_memory(vulkan, &(buffers[i]))) { return -1; }
+	}
+
+	return 0;
+}
+
+int vka_create_instance_stream(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream)
+{
+	if (!instance_stream->stride || !instance_stream->size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Instance stream \"%s\" needs a stride and a size.", instance_stream->name);
+		return -1;
+	}
+
+	snprintf(instance_stream->allocation.name, VKA_MAX_NAME_LENGTH, "%s allocation",
+							instance_stream->name);
+	instance_stream->allocation.properties[0] = VKA_MEMORY_HOST;
+	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		snprintf(instance_stream->buffers[i].name, VKA_MAX_NAME_LENGTH, "%s buffer %d",
+							instance_stream->name, i);
+		instance_stream->buffers[i].allocation	= &(instance_stream->allocation);
+		instance_stream->buffers[i].usage	= VKA_BUFFER_USAGE_VERTEX;
+		instance_stream->buffers[i].size	= instance_stream->size;
+	}
+
+	if (vka_set_up_buffers(vulkan, VKA_MAX_FRAMES_IN_FLIGHT, instance_stream->buffers))
+	{
+		return -1;
+	}
+	if (vka_map_memory(vulkan, &(instance_stream->allocation))) { return -1; }
+
+	instance_stream->used = 0;
+
+	return 0;
+}
+
+void vka_destroy_instance_stream(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream)
+{
+	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		vka_destroy_buffer(vulkan, &(instance_stream->buffers[i]));
+	}
+	vka_unmap_memory(vulkan, &(instance_stream->allocation));
+	vka_destroy_allocation(vulkan, &(instance_stream->allocation));
+}
+
+void vka_reset_instance_stream(vka_instance_stream_t *instance_stream)
+{
+	// Call once per frame, before reserving instances for it.
+	instance_stream->used = 0;
+}
+
+void *vka_reserve_instances(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream,
+				uint32_t num_instances, uint32_t *first_instance)
+{
+	/* Returns a pointer to write num_instances instances of data to, in this frame's buffer.
+	 * Draw them with first_instance, with the stream bound by vka_bind_instance_stream(). */
+	VkDeviceSize size = (VkDeviceSize)num_instances * instance_stream->stride;
+	if ((instance_stream->used + size) > instance_stream->size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Instance stream \"%s\" is full.", instance_stream->name);
+		return NULL;
+	}
+
+	*first_instance = instance_stream->used / instance_stream->stride;
+
+	uint8_t *data = instance_stream->allocation.mapped_data;
+	data += instance_stream->buffers[vulkan->current_frame].offset + instance_stream->used;
+	instance_stream->used += size;
+
+	return data;
+}
+
+void vka_bind_instance_stream(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_instance_stream_t *instance_stream, uint32_t binding)
+{
+	// Binding should use VK_VERTEX_INPUT_RATE_INSTANCE in the pipeline.
+	vka_buffer_t *buffer = &(instance_stream->buffers[vulkan->current_frame]);
+	vka_bind_vertex_buffer_ranges(command_buffer, binding, 1, &buffer, NULL);
+}
+
+int vka_create_mesh_pool(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool)
+{
+	if (!mesh_pool->max_indices || !mesh_pool->max_vertices || !mesh_pool->vertex_size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Mesh pool \"%s\" needs max indices, max vertices and a vertex size.",
+			mesh_pool->name);
+		return -1;
+	}
+
+	uint32_t index_size = 2;
+	if (mesh_pool->index_type == VK_INDEX_TYPE_UINT32) { index_size = 4; }
+
+	snprintf(mesh_pool->allocation.name, VKA_MAX_NAME_LENGTH, "%s allocation", mesh_pool->name);
+	mesh_pool->allocation.properties[0] = VKA_MEMORY_DEVICE;
+
+	// Index buffer:
+	snprintf(mesh_pool->buffers[0].name, VKA_MAX_NAME_LENGTH, "%s index buffer",
+								mesh_pool->name);
+	mesh_pool->buffers[0].allocation	= &(mesh_pool->allocation);
+	mesh_pool->buffers[0].usage		= VKA_BUFFER_USAGE_INDEX | VKA_BUFFER_USAGE_SRC_DST;
+	mesh_pool->buffers[0].index_type	= mesh_pool->index_type;
+	mesh_pool->buffers[0].size		= (VkDeviceSize)(mesh_pool->max_indices) * index_size;
+
+	// Vertex buffer:
+	snprintf(mesh_pool->buffers[1].name, VKA_MAX_NAME_LENGTH, "%s vertex buffer",
+								mesh_pool->name);
+	mesh_pool->buffers[1].allocation	= &(mesh_pool->allocation);
+	mesh_pool->buffers[1].usage		= VKA_BUFFER_USAGE_VERTEX | VKA_BUFFER_USAGE_SRC_DST;
+	mesh_pool->buffers[1].size		= (VkDeviceSize)(mesh_pool->max_vertices) *
+								mesh_pool->vertex_size;
+
+	if (vka_set_up_buffers(vulkan, 2, mesh_pool->buffers)) { return -1; }
+
+	// Everything starts free:
+	if (vka_free_list_release(vulkan, &(mesh_pool->free_lists[0]), 0, mesh_pool->max_indices))
+	{
+		return -1;
+	}
+	if (vka_free_list_release(vulkan, &(mesh_pool->free_lists[1]), 0, mesh_pool->max_vertices))
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+void vka_destroy_mesh_pool(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		vka_forget_retired_ranges(vulkan, &(mesh_pool->free_lists[i]));
+		vka_destroy_buffer(vulkan, &(mesh_pool->buffers[i]));
+
+		if (mesh_pool->free_lists[i].ranges) { free(mesh_pool->free_lists[i].ranges); }
+		mesh_pool->free_lists[i].ranges = NULL;
+		mesh_pool->free_lists[i].num_ranges = 0;
+		mesh_pool->free_lists[i].max_ranges = 0;
+	}
+	vka_destroy_allocation(vulkan, &(mesh_pool->allocation));
+
+	if (mesh_pool->meshes)
+	{
+		free(mesh_pool->meshes);
+		mesh_pool->meshes = NULL;
+	}
+	mesh_pool->num_meshes = 0;
+	mesh_pool->max_meshes = 0;
+}
+
+int vka_allocate_mesh(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool, uint32_t num_vertices,
+					uint32_t num_indices, uint32_t *mesh)
+{
+	// Reuse the handle of a freed mesh if there is one:
+	uint32_t handle = 0;
+	while ((handle < mesh_pool->num_meshes) && mesh_pool->meshes[handle].in_use) { handle++; }
+
+	if (handle == mesh_pool->max_meshes)
+	{
+		uint32_t max_meshes = 2 * mesh_pool->max_meshes;
+		if (!max_meshes) { max_meshes = 16; }
+
+		vka_mesh_t *meshes = realloc(mesh_pool->meshes, max_meshes * sizeof(vka_mesh_t));
+		if (!meshes)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for meshes in pool \"%s\".",
+				mesh_pool->name);
+			return -1;
+		}
+		mesh_pool->meshes = meshes;
+		mesh_pool->max_meshes = max_meshes;
+	}
+
+	uint32_t first_index;
+	uint32_t first_vertex;
+	if (vka_free_list_allocate(&(mesh_pool->free_lists[0]), num_indices, &first_index))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"No free range for %u indices in mesh pool \"%s\".",
+			num_indices, mesh_pool->name);
+		return -1;
+	}
+	if (vka_free_list_allocate(&(mesh_pool->free_lists[1]), num_vertices, &first_vertex))
+	{
+		vka_free_list_release(vulkan, &(mesh_pool->free_lists[0]), first_index, num_indices);
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"No free range for %u vertices in mesh pool \"%s\".",
+			num_vertices, mesh_pool->name);
+		return -1;
+	}
+
+	vka_mesh_t *new_mesh = &(mesh_pool->meshes[handle]);
+	new_mesh->vertex_offset	= (int32_t)first_vertex;
+	new_mesh->first_index	= first_index;
+	new_mesh->num_vertices	= num_vertices;
+	new_mesh->num_indices	= num_indices;
+	new_mesh->in_use	= 1;
+	if (handle == mesh_pool->num_meshes) { mesh_pool->num_meshes++; }
+
+	*mesh = handle;
+	return 0;
+}
+
+int vka_free_mesh(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool, uint32_t mesh)
+{
+	/* The handle can be reused straight away, but frames in flight may still be drawing the
+	 * mesh, so its ranges only go back to the free lists once those have completed. */
+	vka_mesh_t *old_mesh = &(mesh_pool->meshes[mesh]);
+	if (!old_mesh->in_use) { return 0; }
+
+	// Both ranges or neither, so the mesh can be freed again if this fails:
+	uint32_t num_retired_ranges = vulkan->num_retired_ranges;
+	if (vka_free_list_retire(vulkan, &(mesh_pool->free_lists[0]), old_mesh->first_index,
+							old_mesh->num_indices) ||
+		vka_free_list_retire(vulkan, &(mesh_pool->free_lists[1]),
+			(uint32_t)(old_mesh->vertex_offset), old_mesh->num_vertices))
+	{
+		vulkan->num_retired_ranges = num_retired_ranges;
+		return -1;
+	}
+	old_mesh->in_use = 0;
+
+	return 0;
+}
+
+void vka_upload_mesh(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool,
+	uint32_t mesh, vka_buffer_t *source, VkDeviceSize index_offset, VkDeviceSize vertex_offset)
+{
+	// Copies a mesh's indices and vertices from offsets in source (e.g. a staging buffer):
+	vka_mesh_t *new_mesh = &(mesh_pool->meshes[mesh]);
+	uint32_t index_size = 2;
+	if (mesh_pool->index_type == VK_INDEX_TYPE_UINT32) { index_size = 4; }
+
+	vka_copy_info_t copy_info;
+	memset(&copy_info, 0, sizeof(copy_info));
+	copy_info.source = source;
+	if (new_mesh->num_indices)
+	{
+		copy_info.destination		= &(mesh_pool->buffers[0]);
+		copy_info.source_offset		= index_offset;
+		copy_info.destination_offset	= (VkDeviceSize)(new_mesh->first_index) * index_size;
+		copy_info.size			= (VkDeviceSize)(new_mesh->num_indices) * index_size;
+		vka_copy_buffer(command_buffer, &copy_info);
+	}
+
+	if (new_mesh->num_vertices)
+	{
+		copy_info.destination		= &(mesh_pool->buffers[1]);
+		copy_info.source_offset		= vertex_offset;
+		copy_info.destination_offset	= (VkDeviceSize)(new_mesh->vertex_offset) *
+								mesh_pool->vertex_size;
+		copy_info.size			= (VkDeviceSize)(new_mesh->num_vertices) *
+								mesh_pool->vertex_size;
+		vka_copy_buffer(command_buffer, &copy_info);
+	}
+}
+
+int vka_defragment_mesh_pool(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							vka_mesh_pool_t *mesh_pool)
+{
+	/* Packs meshes into new buffers with copies recorded into the command buffer, and retires
+	 * the old buffers. Mesh offsets change straight away, so only draw with them after this. */
+	uint32_t index_size = 2;
+	if (mesh_pool->index_type == VK_INDEX_TYPE_UINT32) { index_size = 4; }
+	uint32_t element_sizes[2] = { index_size, mesh_pool->vertex_size };
+
+	// Room for the old buffers and memory first, so retiring them below can't fail part way:
+	if (vka_reserve_retired_objects(vulkan, 3)) { return -1; }
+
+	VkBufferCopy *copies = NULL;
+	if (mesh_pool->num_meshes)
+	{
+		copies = malloc(2 * mesh_pool->num_meshes * sizeof(VkBufferCopy));
+		if (!copies)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for copies to defragment mesh pool \"%s\".",
+				mesh_pool->name);
+			return -1;
+		}
+	}
+
+	// Create new buffers, keeping the old ones if that doesn't work out:
+	vka_allocation_t old_allocation = mesh_pool->allocation;
+	vka_buffer_t old_buffers[2];
+	memcpy(old_buffers, mesh_pool->buffers, sizeof(old_buffers));
+
+	mesh_pool->allocation.memory = VK_NULL_HANDLE;
+	memset(&(mesh_pool->allocation.requirements), 0, sizeof(mesh_pool->allocation.requirements));
+	for (int i = 0; i < 2; i++) { mesh_pool->buffers[i].buffer = VK_NULL_HANDLE; }
+
+	if (vka_set_up_buffers(vulkan, 2, mesh_pool->buffers))
+	{
+		for (int i = 0; i < 2; i++) { vka_destroy_buffer(vulkan, &(mesh_pool->buffers[i])); }
+		vka_destroy_allocation(vulkan, &(mesh_pool->allocation));
+		mesh_pool->allocation = old_allocation;
+		memcpy(mesh_pool->buffers, old_buffers, sizeof(old_buffers));
+		if (copies) { free(copies); }
+		return -1;
+	}
+
+	// Pack meshes in handle order:
+	uint32_t num_copies[2] = { 0, 0 };
+	uint32_t used[2] = { 0, 0 };
+	for (uint32_t i = 0; i < mesh_pool->num_meshes; i++)
+	{
+		vka_mesh_t *mesh = &(mesh_pool->meshes[i]);
+		if (!mesh->in_use) { continue; }
+
+		uint32_t offsets[2] = { mesh->first_index, (uint32_t)(mesh->vertex_offset) };
+		uint32_t sizes[2] = { mesh->num_indices, mesh->num_vertices };
+		for (int j = 0; j < 2; j++)
+		{
+			if (!sizes[j]) { continue; }
+			VkBufferCopy *copy = &(copies[(j * mesh_pool->num_meshes) + num_copies[j]]);
+			copy->srcOffset	= (VkDeviceSize)(offsets[j]) * element_sizes[j];
+			copy->dstOffset	= (VkDeviceSize)(used[j]) * element_sizes[j];
+			copy->size	= (VkDeviceSize)(sizes[j]) * element_sizes[j];
+			num_copies[j]++;
+		}
+
+		mesh->first_index = used[0];
+		mesh->vertex_offset = (int32_t)(used[1]);
+		used[0] += mesh->num_indices;
+		used[1] += mesh->num_vertices;
+	}
+
+	vka_barrier_info_t barrier_info;
+	memset(&barrier_info, 0, sizeof(barrier_info));
+	for (int i = 0; i < 2; i++)
+	{
+		// Wait for uploads to the old buffer before copying from it:
+		barrier_info.resource		= &(old_buffers[i]);
+		barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier_info.dst_access_mask	= VK_ACCESS_TRANSFER_READ_BIT;
+		barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		vka_buffer_barrier(command_buffer, &barrier_info);
+
+		if (num_copies[i])
+		{
+			vkCmdCopyBuffer(command_buffer->buffer, old_buffers[i].buffer,
+				mesh_pool->buffers[i].buffer, num_copies[i],
+				&(copies[i * mesh_pool->num_meshes]));
+			VKA_COUNT(command_buffer->counters, num_copies, 1);
+			#ifdef VKA_STATISTICS
+			for (uint32_t j = 0; j < num_copies[i]; j++)
+			{
+				command_buffer->counters.bytes_copied +=
+					copies[(i * mesh_pool->num_meshes) + j].size;
+			}
+			#endif
+		}
+
+		barrier_info.resource		= &(mesh_pool->buffers[i]);
+		barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier_info.dst_access_mask	= VK_ACCESS_INDEX_READ_BIT |
+							VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+		barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+		vka_buffer_barrier(command_buffer, &barrier_info);
+	}
+	if (copies) { free(copies); }
+
+	// Old buffers may still be in use by frames in flight (and by the copies above):
+	for (int i = 0; i < 2; i++)
+	{
+		vka_retire_object(vulkan, VK_OBJECT_TYPE_BUFFER, (uint64_t)(old_buffers[i].buffer));
+	}
+	vka_retire_object(vulkan, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)(old_allocation.memory));
+	vulkan->heap_usage[old_allocation.heap_index] -= old_allocation.requirements.size;
+
+	// Everything after the packed meshes is free, and retired ranges were in the old buffers:
+	uint32_t max_elements[2] = { mesh_pool->max_indices, mesh_pool->max_vertices };
+	for (int i = 0; i < 2; i++)
+	{
+		vka_forget_retired_ranges(vulkan, &(mesh_pool->free_lists[i]));
+		mesh_pool->free_lists[i].num_ranges = 0;
+		if (vka_free_list_release(vulkan, &(mesh_pool->free_lists[i]), used[i],
+						max_elements[i] - used[i]))
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void vka_bind_mesh_pool(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool)
+{
+	vka_bind_vertex_buffers(command_buffer, &(mesh_pool->buffers[0]), 1,
+						&(mesh_pool->buffers[1]));
+}
+
+void vka_draw_mesh(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool,
+								uint32_t mesh)
+{
+	// Expects the mesh pool bound already.
+	vka_mesh_t *draw_mesh = &(mesh_pool->meshes[mesh]);
+	if (draw_mesh->num_indices)
+	{
+		vka_draw_indexed(command_buffer, draw_mesh->num_indices, draw_mesh->first_index,
+							draw_mesh->vertex_offset);
+	}
+	else { vka_draw(command_buffer, draw_mesh->num_vertices, draw_mesh->vertex_offset); }
+}
+
+int vka_free_list_allocate(vka_free_list_t *free_list, uint32_t size, uint32_t *offset)
+{
+	// First fit. Returns -1 if no free range is big enough.
+	if (!size)
+	{
+		*offset = 0;
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < free_list->num_ranges; i++)
+	{
+		vka_range_t *range = &(free_list->ranges[i]);
+		if (range->size < size) { continue; }
+
+		*offset = range->offset;
+		range->offset += size;
+		range->size -= size;
+		if (!range->size)
+		{
+			memmove(range, range + 1, (free_list->num_ranges - i - 1) * sizeof(vka_range_t));
+			free_list->num_ranges--;
+		}
+		return 0;
+	}
+
+	return -1;
+}
+
+int vka_free_list_release(vka_vulkan_t *vulkan, vka_free_list_t *free_list, uint32_t offset,
+								uint32_t size)
+{
+	if (!size) { return 0; }
+
+	// Find the first free range after the one being released:
+	uint32_t i = 0;
+	while ((i < free_list->num_ranges) && (free_list->ranges[i].offset < offset)) { i++; }
+
+	vka_range_t *previous = NULL;
+	vka_range_t *next = NULL;
+	if ((i > 0) && ((free_list->ranges[i - 1].offset + free_list->ranges[i - 1].size) == offset))
+	{
+		previous = &(free_list->ranges[i - 1]);
+	}
+	if ((i < free_list->num_ranges) && ((offset + size) == free_list->ranges[i].offset))
+	{
+		next = &(free_list->ranges[i]);
+	}
+
+	// Merge with neighbours if possible:
+	if (previous && next)
+	{
+		previous->size += size + next->size;
+		memmove(next, next + 1, (free_list->num_ranges - i - 1) * sizeof(vka_range_t));
+		free_list->num_ranges--;
+		return 0;
+	}
+	if (previous)
+	{
+		previous->size += size;
+		return 0;
+	}
+	if (next)
+	{
+		next->offset = offset;
+		next->size += size;
+		return 0;
+	}
+
+	// Otherwise insert a new range:
+	if (free_list->num_ranges == free_list->max_ranges)
+	{
+		uint32_t max_ranges = 2 * free_list->max_ranges;
+		if (!max_ranges) { max_ranges = 16; }
+
+		vka_range_t *ranges = realloc(free_list->ranges, max_ranges * sizeof(vka_range_t));
+		if (!ranges)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for free list ranges.");
+			return -1;
+		}
+		free_list->ranges = ranges;
+		free_list->max_ranges = max_ranges;
+	}
+
+	memmove(&(free_list->ranges[i + 1]), &(free_list->ranges[i]),
+			(free_list->num_ranges - i) * sizeof(vka_range_t));
+	free_list->ranges[i].offset = offset;
+	free_list->ranges[i].size = size;
+	free_list->num_ranges++;
+
+	return 0;
+}
+int vka_free_list_retire(vka_vulkan_t *vulkan, vka_free_list_t *free_list, uint32_t offset,
+								uint32_t size)
+{
+	// Defers releasing a range until every frame that might be using it has finished:
+	if (!size) { return 0; }
+
+	if (vulkan->num_retired_ranges == vulkan->max_retired_ranges)
+	{
+		uint32_t max_retired_ranges = 2 * vulkan->max_retired_ranges;
+		if (!max_retired_ranges) { max_retired_ranges = 16; }
+
+		vka_retired_range_t *retired_ranges = realloc(vulkan->retired_ranges,
+					max_retired_ranges * sizeof(vka_retired_range_t));
+		if (!retired_ranges)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for retired free list ranges.");
+			return -1;
+		}
+		vulkan->retired_ranges = retired_ranges;
+		vulkan->max_retired_ranges = max_retired_ranges;
+	}
+
+	vka_retired_range_t *retired = &(vulkan->retired_ranges[vulkan->num_retired_ranges]);
+	retired->free_list = free_list;
+	retired->offset = offset;
+	retired->size = size;
+	retired->frames_remaining = VKA_MAX_FRAMES_IN_FLIGHT + 1;
+	vulkan->num_retired_ranges++;
+
+	return 0;
+}
+void vka_release_retired_ranges(vka_vulkan_t *vulkan)
+{
+	// Ranges that can't be released yet, or couldn't be for lack of memory, are kept:
+	uint32_t num_kept = 0;
+	for (uint32_t i = 0; i < vulkan->num_retired_ranges; i++)
+	{
+		vka_retired_range_t *retired = &(vulkan->retired_ranges[i]);
+		if (retired->frames_remaining ||
+			vka_free_list_release(vulkan, retired->free_list, retired->offset,
+								retired->size))
+		{
+			vulkan->retired_ranges[num_kept] = *retired;
+			num_kept++;
+		}
+	}
+	vulkan->num_retired_ranges = num_kept;
+}
+void vka_forget_retired_ranges(vka_vulkan_t *vulkan, vka_free_list_t *free_list)
+{
+	// For when the free list is destroyed or rebuilt, and its retired ranges no longer apply:
+	uint32_t num_kept = 0;
+	for (uint32_t i = 0; i < vulkan->num_retired_ranges; i++)
+	{
+		if (vulkan->retired_ranges[i].free_list == free_list) { continue; }
+		vulkan->retired_ranges[num_kept] = vulkan->retired_ranges[i];
+		num_kept++;
+	}
+	vulkan->num_retired_ranges = num_kept;
+}
+
+/*************
+ * Rendering *
+ *************/
+
+void vka_begin_rendering(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
+{
+	// TODO - allow for multiple colour images.
+	VkRenderingAttachmentInfo colour_info;
+	memset(&colour_info, 0, sizeof(colour_info));
+	colour_info.sType		= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colour_info.pNext		= NULL;
+	colour_info.imageView		= render_info->colour_image->image_view;
+	colour_info.imageLayout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colour_info.resolveMode		= VK_RESOLVE_MODE_NONE;
+	colour_info.resolveImageView	= VK_NULL_HANDLE;
+	colour_info.resolveImageLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
+	colour_info.loadOp		= render_info->colour_load_op;
+	colour_info.storeOp		= render_info->colour_store_op;
+	colour_info.clearValue		= render_info->colour_clear_value;
+
+	VkRenderingAttachmentInfo depth_info;
+	memset(&depth_info, 0, sizeof(depth_info));
+	VkRenderingAttachmentInfo *depth_info_pointer = NULL;
+	if (render_info->depth_image)
+	{
+		depth_info_pointer = &depth_info;
+
+		depth_info.sType		= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depth_info.pNext		= NULL;
+		depth_info.imageView		= render_info->depth_image->image_view;
+		depth_info.imageLayout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depth_info.resolveMode		= VK_RESOLVE_MODE_NONE;
+		depth_info.resolveImageView	= VK_NULL_HANDLE;
+		depth_info.resolveImageLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
+		depth_info.loadOp		= render_info->depth_load_op;
+		depth_info.storeOp		= render_info->depth_store_op;
+		depth_info.clearValue		= render_info->depth_clear_value;
+	}
+
+	VkRenderingInfo rendering_info;
+	memset(&rendering_info, 0, sizeof(rendering_info));
+	rendering_info.sType			= VK_STRUCTURE_TYPE_RENDERING_INFO;
+	rendering_info.pNext			= NULL;
+	rendering_info.flags			= 0;
+	rendering_info.renderArea		= render_info->render_area;
+	rendering_info.layerCount		= 1;
+	rendering_info.viewMask			= 0;
+	rendering_info.colorAttachmentCount	= 1;
+	rendering_info.pColorAttachments	= &colour_info;
+	rendering_info.pDepthAttachment		= depth_info_pointer;
+	rendering_info.pStencilAttachment	= depth_info_pointer;
+
+	vkCmdBeginRendering(command_buffer->buffer, &rendering_info);
+}
+
+void vka_begin_rendering_barrier(vka_command_buffer_t *command_buffer,
+				vka_render_info_t *render_info)
+{
+	// TODO - allow for multiple colour images.
+	vka_barrier_info_t barrier_info = {0};
+	barrier_info.resource		= render_info->colour_image;
+	barrier_info.src_access_mask	= VK_ACCESS_NONE;
+	barrier_info.dst_access_mask	= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier_info.old_layout		= VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier_info.new_layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
+
+	vka_begin_rendering(command_buffer, render_info);
+}
+
+void vka_end_rendering(vka_command_buffer_t *command_buffer)
+{
+	// TODO - allow for multiple colour images.
+	vkCmdEndRendering(command_buffer->buffer);
+}
+
+void vka_end_rendering_barrier(vka_command_buffer_t *command_buffer,
+				vka_render_info_t *render_info)
+{
+	// TODO - allow for multiple colour images.
+	vka_end_rendering(command_buffer);
+
+	vka_barrier_info_t barrier_info = {0};
+	barrier_info.resource		= render_info->colour_image;
+	barrier_info.src_access_mask	= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_NONE;
+	barrier_info.old_layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barrier_info.new_layout		= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
+}
+
+void vka_set_viewport(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
+{
+	// Flip the viewport:
+	VkViewport viewport;
+	memset(&viewport, 0, sizeof(viewport));
+	viewport.x		= render_info->render_area.offset.x * 1.f;
+	viewport.y		= (render_info->render_target_height * 1.f) -
+				(render_info->render_area.offset.y * 1.f);
+	viewport.width		= render_info->render_area.extent.width * 1.f;
+	viewport.height		= -(render_info->render_area.extent.height * 1.f);
+	viewport.minDepth	= 0.f;
+	viewport.maxDepth	= 1.f;
+
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if (bound_state->viewport_valid &&
+		!memcmp(&(bound_state->viewport), &viewport, sizeof(viewport)))
+	{
+		command_buffer->num_elided_viewports++;
+		return;
+	}
+
+	vkCmdSetViewport(command_buffer->buffer, 0, 1, &viewport);
+	bound_state->viewport = viewport;
+	bound_state->viewport_valid = 1;
+}
+
+void vka_set_scissor(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
+{
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if (bound_state->scissor_valid && !memcmp(&(bound_state->scissor),
+			&(render_info->scissor_area), sizeof(VkRect2D)))
+	{
+		command_buffer->num_elided_viewports++;
+		return;
+	}
+
+	vkCmdSetScissor(command_buffer->buffer, 0, 1, &(render_info->scissor_area));
+	bound_state->scissor = render_info->scissor_area;
+	bound_state->scissor_valid = 1;
+}
+
+void vka_set_cull_mode(vka_command_buffer_t *command_buffer, VkCullModeFlags cull_mode)
+{
+	vkCmdSetCullMode(command_buffer->buffer, cull_mode);
+}
+
+void vka_set_depth_test(vka_command_buffer_t *command_buffer, VkBool32 depth_test_enable)
+{
+	vkCmdSetDepthTestEnable(command_buffer->buffer, depth_test_enable);
+}
+
+void vka_set_depth_write(vka_command_buffer_t *command_buffer, VkBool32 depth_write_enable)
+{
+	vkCmdSetDepthWriteEnable(command_buffer->buffer, depth_write_enable);
+}
+
+void vka_set_depth_compare_op(vka_command_buffer_t *command_buffer, VkCompareOp depth_compare_op)
+{
+	vkCmdSetDepthCompareOp(command_buffer->buffer, depth_compare_op);
+}
+
+void vka_set_topology(vka_command_buffer_t *command_buffer, VkPrimitiveTopology topology)
+{
+	// Must be in the same topology class as the pipeline's topology.
+	vkCmdSetPrimitiveTopology(command_buffer->buffer, topology);
+}
+
+void vka_set_blend_enable(vka_command_buffer_t *command_buffer, VkBool32 blend_enable)
+{
+	/* Needs VK_EXT_extended_dynamic_state3 (use_extended_dynamic_state_3). Without it, blend
+	 * enable isn't dynamic (pipelines use blend_enable), so this does nothing. */
+	if (!vkCmdSetColorBlendEnableEXT) { return; }
+	vkCmdSetColorBlendEnableEXT(command_buffer->buffer, 0, 1, &blend_enable);
+}
+
+void vka_bind_vertex_buffers(vka_command_buffer_t *command_buffer, vka_buffer_t *index_buffer,
+				uint32_t num_vertex_buffers, vka_buffer_t vertex_buffers[])
+{
+	// Rejected the same way as vka_bind_vertex_buffer_ranges(), as buffers has no more room:
+	vka_buffer_t *buffers[VKA_MAX_VERTEX_ATTRIBUTES];
+	SDL_assert(num_vertex_buffers <= VKA_MAX_VERTEX_ATTRIBUTES);
+	if (num_vertex_buffers > VKA_MAX_VERTEX_ATTRIBUTES) { return; }
+	for (uint32_t i = 0; i < num_vertex_buffers; i++) { buffers[i] = &(vertex_buffers[i]); }
+	if (num_vertex_buffers)
+	{
+		vka_bind_vertex_buffer_ranges(command_buffer, 0, num_vertex_buffers, buffers, NULL);
+	}
+
+	if (index_buffer) { vka_bind_index_buffer(command_buffer, index_buffer, 0); }
+}
+
+void vka_bind_index_buffer(vka_command_buffer_t *command_buffer, vka_buffer_t *index_buffer,
+							VkDeviceSize offset)
+{
+	// Offset is in bytes, and must be a multiple of the index size.
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if ((bound_state->index_buffer == index_buffer->buffer) &&
+		(bound_state->index_offset == offset) &&
+		(bound_state->index_type == index_buffer->index_type))
+	{
+		command_buffer->num_elided_vertex_buffers++;
+		return;
+	}
+
+	vkCmdBindIndexBuffer(command_buffer->buffer, index_buffer->buffer, offset,
+						index_buffer->index_type);
+	bound_state->index_buffer = index_buffer->buffer;
+	bound_state->index_offset = offset;
+	bound_state->index_type = index_buffer->index_type;
+}
+
+void vka_bind_vertex_buffer_ranges(vka_command_buffer_t *command_buffer, uint32_t first_binding,
+	uint32_t num_vertex_buffers, vka_buffer_t *vertex_buffers[], VkDeviceSize offsets[])
+{
+	// Binds buffers from first_binding onwards. If offsets is NULL, binds at offset 0.
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+
+	/* Pipelines have at most VKA_MAX_VERTEX_ATTRIBUTES bindings, and the shadow is that size.
+	 * Binding past it is a bug in the caller, so nothing is bound (and debug builds assert)
+	 * rather than drawing with some of the buffers missing: */
+	SDL_assert((first_binding <= VKA_MAX_VERTEX_ATTRIBUTES) &&
+		(num_vertex_buffers <= (VKA_MAX_VERTEX_ATTRIBUTES - first_binding)));
+	if ((first_binding > VKA_MAX_VERTEX_ATTRIBUTES) ||
+		(num_vertex_buffers > (VKA_MAX_VERTEX_ATTRIBUTES - first_binding)))
+	{
+		return;
+	}
+
+	VkBuffer buffers[VKA_MAX_VERTEX_ATTRIBUTES];
+	VkDeviceSize buffer_offsets[VKA_MAX_VERTEX_ATTRIBUTES];
+	int vertex_buffers_bound = 1;
+	for (uint32_t i = 0; i < num_vertex_buffers; i++)
+	{
+		uint32_t binding = first_binding + i;
+		buffers[i] = vertex_buffers[i]->buffer;
+		buffer_offsets[i] = 0;
+		if (offsets) { buffer_offsets[i] = offsets[i]; }
+
+		if ((binding >= bound_state->num_vertex_buffers) ||
+			(buffers[i] != bound_state->vertex_buffers[binding]) ||
+			(buffer_offsets[i] != bound_state->vertex_offsets[binding]))
+		{
+			vertex_buffers_bound = 0;
+		}
+	}
+
+	if (vertex_buffers_bound)
+	{
+		command_buffer->num_elided_vertex_buffers++;
+		return;
+	}
+
+	vkCmdBindVertexBuffers(command_buffer->buffer, first_binding, num_vertex_buffers,
+							buffers, buffer_offsets);
+
+	memcpy(&(bound_state->vertex_buffers[first_binding]), buffers,
+				num_vertex_buffers * sizeof(VkBuffer));
+	memcpy(&(bound_state->vertex_offsets[first_binding]), buffer_offsets,
+				num_vertex_buffers * sizeof(VkDeviceSize));
+	if ((first_binding + num_vertex_buffers) > bound_state->num_vertex_buffers)
+	{
+		bound_state->num_vertex_buffers = first_binding + num_vertex_buffers;
+	}
+}
+
+void vka_bind_descriptor_sets(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
+{
+	VkDescriptorSet descriptor_sets[VKA_MAX_PIPELINE_DESCRIPTOR_SETS];
+	for (uint32_t i = 0; i < pipeline->num_descriptor_sets; i++)
+	{
+		descriptor_sets[i] = pipeline->descriptor_sets[i]->set;
+	}
+
+	VkPipelineBindPoint bind_point;
+	if (pipeline->is_compute_pipeline) { bind_point = VK_PIPELINE_BIND_POINT_COMPUTE; }
+	else { bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS; }
+
+	vka_bind_descriptor_set_array(command_buffer, bind_point, pipeline->layout,
+				pipeline->num_descriptor_sets, descriptor_sets);
+}
+
+void vka_bind_descriptor_set_array(vka_command_buffer_t *command_buffer,
+	VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t num_descriptor_sets,
+	VkDescriptorSet descriptor_sets[])
+{
+	// Only rebinds from the first set that differs, unless the layout has changed:
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	uint32_t first_set = 0;
+	if (bound_state->layouts[bind_point] == layout)
+	{
+		while ((first_set < num_descriptor_sets) &&
+			(first_set < bound_state->num_descriptor_sets[bind_point]) &&
+			(descriptor_sets[first_set] ==
+				bound_state->descriptor_sets[bind_point][first_set]))
+		{
+			first_set++;
+		}
+	}
+
+	if (first_set == num_descriptor_sets)
+	{
+		command_buffer->num_elided_descriptor_sets += num_descriptor_sets;
+		return;
+	}
+	command_buffer->num_elided_descriptor_sets += first_set;
+
+	vkCmdBindDescriptorSets(command_buffer->buffer, bind_point, layout, first_set,
+		num_descriptor_sets - first_set, &(descriptor_sets[first_set]), 0, NULL);
+	VKA_COUNT(command_buffer->counters, num_descriptor_set_binds, 1);
+
+	bound_state->layouts[bind_point] = layout;
+	memcpy(&(bound_state->descriptor_sets[bind_point][first_set]), &(descriptor_sets[first_set]),
+				(num_descriptor_sets - first_set) * sizeof(VkDescriptorSet));
+	if (num_descriptor_sets > bound_state->num_descriptor_sets[bind_point])
+	{
+		bound_state->num_descriptor_sets[bind_point] = num_descriptor_sets;
+	}
+}
+
+void vka_draw(vka_command_buffer_t *command_buffer, uint32_t num_vertices, int32_t vertex_offset)
+{
+	vkCmdDraw(command_buffer->buffer, num_vertices, 1, vertex_offset, 0);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indexed(vka_command_buffer_t *command_buffer, uint32_t num_indices,
+				uint32_t index_offset, int32_t vertex_offset)
+{
+	vkCmdDrawIndexed(command_buffer->buffer, num_indices, 1, index_offset, vertex_offset, 0);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_instanced(vka_command_buffer_t *command_buffer, uint32_t num_vertices,
+		int32_t vertex_offset, uint32_t num_instances, uint32_t first_instance)
+{
+	vkCmdDraw(command_buffer->buffer, num_vertices, num_instances, vertex_offset,
+							first_instance);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indexed_instanced(vka_command_buffer_t *command_buffer, uint32_t num_indices,
+	uint32_t index_offset, int32_t vertex_offset, uint32_t num_instances,
+	uint32_t first_instance)
+{
+	vkCmdDrawIndexed(command_buffer->buffer, num_indices, num_instances, index_offset,
+						vertex_offset, first_instance);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
+			VkDeviceSize draw_offset, uint32_t draw_count, uint32_t stride)
+{
+	// If stride is 0, commands are tightly packed.
+	if (!stride) { stride = sizeof(VkDrawIndirectCommand); }
+	vkCmdDrawIndirect(command_buffer->buffer, draw_commands->buffer, draw_offset, draw_count,
+									stride);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indexed_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
+				VkDeviceSize draw_offset, uint32_t draw_count, uint32_t stride)
+{
+	if (!stride) { stride = sizeof(VkDrawIndexedIndirectCommand); }
+	vkCmdDrawIndexedIndirect(command_buffer->buffer, draw_commands->buffer, draw_offset,
+								draw_count, stride);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indirect_count(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
+	VkDeviceSize draw_offset, vka_buffer_t *draw_counts, VkDeviceSize count_offset,
+	uint32_t max_draw_count, uint32_t stride)
+{
+	// Count offset must be a multiple of 4. If stride is 0, commands are tightly packed.
+	if (!stride) { stride = sizeof(VkDrawIndirectCommand); }
+	vkCmdDrawIndirectCount(command_buffer->buffer, draw_commands->buffer, draw_offset,
+		draw_counts->buffer, count_offset, max_draw_count, stride);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+void vka_draw_indexed_indirect_count(vka_command_buffer_t *command_buffer,
+	vka_buffer_t *draw_commands, VkDeviceSize draw_offset, vka_buffer_t *draw_counts,
+	VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride)
+{
+	if (!stride) { stride = sizeof(VkDrawIndexedIndirectCommand); }
+	vkCmdDrawIndexedIndirectCount(command_buffer->buffer, draw_commands->buffer, draw_offset,
+		draw_counts->buffer, count_offset, max_draw_count, stride);
+	VKA_COUNT(command_buffer->counters, num_draws, 1);
+}
+
+int vka_present_image(vka_vulkan_t *vulkan)
+{
+	VkPresentInfoKHR present_info;
+	memset(&present_info, 0, sizeof(present_info));
+	present_info.sType		= VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present_info.pNext		= NULL;
+	present_info.waitSemaphoreCount	= 1;
+	present_info.pWaitSemaphores	= &(vulkan->render_complete[vulkan->current_frame]);
+	present_info.swapchainCount	= 1;
+	present_info.pSwapchains	= &(vulkan->swapchain);
+	present_info.pImageIndices	= &(vulkan->current_swapchain_index);
+	present_info.pResults		= NULL;
+
+	VKA_TRACE_BEGIN(vulkan, trace_start);
+	VkResult result = vkQueuePresentKHR(vulkan->present_queue, &present_info);
+	VKA_TRACE_END(vulkan, "vka_present_image", trace_start);
+	if (result != VK_SUCCESS)
+	{
+		if ((result == VK_SUBOPTIMAL_KHR) || (result == VK_ERROR_OUT_OF_DATE_KHR))
+		{
+			vulkan->recreate_swapchain = 1;
+			return 0;
+		}
+		else
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not present swapchain image.");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/**************
+ * Draw queue *
+ **************/
+
+int vka_create_draw_queue(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue)
+{
+	if (!draw_queue->max_packets) { draw_queue->max_packets = 256; }
+
+	draw_queue->packets = malloc(draw_queue->max_packets * sizeof(vka_draw_packet_t));
+	draw_queue->keys = malloc(2 * draw_queue->max_packets * sizeof(uint64_t));
+	draw_queue->order = malloc(2 * draw_queue->max_packets * sizeof(uint32_t));
+	if (!draw_queue->packets || !draw_queue->keys || !draw_queue->order)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for draw queue \"%s\".", draw_queue->name);
+		vka_destroy_draw_queue(vulkan, draw_queue);
+		return -1;
+	}
+
+	draw_queue->num_packets = 0;
+	draw_queue->sorted = 1;
+
+	return 0;
+}
+
+void vka_destroy_draw_queue(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue)
+{
+	// Vulkan base not needed:
+	(void)vulkan;
+
+	if (draw_queue->packets)
+	{
+		free(draw_queue->packets);
+		draw_queue->packets = NULL;
+	}
+
+	if (draw_queue->keys)
+	{
+		free(draw_queue->keys);
+		draw_queue->keys = NULL;
+	}
+
+	if (draw_queue->order)
+	{
+		free(draw_queue->order);
+		draw_queue->order = NULL;
+	}
+
+	draw_queue->num_packets = 0;
+}
+
+int vka_queue_draw(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue, vka_draw_packet_t *packet)
+{
+	if (packet->num_descriptor_sets > VKA_MAX_PIPELINE_DESCRIPTOR_SETS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Too many descriptor sets for draw in queue \"%s\".", draw_queue->name);
+		return -1;
+	}
+
+	if (packet->push_constant_size > VKA_MAX_PUSH_CONSTANT_SIZE)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Push constants for draw in queue \"%s\" are larger than %d bytes.",
+			draw_queue->name, VKA_MAX_PUSH_CONSTANT_SIZE);
+		return -1;
+	}
+
+	if (draw_queue->num_packets == draw_queue->max_packets)
+	{
+		uint32_t max_packets = 2 * draw_queue->max_packets;
+
+		vka_draw_packet_t *packets = realloc(draw_queue->packets,
+					max_packets * sizeof(vka_draw_packet_t));
+		if (!packets)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not grow draw queue \"%s\".", draw_queue->name);
+			return -1;
+		}
+		draw_queue->packets = packets;
+
+		uint64_t *keys = realloc(draw_queue->keys, 2 * max_packets * sizeof(uint64_t));
+		if (!keys)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not grow draw queue \"%s\".", draw_queue->name);
+			return -1;
+		}
+		draw_queue->keys = keys;
+
+		uint32_t *order = realloc(draw_queue->order, 2 * max_packets * sizeof(uint32_t));
+		if (!order)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not grow draw queue \"%s\".", draw_queue->name);
+			return -1;
+		}
+		draw_queue->order = order;
+
+		draw_queue->max_packets = max_packets;
+	}
+
+	vka_draw_packet_t *queued = &(draw_queue->packets[draw_queue->num_packets]);
+	*queued = *packet;
+	if (!queued->num_instances) { queued->num_instances = 1; }
+
+	/* Sort key, most significant first: pipeline, descriptor sets, mesh, user key. The
+	 * state is hashed down to 16 bits each - collisions only cost a redundant bind. */
+	uint64_t pipeline_hash = vka_hash(&(packet->pipeline->pipeline), sizeof(VkPipeline),
+								VKA_HASH_SEED);
+	uint64_t set_hash = vka_hash(packet->descriptor_sets,
+		packet->num_descriptor_sets * sizeof(VkDescriptorSet), VKA_HASH_SEED);
+	uint64_t mesh_hash = vka_hash(&(packet->index_buffer), sizeof(vka_buffer_t *),
+								VKA_HASH_SEED);
+	mesh_hash = vka_hash(&(packet->vertex_buffers), sizeof(vka_buffer_t *), mesh_hash);
+	mesh_hash = vka_hash(&(packet->index_offset), sizeof(uint32_t), mesh_hash);
+	mesh_hash = vka_hash(&(packet->vertex_offset), sizeof(int32_t), mesh_hash);
+
+	draw_queue->keys[draw_queue->num_packets] = ((pipeline_hash >> 48) << 48) |
+						((set_hash >> 48) << 32) |
+						((mesh_hash >> 48) << 16) |
+						(uint64_t)(packet->user_key);
+	draw_queue->order[draw_queue->num_packets] = draw_queue->num_packets;
+	draw_queue->num_packets++;
+	draw_queue->sorted = 0;
+
+	return 0;
+}
+
+void vka_clear_draw_queue(vka_draw_queue_t *draw_queue)
+{
+	draw_queue->num_packets = 0;
+	draw_queue->sorted = 1;
+}
+
+void vka_sort_draw_queue(vka_draw_queue_t *draw_queue)
+{
+	/* LSD radix sort of the packet order by key, a byte at a time. Stable, so packets with
+	 * equal keys keep the order they were queued in. Keys and order are double-buffered in
+	 * the second half of their arrays. */
+	uint32_t num_packets = draw_queue->num_packets;
+	draw_queue->sorted = 1;
+	if (num_packets < 2) { return; }
+
+	uint64_t *keys = draw_queue->keys;
+	uint64_t *sorted_keys = draw_queue->keys + draw_queue->max_packets;
+	uint32_t *order = draw_queue->order;
+	uint32_t *sorted_order = draw_queue->order + draw_queue->max_packets;
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		uint32_t counts[256];
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t i = 0; i < num_packets; i++) { counts[(keys[i] >> shift) & 0xFF]++; }
+
+		// Skip bytes that are the same for every key:
+		if (counts[(keys[0] >> shift) & 0xFF] == num_packets) { continue; }
+
+		uint32_t offset = 0;
+		for (int i = 0; i < 256; i++)
+		{
+			uint32_t count = counts[i];
+			counts[i] = offset;
+			offset += count;
+		}
+
+		for (uint32_t i = 0; i < num_packets; i++)
+		{
+			uint32_t destination = counts[(keys[i] >> shift) & 0xFF]++;
+			sorted_keys[destination] = keys[i];
+			sorted_order[destination] = order[i];
+		}
+
+		uint64_t *temp_keys = keys;
+		keys = sorted_keys;
+		sorted_keys = temp_keys;
+
+		uint32_t *temp_order = order;
+		order = sorted_order;
+		sorted_order = temp_order;
+	}
+
+	// Make sure the result is in the first half:
+	if (keys != draw_queue->keys)
+	{
+		memcpy(draw_queue->keys, keys, num_packets * sizeof(uint64_t));
+		memcpy(draw_queue->order, order, num_packets * sizeof(uint32_t));
+	}
+}
+
+void vka_replay_draw_queue(vka_command_buffer_t *command_buffer, vka_draw_queue_t *draw_queue)
+{
+	/* Draws every packet in key order, skipping redundant state changes. Consecutive packets
+	 * drawing the same mesh with the same state, whose instance ranges follow on from each
+	 * other, are merged into one instanced draw. Expects rendering to have begun. */
+	if (!draw_queue->sorted) { vka_sort_draw_queue(draw_queue); }
+
+	draw_queue->num_draws = 0;
+	draw_queue->num_merged = 0;
+
+	uint32_t i = 0;
+	while (i < draw_queue->num_packets)
+	{
+		vka_draw_packet_t *packet = &(draw_queue->packets[draw_queue->order[i]]);
+		uint32_t num_instances = packet->num_instances;
+
+		// Merge following packets into this draw:
+		uint32_t j = i + 1;
+		while (j < draw_queue->num_packets)
+		{
+			vka_draw_packet_t *next = &(draw_queue->packets[draw_queue->order[j]]);
+			if (!vka_draw_packets_match(packet, next) ||
+				(next->first_instance != (packet->first_instance + num_instances)))
+			{
+				break;
+			}
+			num_instances += next->num_instances;
+			draw_queue->num_merged++;
+			j++;
+		}
+
+		vka_bind_pipeline(command_buffer, packet->pipeline);
+		if (packet->num_descriptor_sets)
+		{
+			vka_bind_descriptor_set_array(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				packet->pipeline->layout, packet->num_descriptor_sets,
+				packet->descriptor_sets);
+		}
+		if (packet->num_vertex_buffers || packet->index_buffer)
+		{
+			vka_bind_vertex_buffers(command_buffer, packet->index_buffer,
+				packet->num_vertex_buffers, packet->vertex_buffers);
+		}
+
+		if (packet->push_constant_size)
+		{
+			vka_push_constant_data(command_buffer, packet->pipeline->layout,
+				packet->push_constant_stages, packet->push_constant_size,
+				packet->push_constants);
+		}
+
+		if (packet->index_buffer)
+		{
+			vkCmdDrawIndexed(command_buffer->buffer, packet->num_elements, num_instances,
+				packet->index_offset, packet->vertex_offset, packet->first_instance);
+		}
+		else
+		{
+			vkCmdDraw(command_buffer->buffer, packet->num_elements, num_instances,
+				(uint32_t)(packet->vertex_offset), packet->first_instance);
+		}
+		VKA_COUNT(command_buffer->counters, num_draws, 1);
+		draw_queue->num_draws++;
+
+		i = j;
+	}
+}
+
+int vka_draw_packets_match(vka_draw_packet_t *a, vka_draw_packet_t *b)
+{
+	// Same state and same mesh - only instance ranges may differ.
+	if ((a->pipeline->pipeline != b->pipeline->pipeline) ||
+		(a->index_buffer != b->index_buffer) ||
+		(a->num_vertex_buffers != b->num_vertex_buffers) ||
+		(a->vertex_buffers != b->vertex_buffers) ||
+		(a->num_elements != b->num_elements) ||
+		(a->index_offset != b->index_offset) ||
+		(a->vertex_offset != b->vertex_offset) ||
+		(a->num_descriptor_sets != b->num_descriptor_sets) ||
+		(a->push_constant_size != b->push_constant_size) ||
+		(a->push_constant_stages != b->push_constant_stages))
+	{
+		return 0;
+	}
+
+	if (memcmp(a->descriptor_sets, b->descriptor_sets,
+			a->num_descriptor_sets * sizeof(VkDescriptorSet)))
+	{
+		return 0;
+	}
+
+	if (memcmp(a->push_constants, b->push_constants, a->push_constant_size)) { return 0; }
+
+	return 1;
+}
+
+/***********
+ * Compute *
+ ***********/
+
+void vka_dispatch(vka_command_buffer_t *command_buffer, uint32_t group_count_x,
+			uint32_t group_count_y, uint32_t group_count_z)
+{
+	vkCmdDispatch(command_buffer->buffer, group_count_x, group_count_y, group_count_z);
+	VKA_COUNT(command_buffer->counters, num_dispatches, 1);
+}
+
+void vka_dispatch_indirect(vka_command_buffer_t *command_buffer,
+	vka_buffer_t *dispatch_commands, VkDeviceSize command_offset)
+{
+	vkCmdDispatchIndirect(command_buffer->buffer, dispatch_commands->buffer, command_offset);
+	VKA_COUNT(command_buffer->counters, num_dispatches, 1);
+}
+
+void vka_dispatch_size(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+	vka_pipeline_t *pipeline, uint32_t size_x, uint32_t size_y, uint32_t size_z)
+{
+	/* Dispatches enough workgroups to cover size_x * size_y * size_z invocations, split into
+	 * several dispatches if that's more groups than the device allows at once. The last groups
+	 * can go past the size, so shaders should bounds check gl_GlobalInvocationID. */
+	VkPhysicalDeviceLimits *limits = &(vulkan->device_properties.properties.limits);
+	uint32_t sizes[3] = { size_x, size_y, size_z };
+	uint32_t group_counts[3];
+	uint32_t max_group_counts[3];
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t workgroup_size = pipeline->workgroup_size[i];
+		if (!workgroup_size) { workgroup_size = 1; }
+		group_counts[i] = (sizes[i] / workgroup_size) + ((sizes[i] % workgroup_size) != 0);
+
+		max_group_counts[i] = limits->maxComputeWorkGroupCount[i];
+		if (!max_group_counts[i]) { max_group_counts[i] = 65535; }
+	}
+
+	for (uint32_t z = 0; z < group_counts[2]; z += max_group_counts[2])
+	{
+		uint32_t count_z = group_counts[2] - z;
+		if (count_z > max_group_counts[2]) { count_z = max_group_counts[2]; }
+
+		for (uint32_t y = 0; y < group_counts[1]; y += max_group_counts[1])
+		{
+			uint32_t count_y = group_counts[1] - y;
+			if (count_y > max_group_counts[1]) { count_y = max_group_counts[1]; }
+
+			for (uint32_t x = 0; x < group_counts[0]; x += max_group_counts[0])
+			{
+				uint32_t count_x = group_counts[0] - x;
+				if (count_x > max_group_counts[0]) { count_x = max_group_counts[0]; }
+
+				vkCmdDispatchBase(command_buffer->buffer, x, y, z,
+							count_x, count_y, count_z);
+				VKA_COUNT(command_buffer->counters, num_dispatches, 1);
+			}
+		}
+	}
+}
+
+uint32_t vka_get_default_workgroup_size(vka_vulkan_t *vulkan)
+{
+	/* 1D workgroup size that's a whole number of subgroups, and at least 64 invocations.
+	 * Pass it as the specialisation constant for local_size_x_id. */
+	uint32_t subgroup_size = vulkan->subgroup_properties.subgroupSize;
+	if (!subgroup_size) { subgroup_size = 32; }
+
+	uint32_t workgroup_size = subgroup_size;
+	while (workgroup_size < 64) { workgroup_size *= 2; }
+
+	VkPhysicalDeviceLimits *limits = &(vulkan->device_properties.properties.limits);
+	while ((workgroup_size > subgroup_size) &&
+		((workgroup_size > limits->maxComputeWorkGroupInvocations) ||
+		(workgroup_size > limits->maxComputeWorkGroupSize[0])))
+	{
+		workgroup_size /= 2;
+	}
+
+	return workgroup_size;
+}
+
+int vka_create_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	vka_command_buffer_t *command_buffer = &(compute_batch->command_buffer);
+	snprintf(command_buffer->name, VKA_MAX_NAME_LENGTH, "%s", compute_batch->name);
+	command_buffer->fence_signaled = 0;
+	command_buffer->use_wait = 0;
+	command_buffer->use_signal = 0;
+	command_buffer->queue = &(vulkan->compute_queue);
+	if (vulkan->use_async_compute)
+	{
+		command_buffer->command_pool = vulkan->compute_command_pool;
+	}
+	if (vka_create_command_buffer(vulkan, command_buffer)) { return -1; }
+
+	// Submitted again without re-recording, so not one time submit:
+	command_buffer->flags = 0;
+
+	compute_batch->recorded = 0;
+	compute_batch->submitted = 0;
+
+	return 0;
+}
+
+void vka_destroy_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	if (compute_batch->submitted) { vka_wait_for_compute_batch(vulkan, compute_batch); }
+
+	// The command buffer is freed along with its pool:
+	vka_destroy_command_buffer(vulkan, &(compute_batch->command_buffer));
+
+	if (compute_batch->jobs)
+	{
+		free(compute_batch->jobs);
+		compute_batch->jobs = NULL;
+	}
+	compute_batch->num_jobs = 0;
+	compute_batch->max_jobs = 0;
+	compute_batch->recorded = 0;
+}
+
+int vka_queue_compute_job(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch,
+						vka_compute_job_t *compute_job)
+{
+	if (!compute_job->pipeline || !compute_job->pipeline->is_compute_pipeline)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Compute job for \"%s\" needs a compute pipeline.", compute_batch->name);
+		return -1;
+	}
+
+	if (compute_job->push_constant_size > VKA_MAX_PUSH_CONSTANT_SIZE)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Compute job push constants for \"%s\" are over %d bytes.",
+			compute_batch->name, VKA_MAX_PUSH_CONSTANT_SIZE);
+		return -1;
+	}
+
+	if (compute_job->num_descriptor_sets > VKA_MAX_PIPELINE_DESCRIPTOR_SETS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Compute job for \"%s\" has too many descriptor sets.",
+			compute_batch->name);
+		return -1;
+	}
+
+	if (compute_batch->num_jobs == compute_batch->max_jobs)
+	{
+		uint32_t max_jobs = compute_batch->max_jobs * 2;
+		if (!max_jobs) { max_jobs = 16; }
+
+		vka_compute_job_t *jobs = realloc(compute_batch->jobs,
+					max_jobs * sizeof(vka_compute_job_t));
+		if (!jobs)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for compute jobs for \"%s\".",
+				compute_batch->name);
+			return -1;
+		}
+		compute_batch->jobs = jobs;
+		compute_batch->max_jobs = max_jobs;
+	}
+
+	compute_batch->jobs[compute_batch->num_jobs] = *compute_job;
+	compute_batch->num_jobs++;
+	compute_batch->recorded = 0;
+
+	return 0;
+}
+
+void vka_clear_compute_batch(vka_compute_batch_t *compute_batch)
+{
+	compute_batch->num_jobs = 0;
+	compute_batch->recorded = 0;
+}
+
+int vka_record_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	// Can't be in flight - vka_submit_compute_batch() waits for it first.
+	vka_command_buffer_t *command_buffer = &(compute_batch->command_buffer);
+	if (vka_begin_command_buffer(vulkan, command_buffer)) { return -1; }
+
+	VkMemoryBarrier memory_barrier;
+	memset(&memory_barrier, 0, sizeof(memory_barrier));
+	memory_barrier.sType		= VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.pNext		= NULL;
+	memory_barrier.srcAccessMask	= VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier.dstAccessMask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	for (uint32_t i = 0; i < compute_batch->num_jobs; i++)
+	{
+		vka_compute_job_t *job = &(compute_batch->jobs[i]);
+		vka_pipeline_t *pipeline = job->pipeline;
+
+		if (i && !job->concurrent)
+		{
+			vkCmdPipelineBarrier(command_buffer->buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &memory_barrier, 0, NULL, 0, NULL);
+			VKA_COUNT(command_buffer->counters, num_barriers, 1);
+		}
+
+		vka_bind_pipeline(command_buffer, pipeline);
+		job->recorded_pipeline = pipeline->pipeline;
+
+		// Handles are kept so that vka_submit_compute_batch() can spot reallocated sets:
+		uint32_t num_descriptor_sets = job->num_descriptor_sets;
+		vka_descriptor_set_t **descriptor_sets = job->descriptor_sets;
+		if (!num_descriptor_sets)
+		{
+			num_descriptor_sets = pipeline->num_descriptor_sets;
+			descriptor_sets = pipeline->descriptor_sets;
+		}
+		for (uint32_t j = 0; j < num_descriptor_sets; j++)
+		{
+			job->recorded_descriptor_sets[j] = descriptor_sets[j]->set;
+		}
+		vka_bind_descriptor_set_array(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipeline->layout, num_descriptor_sets, job->recorded_descriptor_sets);
+
+		if (job->push_constant_size)
+		{
+			vka_push_constant_data(command_buffer, pipeline->layout,
+				VK_SHADER_STAGE_COMPUTE_BIT, job->push_constant_size,
+				job->push_constant_data);
+		}
+		else { vka_push_constants(command_buffer, pipeline); }
+
+		vka_begin_label(command_buffer, pipeline->name, NULL);
+		vka_dispatch_size(vulkan, command_buffer, pipeline,
+				job->size[0], job->size[1], job->size[2]);
+		vka_end_label(command_buffer);
+	}
+
+	// Results read back through mapped memory:
+	memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer->buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, NULL, 0, NULL);
+	VKA_COUNT(command_buffer->counters, num_barriers, 1);
+
+	if (vka_end_command_buffer(vulkan, command_buffer)) { return -1; }
+	compute_batch->recorded = 1;
+
+	return 0;
+}
+
+int vka_submit_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	/* Returns without waiting for the jobs to complete - poll with
+	 * vka_compute_batch_complete(), or block with vka_wait_for_compute_batch(). */
+	if (!compute_batch->num_jobs) { return 0; }
+	if (vka_wait_for_compute_batch(vulkan, compute_batch)) { return -1; }
+
+	// Pipelines (e.g. reloaded shaders) or descriptor sets may have been recreated since:
+	for (uint32_t i = 0; i < compute_batch->num_jobs; i++)
+	{
+		vka_compute_job_t *job = &(compute_batch->jobs[i]);
+		if (job->recorded_pipeline != job->pipeline->pipeline) { compute_batch->recorded = 0; }
+
+		uint32_t num_descriptor_sets = job->num_descriptor_sets;
+		vka_descriptor_set_t **descriptor_sets = job->descriptor_sets;
+		if (!num_descriptor_sets)
+		{
+			num_descriptor_sets = job->pipeline->num_descriptor_sets;
+			descriptor_sets = job->pipeline->descriptor_sets;
+		}
+		for (uint32_t j = 0; j < num_descriptor_sets; j++)
+		{
+			if (job->recorded_descriptor_sets[j] != descriptor_sets[j]->set)
+			{
+				compute_batch->recorded = 0;
+			}
+		}
+	}
+
+	if (!compute_batch->recorded && vka_record_compute_batch(vulkan, compute_batch))
+	{
+		return -1;
+	}
+
+	if (vka_submit_command_buffer(vulkan, &(compute_batch->command_buffer))) { return -1; }
+	compute_batch->submitted = 1;
+
+	return 0;
+}
+
+int vka_compute_batch_complete(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	// Returns 1 if complete (or never submitted), 0 if still running, -1 on error.
+	if (!compute_batch->submitted) { return 1; }
+
+	VkResult result = vkGetFenceStatus(vulkan->device, compute_batch->command_buffer.fence);
+	if (result == VK_NOT_READY) { return 0; }
+	if (result != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not get fence status for \"%s\".", compute_batch->name);
+		return -1;
+	}
+
+	if (vka_wait_for_compute_batch(vulkan, compute_batch)) { return -1; }
+	return 1;
+}
+
+int vka_wait_for_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch)
+{
+	if (!compute_batch->submitted) { return 0; }
+	if (vka_wait_for_fence(vulkan, &(compute_batch->command_buffer))) { return -1; }
+	compute_batch->submitted = 0;
+
+	return 0;
+}
+
+/***********
+ * Culling *
+ ***********/
+
+int vka_create_cull_pass(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass)
+{
+	if (!cull_pass->max_objects)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Cull pass \"%s\" has max objects of 0.", cull_pass->name);
+		return -1;
+	}
+
+	if (!vulkan->enabled_features_12.drawIndirectCount ||
+		((cull_pass->max_objects > 1) && !vulkan->enabled_features.multiDrawIndirect))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Cull pass \"%s\" needs drawIndirectCount and multiDrawIndirect enabled.",
+			cull_pass->name);
+		return -1;
+	}
+
+	// Objects and cameras are written by the host, draw commands and count by the GPU:
+	const char *buffer_names[4] = { "objects", "cameras", "draw commands", "draw count" };
+	VkDeviceSize sizes[4] = {
+		VKA_MAX_FRAMES_IN_FLIGHT * cull_pass->max_objects * sizeof(vka_cull_object_t),
+		VKA_MAX_FRAMES_IN_FLIGHT * sizeof(vka_cull_camera_t),
+		cull_pass->max_objects * sizeof(VkDrawIndexedIndirectCommand),
+		sizeof(uint32_t) };
+	VkBufferUsageFlags usages[4] = { VKA_BUFFER_USAGE_STORAGE, VKA_BUFFER_USAGE_STORAGE,
+				VKA_BUFFER_USAGE_STORAGE | VKA_BUFFER_USAGE_INDIRECT,
+				VKA_BUFFER_USAGE_STORAGE_DST | VKA_BUFFER_USAGE_INDIRECT };
+
+	snprintf(cull_pass->host_allocation.name, VKA_MAX_NAME_LENGTH, "%s host allocation",
+								cull_pass->name);
+	snprintf(cull_pass->device_allocation.name, VKA_MAX_NAME_LENGTH, "%s device allocation",
+								cull_pass->name);
+	cull_pass->host_allocation.properties[0] = VKA_MEMORY_HOST;
+	cull_pass->device_allocation.properties[0] = VKA_MEMORY_DEVICE;
+	for (int i = 0; i < 4; i++)
+	{
+		vka_buffer_t *buffer = &(cull_pass->buffers[i]);
+		snprintf(buffer->name, VKA_MAX_NAME_LENGTH, "%s %s", cull_pass->name,
+								buffer_names[i]);
+		buffer->allocation = &(cull_pass->host_allocation);
+		if (i >= VKA_CULL_BUFFER_DRAW_COMMANDS)
+		{
+			buffer->allocation = &(cull_pass->device_allocation);
+		}
+		buffer->size = sizes[i];
+		buffer->usage = usages[i];
+	}
+
+	if (vka_set_up_buffers(vulkan, 2, &(cull_pass->buffers[VKA_CULL_BUFFER_OBJECTS])))
+	{
+		return -1;
+	}
+	if (vka_set_up_buffers(vulkan, 2, &(cull_pass->buffers[VKA_CULL_BUFFER_DRAW_COMMANDS])))
+	{
+		return -1;
+	}
+	if (vka_map_memory(vulkan, &(cull_pass->host_allocation))) { return -1; }
+
+	// One set per buffer, plus the Hi-Z image if occlusion culling:
+	uint32_t num_sets = 4;
+	if (cull_pass->hiz_image) { num_sets = 5; }
+
+	snprintf(cull_pass->descriptor_pool.name, VKA_MAX_NAME_LENGTH, "%s descriptor pool",
+								cull_pass->name);
+	for (uint32_t i = 0; i < num_sets; i++)
+	{
+		vka_descriptor_set_t *descriptor_set = &(cull_pass->descriptor_sets[i]);
+		snprintf(descriptor_set->name, VKA_MAX_NAME_LENGTH, "%s descriptor set %u",
+								cull_pass->name, i);
+		descriptor_set->pool		= &(cull_pass->descriptor_pool);
+		descriptor_set->binding		= 0;
+		descriptor_set->count		= 1;
+		descriptor_set->type		= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptor_set->stage_flags	= VK_SHADER_STAGE_COMPUTE_BIT;
+		if (i == 4) { descriptor_set->type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER; }
+
+		descriptor_set->data = malloc(sizeof(void *));
+		if (!descriptor_set->data)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for descriptor set \"%s\" data.",
+				descriptor_set->name);
+			return -1;
+		}
+		if (i == 4) { descriptor_set->data[0] = cull_pass->hiz_image; }
+		else { descriptor_set->data[0] = &(cull_pass->buffers[i]); }
+
+		if (vka_create_descriptor_set_layout(vulkan, descriptor_set)) { return -1; }
+	}
+
+	if (vka_create_descriptor_pool(vulkan, &(cull_pass->descriptor_pool))) { return -1; }
+	for (uint32_t i = 0; i < num_sets; i++)
+	{
+		if (vka_allocate_descriptor_set(vulkan, &(cull_pass->descriptor_sets[i]))) { return -1; }
+		if (vka_update_descriptor_set(vulkan, &(cull_pass->descriptor_sets[i]))) { return -1; }
+	}
+
+	vka_pipeline_t *pipeline = &(cull_pass->pipeline);
+	snprintf(pipeline->name, VKA_MAX_NAME_LENGTH, "%s pipeline", cull_pass->name);
+	strcpy(pipeline->shaders[VKA_SHADER_TYPE_COMPUTE].path, cull_pass->shader_path);
+	pipeline->is_compute_pipeline = 1;
+	pipeline->num_descriptor_sets = num_sets;
+	for (uint32_t i = 0; i < num_sets; i++)
+	{
+		pipeline->descriptor_sets[i] = &(cull_pass->descriptor_sets[i]);
+	}
+	pipeline->num_push_constants = 1;
+	pipeline->push_constants[0].stage_flags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline->push_constants[0].size = sizeof(cull_pass->push_constants);
+	pipeline->push_constants[0].data = cull_pass->push_constants;
+
+	if (vka_create_pipeline(vulkan, pipeline)) { return -1; }
+
+	return 0;
+}
+
+void vka_destroy_cull_pass(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass)
+{
+	vka_destroy_pipeline(vulkan, &(cull_pass->pipeline));
+	for (int i = 0; i < 5; i++)
+	{
+		vka_destroy_descriptor_set(vulkan, &(cull_pass->descriptor_sets[i]));
+	}
+	vka_destroy_descriptor_pool(vulkan, &(cull_pass->descriptor_pool));
+
+	for (int i = 0; i < 4; i++) { vka_destroy_buffer(vulkan, &(cull_pass->buffers[i])); }
+	vka_unmap_memory(vulkan, &(cull_pass->host_allocation));
+	vka_destroy_allocation(vulkan, &(cull_pass->host_allocation));
+	vka_destroy_allocation(vulkan, &(cull_pass->device_allocation));
+}
+
+vka_cull_object_t *vka_get_cull_objects(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass)
+{
+	// Objects to cull this frame, up to max_objects of them:
+	uint8_t *data = cull_pass->host_allocation.mapped_data;
+	data += cull_pass->buffers[VKA_CULL_BUFFER_OBJECTS].offset;
+	data += vulkan->current_frame * cull_pass->max_objects * sizeof(vka_cull_object_t);
+
+	return (vka_cull_object_t *)data;
+}
+
+void vka_set_cull_camera(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass,
+					const float view_projection[16])
+{
+	uint8_t *data = cull_pass->host_allocation.mapped_data;
+	data += cull_pass->buffers[VKA_CULL_BUFFER_CAMERAS].offset;
+	vka_cull_camera_t *camera = (vka_cull_camera_t *)data + vulkan->current_frame;
+	memcpy(camera->view_projection, view_projection, sizeof(camera->view_projection));
+
+	// Frustum planes from the rows of the matrix (clip space depth is 0 to w):
+	const float *m = view_projection;
+	for (int i = 0; i < 4; i++)
+	{
+		camera->frustum_planes[0][i] = m[(i * 4) + 3] + m[i * 4];	// Left.
+		camera->frustum_planes[1][i] = m[(i * 4) + 3] - m[i * 4];	// Right.
+		camera->frustum_planes[2][i] = m[(i * 4) + 3] + m[(i * 4) + 1];	// Bottom.
+		camera->frustum_planes[3][i] = m[(i * 4) + 3] - m[(i * 4) + 1];	// Top.
+		camera->frustum_planes[4][i] = m[(i * 4) + 2];			// Near.
+		camera->frustum_planes[5][i] = m[(i * 4) + 3] - m[(i * 4) + 2];	// Far.
+	}
+
+	// Normalise so distances to the planes can be compared with radii:
+	for (int i = 0; i < 6; i++)
+	{
+		float *plane = camera->frustum_planes[i];
+		float length = sqrtf((plane[0] * plane[0]) + (plane[1] * plane[1]) +
+							(plane[2] * plane[2]));
+		if (length > 0.f)
+		{
+			for (int j = 0; j < 4; j++) { plane[j] /= length; }
+		}
+	}
+
+	camera->hiz_size[0] = 0.f;
+	camera->hiz_size[1] = 0.f;
+	camera->hiz_mip_levels = 0;
+	if (cull_pass->hiz_image)
+	{
+		camera->hiz_size[0] = (float)(cull_pass->hiz_image->width);
+		camera->hiz_size[1] = (float)(cull_pass->hiz_image->height);
+		camera->hiz_mip_levels = cull_pass->hiz_image->mip_levels;
+	}
+}
+
+void vka_cull(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+			vka_cull_pass_t *cull_pass, uint32_t num_objects)
+{
+	/* Culls this frame's objects against this frame's camera. Record outside rendering,
+	 * then draw with vka_draw_culled() - barriers are handled here. Must be recorded on the
+	 * graphics queue (not compute_command_buffers with use_async_compute): the draw commands
+	 * and count are shared by every frame, and only same-queue submission order keeps the
+	 * next frame's cull from overwriting them while the last frame's draws read them. */
+	SDL_assert(!command_buffer->queue ||
+		(*(command_buffer->queue) == vulkan->graphics_queue));
+	if (num_objects > cull_pass->max_objects) { num_objects = cull_pass->max_objects; }
+
+	vka_buffer_t *draw_commands = &(cull_pass->buffers[VKA_CULL_BUFFER_DRAW_COMMANDS]);
+	vka_buffer_t *draw_count = &(cull_pass->buffers[VKA_CULL_BUFFER_DRAW_COUNT]);
+
+	// Wait for the last frame's indirect draws before resetting the count:
+	vka_begin_label(command_buffer, cull_pass->name, NULL);
+	vka_barrier_info_t barrier_info;
+	memset(&barrier_info, 0, sizeof(barrier_info));
+	barrier_info.resource		= draw_count;
+	barrier_info.src_access_mask	= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vka_buffer_barrier(command_buffer, &barrier_info);
+
+	vka_copy_info_t copy_info;
+	memset(&copy_info, 0, sizeof(copy_info));
+	copy_info.destination = draw_count;
+	copy_info.data = 0;
+	vka_fill_buffer(command_buffer, &copy_info);
+
+	barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	vka_buffer_barrier(command_buffer, &barrier_info);
+
+	barrier_info.resource		= draw_commands;
+	barrier_info.src_access_mask	= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	vka_buffer_barrier(command_buffer, &barrier_info);
+
+	cull_pass->push_constants[0] = vulkan->current_frame * cull_pass->max_objects;
+	cull_pass->push_constants[1] = num_objects;
+	cull_pass->push_constants[2] = vulkan->current_frame;
+
+	vka_bind_pipeline(command_buffer, &(cull_pass->pipeline));
+	vka_bind_descriptor_sets(command_buffer, &(cull_pass->pipeline));
+	vka_push_constants(command_buffer, &(cull_pass->pipeline));
+	vka_dispatch_size(vulkan, command_buffer, &(cull_pass->pipeline), num_objects, 1, 1);
+
+	// Make the results visible to indirect draws:
+	barrier_info.src_access_mask	= VK_ACCESS_SHADER_WRITE_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+	vka_buffer_barrier(command_buffer, &barrier_info);
+
+	barrier_info.resource		= draw_count;
+	barrier_info.src_access_mask	= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vka_buffer_barrier(command_buffer, &barrier_info);
+	vka_end_label(command_buffer);
+}
+
+void vka_draw_culled(vka_command_buffer_t *command_buffer, vka_cull_pass_t *cull_pass)
+{
+	// Expects the pipeline, descriptor sets and buffers for the culled objects bound already.
+	vka_draw_indexed_indirect_count(command_buffer,
+		&(cull_pass->buffers[VKA_CULL_BUFFER_DRAW_COMMANDS]), 0,
+		&(cull_pass->buffers[VKA_CULL_BUFFER_DRAW_COUNT]), 0, cull_pass->max_objects, 0);
+}
+
+/***********
+ * Queries *
+ ***********/
+
+int vka_create_query_pool(vka_vulkan_t *vulkan, vka_query_pool_t *query_pool)
+{
+	vka_destroy_query_pool(vulkan, query_pool);
+
+	if (!query_pool->max_queries)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Query pool \"%s\" has a query count of 0.", query_pool->name);
+		return -1;
+	}
+
+	if (query_pool->type == VK_QUERY_TYPE_PIPELINE_STATISTICS)
+	{
+		if (!vulkan->use_pipeline_statistics || !query_pool->statistics)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Query pool \"%s\" needs use_pipeline_statistics and statistics.",
+				query_pool->name);
+			return -1;
+		}
+
+		// One value per statistic:
+		query_pool->num_values = 0;
+		for (uint32_t i = 0; i < 32; i++)
+		{
+			if (query_pool->statistics & (1U << i)) { query_pool->num_values++; }
+		}
+	}
+	else if (query_pool->type == VK_QUERY_TYPE_OCCLUSION)
+	{
+		if (query_pool->precise && !vulkan->use_precise_occlusion)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Query pool \"%s\" needs use_precise_occlusion.", query_pool->name);
+			return -1;
+		}
+		query_pool->num_values = 1;
+	}
+	else
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Unsupported query type for query pool \"%s\".", query_pool->name);
+		return -1;
+	}
+
+	VkQueryPoolCreateInfo pool_info;
+	memset(&pool_info, 0, sizeof(pool_info));
+	pool_info.sType			= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.pNext			= NULL;
+	pool_info.flags			= 0;
+	pool_info.queryType		= query_pool->type;
+	pool_info.queryCount		= query_pool->max_queries * VKA_MAX_FRAMES_IN_FLIGHT;
+	pool_info.pipelineStatistics	= 0;
+	if (query_pool->type == VK_QUERY_TYPE_PIPELINE_STATISTICS)
+	{
+		pool_info.pipelineStatistics = query_pool->statistics;
+	}
+
+	if (vkCreateQueryPool(vulkan->device, &pool_info, NULL, &(query_pool->pool)) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create query pool \"%s\".", query_pool->name);
+		return -1;
+	}
+	vka_set_object_name(vulkan, VK_OBJECT_TYPE_QUERY_POOL, (uint64_t)(query_pool->pool),
+								query_pool->name);
+
+	size_t num_results = (size_t)(query_pool->max_queries) * query_pool->num_values;
+	query_pool->readback = malloc((num_results + query_pool->max_queries) * sizeof(uint64_t));
+	query_pool->results = malloc(num_results * sizeof(uint64_t));
+	query_pool->result_frames = malloc(query_pool->max_queries * sizeof(uint64_t));
+	if (!query_pool->readback || !query_pool->results || !query_pool->result_frames)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for query pool \"%s\" results.",
+			query_pool->name);
+		return -1;
+	}
+	memset(query_pool->results, 0, num_results * sizeof(uint64_t));
+	memset(query_pool->result_frames, 0, query_pool->max_queries * sizeof(uint64_t));
+	memset(query_pool->pending, 0, sizeof(query_pool->pending));
+	memset(query_pool->num_used, 0, sizeof(query_pool->num_used));
+	query_pool->frame = 0;
+
+	return 0;
+}
+
+void vka_destroy_query_pool(vka_vulkan_t *vulkan, vka_query_pool_t *query_pool)
+{
+	if (query_pool->pool)
+	{
+		vkDestroyQueryPool(vulkan->device, query_pool->pool, NULL);
+		query_pool->pool = VK_NULL_HANDLE;
+	}
+
+	if (query_pool->readback) { free(query_pool->readback); }
+	if (query_pool->results) { free(query_pool->results); }
+	if (query_pool->result_frames) { free(query_pool->result_frames); }
+	query_pool->readback = NULL;
+	query_pool->results = NULL;
+	query_pool->result_frames = NULL;
+}
+
+void vka_update_query_pool(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							vka_query_pool_t *query_pool)
+{
+	/* Call once per frame, outside rendering and before the frame's queries. Reads back the
+	 * results this frame in flight wrote last time round (its fence has already been waited
+	 * on), without waiting for any still in flight, then resets its queries. */
+	uint32_t frame = vulkan->current_frame;
+	uint32_t first_query = frame * query_pool->max_queries;
+	query_pool->frame++;
+
+	if (query_pool->pending[frame] && query_pool->num_used[frame])
+	{
+		uint32_t stride = query_pool->num_values + 1;
+		VkResult result = vkGetQueryPoolResults(vulkan->device, query_pool->pool,
+			first_query, query_pool->num_used[frame],
+			query_pool->num_used[frame] * stride * sizeof(uint64_t),
+			query_pool->readback, stride * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+		if ((result == VK_SUCCESS) || (result == VK_NOT_READY))
+		{
+			for (uint32_t i = 0; i < query_pool->num_used[frame]; i++)
+			{
+				uint64_t *values = &(query_pool->readback[i * stride]);
+				if (!values[query_pool->num_values]) { continue; }
+
+				memcpy(&(query_pool->results[i * query_pool->num_values]), values,
+						query_pool->num_values * sizeof(uint64_t));
+				query_pool->result_frames[i] = query_pool->frame;
+			}
+		}
+	}
+
+	vkCmdResetQueryPool(command_buffer->buffer, query_pool->pool, first_query,
+						query_pool->max_queries);
+	query_pool->pending[frame] = 1;
+	query_pool->num_used[frame] = 0;
+}
+
+void vka_begin_query(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_query_pool_t *query_pool, uint32_t query)
+{
+	// Query indices are chosen by the caller (e.g. an object index), below max_queries:
+	uint32_t frame = vulkan->current_frame;
+	if (query >= query_pool->max_queries) { return; }
+
+	VkQueryControlFlags flags = 0;
+	if (query_pool->precise) { flags = VK_QUERY_CONTROL_PRECISE_BIT; }
+
+	vkCmdBeginQuery(command_buffer->buffer, query_pool->pool,
+			(frame * query_pool->max_queries) + query, flags);
+	if (query >= query_pool->num_used[frame]) { query_pool->num_used[frame] = query + 1; }
+}
+
+void vka_end_query(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_query_pool_t *query_pool, uint32_t query)
+{
+	if (query >= query_pool->max_queries) { return; }
+	vkCmdEndQuery(command_buffer->buffer, query_pool->pool,
+			(vulkan->current_frame * query_pool->max_queries) + query);
+}
+
+const uint64_t *vka_get_query_result(vka_query_pool_t *query_pool, uint32_t query)
+{
+	/* Latest results for a query (num_values of them, in statistic bit order), or NULL if
+	 * there are none yet. Check result_frames against frame for how old they are. */
+	if (query >= query_pool->max_queries) { return NULL; }
+	if (!query_pool->result_frames[query]) { return NULL; }
+	return &(query_pool->results[query * query_pool->num_values]);
+}
+
+/**********
+ * Memory *
+ **********/
+
+int vka_create_allocation(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+{
+	// TODO - check if allocation size exceeds max allocation size? Some implementations
+	// allow allocation larger than the limit anyway so might not be desirable.
+	if (!allocation->requirements.size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Trying to allocate memory of size 0 for \"%s\".", allocation->name);
+		return -1;
+	}
+
+	if (!allocation->properties[0])
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Trying to allocate memory with no first choice of properties for \"%s\".",
+			allocation->name);
+		return -1;
+	}
+
+	VkPhysicalDeviceMemoryProperties device_properties;
+	vkGetPhysicalDeviceMemoryProperties(vulkan->physical_device, &device_properties);
+	int found_type[2] = {0};
+	uint32_t type_index[2];
+	uint32_t heap_index[2];
+	for (uint32_t i = 0; i < device_properties.memoryTypeCount; i++)
+	{
+		if (allocation->requirements.memoryTypeBits & (1 << i))
+		{
+			for (int j = 0; j < 2; j++)
+			{
+				if (!found_type[j] && allocation->properties[j] &&
+					((device_properties.memoryTypes[i].propertyFlags &
+					allocation->properties[j]) == allocation->properties[j]))
+				{
+					type_index[j] = i;
+					heap_index[j] = device_properties.memoryTypes[i].heapIndex;
+					found_type[j] = 1;
+				}
+			}
+		}
+		if (found_type[0] && found_type[1]) { break; }
+	}
+
+	if (!found_type[0] && !found_type[1])
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not find suitable memory type for \"%s\".", allocation->name);
+		return -1;
+	}
+
+	// Try allocating memory for first choice, then second (if applicable):
+	VkMemoryAllocateInfo allocate_info;
+	memset(&allocate_info, 0, sizeof(allocate_info));
+	allocate_info.sType		= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocate_info.pNext		= NULL;
+	allocate_info.allocationSize	= allocation->requirements.size;
+	for (int i = 0; i < 2; i++)
+	{
+		if (!found_type[i]) { continue; }
+
+		// Query heap usage:
+		VkDeviceSize memory_available;
+		if (vulkan->memory_budget_enabled)
+		{
+			// TODO
+			memory_available = (vulkan->heap_sizes[heap_index[i]] *
+				VKA_HEAP_THRESHOLD) - vulkan->heap_usage[heap_index[i]];
+		}
+		else
+		{
+			memory_available = (vulkan->heap_sizes[heap_index[i]] *
+				VKA_HEAP_THRESHOLD) - vulkan->heap_usage[heap_index[i]];
+		}
+
+		// Allocate memory:
+		if (allocation->requirements.size <= memory_available)
+		{
+			allocate_info.memoryTypeIndex = type_index[i];
+			if (vkAllocateMemory(vulkan->device, &allocate_info, NULL,
+					&(allocation->memory)) == VK_SUCCESS)
+			{
+				allocation->heap_index = heap_index[i];
+				vulkan->heap_usage[heap_index[i]] += allocation->requirements.size;
+				vka_set_object_name(vulkan, VK_OBJECT_TYPE_DEVICE_MEMORY,
+					(uint64_t)(allocation->memory), allocation->name);
+				VKA_COUNT(vulkan->counters, num_memory_allocations, 1);
+				VKA_COUNT(vulkan->counters, bytes_allocated,
+						allocation->requirements.size);
+				return 0;
+			}
+		}
+	}
+
+	snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+		"Could not allocate memory for \"%s\".", allocation->name);
+	return -1;
+}
+
+void vka_destroy_allocation(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+{
+	if (allocation->mapped_data) { vka_unmap_memory(vulkan, allocation); }
+
+	if (allocation->memory)
+	{
+		vkFreeMemory(vulkan->device, allocation->memory, NULL);
+		allocation->memory = VK_NULL_HANDLE;
+
+		vulkan->heap_usage[allocation->heap_index] -= allocation->requirements.size;
+		allocation->heap_index = 0;
+	}
+
+	memset(&(allocation->requirements), 0, sizeof(allocation->requirements));
+}
+
+int vka_map_memory(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+{
+	VkDeviceSize map_size = allocation->map_size;
+	if (!map_size) { map_size = VK_WHOLE_SIZE; }
+
+	if (vkMapMemory(vulkan->device, allocation->memory, allocation->map_offset,
+			map_size, 0, &(allocation->mapped_data)) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not map memory for \"%s\".", allocation->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+void vka_unmap_memory(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+{
+	if (allocation->mapped_data)
+	{
+		vkUnmapMemory(vulkan->device, allocation->memory);
+		allocation->mapped_data = NULL;
+	}
+}
+
+/********
+ * Misc *
+ ********/
+
+void vka_device_wait_idle(vka_vulkan_t *vulkan)
+{
+	if (vulkan->device) { vkDeviceWaitIdle(vulkan->device); }
+}
+
+void vka_next_frame(vka_vulkan_t *vulkan)
+{
+	vulkan->current_frame = (vulkan->current_frame + 1) % VKA_MAX_FRAMES_IN_FLIGHT;
+
+	vka_update_pipeline_links(vulkan);
+
+	#ifdef VKA_SHADER_WATCHER
+	vka_shader_watcher_update(vulkan);
+	#endif
+
+	for (uint32_t i = 0; i < vulkan->num_retired_objects; i++)
+	{
+		if (vulkan->retired_objects[i].frames_remaining)
+		{
+			vulkan->retired_objects[i].frames_remaining--;
+		}
+	}
+	if (vulkan->num_retired_objects) { vka_destroy_retired_objects(vulkan, 0); }
+
+	for (uint32_t i = 0; i < vulkan->num_retired_ranges; i++)
+	{
+		if (vulkan->retired_ranges[i].frames_remaining)
+		{
+			vulkan->retired_ranges[i].frames_remaining--;
+		}
+	}
+	if (vulkan->num_retired_ranges) { vka_release_retired_ranges(vulkan); }
+}
+
+int vka_get_next_swapchain_image(vka_vulkan_t *vulkan)
+{
+	VKA_TRACE_BEGIN(vulkan, trace_start);
+	VkResult error = vkAcquireNextImageKHR(vulkan->device, vulkan->swapchain, UINT64_MAX,
+		vulkan->image_available[vulkan->current_frame], VK_NULL_HANDLE,
+		&(vulkan->current_swapchain_index));
+	VKA_TRACE_END(vulkan, "vka_get_next_swapchain_image", trace_start);
+
+	if (error != VK_SUCCESS)
+	{
+		if ((error == VK_SUBOPTIMAL_KHR) || (error == VK_ERROR_OUT_OF_DATE_KHR))
+		{
+			vulkan->recreate_swapchain = 1;
+		}
+		else
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not acquire next swapchain image.");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+uint64_t vka_hash(const void *data, size_t size, uint64_t hash)
+{
+	// FNV-1a. Pass VKA_HASH_SEED to start a new hash, or a previous hash to continue it.
+	const uint8_t *bytes = (const uint8_t *)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+int vka_map_file(vka_vulkan_t *vulkan, const char *path, void **data, size_t *size)
+{
+	// Maps a whole file read-only. Falls back on reading it into memory where mmap is missing.
+	*data = NULL;
+	*size = 0;
+
+	#ifndef _WIN32
+	int file = open(path, O_RDONLY);
+	if (file == -1)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not open file \"%s\".", path);
+		return -1;
+	}
+
+	struct stat file_info;
+	if (fstat(file, &file_info))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not get size of file \"%s\".", path);
+		close(file);
+		return -1;
+	}
+
+	*size = file_info.st_size;
+	if (!(*size))
+	{
+		close(file);
+		return 0;
+	}
+
+	void *mapped_data = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (mapped_data == MAP_FAILED)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not map file \"%s\".", path);
+		*size = 0;
+		return -1;
+	}
+	*data = mapped_data;
+	#else
+	FILE *file = fopen(path, "rb");
+	if (!file)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not open file \"%s\".", path);
+		return -1;
+	}
+
+	long file_size = -1;
+	if (!fseek(file, 0, SEEK_END)) { file_size = ftell(file); }
+	if (file_size == -1)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not get size of file \"%s\".", path);
+		fclose(file);
+		return -1;
+	}
+	rewind(file);
+
+	*size = file_size;
+	if (!(*size))
+	{
+		fclose(file);
+		return 0;
+	}
+
+	*data = malloc(*size);
+	if (!(*data))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for file \"%s\".", path);
+		*size = 0;
+		fclose(file);
+		return -1;
+	}
+
+	if (fread(*data, 1, *size, file) != *size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not read file \"%s\".", path);
+		free(*data);
+		*data = NULL;
+		*size = 0;
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	#endif
+
+	return 0;
+}
+
+void vka_unmap_file(void *data, size_t size)
+{
+	if (!data) { return; }
+
+	#ifndef _WIN32
+	munmap(data, size);
+	#else
+	(void)size;
+	free(data);
+	#endif
+}
+
+int vka_reserve_retired_objects(vka_vulkan_t *vulkan, uint32_t num_objects)
+{
+	// Makes room for num_objects more, so that retiring them afterwards can't fail:
+	uint32_t num_needed = vulkan->num_retired_objects + num_objects;
+	if (num_needed <= vulkan->max_retired_objects) { return 0; }
+
+	uint32_t max_retired_objects = 2 * vulkan->max_retired_objects;
+	if (max_retired_objects < 16) { max_retired_objects = 16; }
+	while (max_retired_objects < num_needed) { max_retired_objects *= 2; }
+
+	vka_retired_object_t *retired_objects = realloc(vulkan->retired_objects,
+				max_retired_objects * sizeof(vka_retired_object_t));
+	if (!retired_objects)
+	{
+		// Fall back on draining the device and destroying everything now:
+		vka_device_wait_idle(vulkan);
+		vka_destroy_retired_objects(vulkan, 1);
+		if (num_objects > vulkan->max_retired_objects)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory for retired objects.");
+			return -1;
+		}
+		return 0;
+	}
+	vulkan->retired_objects = retired_objects;
+	vulkan->max_retired_objects = max_retired_objects;
+
+	return 0;
+}
+
+int vka_retire_object(vka_vulkan_t *vulkan, VkObjectType type, uint64_t handle)
+{
+	/* Defers destruction of an object until every frame that might be using it has finished.
+	 * One frame more than the number in flight, in case the object was retired after the
+	 * current frame was submitted. */
+	if (vka_reserve_retired_objects(vulkan, 1)) { return -1; }
+
+	vka_retired_object_t *retired = &(vulkan->retired_objects[vulkan->num_retired_objects]);
+	retired->type = type;
+	retired->handle = handle;
+	retired->frames_remaining = VKA_MAX_FRAMES_IN_FLIGHT + 1;
+	vulkan->num_retired_objects++;
+
+	return 0;
+}
+
+void vka_destroy_retired_objects(vka_vulkan_t *vulkan, int force)
+{
+	// If force is set, caller must make sure the device is idle.
+	uint32_t num_kept = 0;
+	for (uint32_t i = 0; i < vulkan->num_retired_objects; i++)
+	{
+		vka_retired_object_t *retired = &(vulkan->retired_objects[i]);
+		if (!force && retired->frames_remaining)
+		{
+			vulkan->retired_objects[num_kept] = *retired;
+			num_kept++;
+			continue;
+		}
+
+		if (retired->type == VK_OBJECT_TYPE_SWAPCHAIN_KHR)
+		{
+			vkDestroySwapchainKHR(vulkan->device, (VkSwapchainKHR)(retired->handle), NULL);
+		}
+		else if (retired->type == VK_OBJECT_TYPE_IMAGE_VIEW)
+		{
+			vkDestroyImageView(vulkan->device, (VkImageView)(retired->handle), NULL);
+		}
+		else if (retired->type == VK_OBJECT_TYPE_IMAGE)
+		{
+			vkDestroyImage(vulkan->device, (VkImage)(retired->handle), NULL);
+		}
+		else if (retired->type == VK_OBJECT_TYPE_BUFFER)
+		{
+			vkDestroyBuffer(vulkan->device, (VkBuffer)(retired->handle), NULL);
+		}
+		else if (retired->type == VK_OBJECT_TYPE_DEVICE_MEMORY)
+		{
+			vkFreeMemory(vulkan->device, (VkDeviceMemory)(retired->handle), NULL);
+		}
+		else if (retired->type == VK_OBJECT_TYPE_PIPELINE)
+		{
+			vkDestroyPipeline(vulkan->device, (VkPipeline)(retired->handle), NULL);
+		}
+	}
+	vulkan->num_retired_objects = num_kept;
+}
+
+void vka_push_constants(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
+{
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if (bound_state->push_constant_layout != pipeline->layout)
+	{
+		memset(bound_state->push_constant_sizes, 0, sizeof(bound_state->push_constant_sizes));
+		bound_state->push_constant_layout = pipeline->layout;
+	}
+
+	// Push constants all start at offset 0, so if any of them has changed, push them all:
+	int pushed = 1;
+	for (uint32_t i = 0; i < pipeline->num_push_constants; i++)
+	{
+		vka_push_constant_t *push_constant = &(pipeline->push_constants[i]);
+		if ((push_constant->size != bound_state->push_constant_sizes[i]) ||
+			(push_constant->stage_flags != bound_state->push_constant_stages[i]) ||
+			memcmp(push_constant->data, bound_state->push_constant_data[i],
+							push_constant->size))
+		{
+			pushed = 0;
+			break;
+		}
+	}
+
+	if (pushed)
+	{
+		command_buffer->num_elided_push_constants += pipeline->num_push_constants;
+		return;
+	}
+
+	for (uint32_t i = 0; i < pipeline->num_push_constants; i++)
+	{
+		vka_push_constant_t *push_constant = &(pipeline->push_constants[i]);
+		vkCmdPushConstants(command_buffer->buffer, pipeline->layout,
+			push_constant->stage_flags, 0, push_constant->size, push_constant->data);
+		VKA_COUNT(command_buffer->counters, num_push_constants, 1);
+
+		// Too big to shadow, so always gets pushed:
+		if (push_constant->size > VKA_MAX_PUSH_CONSTANT_SIZE)
+		{
+			bound_state->push_constant_sizes[i] = 0;
+			continue;
+		}
+		memcpy(bound_state->push_constant_data[i], push_constant->data, push_constant->size);
+		bound_state->push_constant_stages[i] = push_constant->stage_flags;
+		bound_state->push_constant_sizes[i] = push_constant->size;
+	}
+}
+
+void vka_push_constant_data(vka_command_buffer_t *command_buffer, VkPipelineLayout layout,
+			VkShaderStageFlags stage_flags, uint32_t size, const void *data)
+{
+	// One range at offset 0, outside of a pipeline's push constants, through the same shadow:
+	vka_bound_state_t *bound_state = &(command_buffer->bound_state);
+	if ((bound_state->push_constant_layout == layout) &&
+		(bound_state->push_constant_stages[0] == stage_flags) &&
+		(bound_state->push_constant_sizes[0] == size) &&
+		!memcmp(bound_state->push_constant_data[0], data, size))
+	{
+		command_buffer->num_elided_push_constants++;
+		return;
+	}
+
+	vkCmdPushConstants(command_buffer->buffer, layout, stage_flags, 0, size, data);
+	VKA_COUNT(command_buffer->counters, num_push_constants, 1);
+
+	// Any other ranges may have been overwritten, and too big to shadow always gets pushed:
+	bound_state->push_constant_layout = layout;
+	memset(bound_state->push_constant_sizes, 0, sizeof(bound_state->push_constant_sizes));
+	if (size > VKA_MAX_PUSH_CONSTANT_SIZE) { return; }
+	bound_state->push_constant_stages[0] = stage_flags;
+	bound_state->push_constant_sizes[0] = size;
+	memcpy(bound_state->push_constant_data[0], data, size);
+}
+
+void vka_set_object_name(vka_vulkan_t *vulkan, VkObjectType type, uint64_t handle,
+							const char *name)
+{
+	// Shows up in validation messages and capture tools. Does nothing without VKA_DEBUG.
+	#ifdef VKA_DEBUG
+	if (!handle || !name || !strcmp(name, "")) { return; }
+
+	VkDebugUtilsObjectNameInfoEXT name_info;
+	memset(&name_info, 0, sizeof(name_info));
+	name_info.sType		= VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	name_info.pNext		= NULL;
+	name_info.objectType	= type;
+	name_info.objectHandle	= handle;
+	name_info.pObjectName	= name;
+	vkSetDebugUtilsObjectNameEXT(vulkan->device, &name_info);
+	#else
+	(void)vulkan;
+	(void)type;
+	(void)handle;
+	(void)name;
+	#endif
+}
+
+void vka_begin_label(vka_command_buffer_t *command_buffer, const char *name,
+						const float colour[4])
+{
+	// Opens a labelled region for capture tools (colour can be NULL). Needs VKA_DEBUG.
+	#ifdef VKA_DEBUG
+	VkDebugUtilsLabelEXT label;
+	memset(&label, 0, sizeof(label));
+	label.sType		= VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pNext		= NULL;
+	label.pLabelName	= name;
+	if (colour) { memcpy(label.color, colour, 4 * sizeof(float)); }
+	vkCmdBeginDebugUtilsLabelEXT(command_buffer->buffer, &label);
+	#else
+	(void)command_buffer;
+	(void)name;
+	(void)colour;
+	#endif
+}
+
+void vka_end_label(vka_command_buffer_t *command_buffer)
+{
+	#ifdef VKA_DEBUG
+	vkCmdEndDebugUtilsLabelEXT(command_buffer->buffer);
+	#else
+	(void)command_buffer;
+	#endif
+}
+
+void vka_insert_label(vka_command_buffer_t *command_buffer, const char *name,
+						const float colour[4])
+{
+	#ifdef VKA_DEBUG
+	VkDebugUtilsLabelEXT label;
+	memset(&label, 0, sizeof(label));
+	label.sType		= VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pNext		= NULL;
+	label.pLabelName	= name;
+	if (colour) { memcpy(label.color, colour, 4 * sizeof(float)); }
+	vkCmdInsertDebugUtilsLabelEXT(command_buffer->buffer, &label);
+	#else
+	(void)command_buffer;
+	(void)name;
+	(void)colour;
+	#endif
+}
+
+#ifdef VKA_NUKLEAR
+int vka_nuklear_set_up(vka_vulkan_t *vulkan)
+{
+	if (!nk_init_default(&(vulkan->nuklear_context), NULL))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not initialise Nuklear context.");
+		return -1;
+	}
+	vulkan->nuklear_context.clip.copy = vka_nuklear_clipboard_copy;
+	vulkan->nuklear_context.clip.paste = vka_nuklear_clipboard_paste;
+	vulkan->nuklear_context.clip.userdata = nk_handle_ptr(NULL);
+	nk_buffer_init_default(&(vulkan->nuklear_commands));
+	nk_buffer_init_default(&(vulkan->nuklear_vertices));
+	nk_buffer_init_default(&(vulkan->nuklear_indices));
+	vulkan->nuklear_hash = 0;
+	memset(vulkan->nuklear_buffer_hashes, 0, sizeof(vulkan->nuklear_buffer_hashes));
+
+	strcpy(vulkan->nuklear_allocation.name, "Nuklear allocation");
+	vulkan->nuklear_allocation.properties[0] = VKA_MEMORY_HOST;
+	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		// Index buffer:
+		snprintf(vulkan->nuklear_buffers[i * 2].name, VKA_MAX_NAME_LENGTH,
+						"Nuklear index buffer %d\n", i);
+		vulkan->nuklear_buffers[i * 2].allocation	= &(vulkan->nuklear_allocation);
+		vulkan->nuklear_buffers[i * 2].usage		= VKA_BUFFER_USAGE_INDEX;
+		vulkan->nuklear_buffers[i * 2].index_type	= VK_INDEX_TYPE_UINT16;
+		vulkan->nuklear_buffers[i * 2].size		= VKA_NUKLEAR_MAX_INDEX_BUFFER;
+
+		// Vertex buffer:
+		snprintf(vulkan->nuklear_buffers[(i * 2) + 1].name, VKA_MAX_NAME_LENGTH,
+						"Nuklear vertex buffer %d\n", i);
+		vulkan->nuklear_buffers[(i * 2) + 1].allocation	= &(vulkan->nuklear_allocation);
+		vulkan->nuklear_buffers[(i * 2) + 1].usage	= VKA_BUFFER_USAGE_VERTEX;
+		vulkan->nuklear_buffers[(i * 2) + 1].size	= VKA_NUKLEAR_MAX_VERTEX_BUFFER;
+	}
+
+	uint32_t num_buffers = 2 * VKA_MAX_FRAMES_IN_FLIGHT;
+	if (vka_set_up_buffers(vulkan, num_buffers, vulkan->nuklear_buffers)) { return -1; }
+	if (vka_map_memory(vulkan, &(vulkan->nuklear_allocation))) { return -1; }
+
+	return 0;
+}
+
+void vka_nuklear_shut_down(vka_vulkan_t *vulkan)
+{
+	for (int i = 0; i < (2 * VKA_MAX_FRAMES_IN_FLIGHT); i++)
+	{
+		vka_destroy_buffer(vulkan, &(vulkan->nuklear_buffers[i]));
+	}
+	vka_unmap_memory(vulkan, &(vulkan->nuklear_allocation));
+	vka_destroy_allocation(vulkan, &(vulkan->nuklear_allocation));
+
+	nk_free(&(vulkan->nuklear_context));
+	nk_buffer_free(&(vulkan->nuklear_commands));
+	nk_buffer_free(&(vulkan->nuklear_vertices));
+	nk_buffer_free(&(vulkan->nuklear_indices));
+	vka_nuklear_destroy_font_atlas(vulkan);
+}
+
+int vka_nuklear_resize_buffers(vka_vulkan_t *vulkan, VkDeviceSize index_buffer_size,
+						VkDeviceSize vertex_buffer_size)
+{
+	// Replaces every frame's buffers, retiring the old ones:
+	uint32_t num_buffers = 2 * VKA_MAX_FRAMES_IN_FLIGHT;
+	if (vka_reserve_retired_objects(vulkan, num_buffers + 1)) { return -1; }
+
+	vka_allocation_t old_allocation = vulkan->nuklear_allocation;
+	vka_buffer_t old_buffers[2 * VKA_MAX_FRAMES_IN_FLIGHT];
+	memcpy(old_buffers, vulkan->nuklear_buffers, sizeof(old_buffers));
+
+	vulkan->nuklear_allocation.memory = VK_NULL_HANDLE;
+	vulkan->nuklear_allocation.mapped_data = NULL;
+	memset(&(vulkan->nuklear_allocation.requirements), 0,
+		sizeof(vulkan->nuklear_allocation.requirements));
+	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		vulkan->nuklear_buffers[i * 2].buffer = VK_NULL_HANDLE;
+		vulkan->nuklear_buffers[i * 2].size = index_buffer_size;
+		vulkan->nuklear_buffers[(i * 2) + 1].buffer = VK_NULL_HANDLE;
+		vulkan->nuklear_buffers[(i * 2) + 1].size = vertex_buffer_size;
+	}
+
+	if (vka_set_up_buffers(vulkan, num_buffers, vulkan->nuklear_buffers) ||
+		vka_map_memory(vulkan, &(vulkan->nuklear_allocation)))
+	{
+		for (uint32_t i = 0; i < num_buffers; i++)
+		{
+			vka_destroy_buffer(vulkan, &(vulkan->nuklear_buffers[i]));
+		}
+		vka_destroy_allocation(vulkan, &(vulkan->nuklear_allocation));
+		vulkan->nuklear_allocation = old_allocation;
+		memcpy(vulkan->nuklear_buffers, old_buffers, sizeof(old_buffers));
+		return -1;
+	}
+
+	// Old buffers may still be in use by frames in flight (room was reserved, so can't fail):
+	for (uint32_t i = 0; i < num_buffers; i++)
+	{
+		vka_retire_object(vulkan, VK_OBJECT_TYPE_BUFFER, (uint64_t)(old_buffers[i].buffer));
+	}
+	vka_retire_object(vulkan, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t)(old_allocation.memory));
+	vulkan->heap_usage[old_allocation.heap_index] -= old_allocation.requirements.size;
+	memset(vulkan->nuklear_buffer_hashes, 0, sizeof(vulkan->nuklear_buffer_hashes));
+
+	return 0;
+}
+
+int vka_nuklear_draw(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+				vka_render_info_t *render_info)
+{
+	/* Expects descriptor sets and pipeline bound already. Texture handles (nk_handle.id) are
+	 * indices into an array of image samplers, pushed as a uint32_t at offset 0 if the
+	 * pipeline has push constants. Each command is scissored to its clip rectangle. */
+	vka_command_buffer_t *command_buffer = &(vulkan->command_buffers[vulkan->current_frame]);
+	struct nk_convert_config convert_config = {0};
+	static const struct nk_draw_vertex_layout_element vertex_layout[] =
+	{
+		{NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(vka_nuklear_vertex_t, position)},
+		{NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(vka_nuklear_vertex_t, colour)},
+		{NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(vka_nuklear_vertex_t, uv)},
+		{NK_VERTEX_LAYOUT_END}
+	};
+	convert_config.vertex_layout = vertex_layout;
+	convert_config.vertex_size = sizeof(vka_nuklear_vertex_t);
+	convert_config.vertex_alignment = NK_ALIGNOF(vka_nuklear_vertex_t);
+	convert_config.tex_null = vulkan->nuklear_null_texture;
+	convert_config.circle_segment_count = 22;
+	convert_config.curve_segment_count = 22;
+	convert_config.arc_segment_count = 22;
+	convert_config.global_alpha = 1.0;
+	convert_config.shape_AA = NK_ANTI_ALIASING_ON;
+	convert_config.line_AA = NK_ANTI_ALIASING_ON;
+
+	// Only convert if the Nuklear commands have changed since the last conversion:
+	struct nk_context *context = &(vulkan->nuklear_context);
+	uint64_t hash = vka_hash(nk_buffer_memory_const(&(context->memory)),
+				context->memory.allocated, VKA_HASH_SEED);
+	hash = vka_hash(&(vulkan->nuklear_null_texture), sizeof(struct nk_draw_null_texture), hash);
+	if (hash != vulkan->nuklear_hash)
+	{
+		nk_buffer_clear(&(vulkan->nuklear_commands));
+		nk_buffer_clear(&(vulkan->nuklear_vertices));
+		nk_buffer_clear(&(vulkan->nuklear_indices));
+		if (nk_convert(context, &(vulkan->nuklear_commands), &(vulkan->nuklear_vertices),
+			&(vulkan->nuklear_indices), &convert_config) != NK_CONVERT_SUCCESS)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not convert Nuklear commands.");
+			vulkan->nuklear_hash = 0;
+			nk_clear(context);
+			return -1;
+		}
+		vulkan->nuklear_hash = hash;
+	}
+
+	// Grow the buffers if the geometry doesn't fit:
+	vka_buffer_t *index_buffer = &(vulkan->nuklear_buffers[vulkan->current_frame * 2]);
+	vka_buffer_t *vertex_buffer = &(vulkan->nuklear_buffers[(vulkan->current_frame * 2) + 1]);
+	VkDeviceSize index_size = vulkan->nuklear_indices.allocated;
+	VkDeviceSize vertex_size = vulkan->nuklear_vertices.allocated;
+	if ((index_size > index_buffer->size) || (vertex_size > vertex_buffer->size))
+	{
+		VkDeviceSize index_buffer_size = index_buffer->size;
+		VkDeviceSize vertex_buffer_size = vertex_buffer->size;
+		while (index_size > index_buffer_size) { index_buffer_size *= 2; }
+		while (vertex_size > vertex_buffer_size) { vertex_buffer_size *= 2; }
+		if (vka_nuklear_resize_buffers(vulkan, index_buffer_size, vertex_buffer_size))
+		{
+			nk_clear(context);
+			return -1;
+		}
+	}
+
+	// Copy into this frame's buffers, unless they already hold the same geometry:
+	if (vulkan->nuklear_buffer_hashes[vulkan->current_frame] != vulkan->nuklear_hash)
+	{
+		uint8_t *mapped_data = vulkan->nuklear_allocation.mapped_data;
+		memcpy(mapped_data + index_buffer->offset,
+			nk_buffer_memory_const(&(vulkan->nuklear_indices)), index_size);
+		memcpy(mapped_data + vertex_buffer->offset,
+			nk_buffer_memory_const(&(vulkan->nuklear_vertices)), vertex_size);
+		vulkan->nuklear_buffer_hashes[vulkan->current_frame] = vulkan->nuklear_hash;
+	}
+
+	// Bind index/vertex buffers:
+	vka_begin_label(command_buffer, "Nuklear", NULL);
+	vka_bind_vertex_buffers(command_buffer, index_buffer, 1, vertex_buffer);
+
+	// Draw GUI elements, merging consecutive commands with the same clip and texture:
+	vka_render_info_t clip_info = *render_info;
+	uint32_t index_offset = 0;
+	uint32_t first_index = 0;
+	uint32_t num_indices = 0;
+	int texture = 0;
+	const struct nk_draw_command *command;
+	nk_draw_foreach(command, context, &(vulkan->nuklear_commands))
+	{
+		if (!command->elem_count) { continue; }
+
+		// Clip rectangle, clamped to the render area:
+		VkRect2D *area = &(render_info->render_area);
+		float x0 = command->clip_rect.x;
+		float y0 = command->clip_rect.y;
+		float x1 = x0 + command->clip_rect.w;
+		float y1 = y0 + command->clip_rect.h;
+		if (x0 < area->offset.x) { x0 = area->offset.x; }
+		if (y0 < area->offset.y) { y0 = area->offset.y; }
+		if (x1 > (area->offset.x + area->extent.width))
+		{
+			x1 = area->offset.x + area->extent.width;
+		}
+		if (y1 > (area->offset.y + area->extent.height))
+		{
+			y1 = area->offset.y + area->extent.height;
+		}
+
+		VkRect2D scissor = {0};
+		if ((x1 > x0) && (y1 > y0))
+		{
+			scissor.offset.x = (int32_t)x0;
+			scissor.offset.y = (int32_t)y0;
+			scissor.extent.width = (uint32_t)(x1 + 0.5f) - scissor.offset.x;
+			scissor.extent.height = (uint32_t)(y1 + 0.5f) - scissor.offset.y;
+		}
+
+		// Extends the pending draw if the state matches:
+		if (num_indices && (command->texture.id == texture) &&
+			!memcmp(&scissor, &(clip_info.scissor_area), sizeof(VkRect2D)))
+		{
+			num_indices += command->elem_count;
+			index_offset += command->elem_count;
+			continue;
+		}
+
+		vka_nuklear_draw_range(command_buffer, pipeline, &clip_info, texture,
+							first_index, num_indices);
+
+		clip_info.scissor_area = scissor;
+		texture = command->texture.id;
+		first_index = index_offset;
+		num_indices = command->elem_count;
+		index_offset += command->elem_count;
+	}
+
+	vka_nuklear_draw_range(command_buffer, pipeline, &clip_info, texture,
+						first_index, num_indices);
+
+	vka_set_scissor(command_buffer, render_info);
+	vka_end_label(command_buffer);
+
+	// Converted commands are kept, in case they're the same next frame:
+	nk_clear(context);
+
+	return 0;
+}
+
+void vka_nuklear_draw_range(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline,
+	vka_render_info_t *clip_info, int texture, uint32_t first_index, uint32_t num_indices)
+{
+	// Empty scissors are fully clipped, so nothing is drawn:
+	VkExtent2D *extent = &(clip_info->scissor_area.extent);
+	if (!num_indices || !extent->width || !extent->height) { return; }
+
+	vka_set_scissor(command_buffer, clip_info);
+	if (pipeline->num_push_constants)
+	{
+		// Same texture as the last draw is elided by the shadow:
+		SDL_assert(pipeline->push_constants[0].size >= sizeof(uint32_t));
+		uint32_t texture_index = texture;
+		vka_push_constant_data(command_buffer, pipeline->layout,
+			pipeline->push_constants[0].stage_flags, sizeof(uint32_t), &texture_index);
+	}
+	vka_draw_indexed(command_buffer, num_indices, first_index, 0);
+}
+
+int vka_nuklear_bake_fonts(vka_vulkan_t *vulkan, uint32_t num_fonts, vka_nuklear_font_t *fonts,
+						int texture, const char *cache_path)
+{
+	/* Bakes all fonts into one atlas, uploaded and sampled as nk_handle.id texture. Each scale
+	 * is its own font, so add one per DPI scale needed. If cache_path isn't NULL, the atlas
+	 * is loaded from there if it was baked from the same fonts, or written there if not. */
+	if (!num_fonts || !fonts)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not bake fonts: no fonts provided.");
+		return -1;
+	}
+
+	// Cache key - font files, sizes and scales:
+	uint32_t version = VKA_NUKLEAR_FONT_CACHE_VERSION;
+	uint64_t hash = vka_hash(&version, sizeof(version), VKA_HASH_SEED);
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		if (fonts[i].scale <= 0.f) { fonts[i].scale = 1.f; }
+		if (fonts[i].size <= 0.f)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not bake fonts: font %u has no size.", i);
+			return -1;
+		}
+		hash = vka_hash(&(fonts[i].size), sizeof(float), hash);
+		hash = vka_hash(&(fonts[i].scale), sizeof(float), hash);
+		hash = vka_hash(fonts[i].path, strlen(fonts[i].path), hash);
+
+		if (strcmp(fonts[i].path, ""))
+		{
+			void *data;
+			size_t size;
+			if (vka_map_file(vulkan, fonts[i].path, &data, &size)) { return -1; }
+			hash = vka_hash(data, size, hash);
+			vka_unmap_file(data, size);
+		}
+	}
+
+	// The atlas may be in use if fonts were baked before:
+	if (vulkan->nuklear_atlas.image)
+	{
+		vka_device_wait_idle(vulkan);
+		vka_nuklear_destroy_font_atlas(vulkan);
+	}
+
+	if (!cache_path || vka_nuklear_load_font_cache(vulkan, num_fonts, fonts, hash, cache_path))
+	{
+		// Anything partly loaded from the cache:
+		vka_nuklear_destroy_font_atlas(vulkan);
+		if (vka_nuklear_bake_font_atlas(vulkan, num_fonts, fonts, hash, cache_path))
+		{
+			return -1;
+		}
+	}
+
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		fonts[i].handle.userdata = nk_handle_ptr(&(fonts[i]));
+		fonts[i].handle.height = fonts[i].baked_height;
+		fonts[i].handle.width = vka_nuklear_font_width;
+		fonts[i].handle.query = vka_nuklear_font_query;
+		fonts[i].handle.texture = nk_handle_id(texture);
+	}
+	vulkan->nuklear_null_texture.texture = nk_handle_id(texture);
+	nk_style_set_font(&(vulkan->nuklear_context), &(fonts[0].handle));
+
+	return 0;
+}
+
+int vka_nuklear_bake_font_atlas(vka_vulkan_t *vulkan, uint32_t num_fonts,
+			vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path)
+{
+	struct nk_font_atlas atlas;
+	nk_font_atlas_init_default(&atlas);
+	nk_font_atlas_begin(&atlas);
+
+	struct nk_font **baked_fonts = malloc(num_fonts * sizeof(struct nk_font *));
+	if (!baked_fonts)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for fonts to bake.");
+		nk_font_atlas_clear(&atlas);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		float height = fonts[i].size * fonts[i].scale;
+		if (!strcmp(fonts[i].path, ""))
+		{
+			baked_fonts[i] = nk_font_atlas_add_default(&atlas, height, NULL);
+		}
+		else
+		{
+			void *data;
+			size_t size;
+			if (vka_map_file(vulkan, fonts[i].path, &data, &size))
+			{
+				free(baked_fonts);
+				nk_font_atlas_clear(&atlas);
+				return -1;
+			}
+
+			// Atlas keeps its own copy of the font data:
+			baked_fonts[i] = nk_font_atlas_add_from_memory(&atlas, data, size,
+									height, NULL);
+			vka_unmap_file(data, size);
+		}
+
+		if (!baked_fonts[i])
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not add font %u to atlas.", i);
+			free(baked_fonts);
+			nk_font_atlas_clear(&atlas);
+			return -1;
+		}
+	}
+
+	int width;
+	int height;
+	const void *pixels = nk_font_atlas_bake(&atlas, &width, &height, NK_FONT_ATLAS_RGBA32);
+	if (!pixels)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not bake font atlas.");
+		free(baked_fonts);
+		nk_font_atlas_clear(&atlas);
+		return -1;
+	}
+
+	// Keep the glyphs, as the atlas is cleared after this:
+	vulkan->nuklear_glyphs = malloc(atlas.glyph_count * sizeof(struct nk_font_glyph));
+	if (!vulkan->nuklear_glyphs)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for font glyphs.");
+		free(baked_fonts);
+		nk_font_atlas_clear(&atlas);
+		return -1;
+	}
+	memcpy(vulkan->nuklear_glyphs, atlas.glyphs, atlas.glyph_count * sizeof(struct nk_font_glyph));
+	vulkan->nuklear_num_glyphs = atlas.glyph_count;
+
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		uint32_t first_glyph = baked_fonts[i]->glyphs - atlas.glyphs;
+		fonts[i].glyphs = vulkan->nuklear_glyphs + first_glyph;
+		fonts[i].num_glyphs = baked_fonts[i]->info.glyph_count;
+		fonts[i].baked_height = baked_fonts[i]->info.height;
+		fonts[i].fallback_glyph = UINT32_MAX;
+		if (baked_fonts[i]->fallback)
+		{
+			fonts[i].fallback_glyph = baked_fonts[i]->fallback - baked_fonts[i]->glyphs;
+		}
+	}
+	free(baked_fonts);
+
+	// White texel for untextured shapes:
+	vulkan->nuklear_null_texture.uv.x = (atlas.custom.x + 0.5f) / width;
+	vulkan->nuklear_null_texture.uv.y = (atlas.custom.y + 0.5f) / height;
+
+	// A cache that can't be written just means baking again next time:
+	if (cache_path)
+	{
+		vka_nuklear_write_font_cache(vulkan, num_fonts, fonts, hash, cache_path,
+							width, height, pixels);
+	}
+
+	if (vka_nuklear_upload_font_atlas(vulkan, width, height, pixels))
+	{
+		nk_font_atlas_clear(&atlas);
+		return -1;
+	}
+
+	nk_font_atlas_clear(&atlas);
+	return 0;
+}
+
+int vka_nuklear_load_font_cache(vka_vulkan_t *vulkan, uint32_t num_fonts,
+			vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path)
+{
+	// Returns -1 if there's no cache, or it was baked from different fonts.
+	uint8_t *data;
+	size_t size;
+	if (vka_map_file(vulkan, cache_path, (void **)&data, &size)) { return -1; }
+
+	uint32_t header[4];
+	uint64_t cache_hash;
+	uint32_t counts[2];
+	float null_uv[2];
+	size_t header_size = sizeof(header) + sizeof(cache_hash) + sizeof(counts) + sizeof(null_uv);
+	size_t font_size = sizeof(float) + (3 * sizeof(uint32_t));
+	if (size < header_size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Font cache \"%s\" is too small.", cache_path);
+		vka_unmap_file(data, size);
+		return -1;
+	}
+
+	// Magic, version, width, height, then hash, fonts, glyphs and null texture UV:
+	memcpy(header, data, sizeof(header));
+	memcpy(&cache_hash, data + sizeof(header), sizeof(cache_hash));
+	memcpy(counts, data + sizeof(header) + sizeof(cache_hash), sizeof(counts));
+	memcpy(null_uv, data + sizeof(header) + sizeof(cache_hash) + sizeof(counts),
+								sizeof(null_uv));
+
+	size_t glyphs_size = (size_t)(counts[1]) * sizeof(struct nk_font_glyph);
+	size_t pixels_size = (size_t)(header[2]) * header[3] * 4;
+	if ((header[0] != VKA_NUKLEAR_FONT_CACHE_MAGIC) ||
+		(header[1] != VKA_NUKLEAR_FONT_CACHE_VERSION) || (cache_hash != hash) ||
+		(counts[0] != num_fonts) || !header[2] || !header[3] ||
+		(size != (header_size + (num_fonts * font_size) + glyphs_size + pixels_size)))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Font cache \"%s\" is out of date.", cache_path);
+		vka_unmap_file(data, size);
+		return -1;
+	}
+
+	vulkan->nuklear_glyphs = malloc(glyphs_size);
+	if (!vulkan->nuklear_glyphs)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for font glyphs.");
+		vka_unmap_file(data, size);
+		return -1;
+	}
+	memcpy(vulkan->nuklear_glyphs, data + header_size + (num_fonts * font_size), glyphs_size);
+	vulkan->nuklear_num_glyphs = counts[1];
+
+	uint8_t *font_data = data + header_size;
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		uint32_t glyph_info[3];	// First glyph, number of glyphs, fallback glyph.
+		memcpy(&(fonts[i].baked_height), font_data, sizeof(float));
+		memcpy(glyph_info, font_data + sizeof(float), sizeof(glyph_info));
+		font_data += font_size;
+
+		if ((glyph_info[0] > counts[1]) || (glyph_info[1] > (counts[1] - glyph_info[0])))
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Font cache \"%s\" has invalid glyphs.", cache_path);
+			vka_nuklear_destroy_font_atlas(vulkan);
+			vka_unmap_file(data, size);
+			return -1;
+		}
+		fonts[i].glyphs = vulkan->nuklear_glyphs + glyph_info[0];
+		fonts[i].num_glyphs = glyph_info[1];
+		fonts[i].fallback_glyph = glyph_info[2];
+	}
+
+	vulkan->nuklear_null_texture.uv.x = null_uv[0];
+	vulkan->nuklear_null_texture.uv.y = null_uv[1];
+
+	if (vka_nuklear_upload_font_atlas(vulkan, header[2], header[3],
+					data + (size - pixels_size)))
+	{
+		vka_unmap_file(data, size);
+		return -1;
+	}
+
+	vka_unmap_file(data, size);
+	return 0;
+}
+
+int vka_nuklear_write_font_cache(vka_vulkan_t *vulkan, uint32_t num_fonts,
+	vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path, uint32_t width,
+	uint32_t height, const void *pixels)
+{
+	FILE *file = fopen(cache_path, "wb");
+	if (!file)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not open font cache \"%s\" for writing.", cache_path);
+		return -1;
+	}
+
+	uint32_t header[4] = { VKA_NUKLEAR_FONT_CACHE_MAGIC, VKA_NUKLEAR_FONT_CACHE_VERSION,
+								width, height };
+	uint32_t counts[2] = { num_fonts, vulkan->nuklear_num_glyphs };
+	float null_uv[2] = { vulkan->nuklear_null_texture.uv.x, vulkan->nuklear_null_texture.uv.y };
+	int failed = 0;
+	failed |= (fwrite(header, sizeof(header), 1, file) != 1);
+	failed |= (fwrite(&hash, sizeof(hash), 1, file) != 1);
+	failed |= (fwrite(counts, sizeof(counts), 1, file) != 1);
+	failed |= (fwrite(null_uv, sizeof(null_uv), 1, file) != 1);
+
+	for (uint32_t i = 0; i < num_fonts; i++)
+	{
+		uint32_t glyph_info[3] = { fonts[i].glyphs - vulkan->nuklear_glyphs,
+					fonts[i].num_glyphs, fonts[i].fallback_glyph };
+		failed |= (fwrite(&(fonts[i].baked_height), sizeof(float), 1, file) != 1);
+		failed |= (fwrite(glyph_info, sizeof(glyph_info), 1, file) != 1);
+	}
+
+	failed |= (fwrite(vulkan->nuklear_glyphs, sizeof(struct nk_font_glyph),
+			vulkan->nuklear_num_glyphs, file) != vulkan->nuklear_num_glyphs);
+	failed |= (fwrite(pixels, (size_t)width * height * 4, 1, file) != 1);
+	failed |= (fclose(file) != 0);
+
+	if (failed)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not write font cache \"%s\".", cache_path);
+		remove(cache_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+int vka_nuklear_upload_font_atlas(vka_vulkan_t *vulkan, uint32_t width, uint32_t height,
+							const void *pixels)
+{
+	// Copies the RGBA atlas through a staging buffer, waiting for the copy to complete.
+	strcpy(vulkan->nuklear_atlas_sampler.name, "Nuklear font atlas sampler");
+	vulkan->nuklear_atlas_sampler.filter = VK_FILTER_LINEAR;
+	if (vka_create_sampler(vulkan, &(vulkan->nuklear_atlas_sampler))) { return -1; }
+
+	strcpy(vulkan->nuklear_atlas_allocation.name, "Nuklear font atlas allocation");
+	vulkan->nuklear_atlas_allocation.properties[0] = VKA_MEMORY_DEVICE;
+	strcpy(vulkan->nuklear_atlas.name, "Nuklear font atlas");
+	vulkan->nuklear_atlas.allocation = &(vulkan->nuklear_atlas_allocation);
+	vulkan->nuklear_atlas.sampler = &(vulkan->nuklear_atlas_sampler);
+	vulkan->nuklear_atlas.format = VK_FORMAT_R8G8B8A8_UNORM;
+	vulkan->nuklear_atlas.width = width;
+	vulkan->nuklear_atlas.height = height;
+	vulkan->nuklear_atlas.mip_levels = 1;
+	vulkan->nuklear_atlas.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	vulkan->nuklear_atlas.aspect_mask = VK_IMAGE_ASPECT_COLOR_BIT;
+	if (vka_set_up_images(vulkan, 1, &(vulkan->nuklear_atlas))) { return -1; }
+
+	vka_allocation_t staging_allocation = {0};
+	strcpy(staging_allocation.name, "Nuklear font atlas staging allocation");
+	staging_allocation.properties[0] = VKA_MEMORY_HOST;
+
+	vka_buffer_t staging_buffer = {0};
+	strcpy(staging_buffer.name, "Nuklear font atlas staging buffer");
+	staging_buffer.allocation = &staging_allocation;
+	staging_buffer.size = (VkDeviceSize)width * height * 4;
+	staging_buffer.usage = VKA_BUFFER_USAGE_SRC;
+
+	vka_command_buffer_t command_buffer = {0};
+	strcpy(command_buffer.name, "Nuklear font atlas upload");
+	command_buffer.queue = &(vulkan->graphics_queue);
+
+	int failed = 0;
+	if (vka_set_up_buffers(vulkan, 1, &staging_buffer) ||
+		vka_map_memory(vulkan, &staging_allocation))
+	{
+		failed = 1;
+	}
+
+	if (!failed)
+	{
+		memcpy(staging_allocation.mapped_data, pixels, staging_buffer.size);
+
+		vka_copy_info_t copy_info = {0};
+		copy_info.source = &staging_buffer;
+		copy_info.destination = &(vulkan->nuklear_atlas);
+
+		if (vka_create_command_buffer(vulkan, &command_buffer) ||
+			vka_begin_command_buffer(vulkan, &command_buffer))
+		{
+			failed = 1;
+		}
+		else
+		{
+			vka_copy_buffer_to_image(&command_buffer, &copy_info);
+			if (vka_end_command_buffer(vulkan, &command_buffer) ||
+				vka_submit_command_buffer(vulkan, &command_buffer) ||
+				vka_wait_for_fence(vulkan, &command_buffer))
+			{
+				failed = 1;
+			}
+		}
+	}
+
+	if (command_buffer.buffer)
+	{
+		vkFreeCommandBuffers(vulkan->device, vulkan->command_pool, 1, &(command_buffer.buffer));
+	}
+	vka_destroy_command_buffer(vulkan, &command_buffer);
+	vka_destroy_buffer(vulkan, &staging_buffer);
+	vka_destroy_allocation(vulkan, &staging_allocation);
+
+	if (failed) { return -1; }
+	return 0;
+}
+
+void vka_nuklear_destroy_font_atlas(vka_vulkan_t *vulkan)
+{
+	vka_destroy_image(vulkan, &(vulkan->nuklear_atlas));
+	vka_destroy_allocation(vulkan, &(vulkan->nuklear_atlas_allocation));
+	vka_destroy_sampler(vulkan, &(vulkan->nuklear_atlas_sampler));
+
+	if (vulkan->nuklear_glyphs)
+	{
+		free(vulkan->nuklear_glyphs);
+		vulkan->nuklear_glyphs = NULL;
+	}
+	vulkan->nuklear_num_glyphs = 0;
+}
+
+const struct nk_font_glyph *vka_nuklear_find_glyph(vka_nuklear_font_t *font, nk_rune codepoint)
+{
+	// Binary search, falling back on the fallback glyph (or NULL):
+	uint32_t first = 0;
+	uint32_t last = font->num_glyphs;
+	while (first < last)
+	{
+		uint32_t middle = first + ((last - first) / 2);
+		if (font->glyphs[middle].codepoint < codepoint) { first = middle + 1; }
+		else { last = middle; }
+	}
+	if ((first < font->num_glyphs) && (font->glyphs[first].codepoint == codepoint))
+	{
+		return &(font->glyphs[first]);
+	}
+
+	if (font->fallback_glyph < font->num_glyphs) { return &(font->glyphs[font->fallback_glyph]); }
+	return NULL;
+}
+
+float vka_nuklear_font_width(nk_handle handle, float height, const char *text, int len)
+{
+	vka_nuklear_font_t *font = (vka_nuklear_font_t *)(handle.ptr);
+	if (!font || !text || (len <= 0)) { return 0.f; }
+
+	float scale = height / font->baked_height;
+	float width = 0.f;
+	int offset = 0;
+	while (offset < len)
+	{
+		nk_rune codepoint;
+		int glyph_length = nk_utf_decode(text + offset, &codepoint, len - offset);
+		if (!glyph_length || (codepoint == NK_UTF_INVALID)) { break; }
+
+		const struct nk_font_glyph *glyph = vka_nuklear_find_glyph(font, codepoint);
+		if (glyph) { width += glyph->xadvance * scale; }
+		offset += glyph_length;
+	}
+
+	return width;
+}
+
+void vka_nuklear_font_query(nk_handle handle, float height, struct nk_user_font_glyph *glyph,
+					nk_rune codepoint, nk_rune next_codepoint)
+{
+	(void)next_codepoint;
+	memset(glyph, 0, sizeof(struct nk_user_font_glyph));
+
+	vka_nuklear_font_t *font = (vka_nuklear_font_t *)(handle.ptr);
+	if (!font) { return; }
+
+	const struct nk_font_glyph *font_glyph = vka_nuklear_find_glyph(font, codepoint);
+	if (!font_glyph) { return; }
+
+	float scale = height / font->baked_height;
+	glyph->width = (font_glyph->x1 - font_glyph->x0) * scale;
+	glyph->height = (font_glyph->y1 - font_glyph->y0) * scale;
+	glyph->offset = nk_vec2(font_glyph->x0 * scale, font_glyph->y0 * scale);
+	glyph->xadvance = font_glyph->xadvance * scale;
+	glyph->uv[0] = nk_vec2(font_glyph->u0, font_glyph->v0);
+	glyph->uv[1] = nk_vec2(font_glyph->u1, font_glyph->v1);
+}
+
+void vka_nuklear_process_event(vka_vulkan_t *vulkan, SDL_Event *event)
+{
+	struct nk_context *context = &(vulkan->nuklear_context);
+	if ((event->type == SDL_EVENT_KEY_UP) || (event->type == SDL_EVENT_KEY_DOWN))
+	{
+		int down = (event->type == SDL_EVENT_KEY_DOWN);
+		const bool *keyboard_state = SDL_GetKeyboardState(NULL);
+		SDL_Keycode key = event->key.key;
+		if ((key == SDLK_LSHIFT) || (key == SDLK_RSHIFT))
+		{
+			nk_input_key(context, NK_KEY_SHIFT, down);
+		}
+		else if (key == SDLK_DELETE)
+		{
+			nk_input_key(context, NK_KEY_DEL, down);
+		}
+		else if (key == SDLK_RETURN)
+		{
+			nk_input_key(context, NK_KEY_ENTER, down);
+		}
+		else if (key == SDLK_TAB)
+		{
+			nk_input_key(context, NK_KEY_TAB, down);
+		}
+		else if (key == SDLK_BACKSPACE)
+		{
+			nk_input_key(context, NK_KEY_BACKSPACE, down);
+		}
+		else if (key == SDLK_HOME)
+		{
+			nk_input_key(context, NK_KEY_TEXT_START, down);
+			nk_input_key(context, NK_KEY_SCROLL_START, down);
+		}
+		else if (key == SDLK_END)
+		{
+			nk_input_key(context, NK_KEY_TEXT_END, down);
+			nk_input_key(context, NK_KEY_SCROLL_END, down);
+		}
+		else if (key == SDLK_PAGEUP)
+		{
+			nk_input_key(context, NK_KEY_SCROLL_UP, down);
+		}
+		else if (key == SDLK_PAGEDOWN)
+		{
+			nk_input_key(context, NK_KEY_SCROLL_DOWN, down);
+		}
+		else if (key == SDLK_Z)
+		{
+			nk_input_key(context, NK_KEY_TEXT_UNDO, down &&
+				keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_R)
+		{
+			nk_input_key(context, NK_KEY_TEXT_REDO, down &&
+				keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_C)
+		{
+			nk_input_key(context, NK_KEY_COPY, down &&
+				keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_V)
+		{
+			nk_input_key(context, NK_KEY_PASTE, down &&
+				keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_X)
+		{
+			nk_input_key(context, NK_KEY_CUT, down &&
+				keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_B)
+		{
+			nk_input_key(context, NK_KEY_TEXT_LINE_START, down &&
+					keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_E)
+		{
+			nk_input_key(context, NK_KEY_TEXT_LINE_END, down &&
+					keyboard_state[SDL_SCANCODE_LCTRL]);
+		}
+		else if (key == SDLK_UP)
+		{
+			nk_input_key(context, NK_KEY_UP, down);
+		}
+		else if (key == SDLK_DOWN)
+		{
+			nk_input_key(context, NK_KEY_DOWN, down);
+		}
+		else if (key == SDLK_LEFT)
+		{
+			if (keyboard_state[SDL_SCANCODE_LCTRL] == 0)
+			{
+				nk_input_key(context, NK_KEY_LEFT, down);
+			}
+			else
+			{
+				nk_input_key(context, NK_KEY_TEXT_WORD_LEFT, down);
+			}
+		}
+		else if (key == SDLK_RIGHT)
+		{
+			if (keyboard_state[SDL_SCANCODE_LCTRL] == 0)
+			{
+				nk_input_key(context, NK_KEY_RIGHT, down);
+			}
+			else
+			{
+				nk_input_key(context, NK_KEY_TEXT_WORD_RIGHT, down);
+			}
+		}
+	}
+	else if ((event->type == SDL_EVENT_MOUSE_BUTTON_UP) ||
+		(event->type == SDL_EVENT_MOUSE_BUTTON_DOWN))
+	{
+		int down = (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN);
+		const int x = event->button.x;
+		const int y = event->button.y;
+		if (event->button.button == SDL_BUTTON_LEFT)
+		{
+			if (event->button.clicks > 1)
+			{
+				nk_input_button(context, NK_BUTTON_DOUBLE, x, y, down);
+			}
+			nk_input_button(context, NK_BUTTON_LEFT, x, y, down);
+		}
+		else if (event->button.button == SDL_BUTTON_RIGHT)
+		{
+			nk_input_button(context, NK_BUTTON_RIGHT, x, y, down);
+		}
+		else if (event->button.button == SDL_BUTTON_MIDDLE)
+		{
+			nk_input_button(context, NK_BUTTON_MIDDLE, x, y, down);
+		}
+	}
+	else if (event->type == SDL_EVENT_MOUSE_MOTION)
+	{
+		if (context->input.mouse.grabbed != 0)
+		{
+			int x = (int)(context->input.mouse.prev.x);
+			int y = (int)(context->input.mouse.prev.y);
+			nk_input_motion(context, x + event->motion.xrel, y + event->motion.yrel);
+		}
+		else { nk_input_motion(context, event->motion.x, event->motion.y); }
+	}
+	else if (event->type == SDL_EVENT_TEXT_INPUT)
+	{
+		nk_glyph glyph;
+		memcpy(glyph, event->text.text, NK_UTF_SIZE);
+		nk_input_glyph(context, glyph);
+	}
+	else if (event->type == SDL_EVENT_MOUSE_WHEEL)
+	{
+		nk_input_scroll(context, nk_vec2((float)(event->wheel.x), (float)(event->wheel.y)));
+	}
+}
+
+void vka_nuklear_process_grab(vka_vulkan_t *vulkan)
+{
+	// Put the mouse in relative mode if button is held down:
+	struct nk_context *context = &(vulkan->nuklear_context);
+	if (context->input.mouse.grab) { SDL_SetWindowRelativeMouseMode(vulkan->window, true); }
+	else if (context->input.mouse.ungrab)
+	{
+		SDL_SetWindowRelativeMouseMode(vulkan->window, false);
+		SDL_WarpMouseInWindow(vulkan->window, (int)(context->input.mouse.prev.x),
+						(int)(context->input.mouse.prev.y));
+	}
+	else if (context->input.mouse.grabbed)
+	{
+		context->input.mouse.pos.x = context->input.mouse.prev.x;
+		context->input.mouse.pos.y = context->input.mouse.prev.y;
+	}
+}
+
+void vka_nuklear_clipboard_copy(nk_handle usr, const char *text, int len)
+{
+	// User data handle not needed:
+	(void)usr;
+
+	if (len < 1) { return; }
+	char *str = malloc((len + 1) * sizeof(char));
+	if (!str) { return; }
+	memcpy(str, text, len * sizeof(char));
+	str[len] = '\0';
+	SDL_SetClipboardText(str);
+	free(str);
 }
 
-void vka_buffer_barrier_reverse(vka_command_buffer_t *command_buffer,
-				vka_barrier_info_t *barrier_info)
+void vka_nuklear_clipboard_paste(nk_handle usr, struct nk_text_edit *edit)
 {
-	// Same as previous function but with source and destination swapped for convenience.
-	vka_buffer_t *buffer = (vka_buffer_t *)(barrier_info->resource);
-
-	VkBufferMemoryBarrier buffer_barrier;
-	memset(&buffer_barrier, 0, sizeof(buffer_barrier));
-	buffer_barrier.sType			= VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
-	buffer_barrier.pNext			= NULL;
-	buffer_barrier.srcAccessMask		= barrier_info->dst_access_mask;
-	buffer_barrier.dstAccessMask		= barrier_info->src_access_mask;
-	buffer_barrier.srcQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
-	buffer_barrier.dstQueueFamilyIndex	= VK_QUEUE_FAMILY_IGNORED;
-	buffer_barrier.buffer			= buffer->buffer;
-	buffer_barrier.offset			= barrier_info->offset;
-
-	if (!barrier_info->size) { buffer_barrier.size = VK_WHOLE_SIZE; }
-	else { buffer_barrier.size = barrier_info->size; }
+	// User data handle not needed:
+	(void)usr;
 
-	vkCmdPipelineBarrier(command_buffer->buffer, barrier_info->dst_stage_mask,
-		barrier_info->src_stage_mask, 0, 0, NULL, 1, &buffer_barrier, 0, NULL);
+	const char *text = SDL_GetClipboardText();
+	if (text) { nk_textedit_paste(edit, text, nk_strlen(text)); }
 }
+#endif // VKA_NUKLEAR
 
-void vka_copy_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+#ifdef VKA_SHADER_WATCHER
+int vka_shader_watcher_set_up(vka_vulkan_t *vulkan)
 {
-	vka_buffer_t *source = (vka_buffer_t *)(copy_info->source);
-	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
 
-	// If no size given, choose size based on which buffer is smaller:
-	VkDeviceSize copy_size = copy_info->size;
-	if (!copy_size)
+	watcher->inotify_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher->inotify_descriptor == -1)
 	{
-		copy_size = destination->size;
-		if (source->size < copy_size) { copy_size = source->size; }
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not initialise inotify for shader watcher.");
+		return -1;
 	}
 
-	VkBufferCopy buffer_copy_info;
-	memset(&buffer_copy_info, 0, sizeof(buffer_copy_info));
-	buffer_copy_info.srcOffset	= copy_info->source_offset;
-	buffer_copy_info.dstOffset	= copy_info->destination_offset;
-	buffer_copy_info.size		= copy_size;
+	watcher->mutex = SDL_CreateMutex();
+	if (!watcher->mutex)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create mutex for shader watcher: %s", SDL_GetError());
+		return -1;
+	}
 
-	vkCmdCopyBuffer(command_buffer->buffer, source->buffer,
-		destination->buffer, 1, &buffer_copy_info);
-}
+	watcher->condition = SDL_CreateCondition();
+	if (!watcher->condition)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create condition for shader watcher: %s", SDL_GetError());
+		return -1;
+	}
 
-void vka_update_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
-{
-	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
+	SDL_SetAtomicInt(&(watcher->quit), 0);
+	watcher->thread = SDL_CreateThread(vka_shader_watcher_thread, "Shader watcher", vulkan);
+	if (!watcher->thread)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create shader watcher thread: %s", SDL_GetError());
+		return -1;
+	}
 
-	// Copy must have size <= 65536. Uses source from copy info as a pointer into host memory.
-	vkCmdUpdateBuffer(command_buffer->buffer, destination->buffer,
-		copy_info->destination_offset, copy_info->size, copy_info->source);
+	return 0;
 }
 
-void vka_fill_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info)
+void vka_shader_watcher_shut_down(vka_vulkan_t *vulkan)
 {
-	// Uses destination buffer and offset in copy_info.
-	vka_buffer_t *destination = (vka_buffer_t *)(copy_info->destination);
-	VkDeviceSize size = copy_info->size;
-	if (!size) { size = VK_WHOLE_SIZE; }
-	vkCmdFillBuffer(command_buffer->buffer, destination->buffer,
-		copy_info->destination_offset, size, copy_info->data);
+	// Device must be idle.
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
+
+	if (watcher->thread)
+	{
+		SDL_SetAtomicInt(&(watcher->quit), 1);
+		SDL_WaitThread(watcher->thread, NULL);
+		watcher->thread = NULL;
+	}
+
+	if (watcher->pipelines)
+	{
+		for (uint32_t i = 0; i < watcher->num_pipelines; i++)
+		{
+			vka_discard_pipeline_reload(vulkan, &(watcher->pipelines[i]));
+		}
+		free(watcher->pipelines);
+		watcher->pipelines = NULL;
+		watcher->num_pipelines = 0;
+		watcher->max_pipelines = 0;
+	}
+
+	if (watcher->condition)
+	{
+		SDL_DestroyCondition(watcher->condition);
+		watcher->condition = NULL;
+	}
+
+	if (watcher->mutex)
+	{
+		SDL_DestroyMutex(watcher->mutex);
+		watcher->mutex = NULL;
+	}
+
+	if (watcher->inotify_descriptor > 0)
+	{
+		close(watcher->inotify_descriptor);
+		watcher->inotify_descriptor = 0;
+	}
 }
 
-int vka_set_up_buffers(vka_vulkan_t *vulkan, uint32_t num_buffers, vka_buffer_t *buffers)
+int vka_watch_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
 {
-	/* Convenience function to set up multiple buffers.
-	 * Does not destroy buffers on failure.
-	 * Expects all buffers to use the same allocation. */
-	if (!num_buffers || !buffers)
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
+	if (!watcher->mutex)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not set up buffers: no buffers provided.");
+			"Could not watch pipeline \"%s\" - shader watcher is not set up.",
+			pipeline->name);
 		return -1;
 	}
 
-	// Check all buffers are using same allocation:
-	for (uint32_t i = 1; i < num_buffers; i++)
+	vka_watched_pipeline_t watched;
+	memset(&watched, 0, sizeof(watched));
+	watched.pipeline = pipeline;
+	for (int i = 0; i < 3; i++)
 	{
-		if (buffers[i].allocation != buffers[i - 1].allocation)
+		watched.watch_descriptors[i] = -1;
+
+		int is_compute_shader = (i == VKA_SHADER_TYPE_COMPUTE);
+		if (is_compute_shader != (pipeline->is_compute_pipeline != 0)) { continue; }
+
+		const char *path = pipeline->shaders[i].path;
+		if (!strcmp(path, "")) { continue; }
+
+		// Watch the directory, since editors often replace files rather than writing to them:
+		char directory[VKA_MAX_PATH_LENGTH];
+		const char *file_name = strrchr(path, '/');
+		if (!file_name) { strcpy(directory, "."); }
+		else if (file_name == path) { strcpy(directory, "/"); }
+		else
+		{
+			memcpy(directory, path, file_name - path);
+			directory[file_name - path] = '\0';
+		}
+
+		watched.watch_descriptors[i] = inotify_add_watch(watcher->inotify_descriptor,
+						directory, IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watched.watch_descriptors[i] == -1)
 		{
 			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Buffer \"%s\" is not using the same allocation as buffer \"%s\".",
-				buffers[i].name, buffers[i - 1].name);
+				"Could not watch directory \"%s\" for shader \"%s\".",
+				directory, path);
 			return -1;
 		}
 	}
 
-	// Check all buffers have a size:
-	for (uint32_t i = 0; i < num_buffers; i++)
+	SDL_LockMutex(watcher->mutex);
+	for (uint32_t i = 0; i < watcher->num_pipelines; i++)
 	{
-		if (!buffers[i].size)
+		if (watcher->pipelines[i].pipeline == pipeline)
 		{
-			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Buffer \"%s\" has a size of 0.", buffers[i].name);
-			return -1;
+			SDL_UnlockMutex(watcher->mutex);
+			return 0;
 		}
 	}
 
-	// Create buffers and get requirements:
-	for (uint32_t i = 0; i < num_buffers; i++)
+	if (watcher->num_pipelines == watcher->max_pipelines)
 	{
-		if (vka_create_buffer(vulkan, &(buffers[i]))) { return -1; }
-		if (vka_get_buffer_requirements(vulkan, &(buffers[i]))) { return -1; }
+		uint32_t max_pipelines = 2 * watcher->max_pipelines;
+		if (!max_pipelines) { max_pipelines = 16; }
+
+		vka_watched_pipeline_t *pipelines = realloc(watcher->pipelines,
+					max_pipelines * sizeof(vka_watched_pipeline_t));
+		if (!pipelines)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not allocate memory to watch pipeline \"%s\".",
+				pipeline->name);
+			SDL_UnlockMutex(watcher->mutex);
+			return -1;
+		}
+		watcher->pipelines = pipelines;
+		watcher->max_pipelines = max_pipelines;
 	}
 
-	// If there is no allocation, stop here:
-	if (!buffers[0].allocation) { return 0; }
+	watcher->pipelines[watcher->num_pipelines] = watched;
+	watcher->num_pipelines++;
+	SDL_UnlockMutex(watcher->mutex);
 
-	// Otherwise set it up:
-	if (vka_create_allocation(vulkan, buffers[0].allocation)) { return -1; }
+	return 0;
+}
 
-	// Bind buffer memory:
-	for (uint32_t i = 0; i < num_buffers; i++)
+void vka_unwatch_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline)
+{
+	/* Directory watches are left in place, as other pipelines may share them. They go
+	 * when the shader watcher is shut down. */
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
+	if (!watcher->mutex) { return; }
+
+	SDL_LockMutex(watcher->mutex);
+	uint32_t i = 0;
+	while (i < watcher->num_pipelines)
 	{
-		if (vka_bind_buffer_memory(vulkan, &(buffers[i]))) { return -1; }
-	}
+		if (watcher->pipelines[i].pipeline != pipeline)
+		{
+			i++;
+			continue;
+		}
 
-	return 0;
-}
+		// Let the watcher thread finish with it first. Entries can move meanwhile:
+		if (watcher->pipelines[i].state == VKA_RELOAD_STATE_BUILDING)
+		{
+			SDL_WaitCondition(watcher->condition, watcher->mutex);
+			i = 0;
+			continue;
+		}
 
-/*************
- * Rendering *
- *************/
+		vka_discard_pipeline_reload(vulkan, &(watcher->pipelines[i]));
+		watcher->num_pipelines--;
+		watcher->pipelines[i] = watcher->pipelines[watcher->num_pipelines];
+		break;
+	}
+	SDL_UnlockMutex(watcher->mutex);
+}
 
-void vka_begin_rendering(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
+void vka_shader_watcher_update(vka_vulkan_t *vulkan)
 {
-	// TODO - allow for multiple colour images.
-	VkRenderingAttachmentInfo colour_info;
-	memset(&colour_info, 0, sizeof(colour_info));
-	colour_info.sType		= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	colour_info.pNext		= NULL;
-	colour_info.imageView		= render_info->colour_image->image_view;
-	colour_info.imageLayout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colour_info.resolveMode		= VK_RESOLVE_MODE_NONE;
-	colour_info.resolveImageView	= VK_NULL_HANDLE;
-	colour_info.resolveImageLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
-	colour_info.loadOp		= render_info->colour_load_op;
-	colour_info.storeOp		= render_info->colour_store_op;
-	colour_info.clearValue		= render_info->colour_clear_value;
+	/* Swaps in pipelines rebuilt since the last call, and queues pipelines whose shaders
+	 * have changed. Shader modules are created here rather than on the watcher thread,
+	 * since the registry in vka_vulkan_t isn't thread safe. */
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
+	if (!watcher->mutex) { return; }
 
-	VkRenderingAttachmentInfo depth_info;
-	memset(&depth_info, 0, sizeof(depth_info));
-	VkRenderingAttachmentInfo *depth_info_pointer = NULL;
-	if (render_info->depth_image)
+	SDL_LockMutex(watcher->mutex);
+	for (uint32_t i = 0; i < watcher->num_pipelines; i++)
 	{
-		depth_info_pointer = &depth_info;
+		vka_watched_pipeline_t *watched = &(watcher->pipelines[i]);
+		vka_pipeline_t *pipeline = watched->pipeline;
 
-		depth_info.sType		= VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-		depth_info.pNext		= NULL;
-		depth_info.imageView		= render_info->depth_image->image_view;
-		depth_info.imageLayout		= VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		depth_info.resolveMode		= VK_RESOLVE_MODE_NONE;
-		depth_info.resolveImageView	= VK_NULL_HANDLE;
-		depth_info.resolveImageLayout	= VK_IMAGE_LAYOUT_UNDEFINED;
-		depth_info.loadOp		= render_info->depth_load_op;
-		depth_info.storeOp		= render_info->depth_store_op;
-		depth_info.clearValue		= render_info->depth_clear_value;
+		if (watched->state == VKA_RELOAD_STATE_READY)
+		{
+			if (pipeline->pipeline != watched->source_pipeline)
+			{
+				// Recreated since the reload was queued, so the copy may be out of date:
+				vka_discard_pipeline_reload(vulkan, watched);
+				watched->changed = 1;
+			}
+			else
+			{
+				for (int j = 0; j < 3; j++)
+				{
+					if (!(watched->reloaded_shaders & (1 << j))) { continue; }
+					vka_destroy_shader(vulkan, &(pipeline->shaders[j]));
+					pipeline->shaders[j] = watched->rebuild.shaders[j];
+				}
+
+				// Old pipeline may still be in use by frames in flight:
+				if (pipeline->pipeline)
+				{
+					vka_retire_object(vulkan, VK_OBJECT_TYPE_PIPELINE,
+							(uint64_t)(pipeline->pipeline));
+				}
+				pipeline->pipeline = watched->rebuild.pipeline;
+				memcpy(pipeline->workgroup_size, watched->rebuild.workgroup_size,
+								3 * sizeof(uint32_t));
+
+				watched->rebuild.pipeline = VK_NULL_HANDLE;
+				watched->reloaded_shaders = 0;
+				watched->state = VKA_RELOAD_STATE_IDLE;
+				strcpy(watcher->error, "");
+			}
+		}
+		else if (watched->state == VKA_RELOAD_STATE_FAILED)
+		{
+			// The old pipeline is still valid, so just report the error:
+			strcpy(watcher->error, watched->error);
+			vka_discard_pipeline_reload(vulkan, watched);
+		}
+
+		if (!watched->changed || (watched->state != VKA_RELOAD_STATE_IDLE)) { continue; }
+		if (!pipeline->layout) { continue; }
+		watched->changed = 0;
+
+		watched->rebuild = *pipeline;
+		watched->rebuild.pipeline = VK_NULL_HANDLE;
+		watched->rebuild.descriptor_layout_tracker = NULL;
+		watched->rebuild.descriptor_set_tracker = NULL;
+		watched->source_pipeline = pipeline->pipeline;
+
+		// Unchanged files hit the module cache, so only changed shaders get new modules:
+		int result = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			if (watched->watch_descriptors[j] == -1) { continue; }
+
+			watched->rebuild.shaders[j].shader = VK_NULL_HANDLE;
+			result = vka_create_shader(vulkan, &(watched->rebuild.shaders[j]));
+			if (result) { break; }
+			watched->reloaded_shaders |= (1 << j);
+		}
+
+		if (result)
+		{
+			strcpy(watcher->error, vulkan->error);
+			vka_discard_pipeline_reload(vulkan, watched);
+			continue;
+		}
+		watched->state = VKA_RELOAD_STATE_QUEUED;
 	}
+	SDL_UnlockMutex(watcher->mutex);
+}
 
-	VkRenderingInfo rendering_info;
-	memset(&rendering_info, 0, sizeof(rendering_info));
-	rendering_info.sType			= VK_STRUCTURE_TYPE_RENDERING_INFO;
-	rendering_info.pNext			= NULL;
-	rendering_info.flags			= 0;
-	rendering_info.renderArea		= render_info->render_area;
-	rendering_info.layerCount		= 1;
-	rendering_info.viewMask			= 0;
-	rendering_info.colorAttachmentCount	= 1;
-	rendering_info.pColorAttachments	= &colour_info;
-	rendering_info.pDepthAttachment		= depth_info_pointer;
-	rendering_info.pStencilAttachment	= depth_info_pointer;
+void vka_discard_pipeline_reload(vka_vulkan_t *vulkan, vka_watched_pipeline_t *watched)
+{
+	// Not for reloads the watcher thread is still building.
+	if (watched->rebuild.pipeline)
+	{
+		// Never bound, so no need to retire it:
+		vkDestroyPipeline(vulkan->device, watched->rebuild.pipeline, NULL);
+		watched->rebuild.pipeline = VK_NULL_HANDLE;
+	}
 
-	vkCmdBeginRendering(command_buffer->buffer, &rendering_info);
+	for (int i = 0; i < 3; i++)
+	{
+		if (watched->reloaded_shaders & (1 << i))
+		{
+			vka_destroy_shader(vulkan, &(watched->rebuild.shaders[i]));
+		}
+	}
+	watched->reloaded_shaders = 0;
+	watched->state = VKA_RELOAD_STATE_IDLE;
 }
 
-void vka_begin_rendering_barrier(vka_command_buffer_t *command_buffer,
-				vka_render_info_t *render_info)
+int vka_shader_watcher_thread(void *data)
 {
-	// TODO - allow for multiple colour images.
-	vka_barrier_info_t barrier_info = {0};
-	barrier_info.resource		= render_info->colour_image;
-	barrier_info.src_access_mask	= VK_ACCESS_NONE;
-	barrier_info.dst_access_mask	= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	barrier_info.old_layout		= VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier_info.new_layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	vka_image_barrier(command_buffer, &barrier_info);
+	vka_vulkan_t *vulkan = (vka_vulkan_t *)data;
+	vka_shader_watcher_t *watcher = &(vulkan->shader_watcher);
+
+	/* Pipelines are built through a private vka_vulkan_t, so errors don't race the main
+	 * thread. It has the same capabilities, so reloads are built like the originals, except
+	 * that they're always monolithic: it has no linker to optimise fast links, and library
+	 * parts keyed on each reload's new modules would pile up until shutdown. */
+	vka_vulkan_t *builder = calloc(1, sizeof(vka_vulkan_t));
+	if (!builder) { return -1; }
+	builder->device				= vulkan->device;
+	builder->physical_device		= vulkan->physical_device;
+	builder->use_pipeline_library		= 0;
+	builder->use_extended_dynamic_state_3	= vulkan->use_extended_dynamic_state_3;
+	builder->enabled_features		= vulkan->enabled_features;
+	builder->enabled_features_11		= vulkan->enabled_features_11;
+	builder->enabled_features_12		= vulkan->enabled_features_12;
+	builder->enabled_features_13		= vulkan->enabled_features_13;
+	builder->maintenance_properties		= vulkan->maintenance_properties;
+	builder->subgroup_properties		= vulkan->subgroup_properties;
+	builder->device_properties		= vulkan->device_properties;
+	builder->device_properties.pNext	= NULL;
+
+	struct pollfd poll_info;
+	poll_info.fd		= watcher->inotify_descriptor;
+	poll_info.events	= POLLIN;
+	poll_info.revents	= 0;
+
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	while (!SDL_GetAtomicInt(&(watcher->quit)))
+	{
+		if (poll(&poll_info, 1, VKA_SHADER_WATCHER_POLL_TIME) > 0)
+		{
+			ssize_t length;
+			while ((length = read(watcher->inotify_descriptor, events, sizeof(events))) > 0)
+			{
+				SDL_LockMutex(watcher->mutex);
+				char *event_data = events;
+				while (event_data < (events + length))
+				{
+					struct inotify_event *event = (struct inotify_event *)event_data;
+					event_data += sizeof(struct inotify_event) + event->len;
+					if (!event->len) { continue; }
+
+					for (uint32_t i = 0; i < watcher->num_pipelines; i++)
+					{
+						vka_watched_pipeline_t *watched = &(watcher->pipelines[i]);
+						for (int j = 0; j < 3; j++)
+						{
+							if (watched->watch_descriptors[j] != event->wd)
+							{
+								continue;
+							}
+
+							const char *path = watched->pipeline->shaders[j].path;
+							const char *file_name = strrchr(path, '/');
+							if (file_name) { file_name++; }
+							else { file_name = path; }
+
+							if (!strcmp(file_name, event->name))
+							{
+								watched->changed = 1;
+							}
+						}
+					}
+				}
+				SDL_UnlockMutex(watcher->mutex);
+			}
+		}
+
+		// Build one queued pipeline at a time:
+		vka_pipeline_t *target = NULL;
+		vka_pipeline_t build;
+		SDL_LockMutex(watcher->mutex);
+		for (uint32_t i = 0; i < watcher->num_pipelines; i++)
+		{
+			if (watcher->pipelines[i].state == VKA_RELOAD_STATE_QUEUED)
+			{
+				watcher->pipelines[i].state = VKA_RELOAD_STATE_BUILDING;
+				target = watcher->pipelines[i].pipeline;
+				build = watcher->pipelines[i].rebuild;
+				break;
+			}
+		}
+		SDL_UnlockMutex(watcher->mutex);
+		if (!target) { continue; }
+
+		int result = vka_create_pipeline(builder, &build);
+		if (build.descriptor_layout_tracker) { free(build.descriptor_layout_tracker); }
+		if (build.descriptor_set_tracker) { free(build.descriptor_set_tracker); }
+
+		// Entries may have moved while building, but can't be removed:
+		SDL_LockMutex(watcher->mutex);
+		for (uint32_t i = 0; i < watcher->num_pipelines; i++)
+		{
+			vka_watched_pipeline_t *watched = &(watcher->pipelines[i]);
+			if (watched->pipeline != target) { continue; }
+
+			if (result)
+			{
+				strcpy(watched->error, builder->error);
+				watched->state = VKA_RELOAD_STATE_FAILED;
+			}
+			else
+			{
+				watched->rebuild.pipeline = build.pipeline;
+				watched->state = VKA_RELOAD_STATE_READY;
+			}
+			break;
+		}
+		SDL_BroadcastCondition(watcher->condition);
+		SDL_UnlockMutex(watcher->mutex);
+	}
 
-	vka_begin_rendering(command_buffer, render_info);
+	free(builder);
+	return 0;
 }
+#endif // VKA_SHADER_WATCHER
 
-void vka_end_rendering(vka_command_buffer_t *command_buffer)
+#ifdef VKA_STATISTICS
+int vka_statistics_set_up(vka_vulkan_t *vulkan)
 {
-	// TODO - allow for multiple colour images.
-	vkCmdEndRendering(command_buffer->buffer);
-}
+	vka_statistics_t *statistics = &(vulkan->statistics);
 
-void vka_end_rendering_barrier(vka_command_buffer_t *command_buffer,
-				vka_render_info_t *render_info)
-{
-	// TODO - allow for multiple colour images.
-	vka_end_rendering(command_buffer);
+	// Timestamps are written on the graphics queue, if it supports them:
+	uint32_t num_families = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vulkan->physical_device, &num_families, NULL);
+	VkQueueFamilyProperties *families = malloc(num_families * sizeof(VkQueueFamilyProperties));
+	if (!families)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for queue family properties.");
+		return -1;
+	}
+	vkGetPhysicalDeviceQueueFamilyProperties(vulkan->physical_device, &num_families, families);
+	uint32_t valid_bits = families[vulkan->graphics_family_index].timestampValidBits;
+	free(families);
 
-	vka_barrier_info_t barrier_info = {0};
-	barrier_info.resource		= render_info->colour_image;
-	barrier_info.src_access_mask	= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	barrier_info.dst_access_mask	= VK_ACCESS_NONE;
-	barrier_info.old_layout		= VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	barrier_info.new_layout		= VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	vka_image_barrier(command_buffer, &barrier_info);
-}
+	statistics->timestamp_period =
+		vulkan->device_properties.properties.limits.timestampPeriod;
+	if (valid_bits >= 64) { statistics->timestamp_mask = UINT64_MAX; }
+	else { statistics->timestamp_mask = (1ULL << valid_bits) - 1; }
+	if (!valid_bits) { return 0; }
 
-void vka_set_viewport(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
-{
-	// Flip the viewport:
-	VkViewport viewport;
-	memset(&viewport, 0, sizeof(viewport));
-	viewport.x		= render_info->render_area.offset.x * 1.f;
-	viewport.y		= (render_info->render_target_height * 1.f) -
-				(render_info->render_area.offset.y * 1.f);
-	viewport.width		= render_info->render_area.extent.width * 1.f;
-	viewport.height		= -(render_info->render_area.extent.height * 1.f);
-	viewport.minDepth	= 0.f;
-	viewport.maxDepth	= 1.f;
+	VkQueryPoolCreateInfo query_pool_info;
+	memset(&query_pool_info, 0, sizeof(query_pool_info));
+	query_pool_info.sType		= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_info.pNext		= NULL;
+	query_pool_info.flags		= 0;
+	query_pool_info.queryType	= VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_info.queryCount	= VKA_STATISTICS_QUERIES_PER_FRAME * VKA_MAX_FRAMES_IN_FLIGHT;
 
-	vkCmdSetViewport(command_buffer->buffer, 0, 1, &viewport);
+	if (vkCreateQueryPool(vulkan->device, &query_pool_info, NULL,
+		&(statistics->timestamp_pool)) != VK_SUCCESS)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not create statistics timestamp query pool.");
+		return -1;
+	}
+
+	return 0;
 }
 
-void vka_set_scissor(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info)
+void vka_statistics_shut_down(vka_vulkan_t *vulkan)
 {
-	vkCmdSetScissor(command_buffer->buffer, 0, 1, &(render_info->scissor_area));
+	if (vulkan->statistics.timestamp_pool)
+	{
+		vkDestroyQueryPool(vulkan->device, vulkan->statistics.timestamp_pool, NULL);
+		vulkan->statistics.timestamp_pool = VK_NULL_HANDLE;
+	}
 }
 
-void vka_bind_vertex_buffers(vka_command_buffer_t *command_buffer, vka_buffer_t *index_buffer,
-				uint32_t num_vertex_buffers, vka_buffer_t vertex_buffers[])
+void vka_begin_frame_statistics(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	VkBuffer buffers[VKA_MAX_VERTEX_ATTRIBUTES];
-	VkDeviceSize offsets[VKA_MAX_VERTEX_ATTRIBUTES];
-	for (uint32_t i = 0; i < num_vertex_buffers; i++)
+	/* Call after beginning the frame's command buffer. GPU results are read back from the
+	 * last time this frame in flight was recorded, which its fence has already waited on. */
+	vka_statistics_t *statistics = &(vulkan->statistics);
+	uint32_t frame = vulkan->current_frame;
+	uint32_t first_query = frame * VKA_STATISTICS_QUERIES_PER_FRAME;
+
+	uint64_t counter = SDL_GetPerformanceCounter();
+	if (statistics->last_frame_counter)
 	{
-		buffers[i] = vertex_buffers[i].buffer;
-		offsets[i] = 0;
+		statistics->cpu_frame_time = (float)((double)(counter -
+			statistics->last_frame_counter) * 1000.0 /
+			(double)SDL_GetPerformanceFrequency());
 	}
+	statistics->last_frame_counter = counter;
+
+	if (statistics->timestamp_pool && statistics->queries_pending[frame])
+	{
+		uint64_t results[VKA_STATISTICS_QUERIES_PER_FRAME];
+		uint32_t num_results = 2 + (2 * statistics->num_queries[frame]);
+		if (vkGetQueryPoolResults(vulkan->device, statistics->timestamp_pool, first_query,
+			num_results, sizeof(results), results, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			double to_milliseconds = (double)(statistics->timestamp_period) / 1000000.0;
+			statistics->gpu_frame_time = (float)((double)((results[1] - results[0]) &
+						statistics->timestamp_mask) * to_milliseconds);
+
+			// A timer can be begun more than once per frame, so totals are summed:
+			for (uint32_t i = 0; i < statistics->num_timers; i++)
+			{
+				statistics->timers[i].milliseconds = 0.0f;
+			}
+			for (uint32_t i = 0; i < statistics->num_queries[frame]; i++)
+			{
+				uint64_t ticks = (results[(i * 2) + 3] - results[(i * 2) + 2]) &
+							statistics->timestamp_mask;
+				vka_gpu_timer_t *timer =
+					&(statistics->timers[statistics->query_timers[frame][i]]);
+				timer->milliseconds += (float)((double)ticks * to_milliseconds);
+			}
 
-	vkCmdBindVertexBuffers(command_buffer->buffer, 0, num_vertex_buffers, buffers, offsets);
+			#ifdef VKA_TRACE
+			if (vulkan->trace.calibrated_timestamps) { vka_trace_calibrate(vulkan); }
+			vka_trace_gpu(vulkan, "Frame", results[0], results[1]);
+			for (uint32_t i = 0; i < statistics->num_queries[frame]; i++)
+			{
+				vka_trace_gpu(vulkan,
+					statistics->timers[statistics->query_timers[frame][i]].name,
+					results[(i * 2) + 2], results[(i * 2) + 3]);
+			}
+			#endif
+		}
+		statistics->queries_pending[frame] = 0;
+	}
 
-	if (index_buffer)
+	uint32_t index = statistics->history_index;
+	statistics->cpu_history[index] = statistics->cpu_frame_time;
+	statistics->gpu_history[index] = statistics->gpu_frame_time;
+	for (uint32_t i = 0; i < statistics->num_timers; i++)
 	{
-		vkCmdBindIndexBuffer(command_buffer->buffer, index_buffer->buffer, 0,
-							index_buffer->index_type);
+		statistics->timers[i].history[index] = statistics->timers[i].milliseconds;
 	}
+	statistics->history_index = (index + 1) % VKA_STATISTICS_HISTORY;
+
+	statistics->num_queries[frame] = 0;
+	if (!statistics->timestamp_pool) { return; }
+
+	vkCmdResetQueryPool(command_buffer->buffer, statistics->timestamp_pool, first_query,
+						VKA_STATISTICS_QUERIES_PER_FRAME);
+	vkCmdWriteTimestamp(command_buffer->buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+					statistics->timestamp_pool, first_query);
 }
 
-void vka_bind_descriptor_sets(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
+void vka_end_frame_statistics(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer)
 {
-	for (uint32_t i = 0; i < pipeline->num_descriptor_sets; i++)
+	// Call before ending the frame's command buffer:
+	vka_statistics_t *statistics = &(vulkan->statistics);
+	uint32_t frame = vulkan->current_frame;
+
+	if (statistics->timestamp_pool)
 	{
-		pipeline->descriptor_layout_tracker[i] = pipeline->descriptor_sets[i]->layout;
-		pipeline->descriptor_set_tracker[i] = pipeline->descriptor_sets[i]->set;
+		vkCmdWriteTimestamp(command_buffer->buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			statistics->timestamp_pool, (frame * VKA_STATISTICS_QUERIES_PER_FRAME) + 1);
+		statistics->queries_pending[frame] = 1;
 	}
 
-	VkPipelineBindPoint bind_point;
-	if (pipeline->is_compute_pipeline) { bind_point = VK_PIPELINE_BIND_POINT_COMPUTE; }
-	else { bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS; }
+	vka_snapshot_counters(vulkan, 1, command_buffer, &(statistics->frame_counters));
+	vka_reset_counters(&(vulkan->counters));
+}
 
-	vkCmdBindDescriptorSets(command_buffer->buffer, bind_point, pipeline->layout, 0,
-		pipeline->num_descriptor_sets, pipeline->descriptor_set_tracker, 0, NULL);
+void vka_reset_counters(vka_counters_t *counters)
+{
+	memset(counters, 0, sizeof(vka_counters_t));
 }
 
-void vka_draw(vka_command_buffer_t *command_buffer, uint32_t num_vertices, int32_t vertex_offset)
+void vka_add_counters(vka_counters_t *total, vka_counters_t *counters)
 {
-	vkCmdDraw(command_buffer->buffer, num_vertices, 1, vertex_offset, 0);
+	total->num_draws			+= counters->num_draws;
+	total->num_dispatches			+= counters->num_dispatches;
+	total->num_barriers			+= counters->num_barriers;
+	total->num_copies			+= counters->num_copies;
+	total->bytes_copied			+= counters->bytes_copied;
+	total->num_pipeline_binds		+= counters->num_pipeline_binds;
+	total->num_descriptor_set_binds		+= counters->num_descriptor_set_binds;
+	total->num_push_constants		+= counters->num_push_constants;
+	total->num_submits			+= counters->num_submits;
+	total->num_descriptor_updates		+= counters->num_descriptor_updates;
+	total->num_descriptor_allocations	+= counters->num_descriptor_allocations;
+	total->num_memory_allocations		+= counters->num_memory_allocations;
+	total->bytes_allocated			+= counters->bytes_allocated;
 }
 
-void vka_draw_indexed(vka_command_buffer_t *command_buffer, uint32_t num_indices,
-				uint32_t index_offset, int32_t vertex_offset)
+void vka_snapshot_counters(vka_vulkan_t *vulkan, uint32_t num_command_buffers,
+		vka_command_buffer_t *command_buffers, vka_counters_t *snapshot)
 {
-	vkCmdDrawIndexed(command_buffer->buffer, num_indices, 1, index_offset, vertex_offset, 0);
+	// Vulkan base counters plus those of each command buffer. Nothing is reset:
+	*snapshot = vulkan->counters;
+	for (uint32_t i = 0; i < num_command_buffers; i++)
+	{
+		vka_add_counters(snapshot, &(command_buffers[i].counters));
+	}
 }
 
-void vka_draw_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-					VkDeviceSize draw_offset, uint32_t draw_count)
+void vka_get_counters(vka_counters_t *counters, const char *names[VKA_NUM_COUNTERS],
+						uint64_t values[VKA_NUM_COUNTERS])
 {
-	vkCmdDrawIndirect(command_buffer->buffer, draw_commands->buffer, draw_offset, draw_count,
-								sizeof(VkDrawIndirectCommand));
+	// Names are used as CSV columns and JSON keys:
+	names[0] = "draws";			values[0] = counters->num_draws;
+	names[1] = "dispatches";		values[1] = counters->num_dispatches;
+	names[2] = "barriers";			values[2] = counters->num_barriers;
+	names[3] = "copies";			values[3] = counters->num_copies;
+	names[4] = "bytes_copied";		values[4] = counters->bytes_copied;
+	names[5] = "pipeline_binds";		values[5] = counters->num_pipeline_binds;
+	names[6] = "descriptor_set_binds";	values[6] = counters->num_descriptor_set_binds;
+	names[7] = "push_constants";		values[7] = counters->num_push_constants;
+	names[8] = "submits";			values[8] = counters->num_submits;
+	names[9] = "descriptor_updates";	values[9] = counters->num_descriptor_updates;
+	names[10] = "descriptor_allocations";	values[10] = counters->num_descriptor_allocations;
+	names[11] = "memory_allocations";	values[11] = counters->num_memory_allocations;
+	names[12] = "bytes_allocated";		values[12] = counters->bytes_allocated;
 }
 
-void vka_draw_indexed_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-						VkDeviceSize draw_offset, uint32_t draw_count)
+void vka_write_counters_csv(FILE *file, uint32_t num_snapshots, vka_counters_t *snapshots)
 {
-	vkCmdDrawIndexedIndirect(command_buffer->buffer, draw_commands->buffer, draw_offset,
-					draw_count, sizeof(VkDrawIndexedIndirectCommand));
+	// Header row, then a row per snapshot:
+	const char *names[VKA_NUM_COUNTERS];
+	uint64_t values[VKA_NUM_COUNTERS];
+	vka_counters_t empty = {0};
+	vka_get_counters(&empty, names, values);
+
+	fprintf(file, "snapshot");
+	for (uint32_t i = 0; i < VKA_NUM_COUNTERS; i++) { fprintf(file, ",%s", names[i]); }
+	fprintf(file, "\n");
+
+	for (uint32_t i = 0; i < num_snapshots; i++)
+	{
+		vka_get_counters(&(snapshots[i]), names, values);
+		fprintf(file, "%u", i);
+		for (uint32_t j = 0; j < VKA_NUM_COUNTERS; j++)
+		{
+			fprintf(file, ",%llu", (unsigned long long)(values[j]));
+		}
+		fprintf(file, "\n");
+	}
 }
 
-void vka_draw_indirect_count(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-					vka_buffer_t *draw_counts, uint32_t max_draw_count)
+void vka_write_counters_json(FILE *file, uint32_t num_snapshots, vka_counters_t *snapshots)
 {
-	vkCmdDrawIndirectCount(command_buffer->buffer, draw_commands->buffer, 0,
-		draw_counts->buffer, 0, max_draw_count, sizeof(VkDrawIndirectCommand));
+	// Array of objects, one per snapshot:
+	const char *names[VKA_NUM_COUNTERS];
+	uint64_t values[VKA_NUM_COUNTERS];
+
+	fprintf(file, "[\n");
+	for (uint32_t i = 0; i < num_snapshots; i++)
+	{
+		vka_get_counters(&(snapshots[i]), names, values);
+		fprintf(file, "\t{ \"snapshot\": %u", i);
+		for (uint32_t j = 0; j < VKA_NUM_COUNTERS; j++)
+		{
+			fprintf(file, ", \"%s\": %llu", names[j], (unsigned long long)(values[j]));
+		}
+		if (i + 1 < num_snapshots) { fprintf(file, " },\n"); }
+		else { fprintf(file, " }\n"); }
+	}
+	fprintf(file, "]\n");
 }
 
-void vka_draw_indexed_indirect_count(vka_command_buffer_t *command_buffer,
-	vka_buffer_t *draw_commands, vka_buffer_t *draw_counts, uint32_t max_draw_count)
+uint32_t vka_begin_gpu_timer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							const char *name)
 {
-	vkCmdDrawIndexedIndirectCount(command_buffer->buffer, draw_commands->buffer, 0,
-		draw_counts->buffer, 0, max_draw_count, sizeof(VkDrawIndexedIndirectCommand));
+	/* Returns the value to pass to vka_end_gpu_timer(), or UINT32_MAX if there are no
+	 * timestamps or timers left. Timers can be nested. */
+	vka_statistics_t *statistics = &(vulkan->statistics);
+	uint32_t frame = vulkan->current_frame;
+
+	if (!statistics->timestamp_pool) { return UINT32_MAX; }
+	if (statistics->num_queries[frame] >= VKA_MAX_GPU_TIMERS) { return UINT32_MAX; }
+
+	uint32_t timer = 0;
+	for (timer = 0; timer < statistics->num_timers; timer++)
+	{
+		if (!strcmp(statistics->timers[timer].name, name)) { break; }
+	}
+	if (timer == statistics->num_timers)
+	{
+		if (statistics->num_timers >= VKA_MAX_GPU_TIMERS) { return UINT32_MAX; }
+		memset(&(statistics->timers[timer]), 0, sizeof(statistics->timers[timer]));
+		strncpy(statistics->timers[timer].name, name, VKA_MAX_NAME_LENGTH - 1);
+		statistics->num_timers++;
+	}
+
+	uint32_t pair = statistics->num_queries[frame];
+	statistics->query_timers[frame][pair] = timer;
+	statistics->num_queries[frame]++;
+
+	vkCmdWriteTimestamp(command_buffer->buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		statistics->timestamp_pool,
+		(frame * VKA_STATISTICS_QUERIES_PER_FRAME) + 2 + (pair * 2));
+
+	return pair;
 }
 
-int vka_present_image(vka_vulkan_t *vulkan)
+void vka_end_gpu_timer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							uint32_t timer)
 {
-	VkPresentInfoKHR present_info;
-	memset(&present_info, 0, sizeof(present_info));
-	present_info.sType		= VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	present_info.pNext		= NULL;
-	present_info.waitSemaphoreCount	= 1;
-	present_info.pWaitSemaphores	= &(vulkan->render_complete[vulkan->current_frame]);
-	present_info.swapchainCount	= 1;
-	present_info.pSwapchains	= &(vulkan->swapchain);
-	present_info.pImageIndices	= &(vulkan->current_swapchain_index);
-	present_info.pResults		= NULL;
+	if (timer == UINT32_MAX) { return; }
 
-	VkResult result = vkQueuePresentKHR(vulkan->present_queue, &present_info);
-	if (result != VK_SUCCESS)
+	uint32_t frame = vulkan->current_frame;
+	vkCmdWriteTimestamp(command_buffer->buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		vulkan->statistics.timestamp_pool,
+		(frame * VKA_STATISTICS_QUERIES_PER_FRAME) + 3 + (timer * 2));
+}
+
+#ifdef VKA_NUKLEAR
+void vka_draw_statistics_hud(vka_vulkan_t *vulkan, struct nk_rect bounds,
+		uint32_t num_descriptor_pools, vka_descriptor_pool_t *descriptor_pools)
+{
+	// Builds a Nuklear window - call between the frame's input and vka_nuklear_draw():
+	vka_statistics_t *statistics = &(vulkan->statistics);
+	struct nk_context *context = &(vulkan->nuklear_context);
+	char text[VKA_MAX_NAME_LENGTH * 2];
+
+	if (nk_begin(context, "Statistics", bounds, NK_WINDOW_BORDER | NK_WINDOW_MOVABLE |
+		NK_WINDOW_SCALABLE | NK_WINDOW_MINIMIZABLE | NK_WINDOW_TITLE))
 	{
-		if ((result == VK_SUBOPTIMAL_KHR) || (result == VK_ERROR_OUT_OF_DATE_KHR))
+		// Frame times (CPU and GPU on one graph):
+		nk_layout_row_dynamic(context, 20, 2);
+		snprintf(text, sizeof(text), "CPU: %.2f ms", statistics->cpu_frame_time);
+		nk_label(context, text, NK_TEXT_LEFT);
+		if (statistics->timestamp_pool)
 		{
-			vulkan->recreate_swapchain = 1;
-			return 0;
+			snprintf(text, sizeof(text), "GPU: %.2f ms", statistics->gpu_frame_time);
+		}
+		else { snprintf(text, sizeof(text), "GPU: no timestamps"); }
+		nk_label(context, text, NK_TEXT_LEFT);
+
+		nk_layout_row_dynamic(context, 60, 1);
+		vka_draw_statistics_graph(context, VKA_STATISTICS_HISTORY,
+			statistics->history_index, statistics->cpu_history,
+			statistics->gpu_history);
+
+		// GPU timers:
+		for (uint32_t i = 0; i < statistics->num_timers; i++)
+		{
+			vka_gpu_timer_t *timer = &(statistics->timers[i]);
+			nk_layout_row_dynamic(context, 20, 1);
+			snprintf(text, sizeof(text), "%s: %.3f ms", timer->name, timer->milliseconds);
+			nk_label(context, text, NK_TEXT_LEFT);
+
+			nk_layout_row_dynamic(context, 30, 1);
+			vka_draw_statistics_graph(context, VKA_STATISTICS_HISTORY,
+				statistics->history_index, timer->history, NULL);
+		}
+
+		// Last frame's counters:
+		const char *names[VKA_NUM_COUNTERS];
+		uint64_t values[VKA_NUM_COUNTERS];
+		vka_get_counters(&(statistics->frame_counters), names, values);
+		nk_layout_row_dynamic(context, 20, 2);
+		for (uint32_t i = 0; i < VKA_NUM_COUNTERS; i++)
+		{
+			snprintf(text, sizeof(text), "%s: %llu", names[i],
+						(unsigned long long)(values[i]));
+			nk_label(context, text, NK_TEXT_LEFT);
+		}
+
+		// Memory heaps (estimated usage):
+		for (uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++)
+		{
+			if (!vulkan->heap_sizes[i]) { continue; }
+			nk_layout_row_dynamic(context, 20, 2);
+			snprintf(text, sizeof(text), "Heap %u: %.1f / %.1f MiB", i,
+				(double)(vulkan->heap_usage[i]) / (1024.0 * 1024.0),
+				(double)(vulkan->heap_sizes[i]) / (1024.0 * 1024.0));
+			nk_label(context, text, NK_TEXT_LEFT);
+			nk_size usage = (nk_size)(vulkan->heap_usage[i]);
+			nk_progress(context, &usage, (nk_size)(vulkan->heap_sizes[i]), nk_false);
 		}
+
+		// Descriptor pools:
+		for (uint32_t i = 0; i < num_descriptor_pools; i++)
+		{
+			vka_descriptor_pool_t *pool = &(descriptor_pools[i]);
+			nk_layout_row_dynamic(context, 20, 2);
+			snprintf(text, sizeof(text), "%s: %u / %u sets", pool->name,
+					pool->num_allocated_sets, pool->max_sets);
+			nk_label(context, text, NK_TEXT_LEFT);
+			nk_size allocated = pool->num_allocated_sets;
+			nk_progress(context, &allocated, pool->max_sets, nk_false);
+		}
+
+		// Swapchain:
+		nk_layout_row_dynamic(context, 20, 1);
+		if (vulkan->headless) { snprintf(text, sizeof(text), "Swapchain: headless"); }
 		else
+		{
+			snprintf(text, sizeof(text), "Swapchain: %u images, %ux%u, image %u",
+				vulkan->num_swapchain_images, vulkan->swapchain_extent.width,
+				vulkan->swapchain_extent.height, vulkan->current_swapchain_index);
+		}
+		nk_label(context, text, NK_TEXT_LEFT);
+		if (vulkan->recreate_swapchain)
+		{
+			nk_layout_row_dynamic(context, 20, 1);
+			nk_label(context, "Swapchain recreation pending", NK_TEXT_LEFT);
+		}
+	}
+	nk_end(context);
+}
+
+void vka_draw_statistics_graph(struct nk_context *context, uint32_t num_values,
+		uint32_t first_value, const float *values, const float *second_values)
+{
+	// Values are a ring buffer starting at first_value. Second values are optional:
+	float maximum = 1.0f;
+	for (uint32_t i = 0; i < num_values; i++)
+	{
+		if (values[i] > maximum) { maximum = values[i]; }
+		if (second_values && (second_values[i] > maximum)) { maximum = second_values[i]; }
+	}
+
+	if (!nk_chart_begin(context, NK_CHART_LINES, (int)num_values, 0.0f, maximum)) { return; }
+	if (second_values)
+	{
+		nk_chart_add_slot(context, NK_CHART_LINES, (int)num_values, 0.0f, maximum);
+	}
+
+	for (uint32_t i = 0; i < num_values; i++)
+	{
+		uint32_t index = (first_value + i) % num_values;
+		nk_chart_push_slot(context, values[index], 0);
+		if (second_values) { nk_chart_push_slot(context, second_values[index], 1); }
+	}
+	nk_chart_end(context);
+}
+#endif // VKA_NUKLEAR
+#endif // VKA_STATISTICS
+
+#ifdef VKA_TRACE
+int vka_trace_set_up(vka_vulkan_t *vulkan)
+{
+	vka_trace_t *trace = &(vulkan->trace);
+	if (vka_create_trace(vulkan, trace)) { return -1; }
+
+	// GPU ticks are converted using the graphics queue's timestamp properties:
+	uint32_t num_families = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vulkan->physical_device, &num_families, NULL);
+	VkQueueFamilyProperties *families = malloc(num_families * sizeof(VkQueueFamilyProperties));
+	if (!families)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for queue family properties.");
+		return -1;
+	}
+	vkGetPhysicalDeviceQueueFamilyProperties(vulkan->physical_device, &num_families, families);
+	uint32_t valid_bits = families[vulkan->graphics_family_index].timestampValidBits;
+	free(families);
+
+	trace->timestamp_period = vulkan->device_properties.properties.limits.timestampPeriod;
+	if (valid_bits >= 64) { trace->timestamp_mask = UINT64_MAX; }
+	else { trace->timestamp_mask = (1ULL << valid_bits) - 1; }
+	if (!valid_bits) { return 0; }
+
+	// The device time domain is needed to calibrate without submitting anything:
+	if (trace->calibrated_timestamps)
+	{
+		uint32_t num_domains = 0;
+		vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(vulkan->physical_device,
+								&num_domains, NULL);
+		VkTimeDomainEXT *domains = malloc(num_domains * sizeof(VkTimeDomainEXT));
+		if (!domains)
 		{
 			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Could not present swapchain image.");
+				"Could not allocate memory for time domains.");
 			return -1;
 		}
+		vkGetPhysicalDeviceCalibrateableTimeDomainsEXT(vulkan->physical_device,
+							&num_domains, domains);
+
+		trace->calibrated_timestamps = 0;
+		for (uint32_t i = 0; i < num_domains; i++)
+		{
+			if (domains[i] == VK_TIME_DOMAIN_DEVICE_EXT) { trace->calibrated_timestamps = 1; }
+		}
+		free(domains);
+	}
+
+	return vka_trace_calibrate(vulkan);
+}
+
+void vka_trace_shut_down(vka_vulkan_t *vulkan)
+{
+	vka_destroy_trace(&(vulkan->trace));
+}
+
+int vka_create_trace(vka_vulkan_t *vulkan, vka_trace_t *trace)
+{
+	// Needs no device, so can be used on its own (with a fake clock, for instance):
+	trace->events = calloc(VKA_TRACE_MAX_EVENTS, sizeof(vka_trace_event_t));
+	if (!trace->events)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for trace events.");
+		return -1;
 	}
+	SDL_SetAtomicInt(&(trace->num_events), 0);
 
 	return 0;
 }
 
-/***********
- * Compute *
- ***********/
+void vka_destroy_trace(vka_trace_t *trace)
+{
+	if (trace->events)
+	{
+		free(trace->events);
+		trace->events = NULL;
+	}
+}
 
-void vka_dispatch(vka_command_buffer_t *command_buffer, uint32_t group_count_x,
-			uint32_t group_count_y, uint32_t group_count_z)
+uint64_t vka_trace_default_clock(void *clock_data)
 {
-	vkCmdDispatch(command_buffer->buffer, group_count_x, group_count_y, group_count_z);
+	(void)clock_data;
+	return SDL_GetTicksNS();
 }
 
-void vka_dispatch_indirect(vka_command_buffer_t *command_buffer,
-	vka_buffer_t *dispatch_commands, VkDeviceSize command_offset)
+uint64_t vka_trace_time(vka_trace_t *trace)
 {
-	vkCmdDispatchIndirect(command_buffer->buffer, dispatch_commands->buffer, command_offset);
+	if (trace->clock) { return trace->clock(trace->clock_data); }
+	return vka_trace_default_clock(NULL);
 }
 
-/**********
- * Memory *
- **********/
+uint64_t vka_trace_begin(vka_trace_t *trace)
+{
+	return vka_trace_time(trace);
+}
 
-int vka_create_allocation(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+void vka_trace_end(vka_trace_t *trace, const char *name, uint64_t start)
 {
-	// TODO - check if allocation size exceeds max allocation size? Some implementations
-	// allow allocation larger than the limit anyway so might not be desirable.
-	if (!allocation->requirements.size)
-	{
-		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Trying to allocate memory of size 0 for \"%s\".", allocation->name);
-		return -1;
+	uint64_t end = vka_trace_time(trace);
+	vka_trace_event(trace, name, (uint64_t)SDL_GetCurrentThreadID(), start, end - start, 0);
+}
+
+void vka_trace_event(vka_trace_t *trace, const char *name, uint64_t thread_id, uint64_t start,
+						uint64_t duration, uint8_t gpu)
+{
+	/* Safe from any thread. Slots are claimed atomically, overwriting the oldest events, and
+	 * only marked with their sequence number once written, so vka_write_trace() can skip
+	 * events that are still being written (or overwritten). */
+	if (!trace->events) { return; }
+
+	uint32_t index = (uint32_t)SDL_AddAtomicInt(&(trace->num_events), 1);
+	vka_trace_event_t *event = &(trace->events[index % VKA_TRACE_MAX_EVENTS]);
+	SDL_SetAtomicInt(&(event->sequence), 0);
+	strncpy(event->name, name, VKA_MAX_NAME_LENGTH - 1);
+	event->name[VKA_MAX_NAME_LENGTH - 1] = '\0';
+	event->thread_id = thread_id;
+	event->start = start;
+	event->duration = duration;
+	event->gpu = gpu;
+	SDL_MemoryBarrierRelease();
+	SDL_SetAtomicInt(&(event->sequence), (int)(index + 1));
+}
+
+int vka_trace_calibrate(vka_vulkan_t *vulkan)
+{
+	/* Matches a GPU tick to the trace clock. With VK_EXT_calibrated_timestamps this is cheap
+	 * enough to repeat every frame. Otherwise a timestamp is submitted once and waited on,
+	 * which is accurate to the submission latency. */
+	vka_trace_t *trace = &(vulkan->trace);
+	if (!trace->timestamp_mask) { return 0; }
+
+	if (trace->calibrated_timestamps)
+	{
+		VkCalibratedTimestampInfoEXT timestamp_info;
+		memset(&timestamp_info, 0, sizeof(timestamp_info));
+		timestamp_info.sType		= VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		timestamp_info.pNext		= NULL;
+		timestamp_info.timeDomain	= VK_TIME_DOMAIN_DEVICE_EXT;
+
+		uint64_t ticks = 0;
+		uint64_t deviation = 0;
+		uint64_t before = vka_trace_time(trace);
+		if (vkGetCalibratedTimestampsEXT(vulkan->device, 1, &timestamp_info, &ticks,
+							&deviation) != VK_SUCCESS)
+		{
+			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+				"Could not get calibrated timestamps.");
+			return -1;
+		}
+		uint64_t after = vka_trace_time(trace);
+
+		trace->gpu_base_ticks = ticks;
+		trace->gpu_base_time = before + ((after - before) / 2);
+		trace->calibrated = 1;
+		return 0;
 	}
+	if (trace->calibrated) { return 0; }
 
-	if (!allocation->properties[0])
+	VkQueryPoolCreateInfo query_pool_info;
+	memset(&query_pool_info, 0, sizeof(query_pool_info));
+	query_pool_info.sType		= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_info.pNext		= NULL;
+	query_pool_info.flags		= 0;
+	query_pool_info.queryType	= VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_info.queryCount	= 1;
+
+	VkQueryPool query_pool = VK_NULL_HANDLE;
+	if (vkCreateQueryPool(vulkan->device, &query_pool_info, NULL, &query_pool) != VK_SUCCESS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Trying to allocate memory with no first choice of properties for \"%s\".",
-			allocation->name);
+			"Could not create trace calibration query pool.");
 		return -1;
 	}
 
-	VkPhysicalDeviceMemoryProperties device_properties;
-	vkGetPhysicalDeviceMemoryProperties(vulkan->physical_device, &device_properties);
-	int found_type[2] = {0};
-	uint32_t type_index[2];
-	uint32_t heap_index[2];
-	for (uint32_t i = 0; i < device_properties.memoryTypeCount; i++)
+	vka_command_buffer_t command_buffer = {0};
+	strcpy(command_buffer.name, "Trace calibration");
+	command_buffer.queue = &(vulkan->graphics_queue);
+
+	int failed = 0;
+	uint64_t submit_time = 0;
+	if (vka_create_command_buffer(vulkan, &command_buffer) ||
+		vka_begin_command_buffer(vulkan, &command_buffer))
 	{
-		if (allocation->requirements.memoryTypeBits & (1 << i))
-		{
-			for (int j = 0; j < 2; j++)
-			{
-				if (!found_type[j] && allocation->properties[j] &&
-					((device_properties.memoryTypes[i].propertyFlags &
-					allocation->properties[j]) == allocation->properties[j]))
-				{
-					type_index[j] = i;
-					heap_index[j] = device_properties.memoryTypes[i].heapIndex;
-					found_type[j] = 1;
-				}
-			}
+		failed = 1;
+	}
+	else
+	{
+		vkCmdResetQueryPool(command_buffer.buffer, query_pool, 0, 1);
+		vkCmdWriteTimestamp(command_buffer.buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+								query_pool, 0);
+		submit_time = vka_trace_time(trace);
+		if (vka_end_command_buffer(vulkan, &command_buffer) ||
+			vka_submit_command_buffer(vulkan, &command_buffer) ||
+			vka_wait_for_fence(vulkan, &command_buffer))
+		{
+			failed = 1;
 		}
-		if (found_type[0] && found_type[1]) { break; }
 	}
 
-	if (!found_type[0] && !found_type[1])
+	uint64_t ticks = 0;
+	if (!failed && (vkGetQueryPoolResults(vulkan->device, query_pool, 0, 1, sizeof(ticks),
+			&ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS))
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not find suitable memory type for \"%s\".", allocation->name);
-		return -1;
+			"Could not read trace calibration timestamp.");
+		failed = 1;
 	}
 
-	// Try allocating memory for first choice, then second (if applicable):
-	VkMemoryAllocateInfo allocate_info;
-	memset(&allocate_info, 0, sizeof(allocate_info));
-	allocate_info.sType		= VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocate_info.pNext		= NULL;
-	allocate_info.allocationSize	= allocation->requirements.size;
-	for (int i = 0; i < 2; i++)
+	if (command_buffer.buffer)
 	{
-		if (!found_type[i]) { continue; }
+		vkFreeCommandBuffers(vulkan->device, vulkan->command_pool, 1, &(command_buffer.buffer));
+	}
+	vka_destroy_command_buffer(vulkan, &command_buffer);
+	vkDestroyQueryPool(vulkan->device, query_pool, NULL);
 
-		// Query heap usage:
-		VkDeviceSize memory_available;
-		if (vulkan->memory_budget_enabled)
-		{
-			// TODO
-			memory_available = (vulkan->heap_sizes[heap_index[i]] *
-				VKA_HEAP_THRESHOLD) - vulkan->heap_usage[heap_index[i]];
-		}
-		else
-		{
-			memory_available = (vulkan->heap_sizes[heap_index[i]] *
-				VKA_HEAP_THRESHOLD) - vulkan->heap_usage[heap_index[i]];
-		}
+	if (failed) { return -1; }
+	trace->gpu_base_ticks = ticks;
+	trace->gpu_base_time = submit_time;
+	trace->calibrated = 1;
 
-		// Allocate memory:
-		if (allocation->requirements.size <= memory_available)
+	return 0;
+}
+
+void vka_trace_gpu(vka_vulkan_t *vulkan, const char *name, uint64_t start_ticks,
+							uint64_t end_ticks)
+{
+	// Records a GPU event from raw timestamps, relative to the last calibration:
+	vka_trace_t *trace = &(vulkan->trace);
+	if (!trace->calibrated) { return; }
+
+	// Ticks before the calibration wrap round, so are sign-extended from the valid bits:
+	int64_t delta = (int64_t)((start_ticks - trace->gpu_base_ticks) & trace->timestamp_mask);
+	if ((trace->timestamp_mask != UINT64_MAX) && ((uint64_t)delta > (trace->timestamp_mask / 2)))
+	{
+		delta -= (int64_t)(trace->timestamp_mask) + 1;
+	}
+	uint64_t ticks = (end_ticks - start_ticks) & trace->timestamp_mask;
+
+	int64_t start = (int64_t)(trace->gpu_base_time) +
+			(int64_t)((double)delta * (double)(trace->timestamp_period));
+	if (start < 0) { start = 0; }
+	uint64_t duration = (uint64_t)((double)ticks * (double)(trace->timestamp_period));
+
+	vka_trace_event(trace, name, 0, (uint64_t)start, duration, 1);
+}
+
+void vka_write_trace(FILE *file, vka_trace_t *trace)
+{
+	// Chrome trace event JSON (chrome://tracing, Perfetto), oldest event first:
+	uint32_t num_events = (uint32_t)SDL_GetAtomicInt(&(trace->num_events));
+	uint32_t first_event = 0;
+	if (num_events > VKA_TRACE_MAX_EVENTS) { first_event = num_events - VKA_TRACE_MAX_EVENTS; }
+
+	fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(file, "\t{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+			"\"args\": {\"name\": \"CPU\"}},\n");
+	fprintf(file, "\t{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 2, "
+			"\"args\": {\"name\": \"GPU\"}}");
+
+	for (uint32_t i = first_event; (i < num_events) && trace->events; i++)
+	{
+		// Copied out, then skipped if it wasn't finished or was overwritten while copying:
+		vka_trace_event_t *slot = &(trace->events[i % VKA_TRACE_MAX_EVENTS]);
+		if ((uint32_t)SDL_GetAtomicInt(&(slot->sequence)) != (i + 1)) { continue; }
+		vka_trace_event_t copy;
+		memcpy(copy.name, slot->name, VKA_MAX_NAME_LENGTH);
+		copy.thread_id = slot->thread_id;
+		copy.start = slot->start;
+		copy.duration = slot->duration;
+		copy.gpu = slot->gpu;
+		SDL_MemoryBarrierAcquire();
+		if ((uint32_t)SDL_GetAtomicInt(&(slot->sequence)) != (i + 1)) { continue; }
+		copy.name[VKA_MAX_NAME_LENGTH - 1] = '\0';
+		vka_trace_event_t *event = &copy;
+
+		fprintf(file, ",\n\t{\"name\": \"");
+		for (const char *c = event->name; *c; c++)
 		{
-			allocate_info.memoryTypeIndex = type_index[i];
-			if (vkAllocateMemory(vulkan->device, &allocate_info, NULL,
-					&(allocation->memory)) == VK_SUCCESS)
-			{
-				allocation->heap_index = heap_index[i];
-				vulkan->heap_usage[heap_index[i]] += allocation->requirements.size;
-				return 0;
-			}
+			if ((*c == '"') || (*c == '\\')) { fputc('\\', file); }
+			if ((unsigned char)(*c) >= 0x20) { fputc(*c, file); }
 		}
-	}
 
-	snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-		"Could not allocate memory for \"%s\".", allocation->name);
-	return -1;
+		int pid = 1;
+		if (event->gpu) { pid = 2; }
+		fprintf(file, "\", \"ph\": \"X\", \"pid\": %d, \"tid\": %llu, "
+			"\"ts\": %.3f, \"dur\": %.3f}", pid, (unsigned long long)(event->thread_id),
+			(double)(event->start) / 1000.0, (double)(event->duration) / 1000.0);
+	}
+	fprintf(file, "\n]}\n");
 }
+#endif // VKA_TRACE
 
-void vka_destroy_allocation(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+#ifdef VKA_BENCHMARK
+int vka_create_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	if (allocation->mapped_data) { vka_unmap_memory(vulkan, allocation); }
+	vka_destroy_benchmark(vulkan, benchmark);
 
-	if (allocation->memory)
+	if (!benchmark->iterations) { benchmark->iterations = VKA_BENCHMARK_ITERATIONS; }
+	if (!benchmark->warm_up_iterations)
 	{
-		vkFreeMemory(vulkan->device, allocation->memory, NULL);
-		allocation->memory = VK_NULL_HANDLE;
+		benchmark->warm_up_iterations = VKA_BENCHMARK_WARM_UP_ITERATIONS;
+	}
+	if (!benchmark->num_draws) { benchmark->num_draws = VKA_BENCHMARK_DRAWS; }
+	if (!benchmark->num_indices) { benchmark->num_indices = 3; }
+	benchmark->num_results = 0;
 
-		vulkan->heap_usage[allocation->heap_index] -= allocation->requirements.size;
-		allocation->heap_index = 0;
+	benchmark->samples = malloc(benchmark->iterations * sizeof(uint64_t));
+	if (!benchmark->samples)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for benchmark samples.");
+		return -1;
 	}
 
-	memset(&(allocation->requirements), 0, sizeof(allocation->requirements));
+	strcpy(benchmark->command_buffer.name, "Benchmark");
+	benchmark->command_buffer.queue = &(vulkan->graphics_queue);
+	if (vka_create_command_buffer(vulkan, &(benchmark->command_buffer))) { return -1; }
+
+	// Scratch buffers sharing one host allocation, like a typical set of uniform buffers:
+	strcpy(benchmark->allocation.name, "Benchmark");
+	benchmark->allocation.properties[0] = VKA_MEMORY_HOST;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		snprintf(benchmark->buffers[i].name, VKA_MAX_NAME_LENGTH, "Benchmark %u", i);
+		benchmark->buffers[i].allocation = &(benchmark->allocation);
+		benchmark->buffers[i].size = 64 * 1024;
+		benchmark->buffers[i].usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+	}
+
+	return 0;
 }
 
-int vka_map_memory(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+void vka_destroy_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	VkDeviceSize map_size = allocation->map_size;
-	if (!map_size) { map_size = VK_WHOLE_SIZE; }
+	if (benchmark->command_buffer.buffer)
+	{
+		vkFreeCommandBuffers(vulkan->device, vulkan->command_pool, 1,
+					&(benchmark->command_buffer.buffer));
+	}
+	vka_destroy_command_buffer(vulkan, &(benchmark->command_buffer));
 
-	if (vkMapMemory(vulkan->device, allocation->memory, allocation->map_offset,
-			map_size, 0, &(allocation->mapped_data)) != VK_SUCCESS)
+	for (uint32_t i = 0; i < 4; i++) { vka_destroy_buffer(vulkan, &(benchmark->buffers[i])); }
+	vka_destroy_allocation(vulkan, &(benchmark->allocation));
+
+	if (benchmark->samples)
+	{
+		free(benchmark->samples);
+		benchmark->samples = NULL;
+	}
+}
+
+int vka_run_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark, const char *name,
+	uint32_t operations, int (*function)(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark))
+{
+	/* Times each iteration of function separately, after some untimed warm-up iterations.
+	 * Operations is how many of the measured calls one iteration makes, so results can be
+	 * compared per call. */
+	if (benchmark->num_results >= VKA_MAX_BENCHMARK_RESULTS)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not map memory for \"%s\".", allocation->name);
+			"Too many benchmark results for \"%s\".", name);
 		return -1;
 	}
 
+	for (uint32_t i = 0; i < benchmark->warm_up_iterations; i++)
+	{
+		if (function(vulkan, benchmark)) { return -1; }
+	}
+
+	uint64_t total = 0;
+	for (uint32_t i = 0; i < benchmark->iterations; i++)
+	{
+		uint64_t start = SDL_GetTicksNS();
+		if (function(vulkan, benchmark)) { return -1; }
+		benchmark->samples[i] = SDL_GetTicksNS() - start;
+		total += benchmark->samples[i];
+	}
+	qsort(benchmark->samples, benchmark->iterations, sizeof(uint64_t),
+					vka_compare_benchmark_samples);
+
+	vka_benchmark_result_t *result = &(benchmark->results[benchmark->num_results]);
+	memset(result, 0, sizeof(vka_benchmark_result_t));
+	strncpy(result->name, name, VKA_MAX_NAME_LENGTH - 1);
+	result->iterations = benchmark->iterations;
+	result->operations = operations;
+	result->total = total;
+	result->minimum = benchmark->samples[0];
+	result->median = benchmark->samples[benchmark->iterations / 2];
+	result->maximum = benchmark->samples[benchmark->iterations - 1];
+	benchmark->num_results++;
+
 	return 0;
 }
 
-void vka_unmap_memory(vka_vulkan_t *vulkan, vka_allocation_t *allocation)
+int vka_run_benchmarks(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	if (allocation->mapped_data)
+	// Runs each core benchmark whose objects are configured. Frame last, as it presents:
+	vka_device_wait_idle(vulkan);
+
+	if (vka_run_benchmark(vulkan, benchmark, "vka_create_allocation", 1,
+					vka_benchmark_allocation))
 	{
-		vkUnmapMemory(vulkan->device, allocation->memory);
-		allocation->mapped_data = NULL;
+		return -1;
+	}
+	if (vka_run_benchmark(vulkan, benchmark, "vka_set_up_buffers", 4, vka_benchmark_buffers))
+	{
+		return -1;
+	}
+	if (benchmark->descriptor_set && vka_run_benchmark(vulkan, benchmark,
+			"vka_update_descriptor_set", 1, vka_benchmark_descriptor_set))
+	{
+		return -1;
+	}
+	if (benchmark->pipeline && vka_run_benchmark(vulkan, benchmark, "vka_create_pipeline", 1,
+								vka_benchmark_pipeline))
+	{
+		return -1;
 	}
+	if (benchmark->pipeline && benchmark->render_info && benchmark->index_buffer &&
+		vka_run_benchmark(vulkan, benchmark, "vka_draw_indexed", benchmark->num_draws,
+							vka_benchmark_draws))
+	{
+		return -1;
+	}
+	if (vka_run_benchmark(vulkan, benchmark, "Frame", 1, vka_benchmark_frame)) { return -1; }
+
+	vka_device_wait_idle(vulkan);
+
+	return 0;
 }
 
-/********
- * Misc *
- ********/
+int vka_benchmark_allocation(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
+{
+	// One host-visible megabyte, allocated and freed:
+	benchmark->allocation.requirements.size = 1024 * 1024;
+	benchmark->allocation.requirements.alignment = 256;
+	benchmark->allocation.requirements.memoryTypeBits = UINT32_MAX;
+	if (vka_create_allocation(vulkan, &(benchmark->allocation))) { return -1; }
+	vka_destroy_allocation(vulkan, &(benchmark->allocation));
 
-void vka_device_wait_idle(vka_vulkan_t *vulkan)
+	return 0;
+}
+
+int vka_benchmark_buffers(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	if (vulkan->device) { vkDeviceWaitIdle(vulkan->device); }
+	if (vka_set_up_buffers(vulkan, 4, benchmark->buffers)) { return -1; }
+	for (uint32_t i = 0; i < 4; i++) { vka_destroy_buffer(vulkan, &(benchmark->buffers[i])); }
+	vka_destroy_allocation(vulkan, &(benchmark->allocation));
+
+	return 0;
 }
 
-void vka_next_frame(vka_vulkan_t *vulkan)
+int vka_benchmark_descriptor_set(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	vulkan->current_frame = (vulkan->current_frame + 1) % VKA_MAX_FRAMES_IN_FLIGHT;
+	return vka_update_descriptor_set(vulkan, benchmark->descriptor_set);
 }
 
-int vka_get_next_swapchain_image(vka_vulkan_t *vulkan)
+int vka_benchmark_pipeline(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
 {
-	VkResult error = vkAcquireNextImageKHR(vulkan->device, vulkan->swapchain, UINT64_MAX,
-		vulkan->image_available[vulkan->current_frame], VK_NULL_HANDLE,
-		&(vulkan->current_swapchain_index));
+	// Shader modules and pipeline library parts are cached, as they would be in a reload:
+	return vka_create_pipeline(vulkan, benchmark->pipeline);
+}
 
-	if (error != VK_SUCCESS)
+int vka_benchmark_draws(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
+{
+	// Recording only. The command buffer is begun again next time, without being submitted:
+	vka_command_buffer_t *command_buffer = &(benchmark->command_buffer);
+	if (vka_begin_command_buffer(vulkan, command_buffer)) { return -1; }
+
+	vka_begin_rendering(command_buffer, benchmark->render_info);
+	vka_bind_pipeline(command_buffer, benchmark->pipeline);
+	vka_bind_descriptor_sets(command_buffer, benchmark->pipeline);
+	vka_set_viewport(command_buffer, benchmark->render_info);
+	vka_set_scissor(command_buffer, benchmark->render_info);
+	vka_bind_vertex_buffers(command_buffer, benchmark->index_buffer,
+			benchmark->num_vertex_buffers, benchmark->vertex_buffers);
+	for (uint32_t i = 0; i < benchmark->num_draws; i++)
 	{
-		if ((error == VK_SUBOPTIMAL_KHR) || (error == VK_ERROR_OUT_OF_DATE_KHR))
-		{
-			vulkan->recreate_swapchain = 1;
-		}
-		else
+		vka_draw_indexed(command_buffer, benchmark->num_indices, 0, 0);
+	}
+	vka_end_rendering(command_buffer);
+
+	return vka_end_command_buffer(vulkan, command_buffer);
+}
+
+int vka_benchmark_frame(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
+{
+	/* An empty frame: acquire, begin (waiting on the frame's fence), clear the swapchain
+	 * image, submit and present. Headless skips the swapchain. */
+	(void)benchmark;
+
+	if (!vulkan->headless)
+	{
+		if (vka_get_next_swapchain_image(vulkan)) { return -1; }
+		if (vulkan->recreate_swapchain)
 		{
 			snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-				"Could not acquire next swapchain image.");
+				"Swapchain out of date during frame benchmark.");
 			return -1;
 		}
 	}
 
+	vka_command_buffer_t *command_buffer = &(vulkan->command_buffers[vulkan->current_frame]);
+	if (vka_begin_command_buffer(vulkan, command_buffer)) { return -1; }
+
+	if (!vulkan->headless)
+	{
+		vka_render_info_t render_info = {0};
+		render_info.colour_image = &(vulkan->swapchain_images[vulkan->current_swapchain_index]);
+		render_info.colour_load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		render_info.colour_store_op = VK_ATTACHMENT_STORE_OP_STORE;
+		render_info.render_area.extent = vulkan->swapchain_extent;
+		vka_begin_rendering_barrier(command_buffer, &render_info);
+		vka_end_rendering_barrier(command_buffer, &render_info);
+	}
+
+	if (vka_end_command_buffer(vulkan, command_buffer)) { return -1; }
+	if (vka_submit_command_buffer(vulkan, command_buffer)) { return -1; }
+	if (!vulkan->headless && vka_present_image(vulkan)) { return -1; }
+	vka_next_frame(vulkan);
+
 	return 0;
 }
 
-void vka_push_constants(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline)
+int vka_compare_benchmark_samples(const void *a, const void *b)
 {
-	for (uint32_t i = 0; i < pipeline->num_push_constants; i++)
+	uint64_t first = *(const uint64_t *)a;
+	uint64_t second = *(const uint64_t *)b;
+	if (first < second) { return -1; }
+	if (first > second) { return 1; }
+	return 0;
+}
+
+void vka_write_benchmarks_json(FILE *file, vka_vulkan_t *vulkan, vka_benchmark_t *benchmark)
+{
+	// One object per run, with the device so results from different drivers aren't mixed:
+	VkPhysicalDeviceProperties *properties = &(vulkan->device_properties.properties);
+	fprintf(file, "{\n\t\"device\": \"");
+	for (const char *c = properties->deviceName; *c; c++)
 	{
-		vkCmdPushConstants(command_buffer->buffer, pipeline->layout,
-			pipeline->push_constants[i].stage_flags, 0,
-			pipeline->push_constants[i].size, pipeline->push_constants[i].data);
+		if ((*c == '"') || (*c == '\\')) { fputc('\\', file); }
+		if ((unsigned char)(*c) >= 0x20) { fputc(*c, file); }
 	}
+	fprintf(file, "\",\n\t\"driver_version\": %u,\n", properties->driverVersion);
+	fprintf(file, "\t\"api_version\": \"%u.%u.%u\",\n",
+		VK_API_VERSION_MAJOR(properties->apiVersion),
+		VK_API_VERSION_MINOR(properties->apiVersion),
+		VK_API_VERSION_PATCH(properties->apiVersion));
+	fprintf(file, "\t\"results\": [\n");
+
+	for (uint32_t i = 0; i < benchmark->num_results; i++)
+	{
+		vka_benchmark_result_t *result = &(benchmark->results[i]);
+		double mean = (double)(result->total) / (double)(result->iterations);
+		double per_operation = mean / (double)(result->operations);
+
+		fprintf(file, "\t\t{ \"name\": \"");
+		for (const char *c = result->name; *c; c++)
+		{
+			if ((*c == '"') || (*c == '\\')) { fputc('\\', file); }
+			if ((unsigned char)(*c) >= 0x20) { fputc(*c, file); }
+		}
+		fprintf(file, "\", \"iterations\": %u, \"operations\": %u, "
+			"\"mean_ns\": %.1f, \"median_ns\": %llu, \"min_ns\": %llu, "
+			"\"max_ns\": %llu, \"ns_per_operation\": %.1f }",
+			result->iterations, result->operations, mean,
+			(unsigned long long)(result->median), (unsigned long long)(result->minimum),
+			(unsigned long long)(result->maximum), per_operation);
+		if (i + 1 < benchmark->num_results) { fprintf(file, ",\n"); }
+		else { fprintf(file, "\n"); }
+	}
+	fprintf(file, "\t]\n}\n");
 }
+#endif // VKA_BENCHMARK
 
-#ifdef VKA_NUKLEAR
-int vka_nuklear_set_up(vka_vulkan_t *vulkan)
+#ifdef VKA_CAPTURE
+int vka_create_capture(vka_vulkan_t *vulkan, vka_capture_t *capture)
 {
-	if (!nk_init_default(&(vulkan->nuklear_context), NULL))
+	vka_destroy_capture(vulkan, capture);
+
+	if (!capture->image)
 	{
 		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
-			"Could not initialise Nuklear context.");
+			"Capture \"%s\" has no image.", capture->name);
 		return -1;
 	}
-	vulkan->nuklear_context.clip.copy = vka_nuklear_clipboard_copy;
-	vulkan->nuklear_context.clip.paste = vka_nuklear_clipboard_paste;
-	vulkan->nuklear_context.clip.userdata = nk_handle_ptr(NULL);
-	nk_buffer_init_default(&(vulkan->nuklear_commands));
 
-	strcpy(vulkan->nuklear_allocation.name, "Nuklear allocation");
-	vulkan->nuklear_allocation.properties[0] = VKA_MEMORY_HOST;
-	for (int i = 0; i < VKA_MAX_FRAMES_IN_FLIGHT; i++)
+	if (capture->layout == VK_IMAGE_LAYOUT_UNDEFINED)
 	{
-		// Index buffer:
-		snprintf(vulkan->nuklear_buffers[i * 2].name, VKA_MAX_NAME_LENGTH,
-						"Nuklear index buffer %d\n", i);
-		vulkan->nuklear_buffers[i * 2].allocation	= &(vulkan->nuklear_allocation);
-		vulkan->nuklear_buffers[i * 2].usage		= VKA_BUFFER_USAGE_INDEX;
-		vulkan->nuklear_buffers[i * 2].index_type	= VK_INDEX_TYPE_UINT16;
-		vulkan->nuklear_buffers[i * 2].size		= VKA_NUKLEAR_MAX_INDEX_BUFFER;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" needs the layout rendering leaves its image in.",
+			capture->name);
+		return -1;
+	}
 
-		// Vertex buffer:
-		snprintf(vulkan->nuklear_buffers[(i * 2) + 1].name, VKA_MAX_NAME_LENGTH,
-						"Nuklear vertex buffer %d\n", i);
-		vulkan->nuklear_buffers[(i * 2) + 1].allocation	= &(vulkan->nuklear_allocation);
-		vulkan->nuklear_buffers[(i * 2) + 1].usage	= VKA_BUFFER_USAGE_VERTEX;
-		vulkan->nuklear_buffers[(i * 2) + 1].size	= VKA_NUKLEAR_MAX_VERTEX_BUFFER;
+	// Golden images are 8-bit RGB, so only 8-bit colour formats can be compared:
+	VkFormat format = capture->image->format;
+	if ((format == VK_FORMAT_B8G8R8A8_UNORM) || (format == VK_FORMAT_B8G8R8A8_SRGB))
+	{
+		capture->bgra = 1;
+	}
+	else if ((format == VK_FORMAT_R8G8B8A8_UNORM) || (format == VK_FORMAT_R8G8B8A8_SRGB))
+	{
+		capture->bgra = 0;
+	}
+	else
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" needs an 8-bit RGBA or BGRA image.", capture->name);
+		return -1;
 	}
 
-	uint32_t num_buffers = 2 * VKA_MAX_FRAMES_IN_FLIGHT;
-	if (vka_set_up_buffers(vulkan, num_buffers, vulkan->nuklear_buffers)) { return -1; }
-	if (vka_map_memory(vulkan, &(vulkan->nuklear_allocation))) { return -1; }
+	if (!capture->max_frames) { capture->max_frames = VKA_CAPTURE_MAX_FRAMES; }
+	capture->frame_times = malloc(capture->max_frames * sizeof(float));
+	if (!capture->frame_times)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for capture \"%s\" frame times.", capture->name);
+		return -1;
+	}
+	capture->num_frames = 0;
+	capture->captured = 0;
+
+	snprintf(capture->allocation.name, VKA_MAX_NAME_LENGTH, "%s readback", capture->name);
+	capture->allocation.properties[0] = VKA_MEMORY_HOST;
+	snprintf(capture->buffer.name, VKA_MAX_NAME_LENGTH, "%s readback", capture->name);
+	capture->buffer.allocation	= &(capture->allocation);
+	capture->buffer.usage		= VKA_BUFFER_USAGE_DST;
+	capture->buffer.size		= (VkDeviceSize)(capture->image->width) *
+						capture->image->height * 4;
+	if (vka_set_up_buffers(vulkan, 1, &(capture->buffer))) { return -1; }
+	if (vka_map_memory(vulkan, &(capture->allocation))) { return -1; }
+
+	strcpy(capture->command_buffer.name, capture->name);
+	capture->command_buffer.queue = &(vulkan->graphics_queue);
+	if (vka_create_command_buffer(vulkan, &(capture->command_buffer))) { return -1; }
 
 	return 0;
 }
 
-void vka_nuklear_shut_down(vka_vulkan_t *vulkan)
+void vka_destroy_capture(vka_vulkan_t *vulkan, vka_capture_t *capture)
 {
-	for (int i = 0; i < (2 * VKA_MAX_FRAMES_IN_FLIGHT); i++)
+	if (capture->command_buffer.buffer)
 	{
-		vka_destroy_buffer(vulkan, &(vulkan->nuklear_buffers[i]));
+		vkFreeCommandBuffers(vulkan->device, vulkan->command_pool, 1,
+					&(capture->command_buffer.buffer));
 	}
-	vka_unmap_memory(vulkan, &(vulkan->nuklear_allocation));
-	vka_destroy_allocation(vulkan, &(vulkan->nuklear_allocation));
+	vka_destroy_command_buffer(vulkan, &(capture->command_buffer));
 
-	nk_free(&(vulkan->nuklear_context));
-	nk_buffer_free(&(vulkan->nuklear_commands));
+	vka_destroy_buffer(vulkan, &(capture->buffer));
+	vka_destroy_allocation(vulkan, &(capture->allocation));
+
+	if (capture->frame_times)
+	{
+		free(capture->frame_times);
+		capture->frame_times = NULL;
+	}
 }
 
-void vka_nuklear_draw(vka_vulkan_t *vulkan)
+int vka_run_capture(vka_vulkan_t *vulkan, vka_capture_t *capture, uint32_t num_frames,
+	int (*render)(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+	uint32_t frame, void *data), void *data)
 {
-	// Expects descriptor sets and pipeline bound already.
-	struct nk_convert_config convert_config = {0};
-	static const struct nk_draw_vertex_layout_element vertex_layout[] =
+	/* Renders num_frames frames into the capture's command buffer, one at a time and waited
+	 * on, so each frame's time covers recording, submission and GPU work. The image is read
+	 * back after the last frame. Works headless, e.g. on a software driver. */
+	vka_command_buffer_t *command_buffer = &(capture->command_buffer);
+	capture->num_frames = 0;
+	capture->captured = 0;
+
+	for (uint32_t i = 0; i < num_frames; i++)
 	{
-		{NK_VERTEX_POSITION, NK_FORMAT_FLOAT, NK_OFFSETOF(vka_nuklear_vertex_t, position)},
-		{NK_VERTEX_COLOR, NK_FORMAT_R8G8B8A8, NK_OFFSETOF(vka_nuklear_vertex_t, colour)},
-		{NK_VERTEX_TEXCOORD, NK_FORMAT_FLOAT, NK_OFFSETOF(vka_nuklear_vertex_t, uv)},
-		{NK_VERTEX_LAYOUT_END}
-	};
-	convert_config.vertex_layout = vertex_layout;
-	convert_config.vertex_size = sizeof(vka_nuklear_vertex_t);
-	convert_config.vertex_alignment = NK_ALIGNOF(vka_nuklear_vertex_t);
-	convert_config.tex_null = vulkan->nuklear_null_texture;
-	convert_config.circle_segment_count = 22;
-	convert_config.curve_segment_count = 22;
-	convert_config.arc_segment_count = 22;
-	convert_config.global_alpha = 1.0;
-	convert_config.shape_AA = NK_ANTI_ALIASING_ON;
-	convert_config.line_AA = NK_ANTI_ALIASING_ON;
+		uint64_t start = SDL_GetTicksNS();
 
-	// Put vertex and index data into Vulkan buffers:
-	void *index_data = vulkan->nuklear_allocation.mapped_data;
-	index_data += vulkan->nuklear_buffers[vulkan->current_frame * 2].offset;
-	void *vertex_data = vulkan->nuklear_allocation.mapped_data;
-	vertex_data += vulkan->nuklear_buffers[(vulkan->current_frame * 2) + 1].offset;
+		if (vka_begin_command_buffer(vulkan, command_buffer)) { return -1; }
+		if (render(vulkan, command_buffer, i, data)) { return -1; }
+		if (i + 1 == num_frames) { vka_record_capture(command_buffer, capture); }
+		if (vka_end_command_buffer(vulkan, command_buffer)) { return -1; }
+		if (vka_submit_command_buffer(vulkan, command_buffer)) { return -1; }
+		if (vka_wait_for_fence(vulkan, command_buffer)) { return -1; }
 
-	struct nk_buffer nuklear_index_buffer;
-	struct nk_buffer nuklear_vertex_buffer;
-	nk_buffer_init_fixed(&nuklear_index_buffer, index_data, VKA_NUKLEAR_MAX_INDEX_BUFFER);
-	nk_buffer_init_fixed(&nuklear_vertex_buffer, vertex_data, VKA_NUKLEAR_MAX_VERTEX_BUFFER);
+		if (capture->num_frames < capture->max_frames)
+		{
+			capture->frame_times[capture->num_frames] =
+				(float)((double)(SDL_GetTicksNS() - start) / 1000000.0);
+			capture->num_frames++;
+		}
+		vka_next_frame(vulkan);
+	}
+
+	// The last frame's fence has been waited on, so the readback buffer holds its image:
+	if (num_frames) { capture->captured = 1; }
+
+	return 0;
+}
+
+void vka_record_capture(vka_command_buffer_t *command_buffer, vka_capture_t *capture)
+{
+	// Copies the image to the readback buffer, leaving the image in its original layout:
+	vka_barrier_info_t barrier_info = {0};
+	barrier_info.resource		= capture->image;
+	barrier_info.src_access_mask	= VK_ACCESS_MEMORY_WRITE_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_TRANSFER_READ_BIT;
+	barrier_info.old_layout		= capture->layout;
+	barrier_info.new_layout		= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
+
+	vka_copy_info_t copy_info = {0};
+	copy_info.source		= capture->image;
+	copy_info.destination		= &(capture->buffer);
+	copy_info.source_layout		= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	vka_copy_image_to_buffer(command_buffer, &copy_info);
+
+	barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_READ_BIT;
+	barrier_info.dst_access_mask	= VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	barrier_info.old_layout		= VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier_info.new_layout		= capture->layout;
+	barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	vka_image_barrier(command_buffer, &barrier_info);
 
-	nk_convert(&(vulkan->nuklear_context), &(vulkan->nuklear_commands), &nuklear_vertex_buffer,
-							&nuklear_index_buffer, &convert_config);
+	vka_barrier_info_t buffer_barrier_info = {0};
+	buffer_barrier_info.resource		= &(capture->buffer);
+	buffer_barrier_info.src_access_mask	= VK_ACCESS_TRANSFER_WRITE_BIT;
+	buffer_barrier_info.dst_access_mask	= VK_ACCESS_HOST_READ_BIT;
+	buffer_barrier_info.src_stage_mask	= VK_PIPELINE_STAGE_TRANSFER_BIT;
+	buffer_barrier_info.dst_stage_mask	= VK_PIPELINE_STAGE_HOST_BIT;
+	vka_buffer_barrier(command_buffer, &buffer_barrier_info);
+}
 
-	// Bind index/vertex buffers:
-	vka_bind_vertex_buffers(&(vulkan->command_buffers[vulkan->current_frame]),
-		&(vulkan->nuklear_buffers[vulkan->current_frame * 2]), 1,
-		&(vulkan->nuklear_buffers[(vulkan->current_frame * 2) + 1]));
+int vka_compare_capture(vka_vulkan_t *vulkan, vka_capture_t *capture, const char *golden_path)
+{
+	/* Compares the last capture with a golden PPM image. Fails (with the differences in
+	 * capture->comparison) if too many pixels differ by more than the tolerance. With
+	 * update_golden set, writes the golden image instead. */
+	memset(&(capture->comparison), 0, sizeof(capture->comparison));
+	if (!capture->captured)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" has no image - run it first.", capture->name);
+		return -1;
+	}
 
-	// Draw GUI elements:
-	uint32_t index_offset = 0;
-	const struct nk_draw_command *command;
-	nk_draw_foreach(command, &(vulkan->nuklear_context), &(vulkan->nuklear_commands))
+	if (capture->update_golden)
 	{
-		if (!command->elem_count) { continue; }
-		vka_draw_indexed(&(vulkan->command_buffers[vulkan->current_frame]),
-					command->elem_count, index_offset, 0);
-		index_offset += command->elem_count;
+		if (vka_write_capture_ppm(vulkan, capture, golden_path)) { return -1; }
+		capture->comparison.passed = 1;
+		return 0;
 	}
 
-	// Clear buffers:
-	nk_clear(&(vulkan->nuklear_context));
-	nk_buffer_clear(&(vulkan->nuklear_commands));
-}
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint8_t *golden = NULL;
+	if (vka_read_ppm(vulkan, golden_path, &width, &height, &golden)) { return -1; }
+	if ((width != capture->image->width) || (height != capture->image->height))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" is %ux%u, but golden image \"%s\" is %ux%u.", capture->name,
+			capture->image->width, capture->image->height, golden_path, width, height);
+		free(golden);
+		return -1;
+	}
 
-void vka_nuklear_process_event(vka_vulkan_t *vulkan, SDL_Event *event)
-{
-	struct nk_context *context = &(vulkan->nuklear_context);
-	if ((event->type == SDL_EVENT_KEY_UP) || (event->type == SDL_EVENT_KEY_DOWN))
+	vka_capture_comparison_t *comparison = &(capture->comparison);
+	const uint8_t *pixels = (const uint8_t *)(capture->allocation.mapped_data);
+	uint64_t total_difference = 0;
+	uint32_t num_pixels = width * height;
+	for (uint32_t i = 0; i < num_pixels; i++)
 	{
-		int down = (event->type == SDL_EVENT_KEY_DOWN);
-		const bool *keyboard_state = SDL_GetKeyboardState(NULL);
-		SDL_Keycode key = event->key.key;
-		if ((key == SDLK_LSHIFT) || (key == SDLK_RSHIFT))
-		{
-			nk_input_key(context, NK_KEY_SHIFT, down);
-		}
-		else if (key == SDLK_DELETE)
-		{
-			nk_input_key(context, NK_KEY_DEL, down);
-		}
-		else if (key == SDLK_RETURN)
-		{
-			nk_input_key(context, NK_KEY_ENTER, down);
-		}
-		else if (key == SDLK_TAB)
-		{
-			nk_input_key(context, NK_KEY_TAB, down);
-		}
-		else if (key == SDLK_BACKSPACE)
-		{
-			nk_input_key(context, NK_KEY_BACKSPACE, down);
-		}
-		else if (key == SDLK_HOME)
-		{
-			nk_input_key(context, NK_KEY_TEXT_START, down);
-			nk_input_key(context, NK_KEY_SCROLL_START, down);
-		}
-		else if (key == SDLK_END)
-		{
-			nk_input_key(context, NK_KEY_TEXT_END, down);
-			nk_input_key(context, NK_KEY_SCROLL_END, down);
-		}
-		else if (key == SDLK_PAGEUP)
-		{
-			nk_input_key(context, NK_KEY_SCROLL_UP, down);
-		}
-		else if (key == SDLK_PAGEDOWN)
-		{
-			nk_input_key(context, NK_KEY_SCROLL_DOWN, down);
-		}
-		else if (key == SDLK_Z)
-		{
-			nk_input_key(context, NK_KEY_TEXT_UNDO, down &&
-				keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_R)
-		{
-			nk_input_key(context, NK_KEY_TEXT_REDO, down &&
-				keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_C)
-		{
-			nk_input_key(context, NK_KEY_COPY, down &&
-				keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_V)
-		{
-			nk_input_key(context, NK_KEY_PASTE, down &&
-				keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_X)
-		{
-			nk_input_key(context, NK_KEY_CUT, down &&
-				keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_B)
-		{
-			nk_input_key(context, NK_KEY_TEXT_LINE_START, down &&
-					keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_E)
-		{
-			nk_input_key(context, NK_KEY_TEXT_LINE_END, down &&
-					keyboard_state[SDL_SCANCODE_LCTRL]);
-		}
-		else if (key == SDLK_UP)
-		{
-			nk_input_key(context, NK_KEY_UP, down);
-		}
-		else if (key == SDLK_DOWN)
-		{
-			nk_input_key(context, NK_KEY_DOWN, down);
-		}
-		else if (key == SDLK_LEFT)
+		uint8_t rgb[3] = { pixels[(i * 4)], pixels[(i * 4) + 1], pixels[(i * 4) + 2] };
+		if (capture->bgra)
 		{
-			if (keyboard_state[SDL_SCANCODE_LCTRL] == 0)
-			{
-				nk_input_key(context, NK_KEY_LEFT, down);
-			}
-			else
-			{
-				nk_input_key(context, NK_KEY_TEXT_WORD_LEFT, down);
-			}
+			rgb[0] = pixels[(i * 4) + 2];
+			rgb[2] = pixels[(i * 4)];
 		}
-		else if (key == SDLK_RIGHT)
+
+		uint8_t differs = 0;
+		for (uint32_t j = 0; j < 3; j++)
 		{
-			if (keyboard_state[SDL_SCANCODE_LCTRL] == 0)
-			{
-				nk_input_key(context, NK_KEY_RIGHT, down);
-			}
-			else
+			int difference = abs((int)(rgb[j]) - (int)(golden[(i * 3) + j]));
+			total_difference += (uint64_t)difference;
+			if ((uint32_t)difference > comparison->max_difference)
 			{
-				nk_input_key(context, NK_KEY_TEXT_WORD_RIGHT, down);
+				comparison->max_difference = (uint32_t)difference;
 			}
+			if (difference > capture->tolerance) { differs = 1; }
 		}
+		comparison->num_pixels += differs;
 	}
-	else if ((event->type == SDL_EVENT_MOUSE_BUTTON_UP) ||
-		(event->type == SDL_EVENT_MOUSE_BUTTON_DOWN))
+	free(golden);
+
+	comparison->mean_difference = (double)total_difference / (double)(num_pixels * 3);
+	comparison->passed = ((float)(comparison->num_pixels) <=
+				(capture->max_differing * (float)num_pixels));
+	if (!comparison->passed)
 	{
-		int down = (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN);
-		const int x = event->button.x;
-		const int y = event->button.y;
-		if (event->button.button == SDL_BUTTON_LEFT)
-		{
-			if (event->button.clicks > 1)
-			{
-				nk_input_button(context, NK_BUTTON_DOUBLE, x, y, down);
-			}
-			nk_input_button(context, NK_BUTTON_LEFT, x, y, down);
-		}
-		else if (event->button.button == SDL_BUTTON_RIGHT)
-		{
-			nk_input_button(context, NK_BUTTON_RIGHT, x, y, down);
-		}
-		else if (event->button.button == SDL_BUTTON_MIDDLE)
-		{
-			nk_input_button(context, NK_BUTTON_MIDDLE, x, y, down);
-		}
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" differs from golden image \"%s\": %u pixels beyond "
+			"tolerance %u, maximum difference %u.", capture->name, golden_path,
+			comparison->num_pixels, capture->tolerance, comparison->max_difference);
+		return -1;
 	}
-	else if (event->type == SDL_EVENT_MOUSE_MOTION)
+
+	return 0;
+}
+
+int vka_write_capture_ppm(vka_vulkan_t *vulkan, vka_capture_t *capture, const char *path)
+{
+	// Binary PPM (alpha is dropped), so any image viewer can show failed captures:
+	if (!capture->captured)
 	{
-		if (context->input.mouse.grabbed != 0)
-		{
-			int x = (int)(context->input.mouse.prev.x);
-			int y = (int)(context->input.mouse.prev.y);
-			nk_input_motion(context, x + event->motion.xrel, y + event->motion.yrel);
-		}
-		else { nk_input_motion(context, event->motion.x, event->motion.y); }
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Capture \"%s\" has no image - run it first.", capture->name);
+		return -1;
 	}
-	else if (event->type == SDL_EVENT_TEXT_INPUT)
+
+	FILE *file = fopen(path, "wb");
+	if (!file)
 	{
-		nk_glyph glyph;
-		memcpy(glyph, event->text.text, NK_UTF_SIZE);
-		nk_input_glyph(context, glyph);
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not open \"%s\".", path);
+		return -1;
 	}
-	else if (event->type == SDL_EVENT_MOUSE_WHEEL)
+
+	const uint8_t *pixels = (const uint8_t *)(capture->allocation.mapped_data);
+	uint32_t num_pixels = capture->image->width * capture->image->height;
+	fprintf(file, "P6\n%u %u\n255\n", capture->image->width, capture->image->height);
+	for (uint32_t i = 0; i < num_pixels; i++)
 	{
-		nk_input_scroll(context, nk_vec2((float)(event->wheel.x), (float)(event->wheel.y)));
+		uint8_t rgb[3] = { pixels[(i * 4)], pixels[(i * 4) + 1], pixels[(i * 4) + 2] };
+		if (capture->bgra)
+		{
+			rgb[0] = pixels[(i * 4) + 2];
+			rgb[2] = pixels[(i * 4)];
+		}
+		fwrite(rgb, 1, 3, file);
+	}
+
+	if (fclose(file))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not write \"%s\".", path);
+		return -1;
 	}
+
+	return 0;
 }
 
-void vka_nuklear_process_grab(vka_vulkan_t *vulkan)
+int vka_read_ppm(vka_vulkan_t *vulkan, const char *path, uint32_t *width, uint32_t *height,
+							uint8_t **pixels)
 {
-	// Put the mouse in relative mode if button is held down:
-	struct nk_context *context = &(vulkan->nuklear_context);
-	if (context->input.mouse.grab) { SDL_SetWindowRelativeMouseMode(vulkan->window, true); }
-	else if (context->input.mouse.ungrab)
+	// Binary PPM with a maximum value of 255 (as written by vka_write_capture_ppm()):
+	FILE *file = fopen(path, "rb");
+	if (!file)
 	{
-		SDL_SetWindowRelativeMouseMode(vulkan->window, false);
-		SDL_WarpMouseInWindow(vulkan->window, (int)(context->input.mouse.prev.x),
-						(int)(context->input.mouse.prev.y));
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "Could not open \"%s\".", path);
+		return -1;
 	}
-	else if (context->input.mouse.grabbed)
+
+	unsigned int max_value = 0;
+	if ((fscanf(file, "P6 %u %u %u", width, height, &max_value) != 3) ||
+		(max_value != 255) || !(*width) || !(*height) || (fgetc(file) == EOF))
 	{
-		context->input.mouse.pos.x = context->input.mouse.prev.x;
-		context->input.mouse.pos.y = context->input.mouse.prev.y;
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"\"%s\" is not an 8-bit binary PPM image.", path);
+		fclose(file);
+		return -1;
 	}
-}
 
-void vka_nuklear_clipboard_copy(nk_handle usr, const char *text, int len)
-{
-	// User data handle not needed:
-	(void)usr;
+	size_t size = (size_t)(*width) * (*height) * 3;
+	*pixels = malloc(size);
+	if (!(*pixels))
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH,
+			"Could not allocate memory for \"%s\".", path);
+		fclose(file);
+		return -1;
+	}
 
-	if (len < 1) { return; }
-	char *str = malloc((len + 1) * sizeof(char));
-	if (!str) { return; }
-	memcpy(str, text, len * sizeof(char));
-	str[len] = '\0';
-	SDL_SetClipboardText(str);
-	free(str);
+	if (fread(*pixels, 1, size, file) != size)
+	{
+		snprintf(vulkan->error, VKA_MAX_ERROR_LENGTH, "\"%s\" is truncated.", path);
+		free(*pixels);
+		*pixels = NULL;
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	return 0;
 }
 
-void vka_nuklear_clipboard_paste(nk_handle usr, struct nk_text_edit *edit)
+void vka_write_capture_timings(FILE *file, vka_capture_t *capture)
 {
-	// User data handle not needed:
-	(void)usr;
-
-	const char *text = SDL_GetClipboardText();
-	if (text) { nk_textedit_paste(edit, text, nk_strlen(text)); }
+	// JSON, so timings can be tracked next to the comparison result:
+	float total = 0.0f;
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	for (uint32_t i = 0; i < capture->num_frames; i++)
+	{
+		float time = capture->frame_times[i];
+		total += time;
+		if (!i || (time < minimum)) { minimum = time; }
+		if (time > maximum) { maximum = time; }
+	}
+	float mean = 0.0f;
+	if (capture->num_frames) { mean = total / (float)(capture->num_frames); }
+
+	vka_capture_comparison_t *comparison = &(capture->comparison);
+	fprintf(file, "{\n\t\"name\": \"");
+	for (const char *c = capture->name; *c; c++)
+	{
+		if ((*c == '"') || (*c == '\\')) { fputc('\\', file); }
+		if ((unsigned char)(*c) >= 0x20) { fputc(*c, file); }
+	}
+	fprintf(file, "\",\n");
+	if (comparison->passed) { fprintf(file, "\t\"passed\": true,\n"); }
+	else { fprintf(file, "\t\"passed\": false,\n"); }
+	fprintf(file, "\t\"differing_pixels\": %u,\n", comparison->num_pixels);
+	fprintf(file, "\t\"max_difference\": %u,\n", comparison->max_difference);
+	fprintf(file, "\t\"mean_difference\": %.4f,\n", comparison->mean_difference);
+	fprintf(file, "\t\"mean_ms\": %.4f,\n\t\"min_ms\": %.4f,\n\t\"max_ms\": %.4f,\n",
+							mean, minimum, maximum);
+	fprintf(file, "\t\"frame_ms\": [");
+	for (uint32_t i = 0; i < capture->num_frames; i++)
+	{
+		if (i) { fprintf(file, ", "); }
+		fprintf(file, "%.4f", capture->frame_times[i]);
+	}
+	fprintf(file, "]\n}\n");
 }
-#endif // VKA_NUKLEAR
+#endif // VKA_CAPTURE
 
 #ifdef VKA_DEBUG
 int vka_check_instance_layer_extension_support(vka_vulkan_t *vulkan)
@@ -3470,6 +9454,38 @@ void vka_print_vulkan(FILE *file, vka_vulkan_t *vulkan)
 	}
 	else { fprintf(file, "Sampler anisotropy\t\t\tNot enabled\n"); }
 
+	if (vulkan->use_pipeline_library)
+	{
+		fprintf(file, "Pipeline library\t\t\tEnabled (%u parts cached)\n",
+						vulkan->num_pipeline_libraries);
+	}
+	else { fprintf(file, "Pipeline library\t\t\tNot enabled\n"); }
+
+	if (vulkan->use_extended_dynamic_state_3)
+	{
+		fprintf(file, "Extended dynamic state 3\t\tEnabled\n");
+	}
+	else { fprintf(file, "Extended dynamic state 3\t\tNot enabled\n"); }
+
+	if (vulkan->headless) { fprintf(file, "Headless\t\t\t\tYes\n"); }
+	else { fprintf(file, "Headless\t\t\t\tNo\n"); }
+
+	if (vulkan->use_async_compute)
+	{
+		fprintf(file, "Async compute\t\t\t\tEnabled (family %u)\n",
+						vulkan->compute_family_index);
+	}
+	else { fprintf(file, "Async compute\t\t\t\tNot enabled\n"); }
+
+	if (vulkan->use_pipeline_statistics)
+	{
+		fprintf(file, "Pipeline statistics queries\t\tEnabled\n");
+	}
+	else { fprintf(file, "Pipeline statistics queries\t\tNot enabled\n"); }
+
+	if (vulkan->use_precise_occlusion) { fprintf(file, "Precise occlusion queries\t\tEnabled\n"); }
+	else { fprintf(file, "Precise occlusion queries\t\tNot enabled\n"); }
+
 	fprintf(file, "\n");
 
 	if (!vulkan->instance)
@@ -3657,6 +9673,29 @@ void vka_print_command_buffer(FILE *file, vka_command_buffer_t *command_buffer)
 
 	if (!(*(command_buffer->queue))) { fprintf(file, "Queue\t\t\t\t\t= VK_NULL_HANDLE\n"); }
 	else { fprintf(file, "Queue\t\t\t\t\t= %p\n", *(command_buffer->queue)); }
+
+	fprintf(file, "\n");
+
+	fprintf(file, "Elided pipeline binds\t\t\t= %u\n", command_buffer->num_elided_pipelines);
+	fprintf(file, "Elided descriptor set binds\t\t= %u\n",
+				command_buffer->num_elided_descriptor_sets);
+	fprintf(file, "Elided vertex/index buffer binds\t= %u\n",
+				command_buffer->num_elided_vertex_buffers);
+	fprintf(file, "Elided viewports/scissors\t\t= %u\n", command_buffer->num_elided_viewports);
+	fprintf(file, "Elided push constants\t\t\t= %u\n",
+				command_buffer->num_elided_push_constants);
+
+	#ifdef VKA_STATISTICS
+	fprintf(file, "\n");
+
+	const char *names[VKA_NUM_COUNTERS];
+	uint64_t values[VKA_NUM_COUNTERS];
+	vka_get_counters(&(command_buffer->counters), names, values);
+	for (uint32_t i = 0; i < VKA_NUM_COUNTERS; i++)
+	{
+		fprintf(file, "%s = %llu\n", names[i], (unsigned long long)(values[i]));
+	}
+	#endif
 }
 
 void vka_print_image(FILE *file, vka_image_t *image)
@@ -3720,6 +9759,7 @@ void vka_print_shader(FILE *file, vka_shader_t *shader)
 
 	if (!shader->shader) { fprintf(file, "Shader\t\t\t\t\t= VK_NULL_HANDLE\n"); }
 	else { fprintf(file, "Shader\t\t\t\t\t= %p\n", shader->shader); }
+	fprintf(file, "SPIR-V hash\t\t\t\t= %016llx\n", (unsigned long long)(shader->hash));
 }
 
 void vka_print_pipeline(FILE *file, vka_pipeline_t *pipeline)
@@ -3730,7 +9770,11 @@ void vka_print_pipeline(FILE *file, vka_pipeline_t *pipeline)
 
 	fprintf(file, "Pipeline name: %s\n", pipeline->name);
 	fprintf(file, "Compute pipeline: ");
-	if (pipeline->is_compute_pipeline) { fprintf(file, "Yes\n"); }
+	if (pipeline->is_compute_pipeline)
+	{
+		fprintf(file, "Yes (workgroup size %u x %u x %u)\n", pipeline->workgroup_size[0],
+				pipeline->workgroup_size[1], pipeline->workgroup_size[2]);
+	}
 	else { fprintf(file, "No\n"); }
 	fprintf(file, "Colour write mask: ");
 	if (!pipeline->colour_write_mask) { fprintf(file, "None\n"); }
@@ -3754,6 +9798,23 @@ void vka_print_pipeline(FILE *file, vka_pipeline_t *pipeline)
 		}
 		fprintf(file, "\n");
 	}
+	fprintf(file, "Dynamic state: Viewport, scissor");
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_CULL_MODE) { fprintf(file, ", cull mode"); }
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_DEPTH_TEST) { fprintf(file, ", depth test"); }
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_DEPTH_WRITE)
+	{
+		fprintf(file, ", depth write");
+	}
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_DEPTH_COMPARE)
+	{
+		fprintf(file, ", depth compare");
+	}
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_TOPOLOGY) { fprintf(file, ", topology"); }
+	if (pipeline->dynamic_state & VKA_DYNAMIC_STATE_BLEND_ENABLE)
+	{
+		fprintf(file, ", blend enable");
+	}
+	fprintf(file, "\n");
 
 	fprintf(file, "\n");
 
@@ -3773,6 +9834,11 @@ void vka_print_pipeline(FILE *file, vka_pipeline_t *pipeline)
 			fprintf(file, "%s= VK_NULL_HANDLE\n", shader_types[i]);
 		}
 		else { fprintf(file, "%s= %p\n", shader_types[i], pipeline->shaders[i].shader); }
+		if (pipeline->specialisation[i].num_constants)
+		{
+			fprintf(file, " ---> Specialisation constants\t\t= %u\n",
+				pipeline->specialisation[i].num_constants);
+		}
 	}
 }
 
@@ -3788,6 +9854,8 @@ void vka_print_descriptor_pool(FILE *file, vka_descriptor_pool_t *descriptor_poo
 
 	if (!descriptor_pool->pool) { fprintf(file, "Pool\t\t\t\t\t= VK_NULL_HANDLE\n"); }
 	else { fprintf(file, "Pool\t\t\t\t\t= %p\n", descriptor_pool->pool); }
+	fprintf(file, "Allocated sets\t\t\t\t= %u / %u\n", descriptor_pool->num_allocated_sets,
+							descriptor_pool->max_sets);
 }
 
 void vka_print_allocation(FILE *file, vka_allocation_t *allocation)
@@ -5,14 +5,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_vulkan.h>
 #include <Volk/volk.h>
 
 #ifdef VKA_NUKLEAR
+// Initial per-frame buffer sizes, grown as needed:
 #define VKA_NUKLEAR_MAX_VERTEX_BUFFER 512 * 1024
 #define VKA_NUKLEAR_MAX_INDEX_BUFFER 128 * 1024
+#define VKA_NUKLEAR_FONT_CACHE_MAGIC 0x464E4B56	// "VKNF".
+#define VKA_NUKLEAR_FONT_CACHE_VERSION 1
 #define NK_ASSERT(expr)
 #define NK_INCLUDE_VERTEX_BUFFER_OUTPUT
 #define NK_INCLUDE_DEFAULT_ALLOCATOR
@@ -23,6 +33,11 @@
 #include <Nuklear/nuklear.h>
 #endif
 
+#ifdef VKA_SHADER_WATCHER
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
 #define VKA_API_VERSION_MAJOR 1
 #define VKA_API_VERSION_MINOR 3
 
@@ -60,6 +75,82 @@
 #define VKA_MAX_PIPELINE_PUSH_CONSTANTS 2
 #endif
 
+// Push constants larger than this are always pushed, rather than compared with the last push:
+#ifndef VKA_MAX_PUSH_CONSTANT_SIZE
+#define VKA_MAX_PUSH_CONSTANT_SIZE 128
+#endif
+
+#ifndef VKA_MAX_SPECIALISATION_CONSTANTS
+#define VKA_MAX_SPECIALISATION_CONSTANTS 8
+#endif
+
+// How long the shader watcher thread waits for file changes before checking for work (ms):
+#ifndef VKA_SHADER_WATCHER_POLL_TIME
+#define VKA_SHADER_WATCHER_POLL_TIME 100
+#endif
+
+// Frames kept for the statistics graphs, and GPU timers (begin/end pairs) per frame:
+#ifndef VKA_STATISTICS_HISTORY
+#define VKA_STATISTICS_HISTORY 128
+#endif
+
+#ifndef VKA_MAX_GPU_TIMERS
+#define VKA_MAX_GPU_TIMERS 32
+#endif
+
+// Timestamp queries per frame in flight (frame start, frame end, then a pair per timer):
+#define VKA_STATISTICS_QUERIES_PER_FRAME (2 + (2 * VKA_MAX_GPU_TIMERS))
+
+// Events kept in the trace ring buffer (oldest overwritten first):
+#ifndef VKA_TRACE_MAX_EVENTS
+#define VKA_TRACE_MAX_EVENTS 16384
+#endif
+#if (VKA_TRACE_MAX_EVENTS & (VKA_TRACE_MAX_EVENTS - 1))
+#error "VKA_TRACE_MAX_EVENTS must be a power of two, so slots stay in order when the count wraps."
+#endif
+
+// Benchmark defaults (timed iterations, untimed warm-up iterations, draws recorded per iteration):
+#ifndef VKA_BENCHMARK_ITERATIONS
+#define VKA_BENCHMARK_ITERATIONS 100
+#endif
+
+#ifndef VKA_BENCHMARK_WARM_UP_ITERATIONS
+#define VKA_BENCHMARK_WARM_UP_ITERATIONS 10
+#endif
+
+#ifndef VKA_BENCHMARK_DRAWS
+#define VKA_BENCHMARK_DRAWS 10000
+#endif
+
+#ifndef VKA_MAX_BENCHMARK_RESULTS
+#define VKA_MAX_BENCHMARK_RESULTS 32
+#endif
+
+// Frame times kept by a capture run (later frames are run but not timed):
+#ifndef VKA_CAPTURE_MAX_FRAMES
+#define VKA_CAPTURE_MAX_FRAMES 1024
+#endif
+
+// Counters in vka_counters_t, and adding to one (compiled out without VKA_STATISTICS):
+#define VKA_NUM_COUNTERS 13
+#ifdef VKA_STATISTICS
+#define VKA_COUNT(counters, counter, amount) ((counters).counter += (amount))
+#else
+#define VKA_COUNT(counters, counter, amount)
+#endif
+
+// CPU trace scopes, declaring a start time variable (compiled out without VKA_TRACE):
+#ifdef VKA_TRACE
+#define VKA_TRACE_BEGIN(vulkan, start) uint64_t start = vka_trace_begin(&((vulkan)->trace))
+#define VKA_TRACE_END(vulkan, name, start) vka_trace_end(&((vulkan)->trace), name, start)
+#else
+#define VKA_TRACE_BEGIN(vulkan, start)
+#define VKA_TRACE_END(vulkan, name, start)
+#endif
+
+// Starting value for vka_hash():
+#define VKA_HASH_SEED 14695981039346656037ULL
+
 // Memory usage threshold (if accurate memory usage statistics aren't available):
 #define VKA_HEAP_THRESHOLD 0.8f
 
@@ -68,6 +159,36 @@
 #define VKA_SHADER_TYPE_FRAGMENT	1
 #define VKA_SHADER_TYPE_COMPUTE		2
 
+// Workgroup size dimension not set by a specialisation constant:
+#define VKA_SPECIALISATION_ID_NONE UINT32_MAX
+
+// Shader watcher reload states:
+#define VKA_RELOAD_STATE_IDLE		0
+#define VKA_RELOAD_STATE_QUEUED		1
+#define VKA_RELOAD_STATE_BUILDING	2
+#define VKA_RELOAD_STATE_READY		3
+#define VKA_RELOAD_STATE_FAILED		4
+
+// Cull pass buffers (index into cull pass buffers array, and descriptor set number):
+#define VKA_CULL_BUFFER_OBJECTS		0	// Per-frame regions of max_objects each.
+#define VKA_CULL_BUFFER_CAMERAS		1	// Camera per frame.
+#define VKA_CULL_BUFFER_DRAW_COMMANDS	2	// VkDrawIndexedIndirectCommand per visible object.
+#define VKA_CULL_BUFFER_DRAW_COUNT	3
+
+// Pipeline dynamic state flags (viewport and scissor are always dynamic):
+#define VKA_DYNAMIC_STATE_CULL_MODE	0x01
+#define VKA_DYNAMIC_STATE_DEPTH_TEST	0x02
+#define VKA_DYNAMIC_STATE_DEPTH_WRITE	0x04
+#define VKA_DYNAMIC_STATE_DEPTH_COMPARE	0x08
+#define VKA_DYNAMIC_STATE_TOPOLOGY	0x10
+#define VKA_DYNAMIC_STATE_BLEND_ENABLE	0x20	// Needs VK_EXT_extended_dynamic_state3.
+
+// Pipeline linker states:
+#define VKA_LINK_STATE_QUEUED	0
+#define VKA_LINK_STATE_BUILDING	1
+#define VKA_LINK_STATE_READY	2
+#define VKA_LINK_STATE_FAILED	3
+
 // Buffer usage base types:
 #define VKA_BUFFER_USAGE_SRC		VK_BUFFER_USAGE_TRANSFER_SRC_BIT
 #define VKA_BUFFER_USAGE_DST		VK_BUFFER_USAGE_TRANSFER_DST_BIT
@@ -108,12 +229,74 @@
  * Functional containers *
  *************************/
 
+typedef struct
+{
+	// What's currently bound to a command buffer, so redundant binds can be skipped:
+	VkPipeline pipelines[2];		// Indexed by bind point (graphics, compute).
+	VkPipelineLayout layouts[2];
+	uint32_t num_descriptor_sets[2];
+	VkDescriptorSet descriptor_sets[2][VKA_MAX_PIPELINE_DESCRIPTOR_SETS];
+
+	uint32_t num_vertex_buffers;
+	VkBuffer vertex_buffers[VKA_MAX_VERTEX_ATTRIBUTES];
+	VkDeviceSize vertex_offsets[VKA_MAX_VERTEX_ATTRIBUTES];
+	VkBuffer index_buffer;
+	VkDeviceSize index_offset;
+	VkIndexType index_type;
+
+	uint8_t viewport_valid;
+	VkViewport viewport;
+	uint8_t scissor_valid;
+	VkRect2D scissor;
+
+	VkPipelineLayout push_constant_layout;
+	VkShaderStageFlags push_constant_stages[VKA_MAX_PIPELINE_PUSH_CONSTANTS];
+	uint32_t push_constant_sizes[VKA_MAX_PIPELINE_PUSH_CONSTANTS];
+	uint8_t push_constant_data[VKA_MAX_PIPELINE_PUSH_CONSTANTS][VKA_MAX_PUSH_CONSTANT_SIZE];
+} vka_bound_state_t;
+
+#ifdef VKA_STATISTICS
+typedef struct
+{
+	// Recorded into command buffers:
+	uint64_t num_draws;
+	uint64_t num_dispatches;
+	uint64_t num_barriers;
+	uint64_t num_copies;			// Buffer and image copies, updates and fills.
+	uint64_t bytes_copied;			// Image copies not included.
+	uint64_t num_pipeline_binds;		// Not including elided binds.
+	uint64_t num_descriptor_set_binds;
+	uint64_t num_push_constants;
+
+	// Counted on the Vulkan base:
+	uint64_t num_submits;
+	uint64_t num_descriptor_updates;
+	uint64_t num_descriptor_allocations;
+	uint64_t num_memory_allocations;
+	uint64_t bytes_allocated;
+} vka_counters_t;
+#endif
+
 typedef struct
 {
 	char name[VKA_MAX_NAME_LENGTH];
 	VkCommandBuffer buffer;
 	VkFence fence;
 
+	// Reset by vka_begin_command_buffer() - don't touch.
+	vka_bound_state_t bound_state;
+
+	// Redundant binds skipped since the command buffer was last begun:
+	uint32_t num_elided_pipelines;
+	uint32_t num_elided_descriptor_sets;
+	uint32_t num_elided_vertex_buffers;
+	uint32_t num_elided_viewports;		// Including scissors.
+	uint32_t num_elided_push_constants;
+
+	#ifdef VKA_STATISTICS
+	vka_counters_t counters;	// Since the command buffer was last begun.
+	#endif
+
 	/*---------------*
 	 * Configuration *
 	 *---------------*/
@@ -127,13 +310,19 @@ typedef struct
 	VkSemaphore *wait_semaphore;
 	VkSemaphore *signal_semaphore;
 
+	// Also waited on by the next submission only, if set (cleared after submitting):
+	VkSemaphore next_wait_semaphore;
+	VkPipelineStageFlags next_wait_dst_stage_mask;
+
 	VkQueue *queue;
+	VkCommandPool command_pool;		// If VK_NULL_HANDLE, uses the Vulkan base pool.
 } vka_command_buffer_t;
 
 typedef struct
 {
 	char name[VKA_MAX_NAME_LENGTH];
 	VkDescriptorPool pool;
+	uint32_t num_allocated_sets;	// Since the pool was created.
 
 	/*---------------*
 	 * Configuration *
@@ -166,8 +355,28 @@ typedef struct
 {
 	char path[VKA_MAX_PATH_LENGTH];
 	VkShaderModule shader;
+	uint64_t hash;		// Hash of the SPIR-V the module was created from.
+
+	// Compute shaders only, read from the SPIR-V:
+	uint32_t workgroup_size[3];
+	uint32_t workgroup_size_ids[3];	// Specialisation constant IDs, or ..._ID_NONE.
 } vka_shader_t;
 
+typedef struct
+{
+	// Shader module shared by all shaders with the same SPIR-V - managed by vka_vulkan_t.
+	char path[VKA_MAX_PATH_LENGTH];	// File first loaded from (empty if from an array).
+	int64_t modified_time;		// Nanoseconds.
+	uint64_t file_size;
+	uint64_t hash;
+	size_t code_size;
+	uint32_t *code;			// Copy of the SPIR-V, to confirm hash matches.
+	VkShaderModule shader;
+	uint32_t reference_count;
+	uint32_t workgroup_size[3];
+	uint32_t workgroup_size_ids[3];
+} vka_shader_module_t;
+
 typedef struct
 {
 	VkShaderStageFlags stage_flags;
@@ -175,6 +384,14 @@ typedef struct
 	void *data;	// Not managed by push constant struct.
 } vka_push_constant_t;
 
+typedef struct
+{
+	uint32_t num_constants;
+	VkSpecializationMapEntry entries[VKA_MAX_SPECIALISATION_CONSTANTS];
+	size_t size;
+	void *data;	// Not managed by specialisation struct.
+} vka_specialisation_t;
+
 typedef struct
 {
 	char name[VKA_MAX_NAME_LENGTH];
@@ -182,9 +399,10 @@ typedef struct
 	VkPipeline pipeline;
 	vka_shader_t shaders[3];
 
-	// These are created and updated automatically - don't touch.
+	// These are created automatically - don't touch.
 	VkDescriptorSetLayout *descriptor_layout_tracker;
 	VkDescriptorSet *descriptor_set_tracker;
+	uint32_t workgroup_size[3];	// Compute only, after specialisation.
 
 	/*---------------*
 	 * Configuration *
@@ -198,6 +416,9 @@ typedef struct
 	uint32_t num_push_constants;
 	vka_push_constant_t push_constants[VKA_MAX_PIPELINE_PUSH_CONSTANTS];
 
+	// Specialisation constants (indexed by shader type, same as shaders):
+	vka_specialisation_t specialisation[3];
+
 	// Vertex input:
 	uint32_t num_vertex_bindings;
 	uint32_t strides[VKA_MAX_VERTEX_ATTRIBUTES];
@@ -229,6 +450,11 @@ typedef struct
 	// Rendering:
 	VkFormat colour_attachment_format; // Default VK_FORMAT_UNDEFINED.
 	VkFormat depth_attachment_format;
+
+	/* Dynamic state (VKA_DYNAMIC_STATE_ flags) - the values above are ignored for dynamic
+	 * states, so set them with vka_set_X() after binding. BLEND_ENABLE is ignored if
+	 * extended dynamic state 3 isn't enabled. */
+	uint32_t dynamic_state;
 } vka_pipeline_t;
 
 typedef struct
@@ -297,6 +523,378 @@ typedef struct
 	VkImageAspectFlags aspect_mask;
 } vka_image_t;
 
+typedef struct
+{
+	// Per-frame mapped buffers of per-instance vertex data (e.g. transforms).
+	char name[VKA_MAX_NAME_LENGTH];
+	vka_allocation_t allocation;
+	vka_buffer_t buffers[VKA_MAX_FRAMES_IN_FLIGHT];
+	VkDeviceSize used;		// Bytes reserved so far this frame.
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	VkDeviceSize size;		// Per frame.
+	uint32_t stride;		// Bytes per instance.
+} vka_instance_stream_t;
+
+typedef struct
+{
+	uint32_t offset;
+	uint32_t size;
+} vka_range_t;
+
+typedef struct
+{
+	// Free ranges, sorted by offset and merged with their neighbours when freed.
+	uint32_t num_ranges;
+	uint32_t max_ranges;
+	vka_range_t *ranges;
+} vka_free_list_t;
+
+typedef struct
+{
+	// Draw with vka_draw_indexed(num_indices, first_index, vertex_offset).
+	int32_t vertex_offset;
+	uint32_t first_index;
+	uint32_t num_vertices;
+	uint32_t num_indices;
+	uint8_t in_use;
+} vka_mesh_t;
+
+typedef struct
+{
+	// One index and one vertex buffer shared by many meshes.
+	char name[VKA_MAX_NAME_LENGTH];
+	vka_allocation_t allocation;
+	vka_buffer_t buffers[2];		// Index, vertex.
+	vka_free_list_t free_lists[2];		// In indices and vertices.
+
+	// Indexed by mesh handle - offsets change when the pool is defragmented.
+	uint32_t num_meshes;
+	uint32_t max_meshes;
+	vka_mesh_t *meshes;
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	uint32_t max_indices;
+	uint32_t max_vertices;
+	uint32_t vertex_size;			// Bytes per vertex.
+	VkIndexType index_type;			// Default VK_INDEX_TYPE_UINT16.
+} vka_mesh_pool_t;
+
+typedef struct
+{
+	// A draw, with all the state it needs - filled in by the caller and copied when queued.
+	vka_pipeline_t *pipeline;
+	uint32_t num_descriptor_sets;
+	VkDescriptorSet descriptor_sets[VKA_MAX_PIPELINE_DESCRIPTOR_SETS];
+	vka_buffer_t *index_buffer;		// If NULL, draw isn't indexed.
+	uint32_t num_vertex_buffers;
+	vka_buffer_t *vertex_buffers;		// Array, not managed by draw packet.
+
+	VkShaderStageFlags push_constant_stages;
+	uint32_t push_constant_size;		// Up to VKA_MAX_PUSH_CONSTANT_SIZE.
+	uint8_t push_constants[VKA_MAX_PUSH_CONSTANT_SIZE];
+
+	uint32_t num_elements;			// Indices, or vertices if not indexed.
+	uint32_t index_offset;
+	int32_t vertex_offset;			// First vertex, if not indexed.
+	uint32_t first_instance;
+	uint32_t num_instances;			// If 0, gets set to 1.
+
+	uint16_t user_key;			// Lowest bits of the sort key, e.g. depth.
+} vka_draw_packet_t;
+
+typedef struct
+{
+	char name[VKA_MAX_NAME_LENGTH];
+	uint32_t num_packets;
+	vka_draw_packet_t *packets;
+	uint64_t *keys;		// Double-buffered for sorting, as is order.
+	uint32_t *order;
+	uint8_t sorted;
+
+	// Results of the last replay:
+	uint32_t num_draws;
+	uint32_t num_merged;	// Packets merged into another packet's instanced draw.
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	uint32_t max_packets;	// Initial capacity, grows as needed. Default 256.
+} vka_draw_queue_t;
+
+typedef struct
+{
+	// Object to be culled by vka_cull() - matches the std430 layout in Shaders/Cull.comp.
+	float sphere[4];		// Bounding sphere centre (xyz) and radius (w).
+	uint32_t num_indices;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;	// Drawn with 1 instance, so can be used as an object index.
+} vka_cull_object_t;
+
+typedef struct
+{
+	// Matches the std430 layout in Shaders/Cull.comp.
+	float view_projection[16];	// Column-major.
+	float frustum_planes[6][4];
+	float hiz_size[2];
+	uint32_t hiz_mip_levels;
+	uint32_t padding;
+} vka_cull_camera_t;
+
+typedef struct
+{
+	// Compute pass culling objects into indexed indirect draw commands and a draw count.
+	char name[VKA_MAX_NAME_LENGTH];
+	vka_allocation_t host_allocation;
+	vka_allocation_t device_allocation;
+	vka_buffer_t buffers[4];	// Indexed by VKA_CULL_BUFFER_ type.
+	vka_descriptor_pool_t descriptor_pool;
+	vka_descriptor_set_t descriptor_sets[5];	// Buffers, then Hi-Z image.
+	vka_pipeline_t pipeline;
+	uint32_t push_constants[3];	// First object, number of objects, camera index.
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	char shader_path[VKA_MAX_PATH_LENGTH];	// Compiled Shaders/Cull.comp.
+	uint32_t max_objects;
+	vka_image_t *hiz_image;	// If not NULL, also occlusion culls (compile with VKA_CULL_HIZ).
+} vka_cull_pass_t;
+
+typedef struct
+{
+	// Queries per frame in flight, with results read back when that frame comes around again.
+	char name[VKA_MAX_NAME_LENGTH];
+	VkQueryPool pool;
+	uint32_t num_values;			// Per query (a statistic each, or a sample count).
+	uint8_t pending[VKA_MAX_FRAMES_IN_FLIGHT];
+	uint32_t num_used[VKA_MAX_FRAMES_IN_FLIGHT];	// Highest query used + 1.
+	uint64_t *readback;			// Values and availability, for one frame.
+
+	// Latest available results (num_values per query), and the frame they were read back:
+	uint64_t *results;
+	uint64_t *result_frames;		// 0 if there's no result yet.
+	uint64_t frame;
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	VkQueryType type;	// VK_QUERY_TYPE_OCCLUSION or VK_QUERY_TYPE_PIPELINE_STATISTICS.
+	uint32_t max_queries;	// Per frame in flight.
+	VkQueryPipelineStatisticFlags statistics;	// Needs use_pipeline_statistics.
+	uint8_t precise;	// Exact occlusion sample counts, rather than zero or non-zero.
+} vka_query_pool_t;
+
+typedef struct
+{
+	/* Compute job, recorded by vka_submit_compute_batch(). The batch is re-recorded if the
+	 * pipeline or descriptor set handles change, but not if a set is updated in place - call
+	 * vka_clear_compute_batch() and queue the jobs again after vka_update_descriptor_set(). */
+	vka_pipeline_t *pipeline;
+	VkPipeline recorded_pipeline;	// Managed.
+	VkDescriptorSet recorded_descriptor_sets[VKA_MAX_PIPELINE_DESCRIPTOR_SETS];	// Managed.
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	uint32_t num_descriptor_sets;	// If 0, uses the pipeline's descriptor sets.
+	vka_descriptor_set_t *descriptor_sets[VKA_MAX_PIPELINE_DESCRIPTOR_SETS];
+	uint32_t push_constant_size;	// If 0, uses the pipeline's push constants.
+	uint8_t push_constant_data[VKA_MAX_PUSH_CONSTANT_SIZE];
+	uint32_t size[3];		// Invocations, dispatched with vka_dispatch_size().
+	uint8_t concurrent;		// If set, doesn't wait for the previous jobs' writes.
+} vka_compute_job_t;
+
+typedef struct
+{
+	// Compute jobs recorded once into a command buffer, then submitted as often as needed.
+	char name[VKA_MAX_NAME_LENGTH];
+	vka_command_buffer_t command_buffer;
+	uint32_t num_jobs;
+	uint32_t max_jobs;
+	vka_compute_job_t *jobs;
+	uint8_t recorded;
+	uint8_t submitted;	// Cleared once completion has been seen.
+} vka_compute_batch_t;
+
+typedef struct
+{
+	VkObjectType type;
+	uint64_t handle;
+	uint32_t frames_remaining;
+} vka_retired_object_t;
+
+typedef struct
+{
+	vka_free_list_t *free_list;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t frames_remaining;
+} vka_retired_range_t;
+
+typedef struct
+{
+	/* State a graphics pipeline library part covers. Everything else is zeroed (padding
+	 * included), as is state that's dynamic, so parts can be compared with memcmp(). */
+	VkGraphicsPipelineLibraryFlagsEXT part;
+	uint32_t num_dynamic_states;
+	VkDynamicState dynamic_states[8];
+
+	// Vertex input:
+	uint32_t num_vertex_bindings;
+	VkVertexInputBindingDescription vertex_bindings[VKA_MAX_VERTEX_ATTRIBUTES];
+	uint32_t num_vertex_attributes;
+	VkVertexInputAttributeDescription vertex_attributes[VKA_MAX_VERTEX_ATTRIBUTES];
+	VkPrimitiveTopology topology;	// Only the topology class, if dynamic.
+
+	// Shaders and layout (pre-rasterisation and fragment shader):
+	VkDescriptorSetLayout set_layouts[VKA_MAX_PIPELINE_DESCRIPTOR_SETS];
+	VkShaderStageFlags push_constant_stages[VKA_MAX_PIPELINE_PUSH_CONSTANTS];
+	uint32_t push_constant_sizes[VKA_MAX_PIPELINE_PUSH_CONSTANTS];
+	VkShaderModule shader;
+	uint64_t shader_hash;
+	uint32_t num_constants;
+	VkSpecializationMapEntry constant_entries[VKA_MAX_SPECIALISATION_CONSTANTS];
+	uint64_t constant_values[VKA_MAX_SPECIALISATION_CONSTANTS];
+
+	// Pre-rasterisation:
+	VkPolygonMode polygon_mode;
+	VkCullModeFlags cull_mode;
+	float line_width;
+
+	// Fragment shader:
+	VkBool32 depth_test_enable;
+	VkBool32 depth_write_enable;
+	VkCompareOp depth_compare_op;
+
+	// Fragment output (and depth format for the fragment shader):
+	VkPipelineColorBlendAttachmentState blend_state;
+	VkFormat colour_attachment_format;
+	VkFormat depth_attachment_format;
+} vka_pipeline_library_key_t;
+
+typedef struct
+{
+	// Graphics pipeline library part, shared between pipelines - managed by vka_vulkan_t.
+	uint64_t hash;				// Hash of the key, to narrow the search.
+	vka_pipeline_library_key_t key;
+	VkPipeline library;
+} vka_pipeline_library_t;
+
+typedef struct
+{
+	// Optimised link of a pipeline's library parts, built on the linker thread.
+	vka_pipeline_t *pipeline;
+	VkPipelineLayout layout;
+	VkPipeline libraries[4];
+	VkPipeline fast_pipeline;	// Replaced by the optimised pipeline, if still current.
+	VkPipeline optimised_pipeline;
+	uint8_t state;
+} vka_pipeline_link_t;
+
+#ifdef VKA_SHADER_WATCHER
+typedef struct
+{
+	vka_pipeline_t *pipeline;
+	int watch_descriptors[3];	// Indexed by shader type, -1 if not watched.
+	uint8_t changed;
+	uint8_t state;
+
+	/* Copy of the pipeline with the reloaded shaders, built by the watcher thread.
+	 * Swapped in by vka_next_frame() if the pipeline hasn't been recreated meanwhile. */
+	vka_pipeline_t rebuild;
+	VkPipeline source_pipeline;
+	uint8_t reloaded_shaders;	// Bit per shader type.
+	char error[VKA_MAX_ERROR_LENGTH];
+} vka_watched_pipeline_t;
+
+typedef struct
+{
+	int inotify_descriptor;
+	SDL_Thread *thread;
+	SDL_Mutex *mutex;
+	SDL_Condition *condition;	// Signalled when the watcher thread finishes a build.
+	SDL_AtomicInt quit;
+
+	uint32_t num_pipelines;
+	uint32_t max_pipelines;
+	vka_watched_pipeline_t *pipelines;
+
+	char error[VKA_MAX_ERROR_LENGTH];	// Last failed reload, empty after a successful one.
+} vka_shader_watcher_t;
+#endif
+
+#ifdef VKA_STATISTICS
+typedef struct
+{
+	char name[VKA_MAX_NAME_LENGTH];
+	float milliseconds;	// Total for the latest frame with results.
+	float history[VKA_STATISTICS_HISTORY];
+} vka_gpu_timer_t;
+
+typedef struct
+{
+	VkQueryPool timestamp_pool;	// VK_NULL_HANDLE if the graphics queue has no timestamps.
+	float timestamp_period;		// Nanoseconds per tick.
+	uint64_t timestamp_mask;
+
+	// Queries written by each frame in flight, read back when that frame comes around again:
+	uint8_t queries_pending[VKA_MAX_FRAMES_IN_FLIGHT];
+	uint32_t num_queries[VKA_MAX_FRAMES_IN_FLIGHT];
+	uint32_t query_timers[VKA_MAX_FRAMES_IN_FLIGHT][VKA_MAX_GPU_TIMERS]; // Timer per pair.
+
+	uint32_t num_timers;
+	vka_gpu_timer_t timers[VKA_MAX_GPU_TIMERS];
+
+	uint64_t last_frame_counter;
+	float cpu_frame_time;	// Milliseconds between calls to vka_begin_frame_statistics().
+	float gpu_frame_time;	// Milliseconds from frame start to end on the GPU.
+	uint32_t history_index;	// Oldest entry, next to be overwritten.
+	float cpu_history[VKA_STATISTICS_HISTORY];
+	float gpu_history[VKA_STATISTICS_HISTORY];
+
+	// Last frame's command buffer and Vulkan base counters, from vka_end_frame_statistics():
+	vka_counters_t frame_counters;
+} vka_statistics_t;
+#endif
+
+#ifdef VKA_TRACE
+typedef struct
+{
+	char name[VKA_MAX_NAME_LENGTH];
+	uint64_t thread_id;	// 0 for GPU events.
+	uint64_t start;		// Nanoseconds, from the trace clock.
+	uint64_t duration;
+	uint8_t gpu;
+	SDL_AtomicInt sequence;	// Event number + 1 once written, 0 while being written.
+} vka_trace_event_t;
+
+typedef struct
+{
+	vka_trace_event_t *events;	// Ring buffer of VKA_TRACE_MAX_EVENTS.
+	SDL_AtomicInt num_events;	// Recorded since creation, including overwritten ones.
+
+	// GPU timestamps, matched to the trace clock by vka_trace_calibrate():
+	uint8_t calibrated_timestamps;	// VK_EXT_calibrated_timestamps enabled.
+	uint8_t calibrated;
+	float timestamp_period;		// Nanoseconds per tick.
+	uint64_t timestamp_mask;
+	uint64_t gpu_base_ticks;
+	uint64_t gpu_base_time;
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	uint64_t (*clock)(void *clock_data);	// Nanoseconds. If NULL, uses SDL_GetTicksNS().
+	void *clock_data;
+} vka_trace_t;
+#endif
+
 typedef struct
 {
 	char name[VKA_MAX_NAME_LENGTH];
@@ -310,12 +908,19 @@ typedef struct
 	VkQueue graphics_queue;
 	uint32_t present_family_index;
 	VkQueue present_queue;
+	uint32_t compute_family_index;	// Same as graphics if there's no dedicated compute family.
+	VkQueue compute_queue;
 
 	VkCommandPool command_pool;
 	vka_command_buffer_t command_buffers[VKA_MAX_FRAMES_IN_FLIGHT];
 
+	// Async compute (if use_async_compute is set):
+	VkCommandPool compute_command_pool;
+	vka_command_buffer_t compute_command_buffers[VKA_MAX_FRAMES_IN_FLIGHT];
+
 	VkSemaphore image_available[VKA_MAX_FRAMES_IN_FLIGHT];
 	VkSemaphore render_complete[VKA_MAX_FRAMES_IN_FLIGHT];
+	VkSemaphore compute_complete[VKA_MAX_FRAMES_IN_FLIGHT];
 
 	uint32_t num_swapchain_images;
 	VkFormat swapchain_format;
@@ -328,6 +933,33 @@ typedef struct
 	uint8_t current_frame;
 	uint32_t current_swapchain_index;
 
+	// Shader modules, shared between shaders with identical SPIR-V:
+	uint32_t num_shader_modules;
+	uint32_t max_shader_modules;
+	vka_shader_module_t *shader_modules;
+
+	// Graphics pipeline library parts, and optimised links being built in the background:
+	uint32_t num_pipeline_libraries;
+	uint32_t max_pipeline_libraries;
+	vka_pipeline_library_t *pipeline_libraries;
+	uint32_t num_pipeline_links;
+	uint32_t max_pipeline_links;
+	vka_pipeline_link_t *pipeline_links;
+	SDL_Thread *pipeline_link_thread;
+	SDL_Mutex *pipeline_link_mutex;
+	SDL_Condition *pipeline_link_condition;
+	SDL_AtomicInt pipeline_link_quit;
+
+	// Objects still in use by frames in flight, destroyed once those frames have completed:
+	uint32_t num_retired_objects;
+	uint32_t max_retired_objects;
+	vka_retired_object_t *retired_objects;
+
+	// Free list ranges still in use by frames in flight, released once those have completed:
+	uint32_t num_retired_ranges;
+	uint32_t max_retired_ranges;
+	vka_retired_range_t *retired_ranges;
+
 	char error[VKA_MAX_ERROR_LENGTH];
 	#ifdef VKA_DEBUG
 	VkDebugUtilsMessengerEXT debug_messenger;
@@ -339,15 +971,49 @@ typedef struct
 	struct nk_draw_null_texture nuklear_null_texture;
 	vka_allocation_t nuklear_allocation;
 	vka_buffer_t nuklear_buffers[2 * VKA_MAX_FRAMES_IN_FLIGHT];
+
+	// Converted geometry, only reconverted when the Nuklear commands change:
+	struct nk_buffer nuklear_vertices;
+	struct nk_buffer nuklear_indices;
+	uint64_t nuklear_hash;
+	uint64_t nuklear_buffer_hashes[VKA_MAX_FRAMES_IN_FLIGHT]; // Geometry in each frame's buffers.
+
+	// Font atlas and glyphs, from vka_nuklear_bake_fonts():
+	vka_allocation_t nuklear_atlas_allocation;
+	vka_image_t nuklear_atlas;
+	vka_sampler_t nuklear_atlas_sampler;
+	uint32_t nuklear_num_glyphs;
+	struct nk_font_glyph *nuklear_glyphs;
+	#endif
+
+	#ifdef VKA_SHADER_WATCHER
+	vka_shader_watcher_t shader_watcher;
+	#endif
+
+	#ifdef VKA_STATISTICS
+	vka_statistics_t statistics;
+	vka_counters_t counters;	// Reset by vka_end_frame_statistics().
+	#endif
+
+	#ifdef VKA_TRACE
+	vka_trace_t trace;
 	#endif
 
 	/*---------------*
 	 * Configuration *
 	 *---------------*/
+	uint8_t headless;	// No window, surface or swapchain (compute and offscreen only).
 	uint8_t window_resizable;
 	int minimum_window_width;
 	int minimum_window_height;
 
+	// Optional extensions (cleared during device creation if not supported):
+	uint8_t use_pipeline_library;	// VK_EXT_graphics_pipeline_library.
+	uint8_t use_extended_dynamic_state_3; // VK_EXT_extended_dynamic_state3 (blend enable).
+	uint8_t use_async_compute;	// Needs a queue family with compute but not graphics.
+	uint8_t use_pipeline_statistics; // pipelineStatisticsQuery feature.
+	uint8_t use_precise_occlusion;	// occlusionQueryPrecise feature.
+
 	// Feature requirements (after device creation, these represent enabled features):
 	VkPhysicalDeviceFeatures enabled_features;
 	VkPhysicalDeviceVulkan11Features enabled_features_11;
@@ -356,6 +1022,7 @@ typedef struct
 
 	// Device properties:
 	VkPhysicalDeviceMaintenance3Properties maintenance_properties;
+	VkPhysicalDeviceSubgroupProperties subgroup_properties;
 	VkPhysicalDeviceProperties2 device_properties;
 
 	/*-------------------*
@@ -401,6 +1068,10 @@ typedef struct
 	VkPipelineStageFlags dst_stage_mask;
 	VkDeviceSize offset;
 	VkDeviceSize size;			// If 0, uses VK_WHOLE_SIZE.
+
+	// Queue family ownership transfer (ignored if the families are the same):
+	uint32_t src_queue_family;
+	uint32_t dst_queue_family;
 } vka_barrier_info_t;
 
 typedef struct
@@ -417,6 +1088,80 @@ typedef struct
 	uint32_t data;				// For vkCmdFillBuffer().
 } vka_copy_info_t;
 
+#ifdef VKA_BENCHMARK
+typedef struct
+{
+	char name[VKA_MAX_NAME_LENGTH];
+	uint32_t iterations;
+	uint32_t operations;	// Per iteration (e.g. draws recorded).
+	uint64_t total;		// Nanoseconds, all iterations.
+	uint64_t minimum;	// Nanoseconds, per iteration.
+	uint64_t median;
+	uint64_t maximum;
+} vka_benchmark_result_t;
+
+typedef struct
+{
+	uint32_t num_results;
+	vka_benchmark_result_t results[VKA_MAX_BENCHMARK_RESULTS];
+	uint64_t *samples;			// Per iteration, sorted for the median.
+	vka_command_buffer_t command_buffer;	// Draws are recorded into this, never submitted.
+
+	// Scratch objects for the allocation and buffer benchmarks:
+	vka_allocation_t allocation;
+	vka_buffer_t buffers[4];
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	uint32_t iterations;		// If 0, uses VKA_BENCHMARK_ITERATIONS.
+	uint32_t warm_up_iterations;	// If 0, uses VKA_BENCHMARK_WARM_UP_ITERATIONS.
+	uint32_t num_draws;		// If 0, uses VKA_BENCHMARK_DRAWS.
+	uint32_t num_indices;		// Per draw. If 0, uses 3.
+
+	// Optional. Benchmarks needing one of these are skipped if it isn't set:
+	vka_descriptor_set_t *descriptor_set;	// Allocated, with data.
+	vka_pipeline_t *pipeline;		// Configured graphics pipeline, recreated each iteration.
+	vka_render_info_t *render_info;		// For the draws, with pipeline and index_buffer.
+	vka_buffer_t *index_buffer;
+	uint32_t num_vertex_buffers;
+	vka_buffer_t *vertex_buffers;
+} vka_benchmark_t;
+#endif
+
+#ifdef VKA_CAPTURE
+typedef struct
+{
+	uint32_t num_pixels;		// Pixels with a channel beyond the tolerance.
+	uint32_t max_difference;	// Largest channel difference.
+	double mean_difference;		// Per channel, over all pixels.
+	uint8_t passed;
+} vka_capture_comparison_t;
+
+typedef struct
+{
+	char name[VKA_MAX_NAME_LENGTH];
+	vka_allocation_t allocation;
+	vka_buffer_t buffer;			// Readback, tightly packed 8-bit RGBA or BGRA.
+	vka_command_buffer_t command_buffer;
+	uint8_t bgra;
+	uint8_t captured;			// Set once a run has read the image back.
+	uint32_t num_frames;
+	float *frame_times;			// Milliseconds, begin to fence, per frame run.
+	vka_capture_comparison_t comparison;
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	vka_image_t *image;		// Colour image read back after the last frame.
+	VkImageLayout layout;		// Layout rendering leaves the image in (restored after).
+	uint32_t max_frames;		// If 0, uses VKA_CAPTURE_MAX_FRAMES.
+	uint8_t tolerance;		// Per channel difference allowed.
+	float max_differing;		// Fraction of pixels allowed beyond the tolerance.
+	uint8_t update_golden;		// Write golden images rather than comparing with them.
+} vka_capture_t;
+#endif
+
 /*************
  * Functions *
  *************/
@@ -431,19 +1176,38 @@ int vka_create_device(vka_vulkan_t *vulkan);
 int vka_create_semaphores(vka_vulkan_t *vulkan);
 int vka_create_command_pool(vka_vulkan_t *vulkan);
 int vka_create_command_buffers(vka_vulkan_t *vulkan);
+int vka_create_compute_command_buffers(vka_vulkan_t *vulkan);
+int vka_submit_compute(vka_vulkan_t *vulkan, VkPipelineStageFlags wait_dst_stage_mask);
 int vka_create_swapchain(vka_vulkan_t *vulkan);
 int vka_score_physical_device(vka_vulkan_t *vulkan, VkPhysicalDevice physical_device,
 		uint32_t *graphics_family_index, uint32_t *present_family_index,
-		VkBool32 *sampler_anisotropy);
+		uint32_t *compute_family_index, VkBool32 *sampler_anisotropy);
+int vka_check_device_extension_support(vka_vulkan_t *vulkan, const char *extension_name);
 
 // Pipelines and shaders:
 int vka_create_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline);
 void vka_destroy_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline);
 void vka_bind_pipeline(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline);
+int vka_link_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+		VkGraphicsPipelineCreateInfo *pipeline_info, VkPipeline *linked_pipeline);
+int vka_pipeline_linker_set_up(vka_vulkan_t *vulkan);
+void vka_pipeline_linker_shut_down(vka_vulkan_t *vulkan);
+void vka_update_pipeline_links(vka_vulkan_t *vulkan);
+void vka_cancel_pipeline_links(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline);
+int vka_pipeline_linker_thread(void *data);
 int vka_create_shader(vka_vulkan_t *vulkan, vka_shader_t *shader);
 int vka_create_shader_from_array(vka_vulkan_t *vulkan, vka_shader_t *shader,
 				size_t code_size, uint32_t *shader_code);
 void vka_destroy_shader(vka_vulkan_t *vulkan, vka_shader_t *shader);
+vka_shader_module_t *vka_acquire_shader_module(vka_vulkan_t *vulkan, vka_shader_t *shader,
+						size_t code_size, uint32_t *shader_code);
+void vka_release_shader_module(vka_vulkan_t *vulkan, VkShaderModule shader);
+void vka_reflect_workgroup_size(size_t code_size, const uint32_t *shader_code,
+			uint32_t workgroup_size[3], uint32_t workgroup_size_ids[3]);
+int vka_reflect_constant(size_t code_size, const uint32_t *shader_code, uint32_t id,
+				uint32_t *value, uint32_t *specialisation_id);
+int vka_get_specialisation_info(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+				uint32_t shader_type, VkSpecializationInfo *specialisation_info);
 
 // Command buffers and fences:
 int vka_create_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer);
@@ -453,6 +1217,7 @@ int vka_end_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_b
 int vka_submit_command_buffer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer);
 int vka_wait_for_fence(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer);
 void vka_execute_commands(vka_command_buffer_t *primary, vka_command_buffer_t *secondary);
+void vka_reset_bound_state(vka_command_buffer_t *command_buffer);
 
 // Descriptors:
 int vka_create_descriptor_pool(vka_vulkan_t *vulkan, vka_descriptor_pool_t *descriptor_pool);
@@ -471,9 +1236,13 @@ void vka_destroy_image(vka_vulkan_t *vulkan, vka_image_t *image);
 int vka_get_image_requirements(vka_vulkan_t *vulkan, vka_image_t *image);
 int vka_bind_image_memory(vka_vulkan_t *vulkan, vka_image_t *image);
 void vka_image_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info);
+void vka_image_ownership_transfer(vka_command_buffer_t *release_command_buffer,
+	vka_command_buffer_t *acquire_command_buffer, vka_barrier_info_t *barrier_info);
 void vka_copy_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
 void vka_copy_buffer_to_image(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
+void vka_copy_image_to_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
 int vka_set_up_images(vka_vulkan_t *vulkan, uint32_t num_images, vka_image_t *images);
+uint32_t vka_get_texel_size(VkFormat format);
 
 // Buffers:
 int vka_create_buffer(vka_vulkan_t *vulkan, vka_buffer_t *buffer);
@@ -483,10 +1252,39 @@ int vka_bind_buffer_memory(vka_vulkan_t *vulkan, vka_buffer_t *buffer);
 void vka_buffer_barrier(vka_command_buffer_t *command_buffer, vka_barrier_info_t *barrier_info);
 void vka_buffer_barrier_reverse(vka_command_buffer_t *command_buffer,
 				vka_barrier_info_t *barrier_info);
+void vka_buffer_ownership_transfer(vka_command_buffer_t *release_command_buffer,
+	vka_command_buffer_t *acquire_command_buffer, vka_barrier_info_t *barrier_info);
 void vka_copy_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
 void vka_update_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
 void vka_fill_buffer(vka_command_buffer_t *command_buffer, vka_copy_info_t *copy_info);
 int vka_set_up_buffers(vka_vulkan_t *vulkan, uint32_t num_buffers, vka_buffer_t *buffers);
+int vka_create_instance_stream(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream);
+void vka_destroy_instance_stream(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream);
+void vka_reset_instance_stream(vka_instance_stream_t *instance_stream);
+void *vka_reserve_instances(vka_vulkan_t *vulkan, vka_instance_stream_t *instance_stream,
+				uint32_t num_instances, uint32_t *first_instance);
+// Binding must be below VKA_MAX_VERTEX_ATTRIBUTES, as for vka_bind_vertex_buffer_ranges():
+void vka_bind_instance_stream(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_instance_stream_t *instance_stream, uint32_t binding);
+int vka_create_mesh_pool(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool);
+void vka_destroy_mesh_pool(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool);
+int vka_allocate_mesh(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool, uint32_t num_vertices,
+					uint32_t num_indices, uint32_t *mesh);
+int vka_free_mesh(vka_vulkan_t *vulkan, vka_mesh_pool_t *mesh_pool, uint32_t mesh);
+void vka_upload_mesh(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool,
+	uint32_t mesh, vka_buffer_t *source, VkDeviceSize index_offset, VkDeviceSize vertex_offset);
+int vka_defragment_mesh_pool(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							vka_mesh_pool_t *mesh_pool);
+void vka_bind_mesh_pool(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool);
+void vka_draw_mesh(vka_command_buffer_t *command_buffer, vka_mesh_pool_t *mesh_pool,
+								uint32_t mesh);
+int vka_free_list_allocate(vka_free_list_t *free_list, uint32_t size, uint32_t *offset);
+int vka_free_list_release(vka_vulkan_t *vulkan, vka_free_list_t *free_list, uint32_t offset,
+								uint32_t size);
+int vka_free_list_retire(vka_vulkan_t *vulkan, vka_free_list_t *free_list, uint32_t offset,
+								uint32_t size);
+void vka_release_retired_ranges(vka_vulkan_t *vulkan);
+void vka_forget_retired_ranges(vka_vulkan_t *vulkan, vka_free_list_t *free_list);
 
 // Rendering:
 void vka_begin_rendering(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info);
@@ -497,27 +1295,90 @@ void vka_end_rendering_barrier(vka_command_buffer_t *command_buffer,
 				vka_render_info_t *render_info);
 void vka_set_viewport(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info);
 void vka_set_scissor(vka_command_buffer_t *command_buffer, vka_render_info_t *render_info);
+void vka_set_cull_mode(vka_command_buffer_t *command_buffer, VkCullModeFlags cull_mode);
+void vka_set_depth_test(vka_command_buffer_t *command_buffer, VkBool32 depth_test_enable);
+void vka_set_depth_write(vka_command_buffer_t *command_buffer, VkBool32 depth_write_enable);
+void vka_set_depth_compare_op(vka_command_buffer_t *command_buffer, VkCompareOp depth_compare_op);
+void vka_set_topology(vka_command_buffer_t *command_buffer, VkPrimitiveTopology topology);
+void vka_set_blend_enable(vka_command_buffer_t *command_buffer, VkBool32 blend_enable);
+// Bindings must be below VKA_MAX_VERTEX_ATTRIBUTES - if not, nothing is bound (debug asserts):
 void vka_bind_vertex_buffers(vka_command_buffer_t *command_buffer, vka_buffer_t *index_buffer,
 				uint32_t num_vertex_buffers, vka_buffer_t vertex_buffers[]);
+void vka_bind_vertex_buffer_ranges(vka_command_buffer_t *command_buffer, uint32_t first_binding,
+	uint32_t num_vertex_buffers, vka_buffer_t *vertex_buffers[], VkDeviceSize offsets[]);
+void vka_bind_index_buffer(vka_command_buffer_t *command_buffer, vka_buffer_t *index_buffer,
+							VkDeviceSize offset);
 void vka_bind_descriptor_sets(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline);
+void vka_bind_descriptor_set_array(vka_command_buffer_t *command_buffer,
+	VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t num_descriptor_sets,
+	VkDescriptorSet descriptor_sets[]);
 void vka_draw(vka_command_buffer_t *command_buffer, uint32_t num_vertices, int32_t vertex_offset);
 void vka_draw_indexed(vka_command_buffer_t *command_buffer, uint32_t num_indices,
 				uint32_t index_offset, int32_t vertex_offset);
+void vka_draw_instanced(vka_command_buffer_t *command_buffer, uint32_t num_vertices,
+		int32_t vertex_offset, uint32_t num_instances, uint32_t first_instance);
+void vka_draw_indexed_instanced(vka_command_buffer_t *command_buffer, uint32_t num_indices,
+	uint32_t index_offset, int32_t vertex_offset, uint32_t num_instances,
+	uint32_t first_instance);
 void vka_draw_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-					VkDeviceSize draw_offset, uint32_t draw_count);
+			VkDeviceSize draw_offset, uint32_t draw_count, uint32_t stride);
 void vka_draw_indexed_indirect(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-						VkDeviceSize draw_offset, uint32_t draw_count);
+				VkDeviceSize draw_offset, uint32_t draw_count, uint32_t stride);
 void vka_draw_indirect_count(vka_command_buffer_t *command_buffer, vka_buffer_t *draw_commands,
-					vka_buffer_t *draw_counts, uint32_t max_draw_count);
+	VkDeviceSize draw_offset, vka_buffer_t *draw_counts, VkDeviceSize count_offset,
+	uint32_t max_draw_count, uint32_t stride);
 void vka_draw_indexed_indirect_count(vka_command_buffer_t *command_buffer,
-	vka_buffer_t *draw_commands, vka_buffer_t *draw_counts, uint32_t max_draw_count);
+	vka_buffer_t *draw_commands, VkDeviceSize draw_offset, vka_buffer_t *draw_counts,
+	VkDeviceSize count_offset, uint32_t max_draw_count, uint32_t stride);
 int vka_present_image(vka_vulkan_t *vulkan);
 
+// Draw queue:
+int vka_create_draw_queue(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue);
+void vka_destroy_draw_queue(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue);
+int vka_queue_draw(vka_vulkan_t *vulkan, vka_draw_queue_t *draw_queue, vka_draw_packet_t *packet);
+void vka_clear_draw_queue(vka_draw_queue_t *draw_queue);
+void vka_sort_draw_queue(vka_draw_queue_t *draw_queue);
+void vka_replay_draw_queue(vka_command_buffer_t *command_buffer, vka_draw_queue_t *draw_queue);
+int vka_draw_packets_match(vka_draw_packet_t *a, vka_draw_packet_t *b);
+
 // Compute:
 void vka_dispatch(vka_command_buffer_t *command_buffer,uint32_t group_count_x,
 			uint32_t group_count_y, uint32_t group_count_z);
 void vka_dispatch_indirect(vka_command_buffer_t *command_buffer,
 	vka_buffer_t *dispatch_commands, VkDeviceSize command_offset);
+void vka_dispatch_size(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+	vka_pipeline_t *pipeline, uint32_t size_x, uint32_t size_y, uint32_t size_z);
+uint32_t vka_get_default_workgroup_size(vka_vulkan_t *vulkan);
+int vka_create_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+void vka_destroy_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+int vka_queue_compute_job(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch,
+						vka_compute_job_t *compute_job);
+void vka_clear_compute_batch(vka_compute_batch_t *compute_batch);
+int vka_record_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+int vka_submit_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+int vka_compute_batch_complete(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+int vka_wait_for_compute_batch(vka_vulkan_t *vulkan, vka_compute_batch_t *compute_batch);
+
+// Culling:
+int vka_create_cull_pass(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass);
+void vka_destroy_cull_pass(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass);
+vka_cull_object_t *vka_get_cull_objects(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass);
+void vka_set_cull_camera(vka_vulkan_t *vulkan, vka_cull_pass_t *cull_pass,
+					const float view_projection[16]);
+void vka_cull(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+			vka_cull_pass_t *cull_pass, uint32_t num_objects);
+void vka_draw_culled(vka_command_buffer_t *command_buffer, vka_cull_pass_t *cull_pass);
+
+// Queries:
+int vka_create_query_pool(vka_vulkan_t *vulkan, vka_query_pool_t *query_pool);
+void vka_destroy_query_pool(vka_vulkan_t *vulkan, vka_query_pool_t *query_pool);
+void vka_update_query_pool(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							vka_query_pool_t *query_pool);
+void vka_begin_query(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_query_pool_t *query_pool, uint32_t query);
+void vka_end_query(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+				vka_query_pool_t *query_pool, uint32_t query);
+const uint64_t *vka_get_query_result(vka_query_pool_t *query_pool, uint32_t query);
 
 // Memory:
 int vka_create_allocation(vka_vulkan_t *vulkan, vka_allocation_t *allocation);
@@ -529,7 +1390,22 @@ void vka_unmap_memory(vka_vulkan_t *vulkan, vka_allocation_t *allocation);
 void vka_device_wait_idle(vka_vulkan_t *vulkan);
 void vka_next_frame(vka_vulkan_t *vulkan);
 int vka_get_next_swapchain_image(vka_vulkan_t *vulkan);
+uint64_t vka_hash(const void *data, size_t size, uint64_t hash);
+int vka_map_file(vka_vulkan_t *vulkan, const char *path, void **data, size_t *size);
+void vka_unmap_file(void *data, size_t size);
+int vka_reserve_retired_objects(vka_vulkan_t *vulkan, uint32_t num_objects);
+int vka_retire_object(vka_vulkan_t *vulkan, VkObjectType type, uint64_t handle);
+void vka_destroy_retired_objects(vka_vulkan_t *vulkan, int force);
 void vka_push_constants(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline);
+void vka_push_constant_data(vka_command_buffer_t *command_buffer, VkPipelineLayout layout,
+			VkShaderStageFlags stage_flags, uint32_t size, const void *data);
+void vka_set_object_name(vka_vulkan_t *vulkan, VkObjectType type, uint64_t handle,
+							const char *name);
+void vka_begin_label(vka_command_buffer_t *command_buffer, const char *name,
+						const float colour[4]);
+void vka_end_label(vka_command_buffer_t *command_buffer);
+void vka_insert_label(vka_command_buffer_t *command_buffer, const char *name,
+						const float colour[4]);
 
 /***********
  * Nuklear *
@@ -543,15 +1419,158 @@ typedef struct
 	float uv[2];
 } vka_nuklear_vertex_t;
 
+typedef struct
+{
+	// Font baked by vka_nuklear_bake_fonts() - pass &handle to nk_style_set_font().
+	struct nk_user_font handle;
+	const struct nk_font_glyph *glyphs;	// Sorted by codepoint.
+	uint32_t num_glyphs;
+	uint32_t fallback_glyph;		// UINT32_MAX if there isn't one.
+	float baked_height;
+
+	/*---------------*
+	 * Configuration *
+	 *---------------*/
+	char path[VKA_MAX_PATH_LENGTH];	// TrueType file, or empty for Nuklear's default font.
+	float size;			// Pixel height at a scale of 1.
+	float scale;			// DPI scale, default 1.
+} vka_nuklear_font_t;
+
+/* Pipelines passed to vka_nuklear_draw() take vka_nuklear_vertex_t vertices. If they have push
+ * constants, the first range must start with the texture index, a uint32_t at offset 0, which
+ * is pushed per draw with push_constants[0].stage_flags - any other data in it is overwritten. */
 int vka_nuklear_set_up(vka_vulkan_t *vulkan);
 void vka_nuklear_shut_down(vka_vulkan_t *vulkan);
-void vka_nuklear_draw(vka_vulkan_t *vulkan);
+int vka_nuklear_draw(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline,
+				vka_render_info_t *render_info);
+int vka_nuklear_resize_buffers(vka_vulkan_t *vulkan, VkDeviceSize index_buffer_size,
+						VkDeviceSize vertex_buffer_size);
+void vka_nuklear_draw_range(vka_command_buffer_t *command_buffer, vka_pipeline_t *pipeline,
+	vka_render_info_t *clip_info, int texture, uint32_t first_index, uint32_t num_indices);
+int vka_nuklear_bake_fonts(vka_vulkan_t *vulkan, uint32_t num_fonts, vka_nuklear_font_t *fonts,
+						int texture, const char *cache_path);
+int vka_nuklear_bake_font_atlas(vka_vulkan_t *vulkan, uint32_t num_fonts,
+			vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path);
+int vka_nuklear_load_font_cache(vka_vulkan_t *vulkan, uint32_t num_fonts,
+			vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path);
+int vka_nuklear_write_font_cache(vka_vulkan_t *vulkan, uint32_t num_fonts,
+	vka_nuklear_font_t *fonts, uint64_t hash, const char *cache_path, uint32_t width,
+	uint32_t height, const void *pixels);
+int vka_nuklear_upload_font_atlas(vka_vulkan_t *vulkan, uint32_t width, uint32_t height,
+							const void *pixels);
+void vka_nuklear_destroy_font_atlas(vka_vulkan_t *vulkan);
+const struct nk_font_glyph *vka_nuklear_find_glyph(vka_nuklear_font_t *font, nk_rune codepoint);
+float vka_nuklear_font_width(nk_handle handle, float height, const char *text, int len);
+void vka_nuklear_font_query(nk_handle handle, float height, struct nk_user_font_glyph *glyph,
+					nk_rune codepoint, nk_rune next_codepoint);
 void vka_nuklear_process_event(vka_vulkan_t *vulkan, SDL_Event *event);
 void vka_nuklear_process_grab(vka_vulkan_t *vulkan);
 void vka_nuklear_clipboard_copy(nk_handle usr, const char *text, int len);
 void vka_nuklear_clipboard_paste(nk_handle usr, struct nk_text_edit *edit);
 #endif
 
+/******************
+ * Shader watcher *
+ ******************/
+
+#ifdef VKA_SHADER_WATCHER
+int vka_shader_watcher_set_up(vka_vulkan_t *vulkan);
+void vka_shader_watcher_shut_down(vka_vulkan_t *vulkan);
+int vka_watch_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline);
+void vka_unwatch_pipeline(vka_vulkan_t *vulkan, vka_pipeline_t *pipeline);
+void vka_shader_watcher_update(vka_vulkan_t *vulkan);
+void vka_discard_pipeline_reload(vka_vulkan_t *vulkan, vka_watched_pipeline_t *watched);
+int vka_shader_watcher_thread(void *data);
+#endif
+
+/**************
+ * Statistics *
+ **************/
+
+#ifdef VKA_STATISTICS
+int vka_statistics_set_up(vka_vulkan_t *vulkan);
+void vka_statistics_shut_down(vka_vulkan_t *vulkan);
+void vka_begin_frame_statistics(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer);
+void vka_end_frame_statistics(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer);
+void vka_reset_counters(vka_counters_t *counters);
+void vka_add_counters(vka_counters_t *total, vka_counters_t *counters);
+void vka_snapshot_counters(vka_vulkan_t *vulkan, uint32_t num_command_buffers,
+		vka_command_buffer_t *command_buffers, vka_counters_t *snapshot);
+void vka_get_counters(vka_counters_t *counters, const char *names[VKA_NUM_COUNTERS],
+						uint64_t values[VKA_NUM_COUNTERS]);
+void vka_write_counters_csv(FILE *file, uint32_t num_snapshots, vka_counters_t *snapshots);
+void vka_write_counters_json(FILE *file, uint32_t num_snapshots, vka_counters_t *snapshots);
+uint32_t vka_begin_gpu_timer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							const char *name);
+void vka_end_gpu_timer(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+							uint32_t timer);
+#ifdef VKA_NUKLEAR
+void vka_draw_statistics_hud(vka_vulkan_t *vulkan, struct nk_rect bounds,
+		uint32_t num_descriptor_pools, vka_descriptor_pool_t *descriptor_pools);
+void vka_draw_statistics_graph(struct nk_context *context, uint32_t num_values,
+		uint32_t first_value, const float *values, const float *second_values);
+#endif
+#endif
+
+/*********
+ * Trace *
+ *********/
+
+#ifdef VKA_TRACE
+int vka_trace_set_up(vka_vulkan_t *vulkan);
+void vka_trace_shut_down(vka_vulkan_t *vulkan);
+int vka_create_trace(vka_vulkan_t *vulkan, vka_trace_t *trace);
+void vka_destroy_trace(vka_trace_t *trace);
+uint64_t vka_trace_default_clock(void *clock_data);
+uint64_t vka_trace_time(vka_trace_t *trace);
+uint64_t vka_trace_begin(vka_trace_t *trace);
+void vka_trace_end(vka_trace_t *trace, const char *name, uint64_t start);
+void vka_trace_event(vka_trace_t *trace, const char *name, uint64_t thread_id, uint64_t start,
+						uint64_t duration, uint8_t gpu);
+int vka_trace_calibrate(vka_vulkan_t *vulkan);
+void vka_trace_gpu(vka_vulkan_t *vulkan, const char *name, uint64_t start_ticks,
+							uint64_t end_ticks);
+void vka_write_trace(FILE *file, vka_trace_t *trace);
+#endif
+
+/*************
+ * Benchmark *
+ *************/
+
+#ifdef VKA_BENCHMARK
+int vka_create_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+void vka_destroy_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_run_benchmark(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark, const char *name,
+	uint32_t operations, int (*function)(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark));
+int vka_run_benchmarks(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_allocation(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_buffers(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_descriptor_set(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_pipeline(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_draws(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_benchmark_frame(vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+int vka_compare_benchmark_samples(const void *a, const void *b);
+void vka_write_benchmarks_json(FILE *file, vka_vulkan_t *vulkan, vka_benchmark_t *benchmark);
+#endif
+
+/***********
+ * Capture *
+ ***********/
+
+#ifdef VKA_CAPTURE
+int vka_create_capture(vka_vulkan_t *vulkan, vka_capture_t *capture);
+void vka_destroy_capture(vka_vulkan_t *vulkan, vka_capture_t *capture);
+int vka_run_capture(vka_vulkan_t *vulkan, vka_capture_t *capture, uint32_t num_frames,
+	int (*render)(vka_vulkan_t *vulkan, vka_command_buffer_t *command_buffer,
+	uint32_t frame, void *data), void *data);
+void vka_record_capture(vka_command_buffer_t *command_buffer, vka_capture_t *capture);
+int vka_compare_capture(vka_vulkan_t *vulkan, vka_capture_t *capture, const char *golden_path);
+int vka_write_capture_ppm(vka_vulkan_t *vulkan, vka_capture_t *capture, const char *path);
+int vka_read_ppm(vka_vulkan_t *vulkan, const char *path, uint32_t *width, uint32_t *height,
+							uint8_t **pixels);
+void vka_write_capture_timings(FILE *file, vka_capture_t *capture);
+#endif
+
 /*******************
  * Debug functions *
  *******************/